@@ -29,6 +29,22 @@ struct vm_cb_backend_mmap : public vm_cb_backend_base {};
  */
 struct vm_cb_backend_shm : public vm_cb_backend_base {};
 
+/**
+ * @brief Carve the mirrored pages out of a shared anonymous file, see
+ * mirrored_ring_slab.
+ */
+struct vm_cb_backend_slab : public vm_cb_backend_base {};
+
+/**
+ * @brief Use an anonymous file backed by huge pages (MFD_HUGETLB),
+ * which cuts the TLB misses and the page faults of large buffers.
+ *
+ * The size must be a multiple of the huge page size, and the system
+ * must have enough huge pages reserved (vm.nr_hugepages), otherwise
+ * the construction fails.
+ */
+struct vm_cb_backend_hugetlb : public vm_cb_backend_base {};
+
 /**
  * @brief Standard memory
  */
@@ -40,9 +56,35 @@ concept cb_has_mmap_backend = std::is_same<vm_cb_backend_mmap, T>::value;
 template <typename T>
 concept cb_has_shm_backend = std::is_same<vm_cb_backend_shm, T>::value;
 
+template <typename T>
+concept cb_has_slab_backend = std::is_same<vm_cb_backend_slab, T>::value;
+
+template <typename T>
+concept cb_has_hugetlb_backend =
+    std::is_same<vm_cb_backend_hugetlb, T>::value;
+
 template <typename T>
 concept circular_buffer_backend = std::is_base_of<vm_cb_backend_base, T>::value;
 
+/**
+ * @brief Mapping options of a circular_buffer_vm, applicable to all
+ * backends.
+ */
+struct vm_cb_map_options {
+    /**
+     * @brief Fault all pages of the buffer in while it is constructed,
+     * so the first writes into the buffer do not take page faults.
+     */
+    bool populate = { false };
+
+    /**
+     * @brief Lock the pages of the buffer into memory (mlock), so they
+     * are never swapped out. Implies populate. Subject to
+     * RLIMIT_MEMLOCK.
+     */
+    bool lock = { false };
+};
+
 /**
  * @brief
  * There's some memory trickery going on here, and I'll try to explain.
@@ -149,20 +191,35 @@ struct circular_buffer_vm : public circular_buffer_base {
      */
     struct auto_align_to_page {};
 
+    /**
+     * @brief Construct an empty circular buffer that owns no mapping,
+     * like a moved-from one. Move a mapped buffer into it to use it.
+     */
+    circular_buffer_vm() noexcept;
+
     /**
      * @brief circular_buffer_fast
      * Construct a `size` amount circular buffer.
-     * The requested size must be multiple of system's page size.
+     * The requested size must be multiple of the backend's page size,
+     * see page_size().
+     *
+     * Throws std::runtime_error if the buffer cannot be mapped, or the
+     * options cannot be applied.
+     *
      * @param size
+     * @param options   Mapping options
      */
-    circular_buffer_vm(const std::size_t size);
+    circular_buffer_vm(const std::size_t size,
+                       const vm_cb_map_options & options = {});
 
     /**
      * @brief circular_buffer_fast
      * Auto-round up size to next multiple of page size.
      * @param size
+     * @param options   Mapping options
      */
-    circular_buffer_vm(const std::size_t size, auto_align_to_page);
+    circular_buffer_vm(const std::size_t size, auto_align_to_page,
+                       const vm_cb_map_options & options = {});
 
     /**
      * @brief Move constructor for circular_buffer_fast
@@ -405,6 +462,15 @@ struct circular_buffer_vm : public circular_buffer_base {
      */
     auto clear() -> void;
 
+    /**
+     * @brief Clear the buffer and give its physical pages back to the
+     * system, keeping the mapping. The pages are faulted in again,
+     * zeroed, when the buffer is written to.
+     *
+     * @return false if the pages are locked, or cannot be released.
+     */
+    auto discard_pages() noexcept -> bool;
+
     inline size_t empty_space() const noexcept {
         return total_size_ - consumed_space();
     }
@@ -413,7 +479,34 @@ struct circular_buffer_vm : public circular_buffer_base {
         return tail_ - head_;
     }
 
+    /**
+     * @brief The mapping options the buffer is constructed with.
+     */
+    inline const vm_cb_map_options & options() const noexcept {
+        return options_;
+    }
+
+    /**
+     * @brief The granularity of the buffer sizes: the system's page
+     * size, or the huge page size for the hugetlb backend.
+     */
+    static auto page_size() noexcept -> std::size_t;
+
+    /**
+     * @brief Whether the buffer owns a mapping, i.e. it is not moved
+     * from.
+     */
+    inline explicit operator bool() const noexcept {
+        return native_buffer_ != nullptr;
+    }
+
 private:
+    /**
+     * @brief release
+     * Unmap the memory and close the anonymous file, if any.
+     */
+    auto release() noexcept -> void;
+
     /**
      * @brief noop_free
      * Dummy free function does nothing.
@@ -425,9 +518,16 @@ private:
      * the circular buffer.
      */
     int anonymous_fd_ = { -1 };
+
+    /**
+     * Mapping options the buffer is constructed with.
+     */
+    vm_cb_map_options options_ = {};
 };
 
 extern template struct circular_buffer_vm<vm_cb_backend_mmap>;
 extern template struct circular_buffer_vm<vm_cb_backend_shm>;
+extern template struct circular_buffer_vm<vm_cb_backend_slab>;
+extern template struct circular_buffer_vm<vm_cb_backend_hugetlb>;
 
 } // namespace mad
@@ -0,0 +1,161 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mad {
+
+/**
+ * @brief A slab of mirrored rings, carved out of a single anonymous
+ * file.
+ *
+ * circular_buffer_vm with the mmap backend creates an anonymous file
+ * per buffer and maps it twice, which costs a file descriptor and two
+ * VMAs per buffer. With many buffers alive, this runs into
+ * RLIMIT_NOFILE and vm.max_map_count.
+ *
+ * The slab instead creates one anonymous file of `ring_count` rings,
+ * and maps every ring twice, back to back, at its own file offset:
+ *
+ * VIRTUAL  |ring 0 |ring 0 |ring 1 |ring 1 |ring 2 |ring 2 | ...
+ * FILE     |0      |0      |S      |S      |2S     |2S     | ...
+ *
+ * The second half of a ring and the first half of the next one are
+ * contiguous both in memory and in the file, so the kernel merges
+ * their mappings. The whole slab takes a single file descriptor and
+ * about one VMA per ring.
+ *
+ * The physical pages of a ring are allocated on the first touch, as
+ * with the regular mmap backend, and given back to the system when the
+ * ring is deallocated.
+ */
+class mirrored_ring_slab {
+public:
+    /**
+     * @brief Create a slab.
+     *
+     * Throws std::runtime_error if the anonymous file cannot be
+     * created or mapped, and std::invalid_argument if the ring size is
+     * not a multiple of the page size.
+     *
+     * @param ring_size   Size of a single ring, multiple of page size
+     * @param ring_count  Amount of rings in the slab
+     */
+    mirrored_ring_slab(std::size_t ring_size, std::size_t ring_count);
+
+    mirrored_ring_slab(const mirrored_ring_slab &) = delete;
+    mirrored_ring_slab & operator=(const mirrored_ring_slab &) = delete;
+
+    /**
+     * @brief Unmap the slab and close its anonymous file. All rings
+     * must be deallocated.
+     */
+    ~mirrored_ring_slab();
+
+    /**
+     * @brief Take a free ring.
+     *
+     * @return The start of the ring's mirrored region, which is twice
+     * the ring size, or nullptr if the slab is full.
+     */
+    [[nodiscard]] std::uint8_t * allocate() noexcept;
+
+    /**
+     * @brief Give back a ring obtained from allocate().
+     *
+     * @param ring The start of the ring
+     */
+    void deallocate(std::uint8_t * ring) noexcept;
+
+    /**
+     * @brief Whether the ring belongs to this slab.
+     */
+    [[nodiscard]] bool owns(const std::uint8_t * ring) const noexcept {
+        return ring >= base_ && ring < base_ + 2 * ring_size_ * ring_count_;
+    }
+
+    [[nodiscard]] const std::uint8_t * base() const noexcept {
+        return base_;
+    }
+
+    [[nodiscard]] std::size_t ring_size() const noexcept {
+        return ring_size_;
+    }
+
+    [[nodiscard]] std::size_t ring_count() const noexcept {
+        return ring_count_;
+    }
+
+    [[nodiscard]] std::size_t free_count() const noexcept {
+        return free_.size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return free_.size() == ring_count_;
+    }
+
+    [[nodiscard]] bool full() const noexcept {
+        return free_.empty();
+    }
+
+    /**
+     * @brief Process-wide allocator of mirrored rings.
+     *
+     * Keeps a list of slabs per ring size, and creates a new slab when
+     * all slabs of a size are full. A slab holds as many rings as fit
+     * into k_slab_size. A slab is released when its last ring is
+     * deallocated, unless it is the last slab of its size.
+     *
+     * Thread-safe.
+     */
+    struct allocator {
+        /**
+         * @brief The target size of a slab, in bytes. A slab holds at
+         * least one ring.
+         */
+        static constexpr std::size_t k_slab_size = 4 * 1024 * 1024;
+
+        /**
+         * @brief Take a free ring of `ring_size` bytes.
+         *
+         * Throws std::runtime_error if a new slab is needed and it
+         * cannot be created.
+         *
+         * @param ring_size Size of the ring, multiple of page size
+         *
+         * @return The start of the ring's mirrored region.
+         */
+        [[nodiscard]] static std::uint8_t * allocate(std::size_t ring_size);
+
+        /**
+         * @brief Give back a ring obtained from allocate().
+         *
+         * @param ring The start of the ring
+         */
+        static void deallocate(std::uint8_t * ring) noexcept;
+
+        /**
+         * @brief Amount of live slabs, i.e. file descriptors held.
+         */
+        [[nodiscard]] static std::size_t slab_count() noexcept;
+    };
+
+private:
+    std::uint8_t * base_ = { nullptr };
+    std::size_t ring_size_ = { 0 };
+    std::size_t ring_count_ = { 0 };
+    int anonymous_fd_ = { -1 };
+
+    /**
+     * Indices of the free rings.
+     */
+    std::vector<std::uint32_t> free_;
+};
+
+} // namespace mad
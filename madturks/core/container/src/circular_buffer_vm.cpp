@@ -4,6 +4,7 @@
  ******************************************************/
 
 #include <mad/circular_buffer_vm.hpp>
+#include <mad/mirrored_ring_slab.hpp>
 
 // system
 #include <random>
@@ -15,7 +16,12 @@
 // #include <boost/uuid/uuid_io.hpp>
 // cppstd
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
 #include <uuid.h>
 // cstd
 #include <unistd.h>
@@ -38,18 +44,73 @@ auto uuid_generator() {
     thread_local uuids::uuid_random_generator uuid_generator{ generator };
     return uuid_generator;
 }
+
+/**
+ * @brief The default huge page size of the system, as reported in
+ * /proc/meminfo. 2 MiB if it cannot be read.
+ */
+std::size_t huge_page_size() noexcept {
+    static const std::size_t size = []() -> std::size_t {
+        std::ifstream meminfo{ "/proc/meminfo" };
+        std::string key{};
+        std::size_t kib = 0;
+        while (meminfo >> key) {
+            if (key == "Hugepagesize:" && meminfo >> kib && kib > 0) {
+                return kib * 1024;
+            }
+            meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return 2 * 1024 * 1024;
+    }();
+    return size;
+}
+
+/**
+ * @brief Fault the pages of a mapping in for writing, without changing
+ * their content.
+ *
+ * @return false if the pages cannot be allocated.
+ */
+bool populate_pages(std::uint8_t * addr, std::size_t length) noexcept {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(addr, length, MADV_POPULATE_WRITE) == 0) {
+        return true;
+    }
+    if (errno != EINVAL) {
+        return false;
+    }
+#endif
+    // The kernel does not support MADV_POPULATE_WRITE, touch the pages
+    // one by one instead.
+    const auto page_size = static_cast<std::size_t>(getpagesize());
+    for (std::size_t offset = 0; offset < length; offset += page_size) {
+        auto page = static_cast<volatile std::uint8_t *>(addr + offset);
+        *page = *page;
+    }
+    return true;
+}
 } // namespace
 
 namespace mad {
 
 template <circular_buffer_backend BT>
-circular_buffer_vm<BT>::circular_buffer_vm(const size_t size) :
-    circular_buffer_base(size) {
+auto circular_buffer_vm<BT>::page_size() noexcept -> std::size_t {
+    if constexpr (cb_has_hugetlb_backend<BT>) {
+        return huge_page_size();
+    } else {
+        return static_cast<std::size_t>(getpagesize());
+    }
+}
+
+template <circular_buffer_backend BT>
+circular_buffer_vm<BT>::circular_buffer_vm(const size_t size,
+                                           const vm_cb_map_options & options) :
+    circular_buffer_base(size), options_(options) {
     /**
      * In order to perform our trick, we need to allocate multiples of
      * page size.
      */
-    if (size % static_cast<size_t>(getpagesize()) != 0)
+    if (size % page_size() != 0)
         throw std::invalid_argument{ "Size must be a multiple of page size" };
 
     element_t * vaddr = nullptr;
@@ -148,6 +209,60 @@ circular_buffer_vm<BT>::circular_buffer_vm(const size_t size) :
             throw std::runtime_error{
                 "Failed to map second page of memory to anonymous file"
             };
+    } else if constexpr (cb_has_slab_backend<BT>) {
+        /**
+         * The slab allocator does the same trick, but many buffers share
+         * a single anonymous file.
+         */
+        vaddr = mirrored_ring_slab::allocator::allocate(size);
+    } else if constexpr (cb_has_hugetlb_backend<BT>) {
+        /**
+         * Same as the mmap backend, except that the file is backed by
+         * huge pages, and the mappings must be aligned to the huge page
+         * size.
+         */
+        if ((anonymous_fd_ = spcfw_memfd_create(
+                 "mad-cb-hugetlb", MFD_CLOEXEC | MFD_HUGETLB)) < 0)
+            throw std::runtime_error{ "Failed to create anonymous file" };
+
+        if (ftruncate(anonymous_fd_, static_cast<long>(size)) < 0) {
+            close(anonymous_fd_);
+            throw std::runtime_error{ "Failed to truncate anonymous file" };
+        }
+
+        /**
+         * Reserve one more huge page to be able to align the address,
+         * then give back the parts around the aligned region.
+         */
+        const auto align = page_size();
+        auto reserved = static_cast<element_t *>(
+            mmap(NULL, 2 * size + align, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+        if (reserved == MAP_FAILED) {
+            close(anonymous_fd_);
+            throw std::runtime_error{ "Failed to map memory" };
+        }
+
+        const auto lead = static_cast<std::size_t>(
+            (align - reinterpret_cast<std::uintptr_t>(reserved) % align) %
+            align);
+        vaddr = reserved + lead;
+        if (lead > 0)
+            munmap(reserved, lead);
+        if (align - lead > 0)
+            munmap(vaddr + 2 * size, align - lead);
+
+        if (mmap(vaddr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 anonymous_fd_, 0) == MAP_FAILED ||
+            mmap(vaddr + size, size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, anonymous_fd_, 0) == MAP_FAILED) {
+            munmap(vaddr, 2 * size);
+            close(anonymous_fd_);
+            throw std::runtime_error{
+                "Failed to map huge pages to anonymous file"
+            };
+        }
     }
 
     /*
@@ -155,6 +270,21 @@ circular_buffer_vm<BT>::circular_buffer_vm(const size_t size) :
      * */
     native_buffer_ = buffer_ptr_t{ vaddr, noop_free };
     assert(native_buffer_ != nullptr);
+
+    /**
+     * Populating one half of the mirror allocates the pages, and the
+     * other half only needs its page table entries.
+     */
+    if ((options_.populate || options_.lock) &&
+        !populate_pages(vaddr, 2 * size)) {
+        release();
+        throw std::runtime_error{ "Failed to populate memory" };
+    }
+
+    if (options_.lock && mlock(vaddr, 2 * size) < 0) {
+        release();
+        throw std::runtime_error{ "Failed to lock memory" };
+    }
 }
 
 static constexpr auto round_up_to_multiple(std::size_t value,
@@ -165,32 +295,61 @@ static constexpr auto round_up_to_multiple(std::size_t value,
 
 template <circular_buffer_backend BT>
 circular_buffer_vm<BT>::circular_buffer_vm(const size_t size,
-                                           auto_align_to_page) :
-    circular_buffer_vm(
-        round_up_to_multiple(size, static_cast<std::size_t>(getpagesize()))) {}
+                                           auto_align_to_page,
+                                           const vm_cb_map_options & options) :
+    circular_buffer_vm(round_up_to_multiple(size, page_size()), options) {}
 
 template <circular_buffer_backend BT>
-circular_buffer_vm<BT>::circular_buffer_vm(circular_buffer_vm &&) = default;
+circular_buffer_vm<BT>::circular_buffer_vm() noexcept :
+    circular_buffer_base(0) {}
+
+template <circular_buffer_backend BT>
+circular_buffer_vm<BT>::circular_buffer_vm(circular_buffer_vm && mv) :
+    circular_buffer_base(std::move(mv)),
+    anonymous_fd_(std::exchange(mv.anonymous_fd_, -1)),
+    options_(mv.options_) {}
 
 template <circular_buffer_backend BT>
 circular_buffer_vm<BT> &
-circular_buffer_vm<BT>::operator=(circular_buffer_vm &&) = default;
+circular_buffer_vm<BT>::operator=(circular_buffer_vm && mv) {
+    if (this != &mv) {
+        // The buffer's deleter does not unmap, so the mapping
+        // must be released before it is replaced.
+        release();
+        circular_buffer_base::operator=(std::move(mv));
+        anonymous_fd_ = std::exchange(mv.anonymous_fd_, -1);
+        options_ = mv.options_;
+    }
+    return *this;
+}
 
 template <circular_buffer_backend BT>
 circular_buffer_vm<BT>::~circular_buffer_vm() {
+    release();
+}
+
+template <circular_buffer_backend BT>
+auto circular_buffer_vm<BT>::release() noexcept -> void {
     if (native_buffer_) {
         auto map_buf = native_buffer_.get();
-        if constexpr (cb_has_mmap_backend<BT>) {
+        if (options_.lock) {
+            // The slab keeps the ring mapped after it is deallocated.
+            munlock(map_buf, 2 * total_size());
+        }
+        if constexpr (cb_has_mmap_backend<BT> || cb_has_hugetlb_backend<BT>) {
             munmap(map_buf + total_size(), total_size());
             munmap(map_buf, total_size());
-            // this might work ?
-            if (anonymous_fd_ > -1) {
-                close(anonymous_fd_);
-            }
         } else if constexpr (cb_has_shm_backend<BT>) {
             shmdt(map_buf);
             shmdt(map_buf + total_size());
+        } else if constexpr (cb_has_slab_backend<BT>) {
+            mirrored_ring_slab::allocator::deallocate(map_buf);
         }
+        native_buffer_.reset();
+    }
+    if (anonymous_fd_ > -1) {
+        close(anonymous_fd_);
+        anonymous_fd_ = -1;
     }
 }
 
@@ -223,6 +382,17 @@ auto circular_buffer_vm<BT>::clear() -> void {
     }
 }
 
+template <circular_buffer_backend BT>
+auto circular_buffer_vm<BT>::discard_pages() noexcept -> bool {
+    clear();
+    if (!native_buffer_ || options_.lock) {
+        return false;
+    }
+    // Both halves map the same shared pages, so removing them
+    // through the first half drops them from the second as well.
+    return madvise(native_buffer_.get(), total_size(), MADV_REMOVE) == 0;
+}
+
 template <circular_buffer_backend BT>
 auto circular_buffer_vm<BT>::mark_as_read(const size_t amount) -> void {
     assert(tail_ > head_);
@@ -291,3 +461,5 @@ auto circular_buffer_vm<BT>::get(element_t * dst, const size_t amount) -> bool {
 // bullshit.
 template struct mad::circular_buffer_vm<mad::vm_cb_backend_mmap>;
 template struct mad::circular_buffer_vm<mad::vm_cb_backend_shm>;
+template struct mad::circular_buffer_vm<mad::vm_cb_backend_slab>;
+template struct mad::circular_buffer_vm<mad::vm_cb_backend_hugetlb>;
@@ -0,0 +1,201 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/mirrored_ring_slab.hpp>
+
+// system
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// cppstd
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+// cstd
+#include <unistd.h>
+
+namespace {
+int slab_memfd_create(const char * name, unsigned int flags) {
+    return static_cast<int>(syscall(__NR_memfd_create, name, flags));
+}
+} // namespace
+
+namespace mad {
+
+mirrored_ring_slab::mirrored_ring_slab(std::size_t ring_size,
+                                       std::size_t ring_count) :
+    ring_size_(ring_size), ring_count_(ring_count) {
+    if (ring_size == 0 || ring_size % static_cast<size_t>(getpagesize()) != 0)
+        throw std::invalid_argument{ "Size must be a multiple of page size" };
+    if (ring_count == 0)
+        throw std::invalid_argument{ "Slab must hold at least one ring" };
+
+    const auto file_size = ring_size * ring_count;
+
+    // The name is only informative, memfd names need not be unique.
+    if ((anonymous_fd_ = slab_memfd_create("mad-ring-slab", MFD_CLOEXEC)) < 0)
+        throw std::runtime_error{ "Failed to create anonymous file" };
+
+    if (ftruncate(anonymous_fd_, static_cast<long>(file_size)) < 0) {
+        close(anonymous_fd_);
+        throw std::runtime_error{ "Failed to truncate anonymous file" };
+    }
+
+    /**
+     * Reserve the address space of the whole slab.
+     */
+    auto vaddr = mmap(nullptr, 2 * file_size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (vaddr == MAP_FAILED) {
+        close(anonymous_fd_);
+        throw std::runtime_error{ "Failed to map memory" };
+    }
+    base_ = static_cast<std::uint8_t *>(vaddr);
+
+    /**
+     * Map every ring twice, back to back, to its own part of the file.
+     */
+    for (std::size_t i = 0; i < ring_count; i++) {
+        const auto offset = static_cast<off_t>(i * ring_size);
+        auto ring = base_ + 2 * i * ring_size;
+        if (mmap(ring, ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, anonymous_fd_, offset) == MAP_FAILED ||
+            mmap(ring + ring_size, ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, anonymous_fd_,
+                 offset) == MAP_FAILED) {
+            munmap(base_, 2 * file_size);
+            close(anonymous_fd_);
+            throw std::runtime_error{
+                "Failed to map ring of memory to anonymous file"
+            };
+        }
+    }
+
+    // Hand out the rings in address order.
+    free_.resize(ring_count);
+    for (std::size_t i = 0; i < ring_count; i++) {
+        free_ [i] = static_cast<std::uint32_t>(ring_count - 1 - i);
+    }
+}
+
+mirrored_ring_slab::~mirrored_ring_slab() {
+    assert(empty());
+    munmap(base_, 2 * ring_size_ * ring_count_);
+    close(anonymous_fd_);
+}
+
+std::uint8_t * mirrored_ring_slab::allocate() noexcept {
+    if (free_.empty()) {
+        return nullptr;
+    }
+    const auto idx = free_.back();
+    free_.pop_back();
+    return base_ + 2 * static_cast<std::size_t>(idx) * ring_size_;
+}
+
+void mirrored_ring_slab::deallocate(std::uint8_t * ring) noexcept {
+    assert(owns(ring));
+    const auto idx = static_cast<std::size_t>(ring - base_) / (2 * ring_size_);
+    assert(base_ + 2 * idx * ring_size_ == ring);
+    // Free the ring's pages in the file, which drops them from both
+    // halves of the mirror. They are faulted in again, zeroed, when
+    // the ring is reused.
+    madvise(ring, ring_size_, MADV_REMOVE);
+    // Never reallocates: the capacity is reserved up front.
+    free_.push_back(static_cast<std::uint32_t>(idx));
+}
+
+namespace {
+
+struct slab_registry {
+    std::mutex mtx;
+
+    /**
+     * The slabs of every ring size. The slabs with free rings are
+     * kept towards the back.
+     */
+    std::map<std::size_t, std::vector<std::unique_ptr<mirrored_ring_slab>>>
+        slabs;
+
+    /**
+     * The slabs by their end address, to find the owner of a ring.
+     */
+    std::map<const std::uint8_t *, mirrored_ring_slab *> by_end;
+};
+
+slab_registry & registry() noexcept {
+    // Intentionally leaked: rings may be deallocated after the static
+    // destructors run.
+    static auto * reg = new slab_registry{};
+    return *reg;
+}
+
+const std::uint8_t * end_of(const mirrored_ring_slab & slab) noexcept {
+    return slab.base() + 2 * slab.ring_size() * slab.ring_count();
+}
+
+} // namespace
+
+std::uint8_t * mirrored_ring_slab::allocator::allocate(std::size_t ring_size) {
+    auto & reg = registry();
+    std::scoped_lock guard{ reg.mtx };
+    auto & slabs = reg.slabs [ring_size];
+
+    auto it = std::find_if(slabs.rbegin(), slabs.rend(), [](auto & s) {
+        return !s->full();
+    });
+
+    if (it == slabs.rend()) {
+        const auto ring_count = std::max<std::size_t>(
+            1, k_slab_size / ring_size);
+        slabs.push_back(
+            std::make_unique<mirrored_ring_slab>(ring_size, ring_count));
+        reg.by_end.emplace(end_of(*slabs.back()), slabs.back().get());
+        it = slabs.rbegin();
+    }
+
+    auto ring = (*it)->allocate();
+    assert(ring);
+    return ring;
+}
+
+void mirrored_ring_slab::allocator::deallocate(std::uint8_t * ring) noexcept {
+    auto & reg = registry();
+    std::scoped_lock guard{ reg.mtx };
+
+    const auto owner = reg.by_end.upper_bound(ring);
+    assert(owner != reg.by_end.end() && owner->second->owns(ring));
+    auto & slab = *owner->second;
+    const bool was_full = slab.full();
+    slab.deallocate(ring);
+
+    auto & slabs = reg.slabs [slab.ring_size()];
+    auto it = std::find_if(slabs.begin(), slabs.end(), [&](auto & s) {
+        return s.get() == &slab;
+    });
+    assert(it != slabs.end());
+
+    if (slab.empty() && slabs.size() > 1) {
+        // Keep the last slab of the size around for the next rings.
+        reg.by_end.erase(owner);
+        slabs.erase(it);
+        return;
+    }
+
+    if (was_full) {
+        // Has free rings again, move it towards the back.
+        std::rotate(it, it + 1, slabs.end());
+    }
+}
+
+std::size_t mirrored_ring_slab::allocator::slab_count() noexcept {
+    auto & reg = registry();
+    std::scoped_lock guard{ reg.mtx };
+    return reg.by_end.size();
+}
+
+} // namespace mad
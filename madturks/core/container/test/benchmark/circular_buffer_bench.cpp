@@ -11,6 +11,11 @@
 #include <benchmark/benchmark.h>
 #include <unistd.h>
 
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
 template <typename T>
 struct cb_fixture : public benchmark::Fixture {
     void SetUp(const ::benchmark::State &) {
@@ -77,11 +82,20 @@ void putget(benchmark::State & st) {
     }
 }
 
+template <class Q>
+void create(benchmark::State & st) {
+    for (auto _ : st) {
+        Q buffer{ static_cast<std::size_t>(getpagesize()) };
+        benchmark::DoNotOptimize(buffer.available_span().data());
+    }
+}
+
 // mad
 BENCHMARK_TEMPLATE(put, mad::circular_buffer);
 BENCHMARK_TEMPLATE(put, mad::circular_buffer_pow2);
 BENCHMARK_TEMPLATE(put, mad::circular_buffer_vm<mad::vm_cb_backend_mmap>);
 BENCHMARK_TEMPLATE(put, mad::circular_buffer_vm<mad::vm_cb_backend_shm>);
+BENCHMARK_TEMPLATE(put, mad::circular_buffer_vm<mad::vm_cb_backend_slab>);
 
 BENCHMARK_TEMPLATE(put_overwrite, mad::circular_buffer);
 BENCHMARK_TEMPLATE(put_overwrite, mad::circular_buffer_pow2);
@@ -89,13 +103,124 @@ BENCHMARK_TEMPLATE(put_overwrite,
                    mad::circular_buffer_vm<mad::vm_cb_backend_mmap>);
 BENCHMARK_TEMPLATE(put_overwrite,
                    mad::circular_buffer_vm<mad::vm_cb_backend_shm>);
+BENCHMARK_TEMPLATE(put_overwrite,
+                   mad::circular_buffer_vm<mad::vm_cb_backend_slab>);
 
 BENCHMARK_TEMPLATE(peek, mad::circular_buffer);
 BENCHMARK_TEMPLATE(peek, mad::circular_buffer_pow2);
 BENCHMARK_TEMPLATE(peek, mad::circular_buffer_vm<mad::vm_cb_backend_mmap>);
 BENCHMARK_TEMPLATE(peek, mad::circular_buffer_vm<mad::vm_cb_backend_shm>);
+BENCHMARK_TEMPLATE(peek, mad::circular_buffer_vm<mad::vm_cb_backend_slab>);
 
 BENCHMARK_TEMPLATE(putget, mad::circular_buffer);
 BENCHMARK_TEMPLATE(putget, mad::circular_buffer_pow2);
 BENCHMARK_TEMPLATE(putget, mad::circular_buffer_vm<mad::vm_cb_backend_mmap>);
 BENCHMARK_TEMPLATE(putget, mad::circular_buffer_vm<mad::vm_cb_backend_shm>);
+BENCHMARK_TEMPLATE(putget, mad::circular_buffer_vm<mad::vm_cb_backend_slab>);
+
+BENCHMARK_TEMPLATE(create, mad::circular_buffer_vm<mad::vm_cb_backend_mmap>);
+BENCHMARK_TEMPLATE(create, mad::circular_buffer_vm<mad::vm_cb_backend_slab>);
+
+////////////////////////////////////
+// Large rings: page faults and TLB
+
+/**
+ * Map a ring, or report why it could not be mapped, e.g. because no
+ * huge pages are reserved.
+ */
+template <class Q>
+std::optional<Q> map_ring(benchmark::State & st, std::size_t size,
+                          const mad::vm_cb_map_options & options) {
+    try {
+        return std::optional<Q>{ std::in_place, size, options };
+    } catch (const std::exception & ex) {
+        st.SkipWithError(ex.what());
+        return std::nullopt;
+    }
+}
+
+/**
+ * The first write pass over a freshly mapped ring, which takes the page
+ * faults unless the ring is populated up front. The mapping itself is
+ * not measured.
+ *
+ * Args: ring size, populate (0/1)
+ */
+template <class Q>
+void first_touch(benchmark::State & st) {
+    const auto size = static_cast<std::size_t>(st.range(0));
+    const mad::vm_cb_map_options options{ .populate = st.range(1) != 0 };
+    std::array<unsigned char, 64 * 1024> chunk;
+    mad::random::bytegen(chunk);
+
+    for (auto _ : st) {
+        st.PauseTiming();
+        auto buffer = map_ring<Q>(st, size, options);
+        st.ResumeTiming();
+        if (!buffer) {
+            break;
+        }
+        while (buffer->put(chunk)) {}
+        benchmark::DoNotOptimize(buffer->consumed_space());
+        st.PauseTiming();
+        buffer.reset();
+        st.ResumeTiming();
+    }
+    st.SetBytesProcessed(static_cast<std::int64_t>(st.iterations() * size));
+}
+
+/**
+ * Reads at random offsets of a full ring, which miss the TLB once the
+ * ring outgrows its reach.
+ *
+ * Args: ring size
+ */
+template <class Q>
+void random_read(benchmark::State & st) {
+    const auto size = static_cast<std::size_t>(st.range(0));
+    auto buffer = map_ring<Q>(st, size, { .populate = true });
+    if (!buffer) {
+        return;
+    }
+    std::array<unsigned char, 64 * 1024> chunk;
+    mad::random::bytegen(chunk);
+    while (buffer->put(chunk)) {}
+
+    std::vector<std::size_t> offsets(4096);
+    std::mt19937_64 rng{ 42 };
+    std::uniform_int_distribution<std::size_t> dist{ 0, size - 1 };
+    for (auto & offset : offsets) {
+        offset = dist(rng);
+    }
+
+    const auto ring = buffer->available_span();
+    for (auto _ : st) {
+        unsigned sum = 0;
+        for (auto offset : offsets) {
+            sum += ring [offset];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    st.SetItemsProcessed(
+        static_cast<std::int64_t>(st.iterations() * offsets.size()));
+}
+
+BENCHMARK_TEMPLATE(first_touch,
+                   mad::circular_buffer_vm<mad::vm_cb_backend_mmap>)
+    ->ArgNames({ "size", "populate" })
+    ->ArgsProduct({ { 2 << 20, 32 << 20 }, { 0, 1 } });
+BENCHMARK_TEMPLATE(first_touch,
+                   mad::circular_buffer_vm<mad::vm_cb_backend_hugetlb>)
+    ->ArgNames({ "size", "populate" })
+    ->ArgsProduct({ { 2 << 20, 32 << 20 }, { 0, 1 } });
+
+BENCHMARK_TEMPLATE(random_read,
+                   mad::circular_buffer_vm<mad::vm_cb_backend_mmap>)
+    ->ArgName("size")
+    ->Arg(2 << 20)
+    ->Arg(32 << 20);
+BENCHMARK_TEMPLATE(random_read,
+                   mad::circular_buffer_vm<mad::vm_cb_backend_hugetlb>)
+    ->ArgName("size")
+    ->Arg(2 << 20)
+    ->Arg(32 << 20);
@@ -9,9 +9,13 @@
 #include <mad/random_bytegen.hpp>
 
 #include <gtest/gtest.h>
+#include <sys/mman.h>
 
+#include <algorithm>
 #include <array>
 #include <cstring>
+#include <optional>
+#include <vector>
 
 using namespace mad;
 
@@ -38,8 +42,15 @@ struct type_wrapper {
 // mad::circular_buffer_pow2,
 using MyTypes = ::testing::Types<mad::circular_buffer_vm<vm_cb_backend_shm>,
                                  mad::circular_buffer_vm<vm_cb_backend_mmap>,
+                                 mad::circular_buffer_vm<vm_cb_backend_slab>,
                                  mad::circular_buffer>;
 
+template <typename T>
+inline constexpr bool is_vm_buffer_v =
+    std::is_same_v<T, mad::circular_buffer_vm<vm_cb_backend_shm>> ||
+    std::is_same_v<T, mad::circular_buffer_vm<vm_cb_backend_mmap>> ||
+    std::is_same_v<T, mad::circular_buffer_vm<vm_cb_backend_slab>>;
+
 class NameGenerator {
 public:
     template <typename T>
@@ -50,6 +61,9 @@ public:
         if constexpr (std::is_same_v<
                           T, mad::circular_buffer_vm<vm_cb_backend_mmap>>)
             return "mmap";
+        if constexpr (std::is_same_v<
+                          T, mad::circular_buffer_vm<vm_cb_backend_slab>>)
+            return "slab";
         if constexpr (std::is_same_v<T, mad::circular_buffer_pow2>)
             return "pow2";
         if constexpr (std::is_same_v<T, mad::circular_buffer>)
@@ -193,10 +207,7 @@ TYPED_TEST(cb_fast_fixture, BufferUnderflow) {
 }
 
 TYPED_TEST(cb_fast_fixture, TransferData) {
-    if constexpr (std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_mmap>> ||
-                  std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_shm>>) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
         TypeParam buffer_{ page_size };
         TypeParam buffer2{ 4096 };
 
@@ -221,10 +232,7 @@ TYPED_TEST(cb_fast_fixture, TransferData) {
 
 TYPED_TEST(cb_fast_fixture, AutoAlignToPage) {
     // Constructing buffer with size not aligned to page size
-    if constexpr (std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_mmap>> ||
-                  std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_shm>>) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
 
         {
             TypeParam aligned_buffer(
@@ -356,10 +364,7 @@ TYPED_TEST(cb_fast_fixture, OverflowUnderflowStress) {
 }
 
 TYPED_TEST(cb_fast_fixture, RapidTransfer) {
-    if constexpr (std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_mmap>> ||
-                  std::is_same_v<TypeParam,
-                                 mad::circular_buffer_vm<vm_cb_backend_shm>>) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
         TypeParam buffer_{ page_size };
         // Test rapid transfers between buffers
         TypeParam buffer2{ page_size };
@@ -378,3 +383,148 @@ TYPED_TEST(cb_fast_fixture, RapidTransfer) {
         }
     }
 }
+
+TYPED_TEST(cb_fast_fixture, MoveAssignReleasesOld) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
+        TypeParam buffer_{ page_size };
+        TypeParam other{ page_size * 2 };
+
+        std::array<std::uint8_t, 10> data{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+        EXPECT_TRUE(other.put(data.data(), data.size()));
+
+        buffer_ = std::move(other);
+        EXPECT_EQ(buffer_.total_size(), page_size * 2);
+        EXPECT_TRUE(buffer_);
+        EXPECT_FALSE(other);
+
+        std::array<std::uint8_t, 10> retrieved{};
+        EXPECT_TRUE(buffer_.get(retrieved));
+        EXPECT_EQ(data, retrieved);
+    }
+}
+
+TYPED_TEST(cb_fast_fixture, DefaultConstructedOwnsNothing) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
+        TypeParam buffer_{};
+        EXPECT_FALSE(buffer_);
+        EXPECT_EQ(buffer_.total_size(), 0);
+        EXPECT_EQ(buffer_.consumed_space(), 0);
+        EXPECT_TRUE(buffer_.available_span().empty());
+
+        std::array<std::uint8_t, 1> data{ 1 };
+        EXPECT_FALSE(buffer_.put(data.data(), data.size()));
+
+        buffer_ = TypeParam{ page_size };
+        EXPECT_TRUE(buffer_);
+        EXPECT_TRUE(buffer_.put(data.data(), data.size()));
+    }
+}
+
+/**
+ * Whether all pages of the buffer's mirrored region are resident.
+ */
+template <typename T>
+static bool is_resident(const T & buffer) {
+    auto addr = const_cast<std::uint8_t *>(buffer.available_span().data());
+    std::vector<unsigned char> pages(2 * buffer.total_size() / page_size);
+    if (mincore(addr, 2 * buffer.total_size(), pages.data()) < 0) {
+        return false;
+    }
+    return std::ranges::all_of(pages, [](unsigned char p) {
+        return (p & 1) != 0;
+    });
+}
+
+TYPED_TEST(cb_fast_fixture, PopulateOption) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
+        TypeParam lazy{ page_size * 4 };
+        EXPECT_FALSE(lazy.options().populate);
+        EXPECT_FALSE(is_resident(lazy));
+
+        TypeParam buffer_{ page_size * 4, { .populate = true } };
+        EXPECT_TRUE(buffer_.options().populate);
+        EXPECT_TRUE(is_resident(buffer_));
+
+        std::array<std::uint8_t, 10> data{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+        EXPECT_TRUE(buffer_.put(data.data(), data.size()));
+
+        std::array<std::uint8_t, 10> retrieved{};
+        EXPECT_TRUE(buffer_.get(retrieved));
+        EXPECT_EQ(data, retrieved);
+    }
+}
+
+TYPED_TEST(cb_fast_fixture, LockOption) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
+        try {
+            TypeParam buffer_{ page_size, { .lock = true } };
+            EXPECT_TRUE(is_resident(buffer_));
+
+            std::array<std::uint8_t, 10> data{ 1, 2, 3 };
+            EXPECT_TRUE(buffer_.put(data.data(), data.size()));
+            std::array<std::uint8_t, 10> retrieved{};
+            EXPECT_TRUE(buffer_.get(retrieved));
+            EXPECT_EQ(data, retrieved);
+        } catch (const std::runtime_error &) {
+            GTEST_SKIP() << "RLIMIT_MEMLOCK does not allow locking";
+        }
+    }
+}
+
+TYPED_TEST(cb_fast_fixture, DiscardPages) {
+    if constexpr (is_vm_buffer_v<TypeParam>) {
+        TypeParam buffer_{ page_size };
+        std::vector<std::uint8_t> data(page_size, 0xAB);
+        EXPECT_TRUE(buffer_.put(data.data(), data.size()));
+
+        EXPECT_TRUE(buffer_.discard_pages());
+        EXPECT_EQ(buffer_.consumed_space(), 0);
+
+        // The old content is gone, the pages read back zeroed.
+        buffer_.mark_as_write(10);
+        std::array<std::uint8_t, 10> retrieved{};
+        retrieved.fill(0xFF);
+        EXPECT_TRUE(buffer_.get(retrieved));
+        EXPECT_EQ(retrieved, (std::array<std::uint8_t, 10>{}));
+
+        std::array<std::uint8_t, 10> more{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+        EXPECT_TRUE(buffer_.put(more.data(), more.size()));
+        EXPECT_TRUE(buffer_.get(retrieved));
+        EXPECT_EQ(more, retrieved);
+    }
+}
+
+TEST(circular_buffer_vm_hugetlb, invalid_size) {
+    using buffer_t = circular_buffer_vm<vm_cb_backend_hugetlb>;
+    if (buffer_t::page_size() == page_size) {
+        GTEST_SKIP() << "huge pages are the size of the regular pages";
+    }
+    EXPECT_THROW(buffer_t{ page_size }, std::invalid_argument);
+}
+
+TEST(circular_buffer_vm_hugetlb, mirrored) {
+    using buffer_t = circular_buffer_vm<vm_cb_backend_hugetlb>;
+    const auto size = buffer_t::page_size();
+
+    std::optional<buffer_t> buffer_{};
+    try {
+        buffer_.emplace(size);
+    } catch (const std::runtime_error &) {
+        GTEST_SKIP() << "no huge pages are reserved";
+    }
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(
+                  buffer_->available_span().data()) %
+                  size,
+              0);
+
+    // Wrap around the end of the buffer.
+    std::vector<std::uint8_t> filler(size - 5);
+    EXPECT_TRUE(buffer_->put(filler.data(), filler.size()));
+    buffer_->clear();
+
+    std::array<std::uint8_t, 10> data{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    EXPECT_TRUE(buffer_->put(data.data(), data.size()));
+    std::array<std::uint8_t, 10> retrieved{};
+    EXPECT_TRUE(buffer_->get(retrieved));
+    EXPECT_EQ(data, retrieved);
+}
@@ -0,0 +1,113 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/circular_buffer_vm.hpp>
+#include <mad/mirrored_ring_slab.hpp>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <set>
+#include <vector>
+
+using namespace mad;
+
+static inline constexpr std::size_t page_size = 4096;
+
+static std::size_t open_fd_count() {
+    return static_cast<std::size_t>(
+        std::distance(std::filesystem::directory_iterator{ "/proc/self/fd" },
+                      std::filesystem::directory_iterator{}));
+}
+
+TEST(mirrored_ring_slab, rings_are_mirrored) {
+    mirrored_ring_slab slab{ page_size, 4 };
+    EXPECT_EQ(slab.free_count(), 4);
+
+    std::array<std::uint8_t *, 4> rings{};
+    for (auto & ring : rings) {
+        ring = slab.allocate();
+        ASSERT_NE(ring, nullptr);
+    }
+    EXPECT_TRUE(slab.full());
+    EXPECT_EQ(slab.allocate(), nullptr);
+
+    for (std::size_t i = 0; i < rings.size(); i++) {
+        // Writing past the end of a ring wraps to its beginning, and
+        // does not touch the neighbouring rings.
+        std::memset(rings [i] + page_size - 2, static_cast<int>(i + 1), 4);
+    }
+    for (std::size_t i = 0; i < rings.size(); i++) {
+        EXPECT_EQ(rings [i] [0], i + 1);
+        EXPECT_EQ(rings [i] [1], i + 1);
+        EXPECT_EQ(rings [i] [2], 0);
+        EXPECT_EQ(rings [i] [page_size - 1], i + 1);
+    }
+
+    for (auto ring : rings) {
+        slab.deallocate(ring);
+    }
+    EXPECT_TRUE(slab.empty());
+}
+
+TEST(mirrored_ring_slab, deallocate_discards_content) {
+    mirrored_ring_slab slab{ page_size, 1 };
+    auto ring = slab.allocate();
+    ASSERT_NE(ring, nullptr);
+    std::memset(ring, 0xAB, page_size);
+    EXPECT_EQ(ring [page_size], 0xAB);
+    slab.deallocate(ring);
+
+    ring = slab.allocate();
+    ASSERT_NE(ring, nullptr);
+    EXPECT_EQ(ring [0], 0);
+    EXPECT_EQ(ring [page_size], 0);
+    slab.deallocate(ring);
+}
+
+TEST(mirrored_ring_slab, invalid_size) {
+    EXPECT_THROW((mirrored_ring_slab{ page_size + 1, 1 }),
+                 std::invalid_argument);
+    EXPECT_THROW((mirrored_ring_slab{ page_size, 0 }), std::invalid_argument);
+}
+
+TEST(mirrored_ring_slab, buffers_share_file_descriptors) {
+    constexpr std::size_t buffer_size = page_size * 8;
+    constexpr std::size_t rings_per_slab =
+        mirrored_ring_slab::allocator::k_slab_size / buffer_size;
+    constexpr std::size_t buffer_count = rings_per_slab * 3;
+
+    const auto fds_before = open_fd_count();
+    const auto slabs_before = mirrored_ring_slab::allocator::slab_count();
+    {
+        std::vector<circular_buffer_vm<vm_cb_backend_slab>> buffers{};
+        buffers.reserve(buffer_count);
+        std::set<const std::uint8_t *> addresses{};
+        for (std::size_t i = 0; i < buffer_count; i++) {
+            auto & buffer = buffers.emplace_back(buffer_size);
+            std::array<std::uint8_t, 1> data{ static_cast<std::uint8_t>(i) };
+            ASSERT_TRUE(buffer.put(data));
+            addresses.insert(buffer.available_span().data());
+        }
+        EXPECT_EQ(addresses.size(), buffer_count);
+
+        EXPECT_EQ(mirrored_ring_slab::allocator::slab_count() - slabs_before,
+                  3);
+        EXPECT_EQ(open_fd_count() - fds_before, 3);
+
+        for (std::size_t i = 0; i < buffer_count; i++) {
+            std::array<std::uint8_t, 1> data{};
+            ASSERT_TRUE(buffers [i].get(data));
+            EXPECT_EQ(data [0], static_cast<std::uint8_t>(i));
+        }
+    }
+
+    // The last slab of the size is kept for the next buffers.
+    EXPECT_EQ(mirrored_ring_slab::allocator::slab_count() - slabs_before, 1);
+    EXPECT_EQ(open_fd_count() - fds_before, 1);
+}
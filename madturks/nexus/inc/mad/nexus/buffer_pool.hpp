@@ -0,0 +1,153 @@
+/******************************************************
+ * Size-class pooled allocator for send buffers.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <flatbuffers/allocator.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Memory bounds of the buffer pool.
+ ******************************************************/
+struct buffer_pool_options {
+    /******************************************************
+     * Maximum amount of free memory cached by a single
+     * thread, in bytes. Blocks released beyond this limit
+     * are moved to the shared cache.
+     ******************************************************/
+    std::size_t thread_cache_bytes{ 1024 * 1024 };
+
+    /******************************************************
+     * Maximum amount of free memory cached in the shared
+     * cache, in bytes. Blocks released beyond this limit
+     * are returned to the system.
+     ******************************************************/
+    std::size_t shared_cache_bytes{ 64 * 1024 * 1024 };
+};
+
+/******************************************************
+ * Buffer pool statistics.
+ ******************************************************/
+struct buffer_pool_stats {
+    /******************************************************
+     * Total amount of allocation requests.
+     ******************************************************/
+    std::uint64_t allocations{ 0 };
+
+    /******************************************************
+     * Allocation requests that are served from a cache.
+     ******************************************************/
+    std::uint64_t cache_hits{ 0 };
+
+    /******************************************************
+     * Free memory held in the caches, in bytes.
+     ******************************************************/
+    std::uint64_t bytes_cached{ 0 };
+
+    /******************************************************
+     * Memory handed out and not yet released, in bytes.
+     ******************************************************/
+    std::uint64_t bytes_in_flight{ 0 };
+
+    /******************************************************
+     * Ratio of the allocations served from a cache.
+     ******************************************************/
+    double hit_rate() const noexcept {
+        return allocations ? static_cast<double>(cache_hits) /
+                                 static_cast<double>(allocations)
+                           : 0.0;
+    }
+};
+
+/******************************************************
+ * Process-wide pool of send buffer memory.
+ *
+ * Requests are rounded up to power-of-two size classes
+ * between k_min_block_size and k_max_block_size. Released
+ * blocks go to a per-thread cache first, then to a shared
+ * cache, and are returned to the system only when both
+ * caches are full. Larger requests bypass the caches.
+ *
+ * Every block carries a small header in front of it, so
+ * the block can be released without knowing its size,
+ * from any thread.
+ ******************************************************/
+class buffer_pool {
+public:
+    /******************************************************
+     * The smallest size class.
+     ******************************************************/
+    static constexpr std::size_t k_min_block_size = 64;
+
+    /******************************************************
+     * The largest size class.
+     ******************************************************/
+    static constexpr std::size_t k_max_block_size = 1024 * 1024;
+
+    /******************************************************
+     * Allocate a block of at least @p size bytes.
+     *
+     * @param size Requested size
+     * @return Pointer to the block, aligned to 16 bytes.
+     * @throws std::bad_alloc when the system is out of memory
+     ******************************************************/
+    [[nodiscard]] static std::uint8_t * allocate(std::size_t size);
+
+    /******************************************************
+     * Release a block obtained from allocate().
+     *
+     * @param ptr The block. nullptr is allowed.
+     ******************************************************/
+    static void deallocate(void * ptr) noexcept;
+
+    /******************************************************
+     * The usable size of a block obtained from allocate().
+     *
+     * @param ptr The block
+     * @return Usable size in bytes
+     ******************************************************/
+    static std::size_t capacity(const void * ptr) noexcept;
+
+    /******************************************************
+     * Change the memory bounds of the pool.
+     *
+     * Affects the blocks released after the call.
+     *
+     * @param options New bounds
+     ******************************************************/
+    static void configure(const buffer_pool_options & options) noexcept;
+
+    /******************************************************
+     * Return the cached memory of the calling thread and
+     * the shared cache to the system.
+     ******************************************************/
+    static void trim() noexcept;
+
+    /******************************************************
+     * Snapshot of the pool statistics.
+     ******************************************************/
+    static buffer_pool_stats stats() noexcept;
+
+    /******************************************************
+     * flatbuffers allocator that allocates from the pool.
+     ******************************************************/
+    static ::flatbuffers::Allocator & allocator() noexcept;
+};
+
+/******************************************************
+ * flatbuffers::Allocator adapter of the buffer_pool.
+ ******************************************************/
+class buffer_pool_allocator : public ::flatbuffers::Allocator {
+public:
+    std::uint8_t * allocate(std::size_t size) override;
+    void deallocate(std::uint8_t * p, std::size_t size) override;
+    ~buffer_pool_allocator() override;
+};
+
+} // namespace mad::nexus
@@ -0,0 +1,308 @@
+/******************************************************
+ * Concurrent connection registry.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/nexus/callback.hpp>
+#include <mad/nexus/result.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace mad::nexus {
+
+struct connection;
+class connection_snapshot;
+
+/******************************************************
+ * A sharded set of connections that can be iterated by
+ * any thread while the connections are being added and
+ * removed by the others.
+ *
+ * Each shard publishes an immutable view of its
+ * connections. Readers pin the current view without
+ * taking a lock, and the writers never wait for the
+ * readers to finish: a write copies the shard's view,
+ * applies the change and publishes the copy.
+ *
+ * Removing never allocates: every insert also sets aside
+ * a spare view, which is large enough for the copy that a
+ * later removal publishes.
+ *
+ * A removed connection stays valid until no reader can
+ * observe it anymore. The registry invokes the reclaim
+ * callback then, which is where the owner can destroy
+ * the connection. The callback is invoked by the thread
+ * that drops the last reference to the connection's last
+ * view: the remover itself when nobody was reading, or
+ * the last reader otherwise.
+ ******************************************************/
+class connection_registry {
+public:
+    using reclaim_callback_t = callback<void(connection &)>;
+
+    static constexpr std::size_t k_default_shard_count = 64;
+
+    /******************************************************
+     * Construct a new connection registry.
+     *
+     * @param on_reclaim Invoked when a removed connection
+     * is not observed by any reader anymore. Can be empty.
+     * @param shard_count Amount of shards. The connections
+     * are distributed by their serial numbers.
+     ******************************************************/
+    explicit connection_registry(
+        reclaim_callback_t on_reclaim = {},
+        std::size_t shard_count = k_default_shard_count);
+
+    connection_registry(const connection_registry &) = delete;
+    connection_registry & operator=(const connection_registry &) = delete;
+    connection_registry(connection_registry &&) = delete;
+    connection_registry & operator=(connection_registry &&) = delete;
+
+    /******************************************************
+     * Destroy the registry. The connections that are
+     * removed but not reclaimed yet are reclaimed. The
+     * snapshots must not outlive the registry.
+     ******************************************************/
+    ~connection_registry();
+
+    /******************************************************
+     * Add a connection.
+     *
+     * @return memory_allocation_failed if the new view of
+     * the shard, or its spare view, could not be allocated.
+     ******************************************************/
+    auto insert(connection & cctx) -> result<>;
+
+    /******************************************************
+     * Remove a connection. It is reclaimed once the readers
+     * that might still observe it are done.
+     *
+     * Never allocates.
+     *
+     * @return value_does_not_exists if the connection is not
+     * in the registry.
+     ******************************************************/
+    auto remove(connection & cctx) -> result<>;
+
+    /******************************************************
+     * Invoke @p fn with every connection, one shard at a
+     * time. Never blocks the writers.
+     *
+     * The connections added or removed meanwhile may or may
+     * not be visited. A visited connection might have just
+     * been removed, but it stays valid until @p fn returns.
+     *
+     * @param fn Callable taking a connection&
+     ******************************************************/
+    template <typename F>
+    void for_each_connection(F && fn) const {
+        for (std::size_t i = 0; i < shard_count_; i++) {
+            const view_ref v{ acquire(shards [i]) };
+            for (auto * cctx : v->connections) {
+                fn(*cctx);
+            }
+        }
+    }
+
+    /******************************************************
+     * Pin the current views of all shards. The connections
+     * in the snapshot stay valid until it is destroyed.
+     *
+     * Snapshots are meant to be short-lived, e.g. one tick:
+     * a pinned view also pins the views that replace it, and
+     * the connections removed meanwhile are not reclaimed.
+     *
+     * @throws std::bad_alloc
+     ******************************************************/
+    [[nodiscard]] connection_snapshot snapshot() const;
+
+    /******************************************************
+     * Amount of connections in the registry.
+     ******************************************************/
+    [[nodiscard]] std::size_t size() const noexcept {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Amount of shards.
+     ******************************************************/
+    [[nodiscard]] std::size_t shard_count() const noexcept {
+        return shard_count_;
+    }
+
+private:
+    friend class connection_snapshot;
+
+    /******************************************************
+     * An immutable set of connections of a shard.
+     ******************************************************/
+    struct view {
+        std::vector<connection *> connections{};
+
+        /******************************************************
+         * The connection removed by the write that replaced
+         * this view. Reclaimed with the view.
+         ******************************************************/
+        connection * retired{ nullptr };
+
+        /******************************************************
+         * The view that replaced this one. Pinned by this
+         * view, so a view is always released after the views
+         * it replaced. Links the spare views of a shard
+         * before the view is published.
+         ******************************************************/
+        view * successor{ nullptr };
+
+        const connection_registry * owner{ nullptr };
+        std::atomic<std::uint32_t> refs{ 1 };
+    };
+
+    /******************************************************
+     * A pinned view.
+     ******************************************************/
+    class view_ref {
+    public:
+        explicit view_ref(view * v) noexcept : v_(v) {}
+
+        view_ref(const view_ref &) = delete;
+        view_ref & operator=(const view_ref &) = delete;
+
+        view_ref(view_ref && other) noexcept :
+            v_(std::exchange(other.v_, nullptr)) {}
+
+        view_ref & operator=(view_ref && other) noexcept {
+            if (this != &other) {
+                release(std::exchange(v_, std::exchange(other.v_, nullptr)));
+            }
+            return *this;
+        }
+
+        ~view_ref() {
+            release(v_);
+        }
+
+        const view * operator->() const noexcept {
+            return v_;
+        }
+
+    private:
+        view * v_;
+    };
+
+    struct alignas(64) shard {
+        std::atomic<view *> current{ nullptr };
+
+        /******************************************************
+         * Readers that are pinning a view, by the parity they
+         * started with. Writers wait for the readers of the
+         * previous parity, which only takes a few instructions.
+         ******************************************************/
+        std::atomic<std::uint32_t> parity{ 0 };
+        std::atomic<std::uint32_t> pins [2]{};
+
+        /******************************************************
+         * The views set aside for the removals, one per
+         * connection in the shard. The n-th spare from the
+         * bottom holds at least n connections, so the top one
+         * always fits the copy that a removal publishes.
+         * Guarded by write_mtx.
+         ******************************************************/
+        view * spares{ nullptr };
+
+        std::mutex write_mtx{};
+    };
+
+    /******************************************************
+     * Pin the current view of a shard. Lock-free.
+     ******************************************************/
+    view * acquire(shard & s) const noexcept;
+
+    /******************************************************
+     * Drop a reference to a view. The views and connections
+     * that are not observed anymore are reclaimed.
+     ******************************************************/
+    static void release(view * v) noexcept;
+
+    /******************************************************
+     * Publish @p next as the current view of @p s. Must be
+     * called with the shard's write lock held.
+     ******************************************************/
+    void replace(shard & s, view * next) noexcept;
+
+    shard & shard_of(const connection & cctx) const noexcept;
+
+    mutable reclaim_callback_t on_reclaim;
+    std::size_t shard_count_;
+    std::unique_ptr<shard []> shards;
+    std::atomic<std::size_t> count{ 0 };
+};
+
+/******************************************************
+ * The connections of a connection_registry at a point in
+ * time, grouped by shard. See connection_registry::snapshot.
+ *
+ * The shards can be processed independently, e.g. by a
+ * different thread each.
+ ******************************************************/
+class connection_snapshot {
+public:
+    connection_snapshot() = default;
+    connection_snapshot(const connection_snapshot &) = delete;
+    connection_snapshot & operator=(const connection_snapshot &) = delete;
+    connection_snapshot(connection_snapshot &&) = default;
+    connection_snapshot & operator=(connection_snapshot &&) = default;
+    ~connection_snapshot() = default;
+
+    /******************************************************
+     * Invoke @p fn with every connection in the snapshot.
+     ******************************************************/
+    template <typename F>
+    void for_each(F && fn) const {
+        for (const auto & v : views) {
+            for (auto * cctx : v->connections) {
+                fn(*cctx);
+            }
+        }
+    }
+
+    /******************************************************
+     * The connections of the shard at @p index.
+     ******************************************************/
+    [[nodiscard]] std::span<connection * const>
+    shard(std::size_t index) const noexcept {
+        return views [index]->connections;
+    }
+
+    /******************************************************
+     * Amount of shards in the snapshot.
+     ******************************************************/
+    [[nodiscard]] std::size_t shard_count() const noexcept {
+        return views.size();
+    }
+
+    /******************************************************
+     * Amount of connections in the snapshot.
+     ******************************************************/
+    [[nodiscard]] std::size_t size() const noexcept;
+
+    [[nodiscard]] bool empty() const noexcept {
+        return 0 == size();
+    }
+
+private:
+    friend class connection_registry;
+
+    std::vector<connection_registry::view_ref> views{};
+};
+
+} // namespace mad::nexus
@@ -0,0 +1,152 @@
+/******************************************************
+ * Length-prefixed frame decoder.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/macro>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Size of the length prefix that precedes every frame.
+ ******************************************************/
+inline constexpr std::size_t k_frame_prefix_size = sizeof(std::uint32_t);
+
+/******************************************************
+ * Read the little-endian frame length prefix at @p ptr.
+ *
+ * @param ptr Pointer to the first byte of the prefix
+ *
+ * @return The length of the frame payload
+ ******************************************************/
+[[nodiscard]] MAD_ALWAYS_INLINE std::uint32_t
+read_frame_size(const std::uint8_t * ptr) noexcept {
+    // Comply with the strict aliasing rules.
+    std::uint32_t size{ 0 };
+    std::memcpy(&size, ptr, sizeof(std::uint32_t));
+
+    // Size is little-endian. Resolved at compile time.
+    if constexpr (std::endian::native == std::endian::big) {
+        size = std::byteswap(size);
+    }
+    return size;
+}
+
+/******************************************************
+ * The payload length of the first frame in @p data, if
+ * @p data is long enough to contain its length prefix.
+ ******************************************************/
+[[nodiscard]] inline std::optional<std::uint32_t>
+peek_frame_size(std::span<const std::uint8_t> data) noexcept {
+    if (data.size() < k_frame_prefix_size) {
+        return std::nullopt;
+    }
+    return read_frame_size(data.data());
+}
+
+/******************************************************
+ * Decoder for the 4-byte little-endian length-prefixed
+ * framing of the nexus streams.
+ *
+ * Splits a contiguous span into the payloads of the
+ * complete frames it contains, in a single pass, up to
+ * Capacity frames per decode() call. The payload spans
+ * refer to the decoded data and are valid as long as it
+ * is. The decoder holds no other state, so the caller
+ * is responsible for the trailing partial frame.
+ *
+ * @tparam Capacity Maximum amount of frames per decode
+ ******************************************************/
+template <std::size_t Capacity = 64>
+class frame_decoder {
+    static_assert(Capacity > 0, "frame_decoder needs room for a frame");
+
+public:
+    using frame_t = std::span<const std::uint8_t>;
+
+    /******************************************************
+     * Decode the complete frames at the start of @p data.
+     *
+     * Stops at the first incomplete frame, or when Capacity
+     * frames are decoded.
+     *
+     * @param data The data, starting with a length prefix
+     *
+     * @return The part of @p data after the decoded frames.
+     ******************************************************/
+    std::span<const std::uint8_t>
+    decode(std::span<const std::uint8_t> data) noexcept {
+        const std::uint8_t * pos = data.data();
+        const std::uint8_t * const end = pos + data.size();
+        std::size_t count = 0;
+
+        while (count < Capacity &&
+               static_cast<std::size_t>(end - pos) >= k_frame_prefix_size) {
+            const std::size_t size = read_frame_size(pos);
+            if (static_cast<std::size_t>(end - pos) - k_frame_prefix_size <
+                size) {
+                break;
+            }
+            frames_ [count++] = frame_t{ pos + k_frame_prefix_size, size };
+            pos += k_frame_prefix_size + size;
+        }
+
+        count_ = count;
+        return { pos, end };
+    }
+
+    /******************************************************
+     * The payloads of the frames found by the last decode.
+     ******************************************************/
+    [[nodiscard]] std::span<const frame_t> frames() const noexcept {
+        return { frames_.data(), count_ };
+    }
+
+    /******************************************************
+     * Amount of frames found by the last decode.
+     ******************************************************/
+    [[nodiscard]] std::size_t size() const noexcept {
+        return count_;
+    }
+
+    /******************************************************
+     * Whether the last decode found no complete frame.
+     ******************************************************/
+    [[nodiscard]] bool empty() const noexcept {
+        return count_ == 0;
+    }
+
+    /******************************************************
+     * Whether the last decode stopped because the decoder
+     * ran out of room, rather than running out of data.
+     ******************************************************/
+    [[nodiscard]] bool full() const noexcept {
+        return count_ == Capacity;
+    }
+
+    /******************************************************
+     * The end of the @p idx th frame, including its length
+     * prefix, i.e. where the data continues after it.
+     ******************************************************/
+    [[nodiscard]] const std::uint8_t *
+    frame_end(std::size_t idx) const noexcept {
+        MAD_EXPECTS(idx < count_);
+        return frames_ [idx].data() + frames_ [idx].size();
+    }
+
+private:
+    std::array<frame_t, Capacity> frames_{};
+    std::size_t count_{ 0 };
+};
+
+} // namespace mad::nexus
@@ -6,9 +6,16 @@
 #pragma once
 
 #include <mad/macro>
+#include <mad/nexus/slot_map.hpp>
+
+#include <cstddef>
 
 namespace mad::nexus {
 
+template <typename HandleContextType, std::size_t InlineCapacity,
+          std::size_t ChunkSize>
+struct handle_context_container;
+
 /******************************************************
  * A base type that carries an opaque handle.
  ******************************************************/
@@ -36,10 +43,23 @@ struct handle_carrier {
         return static_cast<T>(handle_);
     }
 
+    /**
+     * @brief The key of the object in its handle_context_container.
+     *
+     * Refers to nothing if the object is not stored in one.
+     */
+    [[nodiscard]] slot_key context_key() const noexcept {
+        return context_key_;
+    }
+
 protected:
     ~handle_carrier() = default;
 
 private:
+    template <typename, std::size_t, std::size_t>
+    friend struct handle_context_container;
+
     void * handle_;
+    slot_key context_key_{};
 };
 } // namespace mad::nexus
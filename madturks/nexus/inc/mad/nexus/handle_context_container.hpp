@@ -5,17 +5,28 @@
  ******************************************************/
 #pragma once
 
+#include <mad/macro>
+#include <mad/nexus/callback.hpp>
 #include <mad/nexus/quic_error_code.hpp>
 #include <mad/nexus/quic_stream.hpp>
 #include <mad/nexus/result.hpp>
-#include <mad/nexus/shared_ptr_raw_equal.hpp>
-#include <mad/nexus/shared_ptr_raw_hash.hpp>
+#include <mad/nexus/slot_map.hpp>
 
-#include <memory>
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
 
 namespace mad::nexus {
 
+/******************************************************
+ * Releases a handle when its context is removed from the
+ * handle_context_container. Invoked with the handle.
+ ******************************************************/
+using handle_closer_t = callback<void(void *)>;
+
 /******************************************************
  * A container for associating a handle with an user-defined
  * handle context. The handle context's lifetime is bound to
@@ -26,82 +37,308 @@ namespace mad::nexus {
  * needs to store associated data with that context (e.g. connection
  * state, stream state).
  *
- * The handle context can be retrieved by either providing the
- * shared_ptr of the handle, or the raw handle (void*) itself.
+ * The handle contexts are stored in a slot_map, so their
+ * addresses are stable and adding/removing them does not
+ * need a lookup. A handle context is retrieved by its
+ * context_key(), which can also be carried in an opaque
+ * pointer (see slot_key::to_context).
  *
- * @tparam HandleContextType The handle context type
+ * The member functions are thread-safe, except clear().
+ * A handle is never closed while the container's lock is
+ * held: a handle context removed while the lock is held,
+ * e.g. from within for_each, is only marked as removed,
+ * and its handle is closed and the handle context is
+ * destroyed when the lock is released.
+ *
+ * Not movable.
+ *
+ * @tparam HandleContextType The handle context type. Must
+ * derive from handle_carrier.
+ * @tparam InlineCapacity Amount of handle contexts stored
+ * within the container, without allocating.
+ * @tparam ChunkSize Amount of handle contexts allocated at
+ * once past the inline ones.
  ******************************************************/
-template <typename HandleContextType>
+template <typename HandleContextType, std::size_t InlineCapacity = 0,
+          std::size_t ChunkSize = 64>
 struct handle_context_container {
-    using underlying_map_t =
-        std::unordered_map<std::shared_ptr<void>, HandleContextType,
-                           shared_ptr_raw_hash, shared_ptr_raw_equal>;
+    /******************************************************
+     * The container's lock. Completes the pending removals
+     * when it is released by the outermost holder.
+     ******************************************************/
+    class context_lock {
+    public:
+        explicit context_lock(handle_context_container & c) noexcept :
+            owner(c) {}
+
+        void lock() {
+            owner.mtx.lock();
+            ++owner.lock_depth;
+        }
+
+        void unlock() noexcept {
+            owner.release_lock();
+        }
+
+    private:
+        handle_context_container & owner;
+    };
 
     handle_context_container() = default;
-    handle_context_container(const handle_context_container &) = default;
+    handle_context_container(const handle_context_container &) = delete;
     handle_context_container &
-    operator=(const handle_context_container &) = default;
-    handle_context_container(handle_context_container &&) = default;
-    handle_context_container & operator=(handle_context_container &&) = default;
+    operator=(const handle_context_container &) = delete;
+    handle_context_container(handle_context_container &&) = delete;
+    handle_context_container & operator=(handle_context_container &&) = delete;
 
     /******************************************************
-     * Add a new handle/handle context pair.
+     * Add a new handle context.
      *
-     * @param ptr Type-erased shared_ptr handle type
+     * @param closer Invoked with the handle when the handle
+     * context is removed, before the handle context is
+     * destroyed. Can be empty.
      * @param value_args Arguments to be forwarded to the handle_context
      * constructor
      * @return The handle context reference on success, error_code otherwise.
+     * The handle is not closed on failure.
      ******************************************************/
     template <typename... Args>
-    auto add(std::shared_ptr<void> handle, Args &&... value_args)
+    auto add(handle_closer_t closer, Args &&... value_args)
         -> result<std::reference_wrapper<HandleContextType>> {
+        std::lock_guard<std::recursive_mutex> guard{ mtx };
+        try {
+            auto [key, e] = storage.emplace(
+                closer, std::forward<Args>(value_args)...);
+            e.value.context_key_ = key;
+            return e.value;
+        } catch (const std::bad_alloc &) {
+            return std::unexpected(quic_error_code::memory_allocation_failed);
+        }
+    }
 
-        auto present = storage.find(handle);
+    /******************************************************
+     * Look up a handle context by its key.
+     *
+     * A handle context that is being removed can still be
+     * found until its handle is closed.
+     *
+     * @param key The handle context's key
+     * @return The handle context reference on success,
+     *         error code otherwise.
+     ******************************************************/
+    [[nodiscard]] auto find(slot_key key)
+        -> result<std::reference_wrapper<HandleContextType>> {
+        std::lock_guard<std::recursive_mutex> guard{ mtx };
+        auto * e = storage.get(key);
 
-        if (!(storage.end() == present)) {
-            // The same connection already exists?
-            assert(false);
-            return std::unexpected(quic_error_code::value_already_exists);
+        if (nullptr == e) {
+            return std::unexpected(quic_error_code::value_does_not_exists);
         }
+        return e->value;
+    }
+
+    /******************************************************
+     * Invoke @p fn with every handle context, while holding
+     * the container's lock. The handle contexts that are
+     * being removed are skipped.
+     *
+     * @p fn may add and remove handle contexts. The ones
+     * added meanwhile may or may not be visited.
+     *
+     * @param fn Callable taking a HandleContextType&
+     ******************************************************/
+    template <typename F>
+    void for_each(F && fn) {
+        std::unique_lock<context_lock> guard{ lock_ };
+        storage.for_each([&](entry & e) {
+            if (entry_state::live == e.state) {
+                fn(e.value);
+            }
+        });
+    }
+
+    /******************************************************
+     * Hold the container's lock, e.g. to keep the set of
+     * handle contexts stable across several for_each calls.
+     * Blocks adding and removing the handle contexts from
+     * the other threads.
+     ******************************************************/
+    [[nodiscard]] auto lock() -> std::unique_lock<context_lock> {
+        return std::unique_lock<context_lock>{ lock_ };
+    }
 
-        const auto & [emplaced_itr, emplace_status] = storage.emplace(
-            std::move(handle),
-            HandleContextType{ std::forward<Args>(value_args)... });
+    /******************************************************
+     * Remove a handle context. The handle is closed, and then
+     * the handle context is destroyed.
+     *
+     * If the calling thread holds the container's lock, the
+     * removal is completed when the lock is released.
+     *
+     * @param key The handle context's key
+     * @return Result object indicating success or failure.
+     ******************************************************/
+    auto erase(slot_key key) -> result<> {
+        std::unique_lock<context_lock> guard{ lock_ };
+        auto * e = storage.get(key);
 
-        if (!emplace_status) {
-            return std::unexpected(quic_error_code::value_emplace_failed);
+        if (nullptr == e || entry_state::live != e->state) {
+            return std::unexpected(quic_error_code::value_does_not_exists);
         }
-        return emplaced_itr->second;
+        e->state = entry_state::erase_pending;
+        e->next_pending = std::exchange(pending_erases, key);
+        return {};
+    }
+
+    /******************************************************
+     * Remove a handle context. See erase(slot_key).
+     ******************************************************/
+    auto erase(const HandleContextType & value) -> result<> {
+        return erase(value.context_key());
     }
 
     /******************************************************
-     * Remove a handle (and its context) from the map
+     * Detach the closer of a handle context, so removing the
+     * handle context does not close its handle anymore. The
+     * caller becomes responsible for closing the handle.
      *
-     * @param handle The handle
-     * @return Extracted node from the map on success,
-     *         error code otherwise.
+     * @param value The handle context
+     * @return The closer on success, error code otherwise.
      ******************************************************/
-    [[nodiscard]] auto
-    erase(void * handle) -> result<typename underlying_map_t::node_type> {
-        auto present = storage.find(handle);
+    auto release_closer(const HandleContextType & value)
+        -> result<handle_closer_t> {
+        std::lock_guard<std::recursive_mutex> guard{ mtx };
+        auto * e = storage.get(value.context_key());
 
-        if (storage.end() == present) {
+        if (nullptr == e) {
             return std::unexpected(quic_error_code::value_does_not_exists);
         }
+        return std::exchange(e->closer, handle_closer_t{});
+    }
+
+    /******************************************************
+     * Remove all handle contexts. The handles are closed,
+     * and then the handle contexts are destroyed.
+     *
+     * For the teardown; must not run concurrently with the
+     * other member functions.
+     ******************************************************/
+    void clear() noexcept {
+        std::lock_guard<std::recursive_mutex> guard{ mtx };
+        storage.clear();
+        pending_erases = {};
+    }
 
-        // Remove the key-value pair from the map
-        // and return it to caller. The caller might
-        // have some unfinished business with it.
-        return storage.extract(present);
+    /******************************************************
+     * Amount of handle contexts in the container, including
+     * the ones that are being removed.
+     ******************************************************/
+    [[nodiscard]] std::size_t size() const noexcept {
+        std::lock_guard<std::recursive_mutex> guard{ mtx };
+        return storage.size();
     }
 
 protected:
     ~handle_context_container() = default;
 
 private:
+    /******************************************************
+     * Lifecycle of an entry.
+     ******************************************************/
+    enum class entry_state : std::uint8_t
+    {
+        live,
+        // Removed while the lock is held, to be closed when
+        // the lock is released.
+        erase_pending,
+        // The handle is being closed, outside of the lock.
+        closing
+    };
+
+private:
+    /******************************************************
+     * Release one level of the lock. The last level closes
+     * the handles of the pending removals outside of the
+     * lock, since closing may block until the handle's
+     * worker thread processes it, and the worker might be
+     * waiting for the lock.
+     ******************************************************/
+    void release_lock() noexcept {
+        if (--lock_depth > 0) {
+            mtx.unlock();
+            return;
+        }
+
+        while (pending_erases) {
+            const slot_key key = pending_erases;
+            auto * e = storage.get(key);
+            MAD_EXPECTS(e);
+            pending_erases = std::exchange(e->next_pending, slot_key{});
+            e->state = entry_state::closing;
+            handle_closer_t closer = std::exchange(e->closer, {});
+            void * handle = e->value.template handle_as<>();
+
+            mtx.unlock();
+            if (closer) {
+                closer(handle);
+            }
+            mtx.lock();
+            storage.erase(key);
+        }
+        mtx.unlock();
+    }
+
+    /******************************************************
+     * A handle context, and the function that closes its
+     * handle.
+     ******************************************************/
+    struct entry {
+        template <typename... Args>
+        explicit entry(handle_closer_t c, Args &&... args) :
+            closer(c), value(std::forward<Args>(args)...) {}
+
+        entry(const entry &) = delete;
+        entry & operator=(const entry &) = delete;
+
+        ~entry() {
+            // Close first: the events raised while closing may
+            // still refer to the handle context.
+            if (closer) {
+                closer(value.template handle_as<>());
+            }
+        }
+
+        handle_closer_t closer;
+        HandleContextType value;
+        entry_state state{ entry_state::live };
+        // Next entry in the pending removal list.
+        slot_key next_pending{};
+    };
+
     /******************************************************
      * Underlying storage for handle/handle context pairs.
      ******************************************************/
-    underlying_map_t storage{};
+    slot_map<entry, ChunkSize, InlineCapacity> storage{};
+
+    /******************************************************
+     * Guards the storage. Recursive, so the handle contexts
+     * can be added and removed from within for_each.
+     ******************************************************/
+    mutable std::recursive_mutex mtx{};
+
+    /******************************************************
+     * Levels of the lock held through context_lock. Guarded
+     * by mtx.
+     ******************************************************/
+    std::size_t lock_depth{ 0 };
+
+    /******************************************************
+     * Head of the pending removal list. Guarded by mtx.
+     ******************************************************/
+    slot_key pending_erases{};
+
+    /******************************************************
+     * See lock().
+     ******************************************************/
+    context_lock lock_{ *this };
 };
 } // namespace mad::nexus
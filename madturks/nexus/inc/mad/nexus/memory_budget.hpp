@@ -0,0 +1,178 @@
+/******************************************************
+ * Memory accounting of the connections.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/nexus/quic_configuration.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mad::nexus {
+
+struct connection;
+
+/******************************************************
+ * Memory budget statistics.
+ ******************************************************/
+struct memory_budget_stats {
+    /******************************************************
+     * Memory held by all connections, in bytes.
+     ******************************************************/
+    std::uint64_t bytes_in_use{ 0 };
+
+    /******************************************************
+     * New connections refused for being over the total
+     * limit.
+     ******************************************************/
+    std::uint64_t connections_refused{ 0 };
+
+    /******************************************************
+     * Times a stream stopped reading for being over a
+     * limit.
+     ******************************************************/
+    std::uint64_t receives_held{ 0 };
+
+    /******************************************************
+     * Connections disconnected for holding the most memory
+     * while over the total limit.
+     ******************************************************/
+    std::uint64_t connections_evicted{ 0 };
+};
+
+/******************************************************
+ * Accounts the memory held on behalf of the connections,
+ * per connection and in total, and checks it against the
+ * memory_budget_options.
+ *
+ * The receive buffers of the streams are charged with
+ * try_charge(), and are not allocated when it fails. The
+ * sends are charged with charge() once they are handed
+ * over to the QUIC implementation or queued, and credited
+ * when they are completed or discarded.
+ *
+ * The connections carry their own counters, and release
+ * what is left of them when they are destroyed. The
+ * budget must outlive its connections.
+ *
+ * Thread-safe.
+ ******************************************************/
+class memory_budget {
+public:
+    /******************************************************
+     * Construct a budget without limits.
+     ******************************************************/
+    memory_budget() = default;
+
+    memory_budget(const memory_budget &) = delete;
+    memory_budget & operator=(const memory_budget &) = delete;
+
+    /******************************************************
+     * Change the limits. The memory that is already held
+     * is kept, even if it is over the new limits.
+     *
+     * @param options New limits
+     ******************************************************/
+    void configure(const memory_budget_options & options) noexcept;
+
+    /******************************************************
+     * The current limits.
+     ******************************************************/
+    [[nodiscard]] memory_budget_options options() const noexcept;
+
+    /******************************************************
+     * Charge @p bytes to a connection, unless it takes the
+     * connection or the total over its limit.
+     *
+     * @param cctx The connection
+     * @param bytes Amount of memory
+     * @return true if the memory is charged.
+     ******************************************************/
+    [[nodiscard]] bool try_charge(connection & cctx,
+                                  std::size_t bytes) noexcept;
+
+    /******************************************************
+     * Charge @p bytes to a connection, regardless of the
+     * limits. Used for the memory that is already in use.
+     *
+     * @param cctx The connection
+     * @param bytes Amount of memory
+     ******************************************************/
+    void charge(connection & cctx, std::size_t bytes) noexcept;
+
+    /******************************************************
+     * Give back @p bytes charged to a connection before.
+     *
+     * @param cctx The connection
+     * @param bytes Amount of memory
+     ******************************************************/
+    void credit(connection & cctx, std::size_t bytes) noexcept;
+
+    /******************************************************
+     * Give back everything that is charged to a connection.
+     *
+     * @param cctx The connection
+     ******************************************************/
+    void release(connection & cctx) noexcept;
+
+    /******************************************************
+     * Memory held by all connections, in bytes.
+     ******************************************************/
+    [[nodiscard]] std::size_t total() const noexcept;
+
+    /******************************************************
+     * Whether the connections hold more than the total
+     * limit.
+     ******************************************************/
+    [[nodiscard]] bool over_limit() const noexcept;
+
+    /******************************************************
+     * Whether a new connection may be accepted, i.e. the
+     * connections hold less than the total limit. Counts
+     * the refusal otherwise.
+     ******************************************************/
+    [[nodiscard]] bool admit_connection() noexcept;
+
+    /******************************************************
+     * Whether both the connection and the total are below
+     * their limits, so the connection may take more memory.
+     ******************************************************/
+    [[nodiscard]] bool has_room(const connection & cctx) const noexcept;
+
+    /******************************************************
+     * Mark a connection as disconnected for the memory it
+     * holds. Its memory is given back once it is destroyed.
+     *
+     * @return false if the connection is already marked.
+     ******************************************************/
+    bool evict(connection & cctx) noexcept;
+
+    /******************************************************
+     * Whether the connection is marked by evict().
+     ******************************************************/
+    [[nodiscard]] static bool evicted(const connection & cctx) noexcept;
+
+    /******************************************************
+     * Count a stream that stopped reading for being over a
+     * limit.
+     ******************************************************/
+    void receive_held() noexcept;
+
+    /******************************************************
+     * Snapshot of the budget statistics.
+     ******************************************************/
+    [[nodiscard]] memory_budget_stats stats() const noexcept;
+
+private:
+    std::atomic<std::size_t> total_limit_{ 0 };
+    std::atomic<std::size_t> connection_limit_{ 0 };
+    std::atomic<std::size_t> total_{ 0 };
+    std::atomic<std::uint64_t> connections_refused_{ 0 };
+    std::atomic<std::uint64_t> receives_held_{ 0 };
+    std::atomic<std::uint64_t> connections_evicted_{ 0 };
+};
+
+} // namespace mad::nexus
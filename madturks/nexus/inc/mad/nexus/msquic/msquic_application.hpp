@@ -54,6 +54,13 @@ public:
      ******************************************************/
     virtual QUIC_HANDLE * configuration() const noexcept;
 
+    /******************************************************
+     * The receive buffer sizing of the streams.
+     ******************************************************/
+    const stream_receive_options & stream_receive() const noexcept {
+        return stream_receive_;
+    }
+
     /******************************************************
      * Destroy the msquic application object
      ******************************************************/
@@ -90,6 +97,9 @@ protected:
     std::shared_ptr<QUIC_HANDLE> registration_ptr{};
     // The MSQUIC configuration object.
     std::shared_ptr<QUIC_HANDLE> configuration_ptr{};
+
+    // The receive buffer sizing of the streams.
+    stream_receive_options stream_receive_{};
 };
 
 } // namespace mad::nexus
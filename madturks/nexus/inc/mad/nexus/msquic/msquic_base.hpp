@@ -13,6 +13,8 @@
 #include <mad/nexus/quic_stream.hpp>
 #include <mad/nexus/result.hpp>
 
+struct QUIC_CONNECTION_EVENT;
+
 namespace mad::nexus {
 
 /******************************************************
@@ -26,11 +28,39 @@ class msquic_base : virtual public quic_base,
 public:
     auto open_stream(
         connection & cctx,
-        std::optional<stream_data_callback_t> data_callback = std::nullopt)
+        std::optional<stream_data_callback_t> data_callback = std::nullopt,
+        stream_priority_t priority = k_default_stream_priority)
+        -> result<std::reference_wrapper<stream>> override;
+    auto open_stream(connection & cctx,
+                     stream_batch_data_callback_t batch_callback,
+                     stream_priority_t priority = k_default_stream_priority)
         -> result<std::reference_wrapper<stream>> override;
+    auto open_stream(connection & cctx, stream_data_callback_t data_callback,
+                     stream_message_callbacks message_callbacks,
+                     stream_priority_t priority = k_default_stream_priority)
+        -> result<std::reference_wrapper<stream>> override;
+    auto set_stream_priority(stream & sctx,
+                             stream_priority_t priority) -> result<> override;
     auto close_stream(stream & sctx) -> result<> override;
-    auto send(stream & sctx,
-              send_buffer<true> buf) -> result<std::size_t> override;
+    auto resume_receive(stream & sctx) -> result<> override;
+    auto send(stream & sctx, send_buffer<true> buf,
+              send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> override;
+    auto send(stream & sctx, std::span<send_buffer<true>> bufs,
+              send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> override;
+    auto broadcast(std::span<const std::reference_wrapper<stream>> streams,
+                   const shared_send_buffer & buf,
+                   send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> override;
+    auto send_datagram(connection & cctx,
+                       send_buffer<true> buf) -> result<std::size_t> override;
+    auto flush(connection & cctx) -> result<std::size_t> override;
+    auto trim_receive_buffers(connection & cctx) -> std::size_t override;
+    auto statistics(const connection & cctx) const
+        -> result<connection_statistics> override;
+    auto statistics(const stream & sctx) const
+        -> result<stream_statistics> override;
 
     virtual ~msquic_base() override;
 
@@ -40,10 +70,81 @@ protected:
      ******************************************************/
     friend struct tf_msquic_base;
     msquic_base(const class msquic_application & app);
+
+    /******************************************************
+     * Handle the DATAGRAM_* events of a connection.
+     *
+     * @param cctx The connection, or nullptr if the connection
+     * is not known (yet, or anymore). The callbacks are not
+     * invoked then, but the datagrams are still released.
+     * @param event The event
+     ******************************************************/
+    void on_datagram_event(connection * cctx,
+                           const QUIC_CONNECTION_EVENT & event);
+
+    /******************************************************
+     * Enforce the memory budget on the given connections,
+     * see quic_base::enforce_memory_budget.
+     *
+     * @param connections The connections to rank, and to
+     * resume the held back streams of.
+     * @return Amount of the disconnected connections
+     ******************************************************/
+    auto enforce_memory_budget_on(std::span<connection * const> connections)
+        -> std::size_t;
+
+    /******************************************************
+     * Closes the handles of the streams that are removed
+     * from their connection.
+     ******************************************************/
+    handle_closer_t stream_closer() const noexcept;
+
+    /******************************************************
+     * Aborts a stream in both directions, see stream::reset.
+     ******************************************************/
+    handle_closer_t stream_resetter() const noexcept;
+
     /******************************************************
      * The application that client belongs to.
      ******************************************************/
     const class msquic_application & application;
+
+private:
+    /******************************************************
+     * Open and start a new stream with the given callbacks.
+     ******************************************************/
+    auto open_stream_with(connection & cctx, stream_callbacks scb,
+                          stream_priority_t priority)
+        -> result<std::reference_wrapper<stream>>;
+
+    /******************************************************
+     * Queue messages on a stream while the send coalescing
+     * is enabled. Urgent messages are sent immediately,
+     * after the stream's queued messages.
+     ******************************************************/
+    auto send_coalesced(stream & sctx, std::span<send_buffer<true>> bufs,
+                        send_urgency urgency) -> result<std::size_t>;
+
+    /******************************************************
+     * Send the queued messages of a stream. The caller
+     * holds the stream's send queue locked.
+     *
+     * @param sctx The stream
+     * @param urgency Urgency of the send
+     * @param more_to_come Whether more data is going to be
+     * sent right after, in which case the transmission is
+     * delayed until then.
+     ******************************************************/
+    auto flush_stream(stream & sctx, send_urgency urgency,
+                      bool more_to_come) -> result<std::size_t>;
+
+    /******************************************************
+     * Resume a stream held back for memory, unless another
+     * thread delivers its data at the moment.
+     *
+     * @return true if the stream is resumed.
+     ******************************************************/
+    bool try_resume_receive(stream & sctx);
 };
 
 } // namespace mad::nexus
@@ -47,6 +47,21 @@ public:
      ******************************************************/
     virtual auto disconnect() -> result<> override;
 
+    /******************************************************
+     * Flush the queued sends of the connection, if any.
+     ******************************************************/
+    virtual auto flush_all() -> result<std::size_t> override;
+
+    /******************************************************
+     * Trim the receive buffers of the connection, if any.
+     ******************************************************/
+    virtual auto trim_all_receive_buffers() -> std::size_t override;
+
+    /******************************************************
+     * Enforce the memory budget on the connection, if any.
+     ******************************************************/
+    virtual auto enforce_memory_budget() -> std::size_t override;
+
 private:
     /******************************************************
      * MSQUIC client unit tests
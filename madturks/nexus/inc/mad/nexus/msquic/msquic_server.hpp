@@ -28,8 +28,24 @@ public:
 
     virtual result<> listen(std::string_view alpn, std::uint16_t port) override;
 
+    /******************************************************
+     * Flush the queued sends of every client connection.
+     ******************************************************/
+    virtual auto flush_all() -> result<std::size_t> override;
+
+    /******************************************************
+     * Trim the receive buffers of every client connection.
+     ******************************************************/
+    virtual auto trim_all_receive_buffers() -> std::size_t override;
+
+    /******************************************************
+     * Enforce the memory budget on every client connection.
+     ******************************************************/
+    virtual auto enforce_memory_budget() -> std::size_t override;
+
 private:
     friend struct tf_msquic_server;
+    friend struct tf_statistics_sampler;
     friend result<std::unique_ptr<quic_server>>
     msquic_application::make_server();
     /**
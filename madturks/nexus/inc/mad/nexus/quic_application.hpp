@@ -4,6 +4,7 @@
  ******************************************************/
 #pragma once
 
+#include <mad/nexus/memory_budget.hpp>
 #include <mad/nexus/quic_client.hpp>
 #include <mad/nexus/quic_configuration.hpp>
 #include <mad/nexus/quic_server.hpp>
@@ -34,6 +35,14 @@ public:
     [[nodiscard]] virtual result<std::unique_ptr<quic_client>>
     make_client() = 0;
 
+    /******************************************************
+     * The memory accounting of the connections of the
+     * application's servers and clients. Thread-safe.
+     ******************************************************/
+    [[nodiscard]] memory_budget & budget() const noexcept {
+        return budget_;
+    }
+
     /******************************************************
      * Destroy the quic application object
      ******************************************************/
@@ -44,5 +53,12 @@ protected:
      * Prohibit direct construction.
      ******************************************************/
     quic_application();
+
+    /******************************************************
+     * The memory accounting of the connections. Mutable as
+     * the servers and the clients only get to see the
+     * application as const, and the budget is thread-safe.
+     ******************************************************/
+    mutable memory_budget budget_{};
 };
 } // namespace mad::nexus
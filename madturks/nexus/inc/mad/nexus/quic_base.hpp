@@ -5,14 +5,19 @@
 #pragma once
 
 #include <mad/macro>
+#include <mad/nexus/buffer_pool.hpp>
 #include <mad/nexus/quic_configuration.hpp>
 #include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/quic_statistics.hpp>
 #include <mad/nexus/quic_stream.hpp>
 #include <mad/nexus/result.hpp>
 #include <mad/nexus/send_buffer.hpp>
+#include <mad/nexus/shared_send_buffer.hpp>
 
 #include <flatbuffers/flatbuffer_builder.h>
 
+#include <atomic>
+
 namespace mad::nexus {
 
 /******************************************************
@@ -34,13 +39,78 @@ public:
      * Can be used when the stream's data should be handled by
      * a specific function rather than the default stream data
      * callback.
+     * @param [in] priority Send priority of the stream. When
+     * multiple streams of the connection have data to send,
+     * the stream with the higher priority is served first.
      *
      * @return Reference to stream on success, error code otherwise.
      ******************************************************/
     [[nodiscard]] virtual auto
     open_stream(connection & connection,
                 std::optional<stream_data_callback_t> data_callback =
-                    std::nullopt) -> result<std::reference_wrapper<stream>> = 0;
+                    std::nullopt,
+                stream_priority_t priority = k_default_stream_priority)
+        -> result<std::reference_wrapper<stream>> = 0;
+
+    /******************************************************
+     * Open a new stream for the given connection, whose data
+     * is delivered in batches.
+     *
+     * The complete messages found in the received data are
+     * passed to @p batch_callback together, rather than one
+     * call per message. Pausing the stream from within the
+     * callback takes effect after the whole batch.
+     *
+     * @param [in] connection The connection
+     * @param [in] batch_callback Batched stream data callback.
+     * @param [in] priority Send priority of the stream.
+     *
+     * @return Reference to stream on success, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    open_stream(connection & connection,
+                stream_batch_data_callback_t batch_callback,
+                stream_priority_t priority = k_default_stream_priority)
+        -> result<std::reference_wrapper<stream>> = 0;
+
+    /******************************************************
+     * Open a new stream for the given connection, whose large
+     * messages are delivered in chunks.
+     *
+     * A message that does not fit into the stream's receive
+     * buffer is passed to @p message_callbacks piece by piece
+     * as it arrives, so the whole message is never buffered
+     * and the receive buffer never grows. The other messages
+     * are passed to @p data_callback. Pausing the stream from
+     * within a chunk callback holds back the rest of the
+     * message.
+     *
+     * @param [in] connection The connection
+     * @param [in] data_callback Stream data callback.
+     * @param [in] message_callbacks Chunked message callbacks.
+     * @param [in] priority Send priority of the stream.
+     *
+     * @return Reference to stream on success, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    open_stream(connection & connection, stream_data_callback_t data_callback,
+                stream_message_callbacks message_callbacks,
+                stream_priority_t priority = k_default_stream_priority)
+        -> result<std::reference_wrapper<stream>> = 0;
+
+    /******************************************************
+     * Change the send priority of a stream.
+     *
+     * Affects the data that is not sent yet, including the
+     * data that is already queued.
+     *
+     * @param [in] stream The stream
+     * @param [in] priority New priority
+     * @return  Result object indicating success or failure.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    set_stream_priority(stream & stream,
+                        stream_priority_t priority) -> result<> = 0;
 
     /**
      * Close the given stream.
@@ -58,6 +128,28 @@ public:
      ******************************************************/
     [[nodiscard]] virtual auto close_stream(stream & stream) -> result<> = 0;
 
+    /******************************************************
+     * Resume the data delivery of a stream paused by
+     * stream::pause_receive.
+     *
+     * The data held back while the stream was paused is
+     * delivered on the calling thread before the function
+     * returns, and then the implementation is notified that
+     * the data is consumed so the peer can send more. If
+     * the data callback pauses the stream again, delivery
+     * stops there and the rest stays held back.
+     *
+     * When called from the stream's own data callback, only
+     * the pause is lifted, and the ongoing delivery carries
+     * on after the callback returns.
+     *
+     * Must not be called concurrently for the same stream.
+     *
+     * @param [in] stream Stream to resume
+     * @return  Result object indicating success or failure.
+     ******************************************************/
+    [[nodiscard]] virtual auto resume_receive(stream & stream) -> result<> = 0;
+
     /**
      * Send data to an already open stream
      *
@@ -71,12 +163,231 @@ public:
     /******************************************************
      * Send data to a stream.
      *
+     * Ordering guarantees:
+     * - The data sent to a stream is delivered in the order
+     *   it is sent, regardless of the priority and urgency.
+     * - Among the streams of a connection that have data to
+     *   send, the stream with the higher priority is served
+     *   first. The order of the streams with equal priority
+     *   is up to the implementation.
+     * - Urgency does not reorder any data. An urgent send
+     *   makes the connection handle its pending send work
+     *   ahead of its other work. It does not affect other
+     *   connections.
+     *
      * @param [in] stream Target stream
      * @param [in] buf Data to send
+     * @param [in] urgency Urgency of the send
+     * @return Amount of bytes sent if successful, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    send(stream & stream, send_buffer<true> buf,
+         send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Send multiple buffers to a stream at once.
+     *
+     * All buffers are submitted to the underlying QUIC
+     * implementation in a single send call, and released
+     * together when the whole batch is sent. The buffers are
+     * sent in the order they appear in @p bufs.
+     *
+     * On success, the ownership of the buffers are taken over
+     * and the given send_buffer objects are left empty. On
+     * failure, the buffers are left untouched.
+     *
+     * See send(stream&, send_buffer<true>, send_urgency) for
+     * the ordering guarantees.
+     *
+     * @param [in] stream Target stream
+     * @param [in] bufs Data to send
+     * @param [in] urgency Urgency of the send
+     * @return Amount of bytes sent if successful, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    send(stream & stream, std::span<send_buffer<true>> bufs,
+         send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Send the same message to multiple streams.
+     *
+     * The message is not copied; every stream's send refers
+     * to the same memory, which is released after the last
+     * send is completed and the last copy of @p buf is gone.
+     *
+     * A failed send on a stream does not stop the message
+     * from being sent to the rest of the streams.
+     *
+     * @param [in] streams Target streams
+     * @param [in] buf Message to send
+     * @param [in] urgency Urgency of the sends
+     * @return Amount of streams the message is sent to if
+     * successful, error code if it could not be sent to any.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    broadcast(std::span<const std::reference_wrapper<stream>> streams,
+              const shared_send_buffer & buf,
+              send_urgency urgency = send_urgency::normal)
+        -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Send an unreliable datagram to a connection.
+     *
+     * The datagram is not retransmitted when lost, and is
+     * not ordered with respect to the other datagrams or the
+     * streams. The state changes of the datagram are reported
+     * through the datagram_send_state callback, if registered.
+     *
+     * Datagrams must be enabled in the configuration of both
+     * peers, and must fit into a single QUIC packet.
+     *
+     * @param [in] connection Target connection
+     * @param [in] buf Data to send
      * @return Amount of bytes sent if successful, error code otherwise.
      ******************************************************/
     [[nodiscard]] virtual auto
-    send(stream & stream, send_buffer<true> buf) -> result<std::size_t> = 0;
+    send_datagram(connection & connection,
+                  send_buffer<true> buf) -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Retrieve the transport statistics of a connection,
+     * e.g. to find the slow clients.
+     *
+     * @param [in] connection The connection
+     * @return The statistics if successful, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto statistics(const connection & connection) const
+        -> result<connection_statistics> = 0;
+
+    /******************************************************
+     * Retrieve the transport statistics of a stream, e.g.
+     * to find out why its sends are stalling.
+     *
+     * @param [in] stream The stream
+     * @return The statistics if successful, error code otherwise.
+     ******************************************************/
+    [[nodiscard]] virtual auto statistics(const stream & stream) const
+        -> result<stream_statistics> = 0;
+
+    /******************************************************
+     * Enable or disable the send coalescing.
+     *
+     * While enabled, send() does not transmit the messages
+     * but queues them on their stream. The queued messages
+     * are transmitted together by flush() or flush_all(),
+     * e.g. once at the end of every server tick, so they
+     * share fewer and fuller packets.
+     *
+     * An urgent send transmits the stream's queued messages
+     * along with itself immediately. A broadcast transmits
+     * the queued messages of its target streams first, so
+     * the stream order is kept. Datagrams are not queued.
+     *
+     * Disabling the coalescing does not flush the queued
+     * messages. Queued messages of a closed stream are
+     * discarded.
+     *
+     * The sends to a stream are queued under a per-stream
+     * lock, so several threads may send to the same stream
+     * and flush its connection concurrently.
+     *
+     * @param [in] enabled Whether to coalesce the sends
+     ******************************************************/
+    void set_send_coalescing(bool enabled) noexcept {
+        coalesce_sends.store(enabled, std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Whether the send coalescing is enabled.
+     ******************************************************/
+    [[nodiscard]] bool send_coalescing() const noexcept {
+        return coalesce_sends.load(std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Transmit the messages queued on the streams of a
+     * connection.
+     *
+     * All streams are handed over to the implementation
+     * before any of them is transmitted, so the messages of
+     * different streams can share packets.
+     *
+     * A stream whose messages could not be sent keeps them
+     * queued for the next flush; the other streams are still
+     * flushed.
+     *
+     * The connection's streams are locked meanwhile, so they
+     * may be opened and closed concurrently.
+     *
+     * @param [in] connection Connection to flush
+     * @return Amount of bytes sent if successful, error code
+     * if the messages of any stream could not be sent.
+     ******************************************************/
+    [[nodiscard]] virtual auto
+    flush(connection & connection) -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Transmit the queued messages of all connections.
+     *
+     * See flush(connection&).
+     *
+     * @return Amount of bytes sent if successful, error code
+     * if the messages of any stream could not be sent.
+     ******************************************************/
+    [[nodiscard]] virtual auto flush_all() -> result<std::size_t> = 0;
+
+    /******************************************************
+     * Give the receive buffers of a connection's streams
+     * back to the receive_buffer_pool, if they have stayed
+     * empty with no data received for
+     * stream_receive_options::idle_release_after. The
+     * buffers are acquired again on demand, so the memory
+     * held by the idle streams is reclaimed, e.g. once every
+     * few seconds from the server tick.
+     *
+     * May run concurrently with the data delivery of the
+     * streams, and with opening and closing them; the
+     * connection's streams are locked meanwhile.
+     *
+     * @param [in] connection Connection to trim
+     * @return Amount of released receive buffers
+     ******************************************************/
+    virtual auto trim_receive_buffers(connection & connection)
+        -> std::size_t = 0;
+
+    /******************************************************
+     * Trim the receive buffers of all connections.
+     *
+     * See trim_receive_buffers(connection&).
+     *
+     * @return Amount of released receive buffers
+     ******************************************************/
+    virtual auto trim_all_receive_buffers() -> std::size_t = 0;
+
+    /******************************************************
+     * Enforce the memory_budget_options of the application,
+     * e.g. once every tick or two from the server tick.
+     *
+     * While the connections hold more than the total limit,
+     * the connections that hold the most memory are shut
+     * down until the rest fits into the limit. Their memory
+     * is given back once they are gone.
+     *
+     * The streams that stopped reading for the lack of
+     * memory are resumed once their connection and the total
+     * are below the limits again.
+     *
+     * May run concurrently with the data delivery of the
+     * streams, and with opening and closing them; the
+     * streams of a connection are locked while they are
+     * resumed. A stream whose data is delivered by another
+     * thread at the moment is resumed by a later run.
+     *
+     * @return Amount of the disconnected connections
+     ******************************************************/
+    virtual auto enforce_memory_budget() -> std::size_t = 0;
 
     /******************************************************
      * Register a callback function for a specific event happening
@@ -122,6 +433,20 @@ public:
                 "Given callback function's signature does not match the target "
                 "callback.");
             callbacks.on_stream_data_received = callback;
+        } else if constexpr (T == callback_type::datagram_received) {
+            static_assert(
+                std::same_as<decltype(callback),
+                             decltype(callbacks.on_datagram_received)>,
+                "Given callback function's signature does not match the target "
+                "callback.");
+            callbacks.on_datagram_received = callback;
+        } else if constexpr (T == callback_type::datagram_send_state) {
+            static_assert(
+                std::same_as<decltype(callback),
+                             decltype(callbacks.on_datagram_send_state)>,
+                "Given callback function's signature does not match the target "
+                "callback.");
+            callbacks.on_datagram_send_state = callback;
         } else if consteval {
             static_assert(0, "Unhandled callback type");
         }
@@ -143,6 +468,10 @@ public:
      * structure. The send_buffer object by default deallocates the buffer
      * upon destruction, unless .auto_cleanup is set to false.
      *
+     * The message memory is allocated from the buffer_pool. The builder
+     * starts small and grows on demand, so large messages do not cost
+     * every thread a large buffer.
+     *
      * @tparam F Function type
      * @param [in] callable Callable that builds the user message
      *
@@ -151,7 +480,8 @@ public:
     template <typename F>
     static auto build_message(F && callable) -> send_buffer<true> {
         // Each thread gets its own builder.
-        thread_local ::flatbuffers::FlatBufferBuilder fbb(1024 * 1024);
+        thread_local ::flatbuffers::FlatBufferBuilder fbb(
+            k_builder_initial_size, &buffer_pool::allocator());
 
         // Align the buffer properly.
         fbb.PreAlign(send_buffer<true>::k_QuicBufStructSize,
@@ -185,6 +515,11 @@ public:
      ******************************************************/
     virtual ~quic_base();
 
+    /******************************************************
+     * Initial buffer size of the build_message builders.
+     ******************************************************/
+    static constexpr std::size_t k_builder_initial_size = 1024;
+
 protected:
     /******************************************************
      * The callback functions for delivering events to the
@@ -216,6 +551,23 @@ protected:
          * Invoked when data is received from a stream.
          ******************************************************/
         stream_data_callback_t on_stream_data_received{};
+
+        /******************************************************
+         * Invoked when a datagram is received.
+         ******************************************************/
+        datagram_callback_t on_datagram_received{};
+
+        /******************************************************
+         * Invoked when the state of a sent datagram changes.
+         ******************************************************/
+        datagram_send_state_callback_t on_datagram_send_state{};
     } callbacks{};
+
+    /******************************************************
+     * Whether the sends are queued until the next flush.
+     * Read by every send, and may be toggled from another
+     * thread.
+     ******************************************************/
+    std::atomic<bool> coalesce_sends{ false };
 };
 } // namespace mad::nexus
@@ -6,6 +6,7 @@
 
 #include <mad/nexus/callback.hpp>
 
+#include <cstddef>
 #include <cstdint>
 #include <span>
 
@@ -20,9 +21,46 @@ enum class callback_type
     disconnected,
     stream_start,
     stream_end,
-    stream_data
+    stream_data,
+    datagram_received,
+    datagram_send_state
 };
 
+/******************************************************
+ * The states of a sent datagram.
+ ******************************************************/
+enum class datagram_send_state : std::uint8_t
+{
+    /******************************************************
+     * Sent, and waiting for an acknowledgement.
+     ******************************************************/
+    sent,
+    /******************************************************
+     * Suspected as lost, but still tracked.
+     ******************************************************/
+    lost_suspect,
+    /******************************************************
+     * Lost, and no longer tracked.
+     ******************************************************/
+    lost,
+    /******************************************************
+     * Acknowledged by the peer.
+     ******************************************************/
+    acknowledged,
+    /******************************************************
+     * Canceled before being sent.
+     ******************************************************/
+    canceled
+};
+
+/******************************************************
+ * Whether the datagram is done with, i.e. no further
+ * state changes will be reported for it.
+ ******************************************************/
+constexpr bool is_final(datagram_send_state state) noexcept {
+    return state >= datagram_send_state::lost;
+}
+
 /******************************************************
  * Connection callback type.
  *
@@ -42,4 +80,44 @@ using stream_callback_t = callback<void(struct stream &)>;
  ******************************************************/
 using stream_data_callback_t =
     callback<std::size_t(std::span<const std::uint8_t>)>;
+
+/******************************************************
+ * Batched stream data callback type.
+ *
+ * Receives several complete messages at once. The spans
+ * are valid only during the call.
+ ******************************************************/
+using stream_batch_data_callback_t =
+    callback<void(std::span<const std::span<const std::uint8_t>>)>;
+
+/******************************************************
+ * Chunked message callback types.
+ *
+ * A large message is delivered as a begin call with its
+ * total size in bytes, chunk calls with the consecutive
+ * parts of its payload, and an end call. The chunks are
+ * valid only during the call.
+ ******************************************************/
+using stream_message_begin_callback_t = callback<void(std::size_t)>;
+using stream_message_chunk_callback_t =
+    callback<void(std::span<const std::uint8_t>)>;
+using stream_message_end_callback_t = callback<void()>;
+
+/******************************************************
+ * Datagram callback type.
+ *
+ * Used for datagram received.
+ ******************************************************/
+using datagram_callback_t =
+    callback<void(struct connection &, std::span<const std::uint8_t>)>;
+
+/******************************************************
+ * Datagram send state callback type.
+ *
+ * Receives the datagram's data and its new state. The
+ * data is released after a final state is reported.
+ ******************************************************/
+using datagram_send_state_callback_t =
+    callback<void(struct connection &, std::span<const std::uint8_t>,
+                  datagram_send_state)>;
 } // namespace mad::nexus
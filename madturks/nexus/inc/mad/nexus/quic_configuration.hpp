@@ -6,6 +6,7 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -43,6 +44,65 @@ enum class e_role
     server
 };
 
+/******************************************************
+ * Sizing of a stream's receive buffer, which holds the
+ * messages that arrive in pieces until they complete.
+ ******************************************************/
+struct stream_receive_options {
+    /******************************************************
+     * Initial size of the receive buffer, in bytes. Rounded
+     * up to a size class of the receive_buffer_pool.
+     ******************************************************/
+    std::size_t buffer_size{ 32768 };
+
+    /******************************************************
+     * The size the receive buffer may grow up to, in bytes,
+     * to fit a large message. A stream that receives a
+     * message that does not fit is reset.
+     ******************************************************/
+    std::size_t max_buffer_size{ 1024 * 1024 };
+
+    /******************************************************
+     * How long a stream's receive buffer has to stay empty,
+     * with no data received, before quic_base::trim_receive_buffers
+     * gives it back to the receive_buffer_pool. The buffer is
+     * acquired again when the stream buffers a partial
+     * message. std::nullopt keeps the buffers for the whole
+     * lifetime of the streams.
+     ******************************************************/
+    std::optional<std::chrono::milliseconds> idle_release_after{
+        std::chrono::seconds{ 30 }
+    };
+};
+
+/******************************************************
+ * Memory limits of the connections. The memory nexus
+ * holds on behalf of a connection, i.e. the receive
+ * buffers of its streams and its sends that are not
+ * completed yet, is accounted by the application's
+ * memory_budget.
+ ******************************************************/
+struct memory_budget_options {
+    /******************************************************
+     * The memory all connections may hold together, in
+     * bytes. Above it, the server refuses new connections,
+     * and quic_base::enforce_memory_budget disconnects the
+     * connections that hold the most.
+     * Zero disables the limit.
+     ******************************************************/
+    std::size_t total_limit{ 0 };
+
+    /******************************************************
+     * The memory a single connection may hold, in bytes. A
+     * stream whose receive buffer would exceed it, or the
+     * total limit, stops reading until the memory is
+     * available again; the QUIC flow control then holds
+     * the peer back.
+     * Zero disables the limit.
+     ******************************************************/
+    std::size_t connection_limit{ 0 };
+};
+
 /******************************************************
  * Implementation-agnostic configuration values for QUIC
  ******************************************************/
@@ -86,6 +146,29 @@ public:
     std::uint32_t stream_receive_buffer{ 4096 };
     std::uint16_t udp_port_number{ 6666 };
 
+    /******************************************************
+     * The amount of bidirectional streams the peer is allowed
+     * to open on a connection at once.
+     ******************************************************/
+    std::uint16_t peer_stream_count{ 1 };
+
+    /******************************************************
+     * The receive buffer sizing of the streams.
+     ******************************************************/
+    stream_receive_options stream_receive{};
+
+    /******************************************************
+     * The memory limits of the connections.
+     ******************************************************/
+    memory_budget_options memory_budget{};
+
+    /******************************************************
+     * Whether the unreliable datagram extension is enabled.
+     * Datagrams can only be sent to the peers that enabled
+     * it as well.
+     ******************************************************/
+    bool datagrams_enabled{ false };
+
     e_role role() const {
         return role_;
     }
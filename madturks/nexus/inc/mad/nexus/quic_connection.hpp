@@ -7,17 +7,104 @@
 
 #include <mad/nexus/handle_carrier.hpp>
 #include <mad/nexus/handle_context_container.hpp>
+#include <mad/nexus/memory_budget.hpp>
+
+#include <atomic>
+#include <cstddef>
 
 namespace mad::nexus {
 
+/******************************************************
+ * Amount of streams a connection stores inline. Most
+ * connections have a few streams, so they do not allocate
+ * stream storage at all.
+ ******************************************************/
+inline constexpr std::size_t k_connection_inline_streams = 4;
+
+/******************************************************
+ * Amount of streams a connection allocates storage for at
+ * once, past the inline ones.
+ ******************************************************/
+inline constexpr std::size_t k_connection_stream_chunk_size = 16;
+
 /******************************************************
  * Implementation agnostic type representing a QUIC
  * connection.
+ *
+ * Not movable, the streams are stored within the object.
  ******************************************************/
 struct connection : public serial_number_carrier,
                     handle_carrier,
-                    handle_context_container<stream> {
+                    handle_context_container<stream,
+                                             k_connection_inline_streams,
+                                             k_connection_stream_chunk_size> {
+
+    /******************************************************
+     * Construct a new connection object
+     *
+     * @param hconnection The connection handle
+     * @param owner The object that owns the connection, e.g.
+     * the server. Used by the quic implementation to route
+     * the connection's events.
+     * @param budget The budget the connection's memory is
+     * accounted to, nullptr for none.
+     ******************************************************/
+    explicit connection(void * hconnection, void * owner = nullptr,
+                        memory_budget * budget = nullptr) :
+        handle_carrier(hconnection), owner_(owner), budget_(budget) {}
+
+    /******************************************************
+     * Destroy the streams, and give back what is left of the
+     * connection's memory to its budget.
+     ******************************************************/
+    ~connection() {
+        clear();
+        if (budget_) {
+            budget_->release(*this);
+        }
+    }
+
+    /******************************************************
+     * The object that owns the connection.
+     ******************************************************/
+    template <typename T>
+    [[nodiscard]] T & owner_as() const noexcept {
+        MAD_EXPECTS(owner_);
+        return *static_cast<T *>(owner_);
+    }
+
+    /******************************************************
+     * The budget the connection's memory is accounted to,
+     * or nullptr if it is not accounted.
+     ******************************************************/
+    [[nodiscard]] memory_budget * budget() const noexcept {
+        return budget_;
+    }
+
+    /******************************************************
+     * The memory held on behalf of the connection, in bytes.
+     ******************************************************/
+    [[nodiscard]] std::size_t memory_usage() const noexcept {
+        return memory_usage_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Befriend the memory_budget to allow it to account the
+    // connection's memory.
+    friend class memory_budget;
+
+    void * owner_;
+
+    memory_budget * budget_;
+
+    /**
+     * See memory_usage().
+     */
+    std::atomic<std::size_t> memory_usage_{ 0 };
 
-    using handle_carrier::handle_carrier;
+    /**
+     * Set by memory_budget::evict.
+     */
+    std::atomic<bool> evicted_{ false };
 };
 } // namespace mad::nexus
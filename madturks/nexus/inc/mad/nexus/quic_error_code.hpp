@@ -39,7 +39,11 @@ enum class quic_error_code : std::int32_t
     value_emplace_failed,
     value_does_not_exists,
     memory_allocation_failed,
-    no_such_implementation
+    no_such_implementation,
+    datagram_not_enabled,
+    datagram_too_large,
+    set_param_failed,
+    get_param_failed
 };
 
 /******************************************************
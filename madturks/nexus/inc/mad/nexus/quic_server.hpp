@@ -5,17 +5,33 @@
  ******************************************************/
 #pragma once
 
+#include <mad/nexus/connection_registry.hpp>
 #include <mad/nexus/quic_base.hpp>
 #include <mad/nexus/quic_configuration.hpp>
 #include <mad/nexus/quic_connection.hpp>
 #include <mad/nexus/result.hpp>
 
+#include <functional>
+#include <mutex>
 #include <string_view>
+#include <utility>
 
 namespace mad::nexus {
 
 /******************************************************
  * The QUIC server interface.
+ *
+ * The connections are added and removed by the QUIC
+ * implementation's threads. Use for_each_connection() or
+ * connections_snapshot() to access them from the other
+ * threads; the handle_context_container interface is for
+ * the QUIC implementation.
+ *
+ * The reader that stops observing a removed connection
+ * last closes its handle, which blocks until the QUIC
+ * implementation's thread processes it. Thus the readers
+ * must not run on the QUIC implementation's threads, e.g.
+ * from within the callbacks.
  ******************************************************/
 class quic_server : virtual public quic_base,
                     public handle_context_container<connection> {
@@ -34,6 +50,90 @@ public:
      ******************************************************/
     [[nodiscard]] virtual auto listen(std::string_view alpn,
                                       std::uint16_t port) -> result<> = 0;
+
+    /******************************************************
+     * Invoke @p fn with every connected client. Can be
+     * called from any thread, and does not block the
+     * connection setup and teardown.
+     *
+     * See connection_registry::for_each_connection. Must
+     * not be called from the QUIC implementation's threads.
+     *
+     * @param fn Callable taking a connection&
+     ******************************************************/
+    template <typename F>
+    void for_each_connection(F && fn) const {
+        registry.for_each_connection(std::forward<F>(fn));
+    }
+
+    /******************************************************
+     * The connected clients at this point in time. The
+     * connections stay valid while the snapshot is alive.
+     *
+     * See connection_registry::snapshot. Must not be
+     * called, or the snapshot destroyed, on the QUIC
+     * implementation's threads.
+     ******************************************************/
+    [[nodiscard]] connection_snapshot connections_snapshot() const {
+        return registry.snapshot();
+    }
+
+    /******************************************************
+     * Amount of connected clients.
+     ******************************************************/
+    [[nodiscard]] std::size_t connection_count() const noexcept {
+        return registry.size();
+    }
+
+protected:
+    quic_server();
+
+    /******************************************************
+     * Store a new connection and publish it to the readers.
+     * Thread-safe.
+     *
+     * @param closer Closes the connection handle
+     * @param hconnection The connection handle
+     * @param owner The connection's owner
+     * @param budget The budget the connection's memory is
+     * accounted to, nullptr for none.
+     * @return The connection on success, error code otherwise.
+     * The handle is not closed on failure.
+     ******************************************************/
+    auto add_connection(handle_closer_t closer, void * hconnection,
+                        void * owner, memory_budget * budget = nullptr)
+        -> result<std::reference_wrapper<connection>>;
+
+    /******************************************************
+     * Unpublish a connection. The handle is closed and the
+     * connection is destroyed as soon as no reader observes
+     * the connection anymore, which is right away if there
+     * are none. Thread-safe, and never allocates, so it can
+     * be called from the connection's shutdown event.
+     *
+     * @param cctx The connection
+     * @return Result object indicating success or failure.
+     ******************************************************/
+    auto remove_connection(connection & cctx) -> result<>;
+
+private:
+    /******************************************************
+     * Close and destroy a removed connection. Invoked by
+     * the remover when nobody observes the connection, or
+     * by the last reader otherwise.
+     ******************************************************/
+    static void reclaim_connection(void * uctx, connection & cctx);
+
+    /******************************************************
+     * Serializes the modifications of the connection
+     * storage.
+     ******************************************************/
+    std::mutex connections_mtx{};
+
+    /******************************************************
+     * The connections that are visible to the readers.
+     ******************************************************/
+    connection_registry registry;
 };
 
 } // namespace mad::nexus
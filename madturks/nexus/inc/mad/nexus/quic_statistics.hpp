@@ -0,0 +1,132 @@
+/******************************************************
+ * QUIC transport statistics types.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/nexus/callback.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Transport statistics of a connection. The counters are
+ * cumulative since the connection is started.
+ ******************************************************/
+struct connection_statistics {
+    /******************************************************
+     * Smoothed round-trip time.
+     ******************************************************/
+    std::chrono::microseconds rtt{ 0 };
+    std::chrono::microseconds min_rtt{ 0 };
+    std::chrono::microseconds max_rtt{ 0 };
+
+    /******************************************************
+     * Current congestion window, in bytes.
+     ******************************************************/
+    std::uint32_t congestion_window{ 0 };
+
+    /******************************************************
+     * Current path MTU, in bytes.
+     ******************************************************/
+    std::uint16_t path_mtu{ 0 };
+
+    /******************************************************
+     * Amount of congestion events, and how many of them are
+     * persistent congestion or caused by ECN.
+     ******************************************************/
+    std::uint32_t congestion_events{ 0 };
+    std::uint32_t persistent_congestion_events{ 0 };
+    std::uint32_t ecn_congestion_events{ 0 };
+
+    /******************************************************
+     * Sent QUIC packets, and the ones that are lost (the
+     * packets suspected lost, minus the spurious ones).
+     ******************************************************/
+    std::uint64_t sent_packets{ 0 };
+    std::uint64_t lost_packets{ 0 };
+
+    /******************************************************
+     * Sent UDP payload bytes, and the stream payload bytes
+     * among them.
+     ******************************************************/
+    std::uint64_t sent_bytes{ 0 };
+    std::uint64_t sent_stream_bytes{ 0 };
+
+    /******************************************************
+     * Received QUIC packets, and the ones that are dropped,
+     * duplicated or reordered.
+     ******************************************************/
+    std::uint64_t received_packets{ 0 };
+    std::uint64_t dropped_packets{ 0 };
+    std::uint64_t duplicate_packets{ 0 };
+    std::uint64_t reordered_packets{ 0 };
+
+    /******************************************************
+     * Received UDP payload bytes, and the stream payload
+     * bytes among them.
+     ******************************************************/
+    std::uint64_t received_bytes{ 0 };
+    std::uint64_t received_stream_bytes{ 0 };
+};
+
+/******************************************************
+ * How long the sends of a stream have been blocked, by
+ * reason. The durations are cumulative since the stream
+ * is started.
+ ******************************************************/
+struct stream_statistics {
+    /******************************************************
+     * The connection was busy sending the other streams.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_scheduling{ 0 };
+
+    /******************************************************
+     * The connection was pacing the sends.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_pacing{ 0 };
+
+    /******************************************************
+     * The connection was limited by the anti-amplification
+     * limit before the peer's address is validated.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_amplification_protection{ 0 };
+
+    /******************************************************
+     * The congestion window was full.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_congestion_control{ 0 };
+
+    /******************************************************
+     * The peer's connection-wide flow control limit was hit.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_connection_flow_control{ 0 };
+
+    /******************************************************
+     * The peer did not allow any more streams.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_stream_id_flow_control{ 0 };
+
+    /******************************************************
+     * The peer's flow control limit of the stream was hit,
+     * i.e. the peer does not consume the data fast enough.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_stream_flow_control{ 0 };
+
+    /******************************************************
+     * The application had no data to send.
+     ******************************************************/
+    std::chrono::microseconds blocked_by_app{ 0 };
+};
+
+/******************************************************
+ * Callback function type for the sampled connection
+ * statistics.
+ ******************************************************/
+using connection_statistics_callback_t =
+    callback<void(struct connection &, const connection_statistics &)>;
+
+} // namespace mad::nexus
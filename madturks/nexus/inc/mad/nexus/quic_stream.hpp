@@ -5,14 +5,58 @@
 #pragma once
 
 #include <mad/circular_buffer_vm.hpp>
+#include <mad/macro>
 #include <mad/nexus/handle_carrier.hpp>
+#include <mad/nexus/memory_budget.hpp>
 #include <mad/nexus/quic_callback_types.hpp>
+#include <mad/nexus/quic_configuration.hpp>
+#include <mad/nexus/receive_buffer_pool.hpp>
+#include <mad/nexus/send_buffer.hpp>
 #include <mad/nexus/serial_number_carrier.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace mad::nexus {
 
+/******************************************************
+ * Callbacks of the chunked message delivery.
+ *
+ * The messages that do not fit into the stream's receive
+ * buffer are passed on piece by piece as they arrive,
+ * rather than being buffered whole.
+ ******************************************************/
+struct stream_message_callbacks {
+    /******************************************************
+     * Called with the total size of a message, before its
+     * first chunk.
+     ******************************************************/
+    stream_message_begin_callback_t on_message_begin;
+
+    /******************************************************
+     * Called with the next part of the message's payload.
+     ******************************************************/
+    stream_message_chunk_callback_t on_message_chunk;
+
+    /******************************************************
+     * Called after the last chunk of the message.
+     ******************************************************/
+    stream_message_end_callback_t on_message_end;
+
+    /******************************************************
+     * Whether the chunked delivery is enabled.
+     ******************************************************/
+    inline explicit operator bool() noexcept {
+        return on_message_begin && on_message_chunk && on_message_end;
+    }
+};
+
 struct stream_callbacks {
     /******************************************************
      * Called when the stream is started.
@@ -28,39 +72,102 @@ struct stream_callbacks {
      * Called when new data is received from the stream.
      ******************************************************/
     stream_data_callback_t on_data_received;
-};
 
-struct debug_iface {
+    /******************************************************
+     * Called with the received messages in batches instead
+     * of on_data_received, when set.
+     ******************************************************/
+    stream_batch_data_callback_t on_batch_data_received{};
+
+    /******************************************************
+     * Called with the large messages piece by piece instead
+     * of on_data_received, when set.
+     ******************************************************/
+    stream_message_callbacks on_large_message{};
+};
 
-#ifndef NDEBUG
+/******************************************************
+ * Send priority of a stream. When multiple streams of
+ * a connection have data to send, the data of the stream
+ * with the higher priority is sent first.
+ ******************************************************/
+using stream_priority_t = std::uint16_t;
 
-    static inline std::atomic<std::uint64_t> sends_in_flight;
+/******************************************************
+ * The priority streams are opened with by default.
+ ******************************************************/
+inline constexpr stream_priority_t k_default_stream_priority = 0x7FFF;
 
-#endif
+/******************************************************
+ * Urgency of a single send.
+ ******************************************************/
+enum class send_urgency : std::uint8_t
+{
+    /******************************************************
+     * Scheduled along with the connection's other work.
+     ******************************************************/
+    normal,
+    /******************************************************
+     * Scheduled ahead of the connection's other pending
+     * work, e.g. the processing of received packets.
+     ******************************************************/
+    urgent
 };
 
 /******************************************************
  * The stream type. Represents a quic stream.
  ******************************************************/
-struct stream : public serial_number_carrier,
-                handle_carrier,
-                debug_iface {
+struct stream : public serial_number_carrier, handle_carrier {
 
-    using circular_buffer_t = mad::circular_buffer_vm<mad::vm_cb_backend_mmap>;
+    using circular_buffer_t = receive_buffer_pool::buffer_t;
 
     /******************************************************
      * Construct a new stream object
      *
+     * The receive buffer is borrowed from the
+     * receive_buffer_pool when a partial message has to be
+     * buffered for the first time, and returned on
+     * destruction. The streams that only send, or only
+     * receive whole messages, never hold one. An idle
+     * stream gives it back, see release_idle_receive_buffer().
+     *
      * @param hstream The stream handle
      * @param cctx The owning connection
      * @param cbks Stream callbacks
-     * @param receive_buffer_size The receive buffer size
+     * @param receive_options The receive buffer sizing
+     * @param resetter Invoked with the stream handle to reset
+     * the stream, see reset().
+     * @param budget The budget the receive buffer and the
+     * queued sends are accounted to, on behalf of @p cctx.
+     * nullptr for none.
      ******************************************************/
     stream(void * hstream, struct connection & cctx, stream_callbacks cbks,
-           std::size_t receive_buffer_size = 32768) :
+           stream_receive_options receive_options = {},
+           callback<void(void *)> resetter = {},
+           memory_budget * budget = nullptr) :
         handle_carrier(hstream), connection_context_(cctx), callbacks(cbks),
-        receive_buffer(
-            receive_buffer_size, circular_buffer_t::auto_align_to_page{}) {}
+        receive_buffer_size_(receive_options.buffer_size),
+        max_receive_buffer_size_(receive_options.max_buffer_size),
+        receive_idle_release_after_(receive_options.idle_release_after),
+        resetter_(resetter), budget_(budget) {}
+
+    stream(const stream &) = delete;
+    stream & operator=(const stream &) = delete;
+
+    ~stream() {
+        std::size_t held = receive_buffer.total_size();
+        lock_send_queue();
+        for (const auto & buf : send_queue_) {
+            held += buffer_pool::capacity(buf.buf);
+        }
+        send_queue_.clear();
+        unlock_send_queue();
+
+        if (budget_) {
+            budget_->credit(connection_context_, held);
+        }
+        receive_buffer_pool::release(std::move(receive_buffer));
+    }
 
     /******************************************************
      * The owning connection
@@ -70,14 +177,344 @@ struct stream : public serial_number_carrier,
     }
 
     /******************************************************
-     * Receive buffer.
+     * Receive buffer. Owns no mapping until the stream
+     * buffers its first partial message.
      ******************************************************/
     template <typename Self>
     auto && rbuf(this Self && self) {
         return std::forward<Self>(self).receive_buffer;
     }
 
+    /******************************************************
+     * The size of the receive buffer, or the size it will
+     * have once it is allocated.
+     ******************************************************/
+    inline std::size_t receive_buffer_capacity() const noexcept {
+        return receive_buffer
+                   ? receive_buffer.total_size()
+                   : receive_buffer_pool::buffer_size(receive_buffer_size_);
+    }
+
+    /******************************************************
+     * Make room for a message of @p size bytes, including its
+     * length prefix, in the receive buffer.
+     *
+     * The receive buffer is allocated with its initial size
+     * if the stream has none yet. It grows if needed, at
+     * least doubling in size, but never beyond the maximum
+     * size.
+     *
+     * The growth is charged to the memory budget, if any,
+     * and does not happen if the budget has no room for it.
+     *
+     * @return false if the message is larger than the maximum
+     * size, or the receive buffer could not be allocated or
+     * grow.
+     ******************************************************/
+    bool reserve_receive_buffer(std::size_t size) noexcept {
+        const auto current = receive_buffer.total_size();
+        if (receive_buffer && size <= current) {
+            return true;
+        }
+        if (size > std::max(max_receive_buffer_size_,
+                            receive_buffer_capacity())) {
+            return false;
+        }
+        const auto target = receive_buffer
+                                ? std::min(std::max(size, current * 2),
+                                           max_receive_buffer_size_)
+                                : std::max(size, receive_buffer_size_);
+        const auto growth = receive_buffer_pool::buffer_size(target) - current;
+        if (budget_ && !budget_->try_charge(connection_context_, growth)) {
+            return false;
+        }
+        try {
+            auto grown = receive_buffer_pool::acquire(target);
+            if (receive_buffer.consumed_space() > 0) {
+                [[maybe_unused]] const bool put_r = grown.put(
+                    receive_buffer.available_span());
+                MAD_ASSERT(put_r);
+            }
+            receive_buffer_pool::release(
+                std::exchange(receive_buffer, std::move(grown)));
+        } catch (const std::exception &) {
+            if (budget_) {
+                budget_->credit(connection_context_, growth);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    /******************************************************
+     * The size the receive buffer may grow up to.
+     ******************************************************/
+    inline std::size_t max_receive_buffer_size() const noexcept {
+        return max_receive_buffer_size_;
+    }
+
+    /******************************************************
+     * Give the receive buffer back to the receive_buffer_pool
+     * if it is empty and the stream has not received any data
+     * for stream_receive_options::idle_release_after. The
+     * buffer is acquired again when it is needed.
+     *
+     * Safe to call while the stream receives data: a stream
+     * that is receiving at the moment is skipped.
+     *
+     * @param now The current time
+     * @return true if the receive buffer is released.
+     ******************************************************/
+    bool release_idle_receive_buffer(
+        std::chrono::steady_clock::time_point now) noexcept {
+        if (!receive_idle_release_after_) {
+            return false;
+        }
+        if (!try_begin_receive()) {
+            return false;
+        }
+        const bool idle =
+            receive_buffer && receive_buffer.consumed_space() == 0 &&
+            now - last_receive_ >= *receive_idle_release_after_;
+        if (idle) {
+            if (budget_) {
+                budget_->credit(
+                    connection_context_, receive_buffer.total_size());
+            }
+            receive_buffer_pool::release(std::exchange(receive_buffer, {}));
+        }
+        std::atomic_ref{ receiving_ }.store(
+            std::thread::id{}, std::memory_order_release);
+        return idle;
+    }
+
+    /******************************************************
+     * Mark the start of the data delivery of the stream.
+     * Waits for a concurrent release_idle_receive_buffer()
+     * call, or a data delivery on another thread, to finish.
+     * Only meaningful to the quic implementation.
+     *
+     * Must not be called by the thread that is delivering
+     * the stream's data already, e.g. from a data callback.
+     ******************************************************/
+    inline void begin_receive() noexcept {
+        std::atomic_ref busy{ receiving_ };
+        const auto self = std::this_thread::get_id();
+        std::thread::id none{};
+        while (!busy.compare_exchange_weak(none, self,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+            // Would wait for itself forever.
+            MAD_EXPECTS(none != self);
+            none = std::thread::id{};
+            std::this_thread::yield();
+        }
+    }
+
+    /******************************************************
+     * Mark the start of the data delivery of the stream,
+     * unless another thread delivers the stream's data or
+     * releases its receive buffer at the moment. Only
+     * meaningful to the quic implementation.
+     *
+     * @return true if the delivery is started.
+     ******************************************************/
+    [[nodiscard]] inline bool try_begin_receive() noexcept {
+        std::thread::id none{};
+        return std::atomic_ref{ receiving_ }.compare_exchange_strong(
+            none, std::this_thread::get_id(), std::memory_order_acquire,
+            std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Whether the calling thread is delivering the stream's
+     * data at the moment, i.e. it is within a data callback
+     * of the stream. Only meaningful to the quic
+     * implementation.
+     ******************************************************/
+    [[nodiscard]] inline bool receiving_on_this_thread() const noexcept {
+        return std::atomic_ref{ receiving_ }.load(
+                   std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+    /******************************************************
+     * Mark the end of the data delivery of the stream. Only
+     * meaningful to the quic implementation.
+     ******************************************************/
+    inline void end_receive() noexcept {
+        if (receive_idle_release_after_ && receive_buffer) {
+            last_receive_ = std::chrono::steady_clock::now();
+        }
+        std::atomic_ref{ receiving_ }.store(
+            std::thread::id{}, std::memory_order_release);
+    }
+
+    /******************************************************
+     * Abort the stream in both directions, e.g. because it
+     * received a message that can not be processed.
+     *
+     * Does nothing if the stream has no resetter.
+     ******************************************************/
+    inline void reset() {
+        if (resetter_) {
+            resetter_(handle_as());
+        }
+    }
+
+    /******************************************************
+     * Stop delivering received data to the application.
+     *
+     * Takes effect immediately, including when called from
+     * within the data callback. Data that is not delivered
+     * yet is held back and not acknowledged to the peer, so
+     * the QUIC flow control eventually stops the sender.
+     *
+     * Use quic_base::resume_receive to continue.
+     ******************************************************/
+    inline void pause_receive() noexcept {
+        std::atomic_ref{ receive_paused_ }.store(
+            true, std::memory_order_release);
+    }
+
+    /******************************************************
+     * Stop delivering received data until the memory budget
+     * has room for the stream's receive buffer again, see
+     * quic_base::enforce_memory_budget. Pauses the stream.
+     * Only meaningful to the quic implementation.
+     ******************************************************/
+    inline void hold_receive() noexcept {
+        std::atomic_ref{ receive_held_ }.store(true, std::memory_order_release);
+        pause_receive();
+    }
+
+    /******************************************************
+     * Whether the data delivery is held back for the memory
+     * budget, see hold_receive().
+     ******************************************************/
+    inline bool receive_held() const noexcept {
+        return std::atomic_ref{ receive_held_ }.load(
+            std::memory_order_acquire);
+    }
+
+    /******************************************************
+     * The budget the stream's memory is accounted to, or
+     * nullptr if it is not accounted.
+     ******************************************************/
+    inline memory_budget * budget() const noexcept {
+        return budget_;
+    }
+
+    /******************************************************
+     * Whether the data delivery is paused or not.
+     ******************************************************/
+    inline bool receive_paused() const noexcept {
+        return std::atomic_ref{ receive_paused_ }.load(
+            std::memory_order_acquire);
+    }
+
+    /******************************************************
+     * The send priority of the stream.
+     *
+     * Use quic_base::set_stream_priority to change.
+     ******************************************************/
+    inline stream_priority_t priority() const noexcept {
+        return std::atomic_ref{ priority_ }.load(std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Amount of messages queued by the send coalescing and
+     * not flushed yet.
+     *
+     * See quic_base::set_send_coalescing.
+     ******************************************************/
+    inline std::size_t queued_sends() const noexcept {
+        lock_send_queue();
+        const auto queued = send_queue_.size();
+        unlock_send_queue();
+        return queued;
+    }
+
+    /******************************************************
+     * Lock the send queue of the stream, which is written by
+     * the sending threads and the flush. Only meaningful to
+     * the quic implementation.
+     ******************************************************/
+    inline void lock_send_queue() const noexcept {
+        std::atomic_ref busy{ send_queue_locked_ };
+        while (busy.exchange(true, std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /******************************************************
+     * Unlock the send queue, see lock_send_queue(). Only
+     * meaningful to the quic implementation.
+     ******************************************************/
+    inline void unlock_send_queue() const noexcept {
+        std::atomic_ref{ send_queue_locked_ }.store(
+            false, std::memory_order_release);
+    }
+
+    /******************************************************
+     * Received data that is held back while the data delivery
+     * is paused. Only meaningful to the quic implementation.
+     ******************************************************/
+    struct pending_receive_state {
+        /******************************************************
+         * Whether the stream holds on to a receive event.
+         ******************************************************/
+        bool active{ false };
+
+        /******************************************************
+         * Implementation-specific buffer array of the event.
+         ******************************************************/
+        const void * buffers{ nullptr };
+
+        /******************************************************
+         * Amount of buffers in the buffer array.
+         ******************************************************/
+        std::uint32_t buffer_count{ 0 };
+
+        /******************************************************
+         * The first buffer that is not fully consumed yet.
+         ******************************************************/
+        std::uint32_t buffer_index{ 0 };
+
+        /******************************************************
+         * Amount of consumed bytes in the buffer at buffer_index.
+         ******************************************************/
+        std::size_t buffer_offset{ 0 };
+
+        /******************************************************
+         * Total length of the event, in bytes.
+         ******************************************************/
+        std::uint64_t total_length{ 0 };
+    };
+
+    /******************************************************
+     * The held back receive event, if any.
+     ******************************************************/
+    template <typename Self>
+    auto && pending_receive(this Self && self) {
+        return std::forward<Self>(self).pending_receive_;
+    }
+
+    /******************************************************
+     * Payload bytes of the chunked message in progress that
+     * are yet to arrive, zero if there is none. Only
+     * meaningful to the quic implementation.
+     ******************************************************/
+    template <typename Self>
+    auto && chunked_message_remaining(this Self && self) {
+        return std::forward<Self>(self).chunked_message_remaining_;
+    }
+
 private:
+    // Befriend the msquic_base to allow it to resume the data
+    // delivery, to update the priority and to flush the queued
+    // sends.
+    friend class msquic_base;
+
     /******************************************************
      * The connection that the stream belongs to.
      ******************************************************/
@@ -98,7 +535,98 @@ private:
      * as all received stream data for a specific
      * connection guaranteed to happen serially.
      */
-    circular_buffer_t receive_buffer;
+    circular_buffer_t receive_buffer{};
+
+    /**
+     * The size receive_buffer is allocated with.
+     */
+    std::size_t receive_buffer_size_;
+
+    /**
+     * The size receive_buffer may grow up to.
+     */
+    std::size_t max_receive_buffer_size_;
+
+    /**
+     * See stream_receive_options::idle_release_after.
+     */
+    std::optional<std::chrono::milliseconds> receive_idle_release_after_;
+
+    /**
+     * The end of the last data delivery that left the stream
+     * with a receive buffer.
+     */
+    std::chrono::steady_clock::time_point last_receive_{};
+
+    /**
+     * The thread that delivers the data, or releases the
+     * receive buffer at the moment, if any. Accessed through
+     * std::atomic_ref to keep the stream movable.
+     */
+    alignas(std::atomic_ref<std::thread::id>::required_alignment) mutable std::
+        thread::id receiving_{};
+
+    /**
+     * Resets the stream, provided by the quic implementation.
+     */
+    callback<void(void *)> resetter_;
+
+    /**
+     * Set by the application to stop the data delivery.
+     * Accessed through std::atomic_ref to keep the stream
+     * movable.
+     */
+    alignas(std::atomic_ref<bool>::required_alignment) mutable bool
+        receive_paused_{ false };
+
+    /**
+     * Set by hold_receive(), and cleared when the delivery
+     * is resumed. Accessed through std::atomic_ref to keep
+     * the stream movable.
+     */
+    alignas(std::atomic_ref<bool>::required_alignment) mutable bool
+        receive_held_{ false };
+
+    /**
+     * See budget().
+     */
+    memory_budget * budget_;
+
+    /**
+     * The send priority, as last set by the application.
+     * Accessed through std::atomic_ref to keep the stream
+     * movable.
+     */
+    alignas(std::atomic_ref<stream_priority_t>::required_alignment) mutable
+        stream_priority_t priority_{ k_default_stream_priority };
+
+    /**
+     * Accessed only between begin_receive() and
+     * end_receive(). No new data is delivered for the
+     * stream until the pending receive is completed.
+     */
+    pending_receive_state pending_receive_{};
+
+    /**
+     * See chunked_message_remaining().
+     */
+    std::size_t chunked_message_remaining_{ 0 };
+
+    /**
+     * Messages queued by the send coalescing, in send order.
+     * Owned by the stream until they are flushed. The storage
+     * is kept across the flushes. Guarded by
+     * send_queue_locked_.
+     */
+    std::vector<send_buffer<true>> send_queue_{};
+
+    /**
+     * Set while the send queue is locked, see
+     * lock_send_queue(). Accessed through std::atomic_ref to
+     * keep the stream movable.
+     */
+    alignas(std::atomic_ref<bool>::required_alignment) mutable bool
+        send_queue_locked_{ false };
 };
 
 // Stream contexts are going to be stored in connection context.
@@ -0,0 +1,162 @@
+/******************************************************
+ * Size-class pool of stream receive buffers.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/circular_buffer_vm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Bounds of the receive buffer pool.
+ ******************************************************/
+struct receive_buffer_pool_options {
+    /******************************************************
+     * Maximum amount of free buffers cached per size class.
+     * Buffers released beyond this limit are given back to
+     * their slab.
+     * Zero disables the pool.
+     ******************************************************/
+    std::size_t buffers_per_class{ 256 };
+
+    /******************************************************
+     * Maximum total size of the free buffers cached, in
+     * bytes, across all size classes. Buffers released
+     * beyond this limit are given back to their slab.
+     ******************************************************/
+    std::size_t max_cached_bytes{ 64 * 1024 * 1024 };
+
+    /******************************************************
+     * Whether the newly mapped buffers are pre-faulted, so
+     * the streams do not take page faults on the receive
+     * path the first time they buffer data.
+     ******************************************************/
+    bool populate_buffers{ false };
+};
+
+/******************************************************
+ * Receive buffer pool statistics.
+ ******************************************************/
+struct receive_buffer_pool_stats {
+    /******************************************************
+     * Total amount of acquire requests.
+     ******************************************************/
+    std::uint64_t acquisitions{ 0 };
+
+    /******************************************************
+     * Acquire requests that are served from the cache.
+     ******************************************************/
+    std::uint64_t cache_hits{ 0 };
+
+    /******************************************************
+     * Free buffers held in the cache.
+     ******************************************************/
+    std::uint64_t buffers_cached{ 0 };
+
+    /******************************************************
+     * Size of the free buffers held in the cache, in bytes.
+     ******************************************************/
+    std::uint64_t bytes_cached{ 0 };
+
+    /******************************************************
+     * Ratio of the acquire requests served from the cache.
+     ******************************************************/
+    double hit_rate() const noexcept {
+        return acquisitions ? static_cast<double>(cache_hits) /
+                                  static_cast<double>(acquisitions)
+                            : 0.0;
+    }
+};
+
+/******************************************************
+ * Process-wide pool of stream receive buffers.
+ *
+ * The buffers are mirrored rings carved out of shared
+ * slabs (see mad::mirrored_ring_slab), so the streams do
+ * not hold a file descriptor each. The streams borrow
+ * their receive buffers from the pool and return them
+ * when they are destroyed, so a released buffer is
+ * cleared and handed out again, with its pages already
+ * faulted in (up to k_resident_buffer_size). The cache
+ * is bounded both by count and by total size, see
+ * receive_buffer_pool_options.
+ *
+ * Requests are rounded up to power-of-two size classes
+ * between k_min_buffer_size (or the page size, if larger)
+ * and k_max_buffer_size. Larger requests bypass the pool.
+ *
+ * Thread-safe.
+ ******************************************************/
+class receive_buffer_pool {
+public:
+    using buffer_t = mad::circular_buffer_vm<mad::vm_cb_backend_slab>;
+
+    /******************************************************
+     * The smallest size class.
+     ******************************************************/
+    static constexpr std::size_t k_min_buffer_size = 4096;
+
+    /******************************************************
+     * The largest size class.
+     ******************************************************/
+    static constexpr std::size_t k_max_buffer_size = 16 * 1024 * 1024;
+
+    /******************************************************
+     * The largest size class whose cached buffers keep
+     * their pages. The pages of the larger ones are given
+     * back to the system when they are cached, and only
+     * their mapping is reused.
+     ******************************************************/
+    static constexpr std::size_t k_resident_buffer_size = 256 * 1024;
+
+    /******************************************************
+     * Acquire an empty buffer of at least @p size bytes.
+     *
+     * @param size Requested size
+     * @return The buffer
+     * @throws std::runtime_error when a new buffer is needed
+     * and it cannot be mapped
+     ******************************************************/
+    [[nodiscard]] static buffer_t acquire(std::size_t size);
+
+    /******************************************************
+     * The size of the buffer acquire() returns for @p size
+     * bytes.
+     ******************************************************/
+    [[nodiscard]] static std::size_t buffer_size(std::size_t size) noexcept;
+
+    /******************************************************
+     * Return a buffer to the pool. The buffer's content is
+     * discarded.
+     *
+     * @param buffer The buffer. A moved-from buffer is
+     * allowed, and ignored.
+     ******************************************************/
+    static void release(buffer_t && buffer) noexcept;
+
+    /******************************************************
+     * Change the bounds of the pool.
+     *
+     * Affects the buffers released after the call.
+     *
+     * @param options New bounds
+     ******************************************************/
+    static void configure(const receive_buffer_pool_options & options) noexcept;
+
+    /******************************************************
+     * Give all cached buffers back to their slabs.
+     ******************************************************/
+    static void trim() noexcept;
+
+    /******************************************************
+     * Snapshot of the pool statistics.
+     ******************************************************/
+    static receive_buffer_pool_stats stats() noexcept;
+};
+
+} // namespace mad::nexus
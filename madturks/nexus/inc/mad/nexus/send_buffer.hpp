@@ -6,8 +6,7 @@
 #pragma once
 
 #include <mad/macro>
-
-#include <flatbuffers/default_allocator.h>
+#include <mad/nexus/buffer_pool.hpp>
 
 #include <cstdint>
 #include <cstring>
@@ -120,7 +119,7 @@ struct send_buffer {
     ~send_buffer() {
         if (AutoCleanup) {
             // Deallocating a nullptr is defined behavior.
-            ::flatbuffers::DefaultAllocator::dealloc(buf, buf_size);
+            buffer_pool::deallocate(buf);
         }
     }
 
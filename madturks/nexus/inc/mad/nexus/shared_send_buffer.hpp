@@ -0,0 +1,128 @@
+/******************************************************
+ * Reference counted, immutable send buffer type.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/macro>
+#include <mad/nexus/buffer_pool.hpp>
+#include <mad/nexus/send_buffer.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <utility>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Immutable send buffer that can be sent to many streams
+ * at once.
+ *
+ * Copies share the same message memory. The memory is
+ * released when the last copy is destroyed and the last
+ * send that references it is completed.
+ *
+ * The reference count is kept in the space a send_buffer
+ * reserves for the QUIC_BUFFER, so sharing a message does
+ * not need any extra allocation.
+ ******************************************************/
+class shared_send_buffer {
+public:
+    using ref_count_t = std::atomic<std::uint32_t>;
+
+    static_assert(sizeof(ref_count_t) <= send_buffer<>::k_QuicBufStructSize);
+    static_assert(alignof(ref_count_t) <=
+                  send_buffer<>::k_QuicBufStructAlignment);
+
+    /******************************************************
+     * The default constructor. Constructs an empty buffer.
+     ******************************************************/
+    shared_send_buffer() noexcept = default;
+
+    /******************************************************
+     * Take over the ownership of a send buffer.
+     *
+     * @param [in] buf The message, built by build_message.
+     ******************************************************/
+    explicit shared_send_buffer(send_buffer<true> && buf) noexcept {
+        // Verifies the reserved space as a side effect.
+        auto tail = buf.quic_buffer_span();
+        MAD_EXPECTS(reinterpret_cast<std::uintptr_t>(tail.data()) %
+                        alignof(ref_count_t) ==
+                    0);
+        new (tail.data()) ref_count_t{ 1 };
+
+        send_buffer<false> released{ std::move(buf) };
+        this->buf = released.buf;
+        offset = released.offset;
+        buf_size = released.buf_size;
+    }
+
+    shared_send_buffer(const shared_send_buffer & other) noexcept :
+        buf(other.buf), offset(other.offset), buf_size(other.buf_size) {
+        if (buf) {
+            ref_count().fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    shared_send_buffer(shared_send_buffer && other) noexcept :
+        buf(std::exchange(other.buf, nullptr)),
+        offset(std::exchange(other.offset, 0)),
+        buf_size(std::exchange(other.buf_size, 0)) {}
+
+    shared_send_buffer & operator=(shared_send_buffer other) noexcept {
+        std::swap(buf, other.buf);
+        std::swap(offset, other.offset);
+        std::swap(buf_size, other.buf_size);
+        return *this;
+    }
+
+    /******************************************************
+     * Release the reference, and the message memory if this
+     * is the last one.
+     ******************************************************/
+    ~shared_send_buffer() {
+        if (buf &&
+            ref_count().fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            buffer_pool::deallocate(buf);
+        }
+    }
+
+    /******************************************************
+     * The message, including the size prefix.
+     ******************************************************/
+    std::span<const std::uint8_t> data_span() const noexcept {
+        MAD_EXPECTS(buf);
+        MAD_EXPECTS(buf_size - offset >= send_buffer<>::k_QuicBufStructSize);
+        return { buf + offset,
+                 buf_size - offset - send_buffer<>::k_QuicBufStructSize };
+    }
+
+    /******************************************************
+     * The amount of references to the message memory.
+     ******************************************************/
+    std::uint32_t use_count() const noexcept {
+        return buf ? ref_count().load(std::memory_order_relaxed) : 0;
+    }
+
+    /******************************************************
+     * Whether the buffer holds a message.
+     ******************************************************/
+    explicit operator bool() const noexcept {
+        return nullptr != buf;
+    }
+
+private:
+    ref_count_t & ref_count() const noexcept {
+        return *std::launder(reinterpret_cast<ref_count_t *>(
+            buf + buf_size - send_buffer<>::k_QuicBufStructSize));
+    }
+
+    std::uint8_t * buf{ nullptr };
+    std::size_t offset{ 0 };
+    std::size_t buf_size{ 0 };
+};
+} // namespace mad::nexus
@@ -0,0 +1,299 @@
+/******************************************************
+ * Generational slot map.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/macro>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Key of a value stored in a slot_map.
+ *
+ * A key stays invalid after its value is erased, even if
+ * the slot is reused by another value later.
+ ******************************************************/
+struct slot_key {
+    /******************************************************
+     * Index of the slot.
+     ******************************************************/
+    std::uint32_t index{ 0 };
+
+    /******************************************************
+     * Generation of the slot when the value is inserted.
+     * Zero for the keys that refer to nothing.
+     ******************************************************/
+    std::uint32_t generation{ 0 };
+
+    /******************************************************
+     * Whether the key refers to a value (or used to).
+     ******************************************************/
+    explicit operator bool() const noexcept {
+        return generation != 0;
+    }
+
+    bool operator==(const slot_key &) const noexcept = default;
+
+    /******************************************************
+     * Encode the key into a pointer-sized opaque context
+     * value, e.g. for a C API's user context. A valid key
+     * never encodes to nullptr.
+     ******************************************************/
+    [[nodiscard]] void * to_context() const noexcept {
+        static_assert(sizeof(std::uintptr_t) >= sizeof(std::uint64_t),
+                      "slot keys need 64-bit context pointers");
+        return reinterpret_cast<void *>(
+            static_cast<std::uintptr_t>(
+                (static_cast<std::uint64_t>(generation) << 32) | index));
+    }
+
+    /******************************************************
+     * Decode a key encoded by to_context.
+     ******************************************************/
+    [[nodiscard]] static slot_key from_context(const void * ctx) noexcept {
+        const auto value = static_cast<std::uint64_t>(
+            reinterpret_cast<std::uintptr_t>(ctx));
+        return slot_key{ .index = static_cast<std::uint32_t>(value),
+                         .generation = static_cast<std::uint32_t>(value >>
+                                                                  32) };
+    }
+};
+
+/******************************************************
+ * Associative container that hands out its own keys.
+ *
+ * Values are stored in fixed-size chunks that are never
+ * moved or released until the map is destroyed, so the
+ * address of a value is stable for its whole lifetime.
+ * Insertion and erasure are O(1): erased slots are kept
+ * in a free list and reused, and the slot generation is
+ * bumped on every erase to invalidate the old keys.
+ *
+ * The first InlineSlots slots are stored within the map
+ * itself, so a map that holds a few values does not
+ * allocate at all, and its values are next to the map's
+ * owner in memory. The chunks are allocated only past
+ * them. A map with inline slots cannot be moved.
+ *
+ * Not thread-safe.
+ *
+ * @tparam T Value type. Does not need to be movable.
+ * @tparam ChunkSize Amount of slots allocated at once.
+ * @tparam InlineSlots Amount of slots stored inline.
+ ******************************************************/
+template <typename T, std::size_t ChunkSize = 64, std::size_t InlineSlots = 0>
+class slot_map {
+    static_assert(ChunkSize > 0);
+
+    static constexpr std::uint32_t k_end =
+        std::numeric_limits<std::uint32_t>::max();
+
+    struct slot {
+        T * value() noexcept {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+
+        alignas(T) std::byte storage [sizeof(T)];
+        std::uint32_t generation{ 1 };
+        std::uint32_t next_free{ k_end };
+        bool occupied{ false };
+    };
+
+    struct chunk {
+        std::array<slot, ChunkSize> slots{};
+    };
+
+public:
+    slot_map() noexcept {
+        // Lower indices first.
+        for (std::uint32_t i = InlineSlots; i > 0; i--) {
+            inline_slots [i - 1].next_free = free_head;
+            free_head = i - 1;
+        }
+    }
+
+    slot_map(const slot_map &) = delete;
+    slot_map & operator=(const slot_map &) = delete;
+
+    slot_map(slot_map && other) noexcept
+        requires(0 == InlineSlots)
+        :
+        chunks(std::move(other.chunks)),
+        free_head(std::exchange(other.free_head, k_end)),
+        count(std::exchange(other.count, 0)) {}
+
+    slot_map & operator=(slot_map && other) noexcept
+        requires(0 == InlineSlots)
+    {
+        if (this != &other) {
+            clear();
+            chunks = std::move(other.chunks);
+            free_head = std::exchange(other.free_head, k_end);
+            count = std::exchange(other.count, 0);
+        }
+        return *this;
+    }
+
+    ~slot_map() {
+        clear();
+    }
+
+    /******************************************************
+     * Construct a new value in place.
+     *
+     * @throws std::bad_alloc if a new chunk is needed and
+     * cannot be allocated, or whatever T's constructor
+     * throws. The map is left unchanged then.
+     *
+     * @return The key and the value.
+     ******************************************************/
+    template <typename... Args>
+    std::pair<slot_key, T &> emplace(Args &&... args) {
+        if (k_end == free_head) {
+            grow();
+        }
+
+        const auto index = free_head;
+        auto & s = slot_at(index);
+        MAD_EXPECTS(!s.occupied);
+        auto * value = new (s.storage) T(std::forward<Args>(args)...);
+
+        free_head = s.next_free;
+        s.next_free = k_end;
+        s.occupied = true;
+        count++;
+        return { slot_key{ index, s.generation }, *value };
+    }
+
+    /******************************************************
+     * The value of a key, or nullptr if the key is stale.
+     ******************************************************/
+    [[nodiscard]] T * get(slot_key key) noexcept {
+        if (key.index >= capacity()) {
+            return nullptr;
+        }
+        auto & s = slot_at(key.index);
+        if (!s.occupied || s.generation != key.generation) {
+            return nullptr;
+        }
+        return s.value();
+    }
+
+    /******************************************************
+     * Destroy the value of a key.
+     *
+     * @return false if the key is stale.
+     ******************************************************/
+    bool erase(slot_key key) noexcept {
+        if (nullptr == get(key)) {
+            return false;
+        }
+        release(key.index);
+        return true;
+    }
+
+    /******************************************************
+     * Invoke @p fn with every value.
+     *
+     * @p fn may erase the value it is called with, and may
+     * insert into the map. The values inserted meanwhile
+     * may or may not be visited.
+     ******************************************************/
+    template <typename F>
+    void for_each(F && fn) {
+        // Indexed, because an insert may grow the chunk list.
+        for (std::size_t i = 0; i < capacity(); i++) {
+            auto & s = slot_at(static_cast<std::uint32_t>(i));
+            if (s.occupied) {
+                fn(*s.value());
+            }
+        }
+    }
+
+    /******************************************************
+     * Destroy all values. The keys are invalidated, and the
+     * memory is kept for reuse.
+     ******************************************************/
+    void clear() noexcept {
+        for (std::size_t i = 0; i < capacity(); i++) {
+            if (slot_at(static_cast<std::uint32_t>(i)).occupied) {
+                release(static_cast<std::uint32_t>(i));
+            }
+        }
+    }
+
+    /******************************************************
+     * Amount of values in the map.
+     ******************************************************/
+    [[nodiscard]] std::size_t size() const noexcept {
+        return count;
+    }
+
+    /******************************************************
+     * Whether the map holds no values.
+     ******************************************************/
+    [[nodiscard]] bool empty() const noexcept {
+        return 0 == count;
+    }
+
+    /******************************************************
+     * Amount of values the map can hold without allocating.
+     ******************************************************/
+    [[nodiscard]] std::size_t capacity() const noexcept {
+        return InlineSlots + chunks.size() * ChunkSize;
+    }
+
+private:
+    slot & slot_at(std::uint32_t index) noexcept {
+        if (index < InlineSlots) {
+            return inline_slots [index];
+        }
+        index -= static_cast<std::uint32_t>(InlineSlots);
+        return chunks [index / ChunkSize]->slots [index % ChunkSize];
+    }
+
+    void grow() {
+        MAD_EXPECTS(capacity() + ChunkSize < k_end);
+        const auto base = static_cast<std::uint32_t>(capacity());
+        chunks.push_back(std::make_unique<chunk>());
+
+        // Lower indices first.
+        for (std::uint32_t i = ChunkSize; i > 0; i--) {
+            auto & s = slot_at(base + i - 1);
+            s.next_free = free_head;
+            free_head = base + i - 1;
+        }
+    }
+
+    void release(std::uint32_t index) noexcept {
+        auto & s = slot_at(index);
+        s.occupied = false;
+        s.value()->~T();
+
+        // Zero is reserved for the keys that refer to nothing.
+        if (0 == ++s.generation) {
+            s.generation = 1;
+        }
+        s.next_free = free_head;
+        free_head = index;
+        count--;
+    }
+
+    [[no_unique_address]] std::array<slot, InlineSlots> inline_slots{};
+    std::vector<std::unique_ptr<chunk>> chunks{};
+    std::uint32_t free_head{ k_end };
+    std::size_t count{ 0 };
+};
+
+} // namespace mad::nexus
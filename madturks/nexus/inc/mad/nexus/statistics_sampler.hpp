@@ -0,0 +1,78 @@
+/******************************************************
+ * Periodic connection statistics sampler.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <mad/nexus/quic_server.hpp>
+#include <mad/nexus/quic_statistics.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Samples the statistics of every connection of a server
+ * periodically, on a thread of its own.
+ *
+ * The callback is invoked with each connection and its
+ * statistics. The connections whose statistics could not
+ * be retrieved are skipped. Sampling goes through the
+ * server's connection registry, so it does not block the
+ * connection setup and teardown.
+ *
+ * The sampler must be destroyed before the server.
+ ******************************************************/
+class statistics_sampler {
+public:
+    /******************************************************
+     * Start sampling.
+     *
+     * @param server The server whose connections to sample
+     * @param interval Time between two samples
+     * @param on_sample Invoked with every connection and its
+     * statistics, on the sampler's thread.
+     ******************************************************/
+    statistics_sampler(const quic_server & server,
+                       std::chrono::milliseconds interval,
+                       connection_statistics_callback_t on_sample);
+
+    statistics_sampler(const statistics_sampler &) = delete;
+    statistics_sampler & operator=(const statistics_sampler &) = delete;
+    statistics_sampler(statistics_sampler &&) = delete;
+    statistics_sampler & operator=(statistics_sampler &&) = delete;
+
+    /******************************************************
+     * Stop sampling. Waits for the sample in progress.
+     ******************************************************/
+    ~statistics_sampler();
+
+    /******************************************************
+     * Sample all connections once, on the calling thread.
+     * The callback may run concurrently on the sampler's
+     * thread meanwhile.
+     *
+     * @return Amount of connections sampled.
+     ******************************************************/
+    std::size_t sample_now();
+
+private:
+    void run(std::stop_token st);
+
+    const quic_server & server;
+    const std::chrono::milliseconds interval;
+    connection_statistics_callback_t on_sample;
+
+    std::mutex wait_mtx{};
+    std::condition_variable_any wait_cv{};
+
+    // Last, so the thread starts after the rest is initialized.
+    std::jthread worker;
+};
+
+} // namespace mad::nexus
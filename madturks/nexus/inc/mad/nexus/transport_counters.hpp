@@ -0,0 +1,206 @@
+/******************************************************
+ * Always-on transport counters.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Process-wide totals of the stream traffic, as seen by
+ * the quic implementation. The byte counts include the
+ * size prefixes of the messages.
+ ******************************************************/
+struct transport_counters {
+    /******************************************************
+     * Messages handed over to the stream send.
+     ******************************************************/
+    std::uint64_t messages_sent{ 0 };
+
+    /******************************************************
+     * Bytes handed over to the stream send.
+     ******************************************************/
+    std::uint64_t bytes_sent{ 0 };
+
+    /******************************************************
+     * Messages delivered to the data callbacks.
+     ******************************************************/
+    std::uint64_t messages_received{ 0 };
+
+    /******************************************************
+     * Bytes delivered to the data callbacks.
+     ******************************************************/
+    std::uint64_t bytes_received{ 0 };
+
+    /******************************************************
+     * Messages handed over to the stream send, whose send
+     * completion is not reported yet.
+     ******************************************************/
+    std::uint64_t sends_in_flight{ 0 };
+
+    /******************************************************
+     * The most bytes a receive buffer has ever held for a
+     * partial message.
+     ******************************************************/
+    std::uint64_t receive_buffer_high_water{ 0 };
+
+    /******************************************************
+     * Received messages that could not be framed, e.g. a
+     * message that does not fit into the receive buffer.
+     ******************************************************/
+    std::uint64_t framing_errors{ 0 };
+
+    /******************************************************
+     * Sum the counters of all threads.
+     *
+     * The counters are updated without synchronization, so
+     * the totals of a busy process are approximate: the
+     * counters of a thread may be observed in any order.
+     ******************************************************/
+    [[nodiscard]] static transport_counters read() noexcept;
+};
+
+/******************************************************
+ * Transport counters of a single thread. Only the owning
+ * thread writes them, unless the block is shared.
+ ******************************************************/
+struct alignas(64) transport_counter_block {
+    enum counter : std::size_t
+    {
+        messages_sent,
+        bytes_sent,
+        messages_received,
+        bytes_received,
+        sends_completed,
+        receive_buffer_high_water,
+        framing_errors,
+        k_counter_count
+    };
+
+    void add(counter c, std::uint64_t value) noexcept {
+        auto & v = values [c];
+        if (shared) [[unlikely]] {
+            v.fetch_add(value, std::memory_order_relaxed);
+            return;
+        }
+        v.store(v.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+    }
+
+    void raise(counter c, std::uint64_t value) noexcept {
+        auto & v = values [c];
+        auto current = v.load(std::memory_order_relaxed);
+        if (value <= current) [[likely]] {
+            return;
+        }
+        if (shared) [[unlikely]] {
+            while (value > current &&
+                   !v.compare_exchange_weak(
+                       current, value, std::memory_order_relaxed)) {}
+            return;
+        }
+        v.store(value, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<std::uint64_t>, k_counter_count> values{};
+
+    /******************************************************
+     * Whether the block is written by multiple threads.
+     ******************************************************/
+    bool shared{ false };
+};
+
+/******************************************************
+ * The writer side of the transport counters, used by the
+ * quic implementation on its hot paths.
+ *
+ * Every thread updates its own cache line sized counter
+ * block with plain loads and stores, so the counters
+ * cost neither a locked instruction nor cache line
+ * ping-pong between the cores. The blocks are summed by
+ * transport_counters::read().
+ ******************************************************/
+class transport_counter_recorder {
+public:
+    /******************************************************
+     * @p messages messages of @p bytes bytes in total are
+     * handed over to the stream send.
+     ******************************************************/
+    static void sent(std::uint64_t messages, std::uint64_t bytes) noexcept {
+        auto & b = local();
+        b.add(block::messages_sent, messages);
+        b.add(block::bytes_sent, bytes);
+    }
+
+    /******************************************************
+     * The send of @p messages messages is completed.
+     ******************************************************/
+    static void send_completed(std::uint64_t messages) noexcept {
+        local().add(block::sends_completed, messages);
+    }
+
+    /******************************************************
+     * A message of @p bytes bytes is delivered.
+     ******************************************************/
+    static void received(std::uint64_t bytes) noexcept {
+        auto & b = local();
+        b.add(block::messages_received, 1);
+        b.add(block::bytes_received, bytes);
+    }
+
+    /******************************************************
+     * @p messages messages of @p bytes bytes in total are
+     * delivered.
+     ******************************************************/
+    static void received(std::uint64_t messages,
+                         std::uint64_t bytes) noexcept {
+        auto & b = local();
+        b.add(block::messages_received, messages);
+        b.add(block::bytes_received, bytes);
+    }
+
+    /******************************************************
+     * A receive buffer holds @p bytes bytes.
+     ******************************************************/
+    static void receive_buffer_usage(std::uint64_t bytes) noexcept {
+        local().raise(block::receive_buffer_high_water, bytes);
+    }
+
+    /******************************************************
+     * A received message could not be framed.
+     ******************************************************/
+    static void framing_error() noexcept {
+        local().add(block::framing_errors, 1);
+    }
+
+private:
+    friend struct thread_block;
+
+    using block = transport_counter_block;
+
+    /******************************************************
+     * The calling thread's block.
+     ******************************************************/
+    static block & local() noexcept {
+        if (auto * b = local_block) [[likely]] {
+            return *b;
+        }
+        return attach();
+    }
+
+    /******************************************************
+     * Create the calling thread's block. A thread that is
+     * past its thread_local destructors gets a shared block.
+     ******************************************************/
+    static block & attach() noexcept;
+
+    static inline constinit thread_local block * local_block = nullptr;
+};
+
+} // namespace mad::nexus
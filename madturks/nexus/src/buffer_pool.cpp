@@ -0,0 +1,481 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/macro>
+#include <mad/nexus/buffer_pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * Placed in front of every block.
+ ******************************************************/
+struct alignas(16) block_header {
+    /******************************************************
+     * Usable size of the block.
+     ******************************************************/
+    std::size_t capacity;
+
+    /******************************************************
+     * Size class index, k_unpooled for oversized blocks.
+     ******************************************************/
+    std::uint32_t size_class;
+
+    /******************************************************
+     * Catches foreign pointers passed to deallocate.
+     ******************************************************/
+    std::uint32_t magic;
+};
+
+static_assert(sizeof(block_header) == 16);
+
+constexpr std::uint32_t k_block_magic = 0xB10C5EED;
+constexpr std::uint32_t k_unpooled = ~std::uint32_t{ 0 };
+constexpr std::size_t k_class_count =
+    std::bit_width(buffer_pool::k_max_block_size) -
+    std::bit_width(buffer_pool::k_min_block_size) + 1;
+
+/******************************************************
+ * Amount of blocks moved from the shared cache to a thread
+ * cache at once.
+ ******************************************************/
+constexpr std::size_t k_refill_count = 16;
+
+constexpr std::size_t class_size(std::size_t size_class) noexcept {
+    return buffer_pool::k_min_block_size << size_class;
+}
+
+constexpr std::size_t class_of(std::size_t size) noexcept {
+    if (size <= buffer_pool::k_min_block_size) {
+        return 0;
+    }
+    return static_cast<std::size_t>(std::bit_width(size - 1)) -
+           static_cast<std::size_t>(
+               std::bit_width(buffer_pool::k_min_block_size - 1));
+}
+
+static_assert(class_of(1) == 0);
+static_assert(class_of(buffer_pool::k_min_block_size) == 0);
+static_assert(class_of(buffer_pool::k_min_block_size + 1) == 1);
+static_assert(class_of(buffer_pool::k_max_block_size) == k_class_count - 1);
+
+inline block_header * header_of(const void * ptr) noexcept {
+    return reinterpret_cast<block_header *>(const_cast<void *>(ptr)) - 1;
+}
+
+inline std::uint8_t * data_of(block_header * hdr) noexcept {
+    return reinterpret_cast<std::uint8_t *>(hdr + 1);
+}
+
+/******************************************************
+ * Intrusive singly-linked list of free blocks. The link
+ * is stored in the block's data area.
+ ******************************************************/
+struct free_list {
+    struct node {
+        node * next;
+    };
+
+    void push(block_header * hdr) noexcept {
+        auto n = new (data_of(hdr)) node{ head };
+        head = n;
+        count++;
+    }
+
+    block_header * pop() noexcept {
+        if (nullptr == head) {
+            return nullptr;
+        }
+        auto n = head;
+        head = n->next;
+        count--;
+        return header_of(n);
+    }
+
+    node * head{ nullptr };
+    std::size_t count{ 0 };
+};
+
+/******************************************************
+ * Statistics kept by a single thread. Only the owning
+ * thread writes them, so plain load/store pairs are
+ * enough and no read-modify-write is needed.
+ ******************************************************/
+struct thread_counters {
+    std::atomic<std::uint64_t> allocations{ 0 };
+    std::atomic<std::uint64_t> cache_hits{ 0 };
+    std::atomic<std::int64_t> bytes_cached{ 0 };
+    std::atomic<std::int64_t> bytes_in_flight{ 0 };
+
+    template <typename T>
+    static void add(std::atomic<T> & counter, T value) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+};
+
+/******************************************************
+ * Process-wide part of the pool.
+ ******************************************************/
+struct shared_state {
+    struct alignas(64) shared_list {
+        std::mutex mtx;
+        free_list list;
+    };
+
+    std::array<shared_list, k_class_count> lists{};
+
+    alignas(64) std::atomic<std::size_t> thread_cache_limit{
+        buffer_pool_options{}.thread_cache_bytes
+    };
+    std::atomic<std::size_t> shared_cache_limit{
+        buffer_pool_options{}.shared_cache_bytes
+    };
+    alignas(64) std::atomic<std::size_t> shared_cached_bytes{ 0 };
+
+    /******************************************************
+     * Counters of the live threads, and the totals of the
+     * exited ones.
+     ******************************************************/
+    std::mutex registry_mtx;
+    std::vector<const thread_counters *> registry{};
+    std::uint64_t retired_allocations{ 0 };
+    std::uint64_t retired_cache_hits{ 0 };
+    std::int64_t retired_bytes_in_flight{ 0 };
+
+    /******************************************************
+     * Counters of the threads without a thread cache.
+     ******************************************************/
+    alignas(64) std::atomic<std::uint64_t> uncached_allocations{ 0 };
+    std::atomic<std::int64_t> uncached_bytes_in_flight{ 0 };
+
+    /******************************************************
+     * Put the block into the shared cache, or release it
+     * if the shared cache is full.
+     ******************************************************/
+    void release(block_header * hdr) noexcept {
+        const auto size = hdr->capacity;
+        if (shared_cached_bytes.fetch_add(size, std::memory_order_relaxed) +
+                size <=
+            shared_cache_limit.load(std::memory_order_relaxed)) {
+            auto & shared = lists [hdr->size_class];
+            std::scoped_lock guard{ shared.mtx };
+            shared.list.push(hdr);
+            return;
+        }
+        shared_cached_bytes.fetch_sub(size, std::memory_order_relaxed);
+        ::operator delete (hdr);
+    }
+
+    /******************************************************
+     * Move up to @p count blocks of a size class from the
+     * shared cache into @p dst.
+     ******************************************************/
+    std::size_t acquire(std::size_t size_class, free_list & dst,
+                        std::size_t count) noexcept {
+        auto & shared = lists [size_class];
+        std::size_t moved = 0;
+        {
+            std::scoped_lock guard{ shared.mtx };
+            for (; moved < count; moved++) {
+                auto hdr = shared.list.pop();
+                if (nullptr == hdr) {
+                    break;
+                }
+                dst.push(hdr);
+            }
+        }
+        shared_cached_bytes.fetch_sub(
+            moved * class_size(size_class), std::memory_order_relaxed);
+        return moved;
+    }
+
+    /******************************************************
+     * Return all blocks in the shared cache to the system.
+     ******************************************************/
+    void trim() noexcept {
+        for (std::size_t i = 0; i < k_class_count; i++) {
+            free_list released{};
+            {
+                std::scoped_lock guard{ lists [i].mtx };
+                std::swap(released, lists [i].list);
+            }
+            shared_cached_bytes.fetch_sub(
+                released.count * class_size(i), std::memory_order_relaxed);
+            while (auto hdr = released.pop()) {
+                ::operator delete (hdr);
+            }
+        }
+    }
+};
+
+shared_state & shared() noexcept {
+    // Intentionally leaked: blocks may be released by threads
+    // that outlive the static destructors.
+    static auto * state = new shared_state{};
+    return *state;
+}
+
+/******************************************************
+ * Lifetime of the calling thread's cache.
+ ******************************************************/
+enum class cache_state : std::uint8_t
+{
+    not_created,
+    alive,
+    destroyed
+};
+
+constinit thread_local cache_state thread_cache_state =
+    cache_state::not_created;
+
+/******************************************************
+ * Per-thread part of the pool.
+ ******************************************************/
+struct thread_cache {
+    thread_cache() {
+        auto & state = shared();
+        std::scoped_lock guard{ state.registry_mtx };
+        state.registry.push_back(&counters);
+        thread_cache_state = cache_state::alive;
+    }
+
+    ~thread_cache() {
+        thread_cache_state = cache_state::destroyed;
+        flush();
+
+        auto & state = shared();
+        std::scoped_lock guard{ state.registry_mtx };
+        std::erase(state.registry, &counters);
+        state.retired_allocations += counters.allocations.load(
+            std::memory_order_relaxed);
+        state.retired_cache_hits += counters.cache_hits.load(
+            std::memory_order_relaxed);
+        state.retired_bytes_in_flight += counters.bytes_in_flight.load(
+            std::memory_order_relaxed);
+    }
+
+    /******************************************************
+     * Move all cached blocks to the shared cache.
+     ******************************************************/
+    void flush() noexcept {
+        auto & state = shared();
+        for (auto & list : lists) {
+            while (auto hdr = list.pop()) {
+                state.release(hdr);
+            }
+        }
+        counters.bytes_cached.store(0, std::memory_order_relaxed);
+    }
+
+    block_header * pop(std::size_t size_class) noexcept {
+        auto & list = lists [size_class];
+        if (nullptr == list.head) {
+            // Refill in batches, without exceeding the cache limit.
+            const auto limit = shared().thread_cache_limit.load(
+                std::memory_order_relaxed);
+            const auto cached = cached_bytes();
+            const auto room = limit > cached ? limit - cached : 0;
+            const auto count = std::clamp<std::size_t>(
+                room / class_size(size_class), 1, k_refill_count);
+            const auto moved = shared().acquire(size_class, list, count);
+            thread_counters::add(counters.bytes_cached,
+                                 static_cast<std::int64_t>(
+                                     moved * class_size(size_class)));
+        }
+        auto hdr = list.pop();
+        if (hdr) {
+            thread_counters::add(counters.bytes_cached,
+                                 -static_cast<std::int64_t>(hdr->capacity));
+        }
+        return hdr;
+    }
+
+    void push(block_header * hdr) noexcept {
+        auto & state = shared();
+        if (cached_bytes() + hdr->capacity >
+            state.thread_cache_limit.load(std::memory_order_relaxed)) {
+            state.release(hdr);
+            return;
+        }
+        lists [hdr->size_class].push(hdr);
+        thread_counters::add(counters.bytes_cached,
+                             static_cast<std::int64_t>(hdr->capacity));
+    }
+
+    std::size_t cached_bytes() const noexcept {
+        return static_cast<std::size_t>(
+            counters.bytes_cached.load(std::memory_order_relaxed));
+    }
+
+    std::array<free_list, k_class_count> lists{};
+    thread_counters counters{};
+};
+
+/******************************************************
+ * The calling thread's cache, or nullptr if the thread is
+ * already past its thread_local destructors.
+ ******************************************************/
+thread_cache * local_cache() noexcept {
+    if (thread_cache_state == cache_state::destroyed) [[unlikely]] {
+        return nullptr;
+    }
+    thread_local thread_cache cache{};
+    return &cache;
+}
+
+} // namespace
+
+std::uint8_t * buffer_pool::allocate(std::size_t size) {
+    auto cache = local_cache();
+
+    const auto size_class = class_of(size);
+    const auto capacity = size > k_max_block_size ? size
+                                                  : class_size(size_class);
+
+    if (cache) {
+        thread_counters::add(cache->counters.allocations, std::uint64_t{ 1 });
+        thread_counters::add(cache->counters.bytes_in_flight,
+                             static_cast<std::int64_t>(capacity));
+    } else {
+        auto & state = shared();
+        state.uncached_allocations.fetch_add(1, std::memory_order_relaxed);
+        state.uncached_bytes_in_flight.fetch_add(
+            static_cast<std::int64_t>(capacity), std::memory_order_relaxed);
+    }
+
+    if (size > k_max_block_size) {
+        auto hdr = new (::operator new (sizeof(block_header) + size))
+            block_header{ size, k_unpooled, k_block_magic };
+        return data_of(hdr);
+    }
+
+    // Cached blocks keep their header.
+    if (cache) {
+        if (auto hdr = cache->pop(size_class)) {
+            MAD_EXPECTS(hdr->magic == k_block_magic);
+            thread_counters::add(cache->counters.cache_hits,
+                                 std::uint64_t{ 1 });
+            return data_of(hdr);
+        }
+    }
+
+    auto hdr = new (::operator new (sizeof(block_header) + capacity))
+        block_header{ capacity, static_cast<std::uint32_t>(size_class),
+                      k_block_magic };
+    return data_of(hdr);
+}
+
+void buffer_pool::deallocate(void * ptr) noexcept {
+    if (nullptr == ptr) {
+        return;
+    }
+
+    auto hdr = header_of(ptr);
+    MAD_EXPECTS(hdr->magic == k_block_magic);
+
+    // The thread cache is already destroyed when a block is released
+    // from a thread_local destructor that runs after it.
+    auto cache = local_cache();
+
+    if (cache) {
+        thread_counters::add(cache->counters.bytes_in_flight,
+                             -static_cast<std::int64_t>(hdr->capacity));
+    } else {
+        shared().uncached_bytes_in_flight.fetch_sub(
+            static_cast<std::int64_t>(hdr->capacity),
+            std::memory_order_relaxed);
+    }
+
+    if (hdr->size_class == k_unpooled) {
+        ::operator delete (hdr);
+        return;
+    }
+
+    if (cache) {
+        cache->push(hdr);
+        return;
+    }
+    shared().release(hdr);
+}
+
+std::size_t buffer_pool::capacity(const void * ptr) noexcept {
+    MAD_EXPECTS(ptr);
+    return header_of(ptr)->capacity;
+}
+
+void buffer_pool::configure(const buffer_pool_options & options) noexcept {
+    auto & state = shared();
+    state.thread_cache_limit.store(
+        options.thread_cache_bytes, std::memory_order_relaxed);
+    state.shared_cache_limit.store(
+        options.shared_cache_bytes, std::memory_order_relaxed);
+}
+
+void buffer_pool::trim() noexcept {
+    if (thread_cache_state == cache_state::alive) {
+        local_cache()->flush();
+    }
+    shared().trim();
+}
+
+buffer_pool_stats buffer_pool::stats() noexcept {
+    auto & state = shared();
+    std::scoped_lock guard{ state.registry_mtx };
+
+    std::uint64_t allocations =
+        state.retired_allocations +
+        state.uncached_allocations.load(std::memory_order_relaxed);
+    std::uint64_t cache_hits = state.retired_cache_hits;
+    std::int64_t bytes_cached = static_cast<std::int64_t>(
+        state.shared_cached_bytes.load(std::memory_order_relaxed));
+    std::int64_t bytes_in_flight =
+        state.retired_bytes_in_flight +
+        state.uncached_bytes_in_flight.load(std::memory_order_relaxed);
+
+    for (const auto * counters : state.registry) {
+        allocations += counters->allocations.load(std::memory_order_relaxed);
+        cache_hits += counters->cache_hits.load(std::memory_order_relaxed);
+        bytes_cached += counters->bytes_cached.load(std::memory_order_relaxed);
+        bytes_in_flight += counters->bytes_in_flight.load(
+            std::memory_order_relaxed);
+    }
+
+    return buffer_pool_stats{
+        .allocations = allocations,
+        .cache_hits = cache_hits,
+        .bytes_cached = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(bytes_cached, 0)),
+        .bytes_in_flight = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(bytes_in_flight, 0))
+    };
+}
+
+::flatbuffers::Allocator & buffer_pool::allocator() noexcept {
+    // Intentionally leaked, see shared().
+    static auto * pool_allocator = new buffer_pool_allocator{};
+    return *pool_allocator;
+}
+
+std::uint8_t * buffer_pool_allocator::allocate(std::size_t size) {
+    return buffer_pool::allocate(size);
+}
+
+void buffer_pool_allocator::deallocate(std::uint8_t * p, std::size_t) {
+    buffer_pool::deallocate(p);
+}
+
+buffer_pool_allocator::~buffer_pool_allocator() = default;
+
+} // namespace mad::nexus
@@ -0,0 +1,170 @@
+/******************************************************
+ * Concurrent connection registry.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/macro>
+#include <mad/nexus/connection_registry.hpp>
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/quic_error_code.hpp>
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+namespace mad::nexus {
+
+connection_registry::connection_registry(reclaim_callback_t reclaim,
+                                         std::size_t shard_count) :
+    on_reclaim(reclaim), shard_count_(shard_count),
+    shards(std::make_unique<shard []>(shard_count)) {
+    MAD_EXPECTS(shard_count > 0);
+    for (std::size_t i = 0; i < shard_count_; i++) {
+        auto * v = new view{};
+        v->owner = this;
+        shards [i].current.store(v, std::memory_order_relaxed);
+    }
+}
+
+connection_registry::~connection_registry() {
+    for (std::size_t i = 0; i < shard_count_; i++) {
+        release(shards [i].current.exchange(nullptr));
+        while (auto * spare = shards [i].spares) {
+            shards [i].spares = spare->successor;
+            delete spare;
+        }
+    }
+}
+
+auto connection_registry::insert(connection & cctx) -> result<> {
+    auto & s = shard_of(cctx);
+    std::lock_guard<std::mutex> guard{ s.write_mtx };
+    const auto * current = s.current.load(std::memory_order_relaxed);
+    const auto size = current->connections.size() + 1;
+
+    std::unique_ptr<view> next{};
+    std::unique_ptr<view> spare{};
+    try {
+        next = std::make_unique<view>();
+        next->connections.reserve(size);
+        spare = std::make_unique<view>();
+        spare->connections.reserve(size);
+    } catch (const std::bad_alloc &) {
+        return std::unexpected(quic_error_code::memory_allocation_failed);
+    }
+
+    next->owner = this;
+    next->connections.assign(
+        current->connections.begin(), current->connections.end());
+    next->connections.push_back(&cctx);
+    replace(s, next.release());
+
+    spare->owner = this;
+    spare->successor = s.spares;
+    s.spares = spare.release();
+    count.fetch_add(1, std::memory_order_relaxed);
+    return {};
+}
+
+auto connection_registry::remove(connection & cctx) -> result<> {
+    auto & s = shard_of(cctx);
+    std::lock_guard<std::mutex> guard{ s.write_mtx };
+    auto * current = s.current.load(std::memory_order_relaxed);
+
+    const auto itr = std::ranges::find(current->connections, &cctx);
+    if (current->connections.end() == itr) {
+        return std::unexpected(quic_error_code::value_does_not_exists);
+    }
+
+    auto * next = s.spares;
+    MAD_EXPECTS(next);
+    MAD_EXPECTS(next->connections.capacity() >= current->connections.size());
+    s.spares = std::exchange(next->successor, nullptr);
+
+    // Fits in the reserved capacity, so it does not allocate.
+    next->connections.assign(current->connections.begin(), itr);
+    next->connections.insert(
+        next->connections.end(), itr + 1, current->connections.end());
+    // Readers only touch the connection list, so the retired
+    // connection can be attached to the published view.
+    current->retired = &cctx;
+    replace(s, next);
+    count.fetch_sub(1, std::memory_order_relaxed);
+    return {};
+}
+
+connection_snapshot connection_registry::snapshot() const {
+    connection_snapshot result{};
+    result.views.reserve(shard_count_);
+    for (std::size_t i = 0; i < shard_count_; i++) {
+        result.views.emplace_back(acquire(shards [i]));
+    }
+    return result;
+}
+
+auto connection_registry::acquire(shard & s) const noexcept -> view * {
+    // Count this reader in the pins of the current parity. The
+    // first writer that flips the parity afterwards waits for
+    // the reader, and the writers that flipped it before have
+    // already published their views, so the view loaded below
+    // cannot be released in between.
+    std::uint32_t parity = 0;
+    for (;;) {
+        parity = s.parity.load(std::memory_order_seq_cst) & 1u;
+        s.pins [parity].fetch_add(1, std::memory_order_seq_cst);
+        if (parity == (s.parity.load(std::memory_order_seq_cst) & 1u)) {
+            break;
+        }
+        s.pins [parity].fetch_sub(1, std::memory_order_release);
+    }
+
+    auto * v = s.current.load(std::memory_order_seq_cst);
+    MAD_EXPECTS(v);
+    v->refs.fetch_add(1, std::memory_order_relaxed);
+    s.pins [parity].fetch_sub(1, std::memory_order_release);
+    return v;
+}
+
+void connection_registry::release(view * v) noexcept {
+    while (nullptr != v &&
+           1 == v->refs.fetch_sub(1, std::memory_order_acq_rel)) {
+        auto * successor = v->successor;
+        if (nullptr != v->retired && v->owner->on_reclaim) {
+            v->owner->on_reclaim(*v->retired);
+        }
+        delete v;
+        v = successor;
+    }
+}
+
+void connection_registry::replace(shard & s, view * next) noexcept {
+    auto * previous = s.current.load(std::memory_order_relaxed);
+    // One reference for the registry, one for the previous view.
+    next->refs.store(2, std::memory_order_relaxed);
+    previous->successor = next;
+    s.current.store(next, std::memory_order_seq_cst);
+
+    // Readers that start from now on pin the new view. Wait for
+    // the ones that are in the middle of pinning the previous one.
+    const auto parity = s.parity.fetch_xor(1, std::memory_order_seq_cst) & 1u;
+    while (0 != s.pins [parity].load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    release(previous);
+}
+
+auto connection_registry::shard_of(const connection & cctx) const noexcept
+    -> shard & {
+    return shards [cctx.serial_number() % shard_count_];
+}
+
+std::size_t connection_snapshot::size() const noexcept {
+    std::size_t total = 0;
+    for (const auto & v : views) {
+        total += v->connections.size();
+    }
+    return total;
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,111 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/memory_budget.hpp>
+#include <mad/nexus/quic_connection.hpp>
+
+namespace mad::nexus {
+
+void memory_budget::configure(const memory_budget_options & options) noexcept {
+    total_limit_.store(options.total_limit, std::memory_order_relaxed);
+    connection_limit_.store(options.connection_limit, std::memory_order_relaxed);
+}
+
+memory_budget_options memory_budget::options() const noexcept {
+    return { .total_limit = total_limit_.load(std::memory_order_relaxed),
+             .connection_limit = connection_limit_.load(
+                 std::memory_order_relaxed) };
+}
+
+bool memory_budget::try_charge(connection & cctx, std::size_t bytes) noexcept {
+    const auto connection_limit = connection_limit_.load(
+        std::memory_order_relaxed);
+    auto usage = cctx.memory_usage_.load(std::memory_order_relaxed);
+    do {
+        if (connection_limit && usage + bytes > connection_limit) {
+            return false;
+        }
+    } while (!cctx.memory_usage_.compare_exchange_weak(
+        usage, usage + bytes, std::memory_order_relaxed));
+
+    const auto total_limit = total_limit_.load(std::memory_order_relaxed);
+    auto total = total_.load(std::memory_order_relaxed);
+    do {
+        if (total_limit && total + bytes > total_limit) {
+            cctx.memory_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!total_.compare_exchange_weak(
+        total, total + bytes, std::memory_order_relaxed));
+    return true;
+}
+
+void memory_budget::charge(connection & cctx, std::size_t bytes) noexcept {
+    cctx.memory_usage_.fetch_add(bytes, std::memory_order_relaxed);
+    total_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void memory_budget::credit(connection & cctx, std::size_t bytes) noexcept {
+    cctx.memory_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+    total_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void memory_budget::release(connection & cctx) noexcept {
+    total_.fetch_sub(cctx.memory_usage_.exchange(0, std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+}
+
+std::size_t memory_budget::total() const noexcept {
+    return total_.load(std::memory_order_relaxed);
+}
+
+bool memory_budget::over_limit() const noexcept {
+    const auto total_limit = total_limit_.load(std::memory_order_relaxed);
+    return total_limit && total() > total_limit;
+}
+
+bool memory_budget::admit_connection() noexcept {
+    const auto total_limit = total_limit_.load(std::memory_order_relaxed);
+    if (total_limit && total() >= total_limit) {
+        connections_refused_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool memory_budget::has_room(const connection & cctx) const noexcept {
+    const auto total_limit = total_limit_.load(std::memory_order_relaxed);
+    const auto connection_limit = connection_limit_.load(
+        std::memory_order_relaxed);
+    return (!total_limit || total() < total_limit) &&
+           (!connection_limit || cctx.memory_usage() < connection_limit);
+}
+
+bool memory_budget::evict(connection & cctx) noexcept {
+    if (cctx.evicted_.exchange(true, std::memory_order_relaxed)) {
+        return false;
+    }
+    connections_evicted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool memory_budget::evicted(const connection & cctx) noexcept {
+    return cctx.evicted_.load(std::memory_order_relaxed);
+}
+
+void memory_budget::receive_held() noexcept {
+    receives_held_.fetch_add(1, std::memory_order_relaxed);
+}
+
+memory_budget_stats memory_budget::stats() const noexcept {
+    return { .bytes_in_use = total(),
+             .connections_refused = connections_refused_.load(
+                 std::memory_order_relaxed),
+             .receives_held = receives_held_.load(std::memory_order_relaxed),
+             .connections_evicted = connections_evicted_.load(
+                 std::memory_order_relaxed) };
+}
+
+} // namespace mad::nexus
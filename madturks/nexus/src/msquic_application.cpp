@@ -48,15 +48,20 @@ settings_to_msquic(const mad::nexus::quic_configuration & cfg) {
     settings.SendBufferingEnabled = false;
     settings.IsSet.SendBufferingEnabled = true;
 
-    // Configures the server's settings to allow for the peer to open a
-    // single bidirectional stream. By default connections are not
-    // configured to allow any streams from the peer.
-    settings.PeerBidiStreamCount = 1;
+    // Configures the amount of bidirectional streams the peer is allowed
+    // to open. By default connections are not configured to allow any
+    // streams from the peer.
+    settings.PeerBidiStreamCount = cfg.peer_stream_count;
     settings.IsSet.PeerBidiStreamCount = true;
 
     settings.StreamRecvWindowDefault = cfg.stream_receive_window;
     settings.IsSet.StreamRecvWindowDefault = true;
 
+    // Advertise the datagram support to the peer. Sending is enabled
+    // once the peer advertises it too.
+    settings.DatagramReceiveEnabled = cfg.datagrams_enabled;
+    settings.IsSet.DatagramReceiveEnabled = true;
+
     return settings;
 }
 
@@ -209,6 +214,9 @@ make_msquic_application(const quic_configuration & cfg) {
         return std::unexpected(quic_error_code::memory_allocation_failed);
     }
 
+    result->stream_receive_ = cfg.stream_receive;
+    result->budget_.configure(cfg.memory_budget);
+
     return std::unique_ptr<msquic_application>(result);
 }
 
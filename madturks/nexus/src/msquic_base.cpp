@@ -5,18 +5,32 @@
 
 #include <mad/log>
 #include <mad/macro>
+#include <mad/nexus/buffer_pool.hpp>
+#include <mad/nexus/frame_decoder.hpp>
+#include <mad/nexus/memory_budget.hpp>
 #include <mad/nexus/msquic/msquic_application.hpp>
 #include <mad/nexus/msquic/msquic_base.hpp>
 #include <mad/nexus/quic_connection.hpp>
 #include <mad/nexus/quic_error_code.hpp>
 #include <mad/nexus/quic_stream.hpp>
+#include <mad/nexus/transport_counters.hpp>
 
-#include <flatbuffers/default_allocator.h>
 #include <flatbuffers/detached_buffer.h>
 #include <msquic.h>
 
+#include <algorithm>
+#include <atomic>
 #include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
 #include <utility>
+#include <vector>
 
 namespace mad::nexus {
 
@@ -26,6 +40,12 @@ static mad::log_printer & stream_logger() {
 }
 
 struct events {
+    using datagram_received =
+        decltype(QUIC_CONNECTION_EVENT::DATAGRAM_RECEIVED);
+    using datagram_send_state_changed =
+        decltype(QUIC_CONNECTION_EVENT::DATAGRAM_SEND_STATE_CHANGED);
+    using datagram_state_changed =
+        decltype(QUIC_CONNECTION_EVENT::DATAGRAM_STATE_CHANGED);
     using send_complete = decltype(QUIC_STREAM_EVENT::SEND_COMPLETE);
     using receive = decltype(QUIC_STREAM_EVENT::RECEIVE);
     using shutdown_complete = decltype(QUIC_STREAM_EVENT::SHUTDOWN_COMPLETE);
@@ -70,6 +90,204 @@ constexpr std::string_view quic_stream_event_to_str(int etype) {
     std::unreachable();
 }
 
+/**
+ * @brief Convert a send_urgency to the StreamSend flags.
+ */
+static constexpr QUIC_SEND_FLAGS to_send_flags(send_urgency urgency) noexcept {
+    MAD_EXHAUSTIVE_SWITCH_BEGIN
+    switch (urgency) {
+        case send_urgency::normal:
+            return QUIC_SEND_FLAG_NONE;
+        case send_urgency::urgent:
+            return QUIC_SEND_FLAG_PRIORITY_WORK;
+    }
+    MAD_EXHAUSTIVE_SWITCH_END
+    std::unreachable();
+}
+
+/**
+ * @brief Kind of the context that is passed to StreamSend.
+ *
+ * The contexts are at least 8-byte aligned, so the kind is carried
+ * in the lowest bits of the context pointer.
+ */
+enum class send_context_kind : std::uintptr_t
+{
+    buffer = 0x0, // A single send buffer allocation
+    batch = 0x1,  // A send_batch
+    fanout = 0x2  // A send_fanout
+};
+
+static constexpr std::uintptr_t k_send_context_kind_mask = 0x3;
+
+/**
+ * @brief The application error code a stream is aborted with when it
+ * receives a message it can not process.
+ */
+static constexpr QUIC_UINT62 k_stream_reset_error_code = 0x1;
+
+/**
+ * @brief The application error code a connection is shut down with when
+ * it is disconnected for exceeding the memory budget.
+ */
+static constexpr QUIC_UINT62 k_memory_budget_error_code = 0x2;
+
+/**
+ * @brief Tag a StreamSend context pointer with its kind.
+ */
+static void * make_send_context(void * ptr, send_context_kind kind) noexcept {
+    const auto value = reinterpret_cast<std::uintptr_t>(ptr);
+    MAD_EXPECTS(0 == (value & k_send_context_kind_mask));
+    return reinterpret_cast<void *>(value | std::to_underlying(kind));
+}
+
+/**
+ * @brief The kind of a StreamSend context pointer.
+ */
+static send_context_kind send_context_kind_of(void * ctx) noexcept {
+    return static_cast<send_context_kind>(
+        reinterpret_cast<std::uintptr_t>(ctx) & k_send_context_kind_mask);
+}
+
+/**
+ * @brief Strip the kind tag from a StreamSend context pointer.
+ */
+template <typename T>
+static T * send_context_ptr(void * ctx) noexcept {
+    return reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(ctx) &
+                                 ~k_send_context_kind_mask);
+}
+
+/**
+ * @brief Memory block that carries a gather send.
+ *
+ * Allocated in one piece from the buffer_pool by
+ * msquic_base::send(stream&, span). The header is followed by the
+ * QUIC_BUFFER array that is handed to StreamSend and by the owned
+ * send buffer allocations.
+ */
+struct send_batch {
+    /**
+     * @brief Amount of buffers in the batch.
+     */
+    std::size_t count;
+
+    /**
+     * @brief The allocation size of a batch with @p count buffers.
+     */
+    static constexpr std::size_t allocation_size(std::size_t count) noexcept {
+        return sizeof(send_batch) + (sizeof(QUIC_BUFFER) * count) +
+               (sizeof(std::uint8_t *) * count);
+    }
+
+    /**
+     * @brief Destroy the batch and give its block back to the
+     * buffer_pool. The send buffer allocations are left alone.
+     */
+    void destroy() noexcept {
+        this->~send_batch();
+        buffer_pool::deallocate(this);
+    }
+
+    /**
+     * @brief The QUIC_BUFFER array of the batch.
+     */
+    QUIC_BUFFER * quic_buffers() noexcept {
+        return reinterpret_cast<QUIC_BUFFER *>(this + 1);
+    }
+
+    /**
+     * @brief The send buffer allocations owned by the batch.
+     */
+    std::uint8_t ** allocations() noexcept {
+        return reinterpret_cast<std::uint8_t **>(quic_buffers() + count);
+    }
+};
+
+static_assert(alignof(send_batch) >= alignof(QUIC_BUFFER));
+static_assert(sizeof(send_batch) % alignof(QUIC_BUFFER) == 0);
+
+/**
+ * @brief A message that is sent to multiple streams.
+ *
+ * Allocated from the buffer_pool once per msquic_base::broadcast
+ * call. Every StreamSend of the broadcast reads the same QUIC_BUFFER,
+ * and each of them holds a reference to the fanout until its send is
+ * completed.
+ */
+struct send_fanout {
+    /**
+     * @brief Release a reference, and destroy the fanout if it is
+     * the last one.
+     */
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~send_fanout();
+            buffer_pool::deallocate(this);
+        }
+    }
+
+    /**
+     * @brief Keeps the message memory alive.
+     */
+    shared_send_buffer payload;
+
+    /**
+     * @brief The buffer descriptor shared by all sends.
+     */
+    QUIC_BUFFER quic_buffer;
+
+    /**
+     * @brief Amount of the sends that are not completed yet.
+     */
+    std::atomic<std::size_t> refs;
+};
+
+/**
+ * @brief A datagram in flight.
+ *
+ * Allocated from the buffer_pool by msquic_base::send_datagram and
+ * released when the datagram reaches a final send state.
+ */
+struct datagram_send {
+    /**
+     * @brief The datagram data, without the size prefix.
+     */
+    QUIC_BUFFER quic_buffer;
+
+    /**
+     * @brief The send buffer allocation that holds the data.
+     */
+    std::uint8_t * allocation;
+};
+
+/**
+ * @brief Convert a QUIC_DATAGRAM_SEND_STATE to datagram_send_state.
+ *
+ * @return The state, or std::nullopt for QUIC_DATAGRAM_SEND_UNKNOWN
+ */
+static std::optional<datagram_send_state>
+to_datagram_send_state(QUIC_DATAGRAM_SEND_STATE state) noexcept {
+    MAD_EXHAUSTIVE_SWITCH_BEGIN
+    switch (state) {
+        case QUIC_DATAGRAM_SEND_UNKNOWN:
+            return std::nullopt;
+        case QUIC_DATAGRAM_SEND_SENT:
+            return datagram_send_state::sent;
+        case QUIC_DATAGRAM_SEND_LOST_SUSPECT:
+            return datagram_send_state::lost_suspect;
+        case QUIC_DATAGRAM_SEND_LOST_DISCARDED:
+            return datagram_send_state::lost;
+        case QUIC_DATAGRAM_SEND_ACKNOWLEDGED:
+        case QUIC_DATAGRAM_SEND_ACKNOWLEDGED_SPURIOUS:
+            return datagram_send_state::acknowledged;
+        case QUIC_DATAGRAM_SEND_CANCELED:
+            return datagram_send_state::canceled;
+    }
+    MAD_EXHAUSTIVE_SWITCH_END
+    std::unreachable();
+}
+
 /**
  * @brief Send completion callback.
  *
@@ -81,7 +299,7 @@ constexpr std::string_view quic_stream_event_to_str(int etype) {
  *
  * @return QUIC_STATUS Return code indicating callback result
  */
-static QUIC_STATUS StreamCallbackSendComplete([[maybe_unused]] stream & sctx,
+static QUIC_STATUS StreamCallbackSendComplete(stream & sctx,
                                               events::send_complete & event) {
     //
     // A previous StreamSend call has completed, and the context is
@@ -90,119 +308,542 @@ static QUIC_STATUS StreamCallbackSendComplete([[maybe_unused]] stream & sctx,
     MAD_LOG_DEBUG_I(
         stream_logger(), "data sent to stream %p", event.ClientContext);
 
-    // The size does not matter for the default allocator.
-    // FIXME: Get this dynamically from the user
-    flatbuffers::DefaultAllocator::dealloc(event.ClientContext, 0);
-#ifndef NDEBUG
-    sctx.sends_in_flight.fetch_sub(1);
-#endif
+    if (nullptr == event.ClientContext) {
+        // The empty send that starts the delayed sends, see
+        // start_delayed_sends.
+        return QUIC_STATUS_SUCCESS;
+    }
+
+    std::size_t completed_sends = 1;
+    std::size_t released_bytes = 0;
+
+    MAD_EXHAUSTIVE_SWITCH_BEGIN
+    switch (send_context_kind_of(event.ClientContext)) {
+        case send_context_kind::buffer:
+            released_bytes = buffer_pool::capacity(event.ClientContext);
+            buffer_pool::deallocate(event.ClientContext);
+            break;
+        case send_context_kind::batch: {
+            auto batch = send_context_ptr<send_batch>(event.ClientContext);
+            completed_sends = batch->count;
+            for (std::size_t i = 0; i < batch->count; i++) {
+                released_bytes += buffer_pool::capacity(
+                    batch->allocations() [i]);
+                buffer_pool::deallocate(batch->allocations() [i]);
+            }
+            batch->destroy();
+        } break;
+        case send_context_kind::fanout: {
+            auto fanout = send_context_ptr<send_fanout>(event.ClientContext);
+            released_bytes = fanout->quic_buffer.Length;
+            fanout->release();
+        } break;
+    }
+    MAD_EXHAUSTIVE_SWITCH_END
+    if (auto * budget = sctx.budget()) {
+        budget->credit(sctx.connection(), released_bytes);
+    }
+    transport_counter_recorder::send_completed(completed_sends);
     return QUIC_STATUS_SUCCESS;
 }
 
-// Chunked reader?
+/**
+ * @brief Outcome of reserve_message.
+ */
+enum class reserve_status
+{
+    reserved, // The message fits into the receive buffer
+    held,     // No memory for the message yet, the stream is held
+    rejected  // The message can never fit, the stream is reset
+};
 
 /**
- * @brief The callback function for incoming stream data.
+ * @brief Make room in the receive buffer for a message.
+ *
+ * Grows the receive buffer if needed. A message that exceeds the
+ * stream's receive buffer limit is rejected by resetting the stream,
+ * rather than dropping a part of it and misframing the rest.
  *
- * The callback transfers the received data to stream-specific
- * circular receive buffer for parsing.
+ * A message that would fit, but the receive buffer can not grow for
+ * the lack of memory, e.g. because the connection is over its memory
+ * budget, holds the stream back instead. The message is retried when
+ * the stream is resumed.
  *
  * @param sctx The owning stream
- * @param event The receive event details
+ * @param size Payload size of the message
+ */
+static reserve_status reserve_message(stream & sctx, std::uint32_t size) {
+    const std::size_t length = k_frame_prefix_size + size;
+    if (sctx.reserve_receive_buffer(length)) {
+        return reserve_status::reserved;
+    }
+
+    if (length <= std::max(sctx.max_receive_buffer_size(),
+                           sctx.receive_buffer_capacity())) {
+        MAD_LOG_WARN_I(stream_logger(),
+                       "No memory for a message of {} byte(s), holding "
+                       "the stream back!",
+                       size);
+        if (auto * budget = sctx.budget()) {
+            budget->receive_held();
+        }
+        sctx.hold_receive();
+        return reserve_status::held;
+    }
+
+    MAD_LOG_ERROR_I(stream_logger(),
+                    "Message of {} byte(s) does not fit into the receive "
+                    "buffer (at most {} byte(s)), resetting the stream!",
+                    size, sctx.max_receive_buffer_size());
+    transport_counter_recorder::framing_error();
+    sctx.rbuf().clear();
+    sctx.reset();
+    return reserve_status::rejected;
+}
+
+/**
+ * @brief Whether a message is delivered in chunks rather than whole.
  *
- * @return QUIC_STATUS Return code indicating callback result
+ * The chunked delivery takes over the messages that do not fit into
+ * the receive buffer, so the receive buffer never grows on a stream
+ * with chunked message callbacks.
+ *
+ * @param sctx The owning stream
+ * @param size Payload size of the message
  */
-QUIC_STATUS StreamCallbackReceive(stream & sctx, events::receive & event) {
+static bool is_chunked_message(stream & sctx, std::uint32_t size) {
+    return sctx.callbacks.on_large_message &&
+           k_frame_prefix_size + size > sctx.receive_buffer_capacity();
+}
 
-    MAD_EXPECTS(sctx.callbacks.on_data_received);
-    MAD_EXPECTS(event.BufferCount > 0);
-    MAD_EXPECTS(event.TotalBufferLength > 0);
-    auto & receive_buffer = sctx.rbuf();
+/**
+ * @brief Deliver the next chunk of the chunked message in progress.
+ *
+ * @param sctx The owning stream
+ * @param data Received data, continuing the message
+ *
+ * @return The part of @p data after the message's payload.
+ */
+static std::span<const std::uint8_t>
+continue_chunked_message(stream & sctx, std::span<const std::uint8_t> data) {
+    auto & remaining = sctx.chunked_message_remaining();
+    MAD_EXPECTS(remaining > 0);
+    const auto chunk = data.first(std::min(remaining, data.size()));
+    remaining -= chunk.size();
 
-    std::size_t buffer_offset = 0;
+    auto & cbs = sctx.callbacks.on_large_message;
+    if (!chunk.empty()) {
+        cbs.on_message_chunk(chunk);
+    }
+    if (remaining == 0) {
+        cbs.on_message_end();
+    }
+    return data.subspan(chunk.size());
+}
 
-    // FIXME: Optimize this.
-    for (std::uint32_t buffer_idx = 0; buffer_idx < event.BufferCount;) {
+/**
+ * @brief Start the chunked delivery of a message.
+ *
+ * The message is counted as received as soon as it begins.
+ *
+ * @param sctx The owning stream
+ * @param size Payload size of the message
+ * @param data Received data, starting right after the size prefix
+ *
+ * @return The part of @p data after the message's payload.
+ */
+static std::span<const std::uint8_t>
+begin_chunked_message(stream & sctx, std::uint32_t size,
+                      std::span<const std::uint8_t> data) {
+    MAD_EXPECTS(sctx.chunked_message_remaining() == 0);
+    transport_counter_recorder::received(k_frame_prefix_size + size);
+    sctx.chunked_message_remaining() = size;
+    sctx.callbacks.on_large_message.on_message_begin(size);
+    return continue_chunked_message(sctx, data);
+}
 
-        const auto & received_data = event.Buffers [buffer_idx];
+/**
+ * @brief Deliver a complete message, whole or in a single chunk.
+ *
+ * @param sctx The owning stream
+ * @param message The message payload
+ */
+static void deliver_message(stream & sctx,
+                            std::span<const std::uint8_t> message) {
+    const auto size = static_cast<std::uint32_t>(message.size());
+    if (is_chunked_message(sctx, size)) {
+        begin_chunked_message(sctx, size, message);
+        return;
+    }
+    transport_counter_recorder::received(k_frame_prefix_size + size);
+    [[maybe_unused]] auto consumed_bytes =
+        sctx.callbacks.on_data_received(message);
+}
+
+/**
+ * @brief Finish the partial message waiting in the receive buffer.
+ *
+ * The receive buffer holds at most one partial message at a time. The
+ * function moves only the bytes needed to complete that message from
+ * @p data into the receive buffer and delivers the message once it
+ * is complete. A chunked message is passed on from @p data instead,
+ * once its size prefix is complete.
+ *
+ * @param sctx The owning stream
+ * @param data Received data, starting right after the buffered bytes
+ *
+ * @return The unconsumed part of @p data on success, std::nullopt
+ * when the partial message can never fit into the receive buffer and
+ * the stream is reset. The stream is paused if the partial message
+ * has to wait for memory.
+ */
+static std::optional<std::span<const std::uint8_t>>
+complete_buffered_message(stream & sctx, std::span<const std::uint8_t> data) {
+    auto & receive_buffer = sctx.rbuf();
 
+    // Pull the rest of the size prefix first, if needed.
+    if (receive_buffer.consumed_space() < k_frame_prefix_size) {
         const auto pull_amount = std::min(
-            receive_buffer.empty_space(), received_data.Length - buffer_offset);
+            k_frame_prefix_size - receive_buffer.consumed_space(), data.size());
+        [[maybe_unused]] auto pull_r = receive_buffer.put(
+            data.first(pull_amount));
+        MAD_ASSERT(pull_r);
+        data = data.subspan(pull_amount);
 
-        MAD_LOG_DEBUG_I(stream_logger(),
-                        "Pulled {} byte(s) into the receive buffer (rb "
-                        "allocation size: {})",
-                        pull_amount, receive_buffer.total_size());
-
-        if (pull_amount == 0) {
-            MAD_LOG_ERROR_I(
-                stream_logger(), "No empty space left in the receive buffer!");
-            // FIXME: What to do here? close stream? close connection?
-            // skip the message?
-            // Probably corrupt message, disconnect and break
+        if (receive_buffer.consumed_space() < k_frame_prefix_size) {
+            return data;
+        }
+    }
+
+    const std::uint32_t size = read_frame_size(
+        receive_buffer.available_span().data());
+    const std::size_t message_length = k_frame_prefix_size + size;
+
+    if (is_chunked_message(sctx, size)) {
+        // Only the size prefix is buffered, the payload is not.
+        MAD_ASSERT(receive_buffer.consumed_space() == k_frame_prefix_size);
+        receive_buffer.mark_as_read(k_frame_prefix_size);
+        return begin_chunked_message(sctx, size, data);
+    }
+
+    MAD_EXHAUSTIVE_SWITCH_BEGIN
+    switch (reserve_message(sctx, size)) {
+        case reserve_status::reserved:
             break;
+        case reserve_status::held:
+            // The stream is paused, the rest is pulled on resume.
+            return data;
+        case reserve_status::rejected:
+            return std::nullopt;
+    }
+    MAD_EXHAUSTIVE_SWITCH_END
+
+    const auto pull_amount = std::min(
+        message_length - receive_buffer.consumed_space(), data.size());
+    [[maybe_unused]] auto pull_r = receive_buffer.put(data.first(pull_amount));
+    MAD_ASSERT(pull_r);
+    data = data.subspan(pull_amount);
+    transport_counter_recorder::receive_buffer_usage(
+        receive_buffer.consumed_space());
+
+    if (receive_buffer.consumed_space() == message_length) {
+        transport_counter_recorder::received(message_length);
+        const std::span<const std::uint8_t> message =
+            receive_buffer.available_span().subspan(k_frame_prefix_size, size);
+        if (sctx.callbacks.on_batch_data_received) {
+            sctx.callbacks.on_batch_data_received({ &message, 1 });
+        } else {
+            [[maybe_unused]] auto consumed_bytes =
+                sctx.callbacks.on_data_received(message);
         }
-        [[maybe_unused]] auto pull_r = receive_buffer.put(
-            received_data.Buffer + buffer_offset, pull_amount);
-        MAD_ASSERT(pull_r);
-        buffer_offset += pull_amount;
+        receive_buffer.mark_as_read(message_length);
+    }
+    return data;
+}
 
-        std::uint32_t push_payload_cnt = 0;
+/**
+ * @brief Deliver received data to the application, starting from the
+ * given position.
+ *
+ * Complete messages are delivered to the application straight from
+ * the msquic buffers (zero-copy). Only a partial message that spans
+ * across QUIC_BUFFERs or receive events is copied into the stream's
+ * circular receive buffer. A message that does not fit into the
+ * receive buffer is passed on in chunks instead, on the streams with
+ * chunked message callbacks.
+ *
+ * The delivery stops as soon as the application pauses the stream, or
+ * the stream is held back for the lack of memory (see reserve_message).
+ *
+ * @param sctx The owning stream
+ * @param buffers Received data
+ * @param [in,out] buffer_idx Index of the first buffer to process
+ * @param [in,out] buffer_offset Consumed bytes in the first buffer
+ *
+ * @return true if all data is processed, false if the stream is
+ * paused. @p buffer_idx and @p buffer_offset point to the first
+ * unprocessed byte in the latter case.
+ */
+static bool deliver_received_data(stream & sctx,
+                                  std::span<const QUIC_BUFFER> buffers,
+                                  std::uint32_t & buffer_idx,
+                                  std::size_t & buffer_offset) {
+    auto & receive_buffer = sctx.rbuf();
+    frame_decoder<> decoder;
+
+    for (; buffer_idx < buffers.size(); buffer_idx++, buffer_offset = 0) {
+
+        const auto & received_data = buffers [buffer_idx];
+        std::span<const std::uint8_t> data{ received_data.Buffer +
+                                                buffer_offset,
+                                            received_data.Length -
+                                                buffer_offset };
+
+        const auto paused = [&] {
+            if (!sctx.receive_paused()) {
+                return false;
+            }
+            buffer_offset = received_data.Length - data.size();
+            return true;
+        };
+
+        if (paused()) {
+            return false;
+        }
 
-        // Deliver all complete messages to the app layer
-        for (auto available_span = receive_buffer.available_span();
-             available_span.size_bytes() >= sizeof(std::uint32_t);
-             available_span = receive_buffer.available_span()) {
+        // A chunked message is in progress, pass on its next chunk.
+        if (sctx.chunked_message_remaining() > 0) {
+            data = continue_chunked_message(sctx, data);
 
-            // Read the size of the message
-            // Comply with the strict aliasing rules.
-            std::uint32_t size{ 0 };
-            std::memcpy(&size, available_span.data(), sizeof(std::uint32_t));
+            if (paused()) {
+                return false;
+            }
+        }
 
-            // Size is little-endian.
-            if constexpr (std::endian::native == std::endian::big) {
-                size = std::byteswap(size);
+        // A message is already in progress, finish it first.
+        if (receive_buffer.consumed_space() > 0) {
+            auto remaining = complete_buffered_message(sctx, data);
+            if (!remaining) {
+                // The message does not fit into the receive buffer, and
+                // the stream is reset. The rest of the event is dropped.
+                break;
             }
+            data = *remaining;
 
-            MAD_LOG_DEBUG_I(stream_logger(), "Message size {}", size);
-            if ((available_span.size_bytes() - sizeof(std::uint32_t)) >= size) {
-                auto message = available_span.subspan(
-                    sizeof(std::uint32_t), size);
+            if (paused()) {
+                return false;
+            }
+        }
 
-                // Only deliver complete messages to the application layer.
-                [[maybe_unused]] auto consumed_bytes =
-                    sctx.callbacks.on_data_received(message);
-                push_payload_cnt++;
-                MAD_LOG_DEBUG_I(
-                    stream_logger(), "Push payload count {}", push_payload_cnt);
+        // Deliver all complete messages directly from the QUIC_BUFFER,
+        // a batch of frames at a time.
+        do {
+            const auto rest = decoder.decode(data);
+            const auto frames = decoder.frames();
 
-                receive_buffer.mark_as_read(sizeof(std::uint32_t) +
-                                            message.size_bytes());
+            if (sctx.callbacks.on_batch_data_received) {
+                if (frames.empty()) {
+                    break;
+                }
+                transport_counter_recorder::received(
+                    frames.size(),
+                    static_cast<std::size_t>(rest.data() - data.data()));
+                sctx.callbacks.on_batch_data_received(frames);
+                data = rest;
+                if (paused()) {
+                    return false;
+                }
                 continue;
             }
-            MAD_LOG_DEBUG_I(
-                stream_logger(),
-                "Partial data received({}), need {} more byte(s)",
-                available_span.size_bytes() - sizeof(std::uint32_t),
-                (size + sizeof(std::uint32_t)) - available_span.size_bytes());
-            break;
+
+            for (std::size_t i = 0; i < frames.size(); i++) {
+                deliver_message(sctx, frames [i]);
+
+                if (sctx.receive_paused()) {
+                    // Resume right after the delivered frame.
+                    buffer_offset = static_cast<std::size_t>(
+                        decoder.frame_end(i) - received_data.Buffer);
+                    return false;
+                }
+            }
+            data = rest;
+        } while (decoder.full());
+
+        // Keep the trailing partial message for the next buffer or event.
+        // The receive buffer is empty at this point, and is allocated or
+        // grown to hold the whole message (or at least the size prefix,
+        // if that is partial too), so a single put is enough. A chunked
+        // message is passed on as far as it goes instead.
+        if (!data.empty()) {
+            const auto size = peek_frame_size(data);
+            if (size && is_chunked_message(sctx, *size)) {
+                data = begin_chunked_message(
+                    sctx, *size, data.subspan(k_frame_prefix_size));
+                MAD_ASSERT(data.empty());
+                if (paused()) {
+                    return false;
+                }
+                continue;
+            }
+            const auto status = reserve_message(sctx, size.value_or(0));
+            if (status == reserve_status::rejected) {
+                break;
+            }
+            // Held back, resume from the start of the partial message.
+            if (status == reserve_status::held && paused()) {
+                return false;
+            }
+            [[maybe_unused]] auto pull_r = receive_buffer.put(data);
+            MAD_ASSERT(pull_r);
+            transport_counter_recorder::receive_buffer_usage(
+                receive_buffer.consumed_space());
         }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Marks the data delivery of a stream, so its receive buffer is
+ * not released by msquic_base::trim_receive_buffers meanwhile.
+ */
+struct receive_scope {
+    explicit receive_scope(stream & s) noexcept : sctx(s), owns(true) {
+        sctx.begin_receive();
+    }
+
+    /**
+     * @brief Does not wait for another thread's data delivery. Check
+     * the scope to see whether the delivery is started.
+     */
+    receive_scope(stream & s, std::try_to_lock_t) noexcept :
+        sctx(s), owns(s.try_begin_receive()) {}
+
+    ~receive_scope() {
+        release();
+    }
+
+    receive_scope(const receive_scope &) = delete;
+    receive_scope & operator=(const receive_scope &) = delete;
+
+    explicit operator bool() const noexcept {
+        return owns;
+    }
 
-        if (buffer_offset == received_data.Length) {
-            buffer_idx++;
-            buffer_offset = 0;
-            MAD_LOG_DEBUG_I(
-                stream_logger(), "proceed to next buffer(idx: {})", buffer_idx);
+    /**
+     * @brief End the data delivery before the scope ends.
+     */
+    void release() noexcept {
+        if (std::exchange(owns, false)) {
+            sctx.end_receive();
         }
     }
 
-    // MsQuic->StreamReceiveComplete()
+    stream & sctx;
+    bool owns;
+};
+
+/**
+ * @brief Holds the send queue of a stream locked, see
+ * stream::lock_send_queue.
+ */
+struct send_queue_scope {
+    explicit send_queue_scope(const stream & s) noexcept : sctx(s) {
+        sctx.lock_send_queue();
+    }
+
+    ~send_queue_scope() {
+        sctx.unlock_send_queue();
+    }
+
+    send_queue_scope(const send_queue_scope &) = delete;
+    send_queue_scope & operator=(const send_queue_scope &) = delete;
+
+    const stream & sctx;
+};
+
+/**
+ * @brief Delivers the rest of the receive event a stream holds back,
+ * and completes the event once all of it is delivered.
+ *
+ * @param api The msquic API table
+ * @param receiving The data delivery of the stream. Released before the
+ * event is completed, since StreamReceiveComplete may indicate the next
+ * receive event right away.
+ */
+static void deliver_pending_receive(const QUIC_API_TABLE & api,
+                                    receive_scope & receiving) {
+    auto & sctx = receiving.sctx;
+    auto & pending = sctx.pending_receive();
+    if (!pending.active) {
+        return;
+    }
+
+    if (!deliver_received_data(
+            sctx,
+            { static_cast<const QUIC_BUFFER *>(pending.buffers),
+              pending.buffer_count },
+            pending.buffer_index, pending.buffer_offset)) {
+        // Paused again by the application.
+        return;
+    }
+
+    const auto total_length = pending.total_length;
+    pending = {};
+    receiving.release();
+
+    MAD_LOG_DEBUG_I(stream_logger(),
+                    "Stream receive resumed, completing {} byte(s)",
+                    total_length);
+    api.StreamReceiveComplete(sctx.handle_as<HQUIC>(), total_length);
+}
+
+/**
+ * @brief The callback function for incoming stream data.
+ *
+ * If the application pauses the stream, the rest of the event is held
+ * back and QUIC_STATUS_PENDING is returned. msquic does not indicate
+ * any more data for the stream until msquic_base::resume_receive
+ * delivers the rest and calls StreamReceiveComplete.
+ *
+ * @param sctx The owning stream
+ * @param event The receive event details
+ *
+ * @return QUIC_STATUS Return code indicating callback result
+ */
+QUIC_STATUS StreamCallbackReceive(stream & sctx, events::receive & event) {
+
+    MAD_EXPECTS(sctx.callbacks.on_data_received ||
+                sctx.callbacks.on_batch_data_received);
+    MAD_EXPECTS(event.BufferCount > 0);
+    MAD_EXPECTS(event.TotalBufferLength > 0);
+
+    const receive_scope receiving{ sctx };
+    MAD_EXPECTS(!sctx.pending_receive().active);
+    std::uint32_t buffer_idx = 0;
+    std::size_t buffer_offset = 0;
+
+    if (!deliver_received_data(sctx, { event.Buffers, event.BufferCount },
+                               buffer_idx, buffer_offset)) {
+        sctx.pending_receive() = { .active = true,
+                                   .buffers = event.Buffers,
+                                   .buffer_count = event.BufferCount,
+                                   .buffer_index = buffer_idx,
+                                   .buffer_offset = buffer_offset,
+                                   .total_length = event.TotalBufferLength };
+
+        MAD_LOG_DEBUG_I(stream_logger(),
+                        "Stream receive paused, holding {} byte(s) in {} "
+                        "QUIC_BUFFER(s) back",
+                        event.TotalBufferLength, event.BufferCount);
+        return QUIC_STATUS_PENDING;
+    }
 
     MAD_LOG_DEBUG_I(stream_logger(),
                     "Processed {} QUIC_BUFFER(s), total {} byte(s). "
                     "Receive buffer has {} byte(s) inside.",
                     event.BufferCount, event.TotalBufferLength,
-                    receive_buffer.consumed_space());
+                    sctx.rbuf().consumed_space());
     return QUIC_STATUS_SUCCESS;
 }
 
@@ -220,6 +861,15 @@ MAD_ALWAYS_INLINE QUIC_STATUS StreamCallbackShutdownComplete(
     stream & sctx, [[maybe_unused]] events::shutdown_complete & event)
 
 {
+    // The buffers of a held back receive event are gone with the
+    // stream, so it must not be resumed anymore.
+    if (sctx.receiving_on_this_thread()) {
+        sctx.pending_receive() = {};
+    } else {
+        const receive_scope receiving{ sctx };
+        sctx.pending_receive() = {};
+    }
+
     MAD_EXPECTS(sctx.callbacks.on_close);
     sctx.callbacks.on_close(sctx);
 
@@ -229,8 +879,8 @@ MAD_ALWAYS_INLINE QUIC_STATUS StreamCallbackShutdownComplete(
     }
 
     return sctx.connection()
-        .erase(sctx.handle_as<>())
-        .and_then([&](auto &&) -> result<QUIC_STATUS> {
+        .erase(sctx)
+        .and_then([&]() -> result<QUIC_STATUS> {
             MAD_LOG_DEBUG_I(stream_logger(),
                             "StreamCallbackShutdownComplete - stream "
                             "erased from connection map");
@@ -255,8 +905,8 @@ StreamCallbackStartComplete(stream & sctx, events::start_complete & event)
 {
     if (QUIC_FAILED(event.Status)) {
         return sctx.connection()
-            .erase(sctx.handle_as<>())
-            .and_then([&](auto &&) -> result<QUIC_STATUS> {
+            .erase(sctx)
+            .and_then([&]() -> result<QUIC_STATUS> {
                 MAD_LOG_DEBUG_I(stream_logger(),
                                 "StreamCallbackStartComplete - stream "
                                 "start failure, erasing stream");
@@ -314,6 +964,195 @@ QUIC_STATUS StreamCallback([[maybe_unused]] HQUIC stream_handle, void * context,
     return QUIC_STATUS_SUCCESS;
 };
 
+/**
+ * @brief Charge the memory of send buffers to the memory budget of
+ * their stream's connection, if any.
+ *
+ * The sends are charged by their allocation size, which is credited
+ * back by StreamCallbackSendComplete.
+ *
+ * @return The charged amount, in bytes.
+ */
+static std::size_t charge_sends(stream & sctx,
+                                std::span<const send_buffer<true>> bufs) {
+    auto * budget = sctx.budget();
+    if (nullptr == budget) {
+        return 0;
+    }
+    std::size_t bytes = 0;
+    for (const auto & buf : bufs) {
+        bytes += buffer_pool::capacity(buf.buf);
+    }
+    budget->charge(sctx.connection(), bytes);
+    return bytes;
+}
+
+/**
+ * @brief Give back the memory charged by charge_sends, for the sends
+ * that did not go through.
+ */
+static void credit_sends(stream & sctx, std::size_t bytes) {
+    if (auto * budget = sctx.budget()) {
+        budget->credit(sctx.connection(), bytes);
+    }
+}
+
+/**
+ * @brief Hand a single send buffer over to StreamSend.
+ *
+ * On success, the ownership of @p buf is taken over and @p buf is
+ * left empty. On failure, @p buf is left untouched.
+ *
+ * @return Amount of bytes sent if successful, error code otherwise.
+ */
+static auto stream_send_one(const QUIC_API_TABLE & api, stream & sctx,
+                            send_buffer<true> & buf,
+                            QUIC_SEND_FLAGS flags) -> result<std::size_t> {
+
+    // This function is used to queue data on a stream to be sent.
+    // The function itself is non-blocking and simply queues the data and
+    // returns. The app may pass zero or more buffers of data that will be sent
+    // on the stream in the order they are passed. The buffers (both the
+    // QUIC_BUFFERs and the memory they reference) are "owned" by MsQuic (and
+    // must not be modified by the app) until MsQuic indicates the
+    // QUIC_STREAM_EVENT_SEND_COMPLETE event for the send.
+
+    // We have 16 bytes of reserved space at the beginning of 'buf'
+    // We're gonna use it for storing QUIC_BUF.
+
+    // These are not invalidated after move.
+    auto quic_buffer_span = buf.quic_buffer_span();
+    auto data_span = buf.data_span();
+
+    QUIC_BUFFER * qbuf = reinterpret_cast<QUIC_BUFFER *>(
+        quic_buffer_span.data());
+    qbuf->Length = static_cast<std::uint32_t>(data_span.size_bytes());
+    qbuf->Buffer = data_span.data();
+
+    MAD_LOG_DEBUG_I(stream_logger(),
+                    "sending {} bytes of data of {}, offset: {}, allocation "
+                    "size: {}, encoded size: {}",
+                    qbuf->Length, buf.size(), buf.offset, buf.buf_size,
+                    buf.encoded_data_size());
+
+    // We're using the context pointer here to store the key.
+    if (auto status = api.StreamSend(
+            sctx.handle_as<HQUIC>(), qbuf, 1, flags, buf.buf);
+        QUIC_FAILED(status)) {
+        MAD_LOG_ERROR_I(stream_logger(), "stream send failed!");
+        return std::unexpected(quic_error_code::send_failed);
+    }
+    // The object is in use by MSQUIC.
+    // The STREAM_SEND_COMPLETE callback will handle the cleanup.
+    send_buffer<false> _{ std::move(buf) };
+
+    transport_counter_recorder::sent(1, data_span.size_bytes());
+    return data_span.size_bytes();
+}
+
+/**
+ * @brief Hand multiple send buffers over to StreamSend at once.
+ *
+ * On success, the ownership of the buffers are taken over and the
+ * buffers are left empty. On failure, the buffers are left untouched.
+ *
+ * @return Amount of bytes sent if successful, error code otherwise.
+ */
+static auto stream_send_many(const QUIC_API_TABLE & api, stream & sctx,
+                             std::span<send_buffer<true>> bufs,
+                             QUIC_SEND_FLAGS flags) -> result<std::size_t> {
+
+    if (bufs.empty()) {
+        return 0;
+    }
+
+    // No need for a batch for a single buffer.
+    if (bufs.size() == 1) {
+        return stream_send_one(api, sctx, bufs.front(), flags);
+    }
+
+    // The QUIC_BUFFER array and the completion context share
+    // a single allocation.
+    void * storage = nullptr;
+    try {
+        storage = buffer_pool::allocate(
+            send_batch::allocation_size(bufs.size()));
+    } catch (const std::bad_alloc &) {
+        return std::unexpected(quic_error_code::memory_allocation_failed);
+    }
+
+    auto * batch = new (storage) send_batch{ bufs.size() };
+    std::size_t total_size = 0;
+
+    for (std::size_t i = 0; i < bufs.size(); i++) {
+        auto data_span = bufs [i].data_span();
+        batch->quic_buffers() [i] = QUIC_BUFFER{
+            .Length = static_cast<std::uint32_t>(data_span.size_bytes()),
+            .Buffer = data_span.data()
+        };
+        batch->allocations() [i] = bufs [i].buf;
+        total_size += data_span.size_bytes();
+    }
+
+    MAD_LOG_DEBUG_I(stream_logger(),
+                    "sending {} buffer(s), {} bytes of data in total",
+                    bufs.size(), total_size);
+
+    if (auto status = api.StreamSend(
+            sctx.handle_as<HQUIC>(), batch->quic_buffers(),
+            static_cast<std::uint32_t>(bufs.size()), flags,
+            make_send_context(batch, send_context_kind::batch));
+        QUIC_FAILED(status)) {
+        MAD_LOG_ERROR_I(stream_logger(), "stream send failed!");
+        // The buffers are still owned by the caller.
+        batch->destroy();
+        return std::unexpected(quic_error_code::send_failed);
+    }
+
+    // The objects are in use by MSQUIC.
+    // The STREAM_SEND_COMPLETE callback will handle the cleanup.
+    for (auto & buf : bufs) {
+        send_buffer<false> _{ std::move(buf) };
+    }
+
+    transport_counter_recorder::sent(bufs.size(), total_size);
+    return total_size;
+}
+
+/**
+ * @brief Starts the transmission of the sends of a stream that are
+ * delayed with QUIC_SEND_FLAG_DELAY_SEND, when the send that was to
+ * start them failed. Otherwise they would wait for an unrelated send.
+ *
+ * @param api The msquic API table
+ * @param sctx The stream
+ */
+static void start_delayed_sends(const QUIC_API_TABLE & api,
+                                const stream & sctx) {
+    // An empty send, whose completion carries no context.
+    if (QUIC_FAILED(api.StreamSend(sctx.handle_as<HQUIC>(), nullptr, 0,
+                                   QUIC_SEND_FLAG_NONE, nullptr))) {
+        MAD_LOG_ERROR_I(stream_logger(), "stream send failed!");
+    }
+}
+
+/**
+ * @brief Send buffers that are not charged to the memory budget yet.
+ *
+ * See stream_send_many.
+ */
+static auto stream_send_charged(const QUIC_API_TABLE & api, stream & sctx,
+                                std::span<send_buffer<true>> bufs,
+                                QUIC_SEND_FLAGS flags) -> result<std::size_t> {
+    // Charged up front, the sends may complete before StreamSend returns.
+    const auto charged = charge_sends(sctx, bufs);
+    auto r = stream_send_many(api, sctx, bufs, flags);
+    if (!r) {
+        credit_sends(sctx, charged);
+    }
+    return r;
+}
+
 msquic_base::msquic_base(const msquic_application & app) :
     log_printer("console"), application(app) {
     set_log_level(log_level::info);
@@ -321,8 +1160,70 @@ msquic_base::msquic_base(const msquic_application & app) :
 
 msquic_base::~msquic_base() = default;
 
-auto msquic_base::open_stream(
-    connection & cctx, std::optional<stream_data_callback_t> data_callback)
+handle_closer_t msquic_base::stream_closer() const noexcept {
+    return handle_closer_t{
+        +[](void * api, void * h) {
+            static_cast<const QUIC_API_TABLE *>(api)->StreamClose(
+                static_cast<HQUIC>(h));
+        },
+        const_cast<QUIC_API_TABLE *>(application.api())
+    };
+}
+
+handle_closer_t msquic_base::stream_resetter() const noexcept {
+    return handle_closer_t{
+        +[](void * api, void * h) {
+            static_cast<const QUIC_API_TABLE *>(api)->StreamShutdown(
+                static_cast<HQUIC>(h), QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                k_stream_reset_error_code);
+        },
+        const_cast<QUIC_API_TABLE *>(application.api())
+    };
+}
+
+auto msquic_base::open_stream(connection & cctx,
+                              std::optional<stream_data_callback_t> data_callback,
+                              stream_priority_t priority)
+    -> result<std::reference_wrapper<stream>> {
+    // The user may decide to use different callbacks per stream.
+    stream_callbacks scb{
+        .on_start = callbacks.on_stream_start,
+        .on_close = callbacks.on_stream_close,
+        .on_data_received = data_callback ? data_callback.value()
+                                          : callbacks.on_stream_data_received
+    };
+    return open_stream_with(cctx, std::move(scb), priority);
+}
+
+auto msquic_base::open_stream(connection & cctx,
+                              stream_batch_data_callback_t batch_callback,
+                              stream_priority_t priority)
+    -> result<std::reference_wrapper<stream>> {
+    MAD_EXPECTS(batch_callback);
+    stream_callbacks scb{ .on_start = callbacks.on_stream_start,
+                          .on_close = callbacks.on_stream_close,
+                          .on_data_received = {},
+                          .on_batch_data_received = batch_callback };
+    return open_stream_with(cctx, std::move(scb), priority);
+}
+
+auto msquic_base::open_stream(connection & cctx,
+                              stream_data_callback_t data_callback,
+                              stream_message_callbacks message_callbacks,
+                              stream_priority_t priority)
+    -> result<std::reference_wrapper<stream>> {
+    MAD_EXPECTS(data_callback);
+    MAD_EXPECTS(message_callbacks);
+    stream_callbacks scb{ .on_start = callbacks.on_stream_start,
+                          .on_close = callbacks.on_stream_close,
+                          .on_data_received = data_callback,
+                          .on_batch_data_received = {},
+                          .on_large_message = message_callbacks };
+    return open_stream_with(cctx, std::move(scb), priority);
+}
+
+auto msquic_base::open_stream_with(connection & cctx, stream_callbacks scb,
+                                   stream_priority_t priority)
     -> result<std::reference_wrapper<stream>> {
     MAD_LOG_INFO("new stream open call");
 
@@ -336,24 +1237,30 @@ auto msquic_base::open_stream(
         return std::unexpected(quic_error_code::stream_open_failed);
     }
 
-    // The user may decide to use different callbacks per stream.
-    stream_callbacks scb{
-        .on_start = callbacks.on_stream_start,
-        .on_close = callbacks.on_stream_close,
-        .on_data_received = data_callback ? data_callback.value()
-                                          : callbacks.on_stream_data_received
-    };
+    // msquic already uses the default priority for new streams.
+    if (priority != k_default_stream_priority) {
+        if (auto result = application.api()->SetParam(
+                new_stream, QUIC_PARAM_STREAM_PRIORITY, sizeof(priority),
+                &priority);
+            QUIC_FAILED(result)) {
+            MAD_LOG_ERROR("stream priority could not be set, {}", result);
+            application.api()->StreamClose(new_stream);
+            return std::unexpected(quic_error_code::set_param_failed);
+        }
+    }
 
-    auto stream_shared_ptr =
-        std::shared_ptr<void>{ new_stream,
-                               [api = application.api()](QUIC_HANDLE * h) {
-                                   api->StreamClose(h);
-                               } };
+    auto added = cctx.add(stream_closer(), new_stream, cctx, std::move(scb),
+                          application.stream_receive(), stream_resetter(),
+                          cctx.budget());
+    if (!added) {
+        application.api()->StreamClose(new_stream);
+        return std::unexpected(added.error());
+    }
 
-    return cctx
-        .add(stream_shared_ptr, stream_shared_ptr.get(), cctx, std::move(scb))
-        .and_then([api = application.api()](
+    return std::move(added)
+        .and_then([api = application.api(), priority](
                       auto && v) -> result<std::reference_wrapper<stream>> {
+            v.get().priority_ = priority;
             api->SetContext(v.get().template handle_as<HQUIC>(),
                             static_cast<void *>(&v.get()));
             return std::move(v);
@@ -377,56 +1284,511 @@ auto msquic_base::open_stream(
         });
 }
 
+auto msquic_base::set_stream_priority(stream & sctx,
+                                      stream_priority_t priority) -> result<> {
+    if (auto result = application.api()->SetParam(
+            sctx.handle_as<HQUIC>(), QUIC_PARAM_STREAM_PRIORITY,
+            sizeof(priority), &priority);
+        QUIC_FAILED(result)) {
+        MAD_LOG_ERROR("stream priority could not be set, {}", result);
+        return std::unexpected(quic_error_code::set_param_failed);
+    }
+
+    std::atomic_ref{ sctx.priority_ }.store(
+        priority, std::memory_order_relaxed);
+    return {};
+}
+
 auto msquic_base::close_stream(stream & sctx) -> result<> {
-    return sctx.connection().erase(sctx.handle_as<>()).and_then([&](auto &&) {
+    return sctx.connection().erase(sctx).and_then([&]() {
         MAD_LOG_DEBUG_I(stream_logger(), "stream erased from connection map");
         return result<>{};
     });
 }
 
-auto msquic_base::send(stream & sctx,
-                       send_buffer<true> buf) -> result<std::size_t> {
+auto msquic_base::resume_receive(stream & sctx) -> result<> {
+    std::atomic_ref{ sctx.receive_held_ }.store(
+        false, std::memory_order_release);
+    std::atomic_ref{ sctx.receive_paused_ }.store(
+        false, std::memory_order_release);
 
-    // This function is used to queue data on a stream to be sent.
-    // The function itself is non-blocking and simply queues the data and
-    // returns. The app may pass zero or more buffers of data that will be sent
-    // on the stream in the order they are passed. The buffers (both the
-    // QUIC_BUFFERs and the memory they reference) are "owned" by MsQuic (and
-    // must not be modified by the app) until MsQuic indicates the
-    // QUIC_STREAM_EVENT_SEND_COMPLETE event for the send.
+    if (sctx.receiving_on_this_thread()) {
+        // Paused and resumed from the stream's own data callback.
+        // The ongoing delivery sees the pause lifted and carries on.
+        return {};
+    }
 
-    // We have 16 bytes of reserved space at the beginning of 'buf'
-    // We're gonna use it for storing QUIC_BUF.
+    // Checked within the scope: the worker thread may be about to
+    // hold the event back, after the pause is lifted above.
+    receive_scope receiving{ sctx };
+    deliver_pending_receive(*application.api(), receiving);
+    return {};
+}
+
+bool msquic_base::try_resume_receive(stream & sctx) {
+    receive_scope receiving{ sctx, std::try_to_lock };
+    if (!receiving) {
+        return false;
+    }
+
+    // Lifted only once the delivery is started, so the held back
+    // event is not left behind.
+    std::atomic_ref{ sctx.receive_held_ }.store(
+        false, std::memory_order_release);
+    std::atomic_ref{ sctx.receive_paused_ }.store(
+        false, std::memory_order_release);
+
+    deliver_pending_receive(*application.api(), receiving);
+    return true;
+}
+
+auto msquic_base::send(stream & sctx, send_buffer<true> buf,
+                       send_urgency urgency) -> result<std::size_t> {
+    if (coalesce_sends.load(std::memory_order_relaxed)) {
+        return send_coalesced(sctx, { &buf, 1 }, urgency);
+    }
+    return stream_send_charged(
+        *application.api(), sctx, { &buf, 1 }, to_send_flags(urgency));
+}
+
+auto msquic_base::send(stream & sctx, std::span<send_buffer<true>> bufs,
+                       send_urgency urgency) -> result<std::size_t> {
+    if (coalesce_sends.load(std::memory_order_relaxed)) {
+        return send_coalesced(sctx, bufs, urgency);
+    }
+    return stream_send_charged(
+        *application.api(), sctx, bufs, to_send_flags(urgency));
+}
+
+auto msquic_base::send_coalesced(stream & sctx,
+                                 std::span<send_buffer<true>> bufs,
+                                 send_urgency urgency) -> result<std::size_t> {
+    if (bufs.empty()) {
+        return 0;
+    }
+
+    const send_queue_scope queue_locked{ sctx };
+
+    if (urgency == send_urgency::urgent) {
+        // Keep the stream order: the queued messages go first, and
+        // the urgent send starts the transmission of both.
+        auto flushed = flush_stream(sctx, urgency, true);
+        if (!flushed) {
+            return std::unexpected(flushed.error());
+        }
+        auto r = stream_send_charged(
+            *application.api(), sctx, bufs, to_send_flags(urgency));
+        if (!r && flushed.value() > 0) {
+            start_delayed_sends(*application.api(), sctx);
+        }
+        return r;
+    }
+
+    try {
+        sctx.send_queue_.reserve(sctx.send_queue_.size() + bufs.size());
+    } catch (const std::bad_alloc &) {
+        return std::unexpected(quic_error_code::memory_allocation_failed);
+    }
+
+    // Charged while queued, and until the sends are completed.
+    charge_sends(sctx, bufs);
+
+    std::size_t total_size = 0;
+    for (auto & buf : bufs) {
+        total_size += buf.data_span().size_bytes();
+        sctx.send_queue_.emplace_back(std::move(buf));
+    }
+    return total_size;
+}
+
+auto msquic_base::flush_stream(stream & sctx, send_urgency urgency,
+                               bool more_to_come) -> result<std::size_t> {
+    auto & queue = sctx.send_queue_;
+    if (queue.empty()) {
+        return 0;
+    }
+
+    auto flags = to_send_flags(urgency);
+    if (more_to_come) {
+        // Let msquic wait for the rest before building the packets.
+        flags |= QUIC_SEND_FLAG_DELAY_SEND;
+    }
+
+    // The queue is left untouched on failure, and retried by the
+    // next flush. The queued sends are charged already.
+    return stream_send_many(*application.api(), sctx, queue, flags)
+        .transform([&](std::size_t sent) {
+            queue.clear();
+            return sent;
+        });
+}
+
+auto msquic_base::flush(connection & cctx) -> result<std::size_t> {
+    // Both passes see the same streams.
+    const auto streams_lock = cctx.lock();
+
+    // Count the streams first, so the last one can be sent without
+    // the delay flag. That send starts the transmission of all.
+    std::size_t remaining = 0;
+    cctx.for_each([&](stream & sctx) {
+        if (sctx.queued_sends() > 0) {
+            remaining++;
+        }
+    });
+
+    std::size_t sent = 0;
+    bool failed = false;
+    // The last stream whose send is delayed, until a send without the
+    // delay flag starts the transmission.
+    stream * delayed = nullptr;
+
+    cctx.for_each([&](stream & sctx) {
+        const send_queue_scope queue_locked{ sctx };
+        if (sctx.send_queue_.empty()) {
+            return;
+        }
+        // Queued after the count, sent along with the others.
+        remaining -= std::min<std::size_t>(remaining, 1);
+        if (auto r = flush_stream(sctx, send_urgency::normal, remaining > 0)) {
+            sent += r.value();
+            delayed = remaining > 0 ? &sctx : nullptr;
+        } else {
+            failed = true;
+        }
+    });
+
+    if (delayed) {
+        // The last send failed.
+        start_delayed_sends(*application.api(), *delayed);
+    }
+
+    MAD_LOG_DEBUG("flushed {} bytes of data", sent);
+
+    if (failed) {
+        return std::unexpected(quic_error_code::send_failed);
+    }
+    return sent;
+}
+
+auto msquic_base::trim_receive_buffers(connection & cctx) -> std::size_t {
+    const auto now = std::chrono::steady_clock::now();
+    std::size_t released = 0;
+    cctx.for_each([&](stream & sctx) {
+        if (sctx.release_idle_receive_buffer(now)) {
+            released++;
+        }
+    });
+
+    MAD_LOG_DEBUG("released {} idle receive buffer(s)", released);
+    return released;
+}
+
+auto msquic_base::enforce_memory_budget_on(
+    std::span<connection * const> connections) -> std::size_t {
+    auto & budget = application.budget();
+    std::size_t evicted = 0;
+
+    if (budget.over_limit()) {
+        // The memory of the connections that are already being shut
+        // down is about to be given back.
+        std::size_t excess = budget.total() - budget.options().total_limit;
+        std::vector<std::pair<std::size_t, connection *>> ranked{};
+        ranked.reserve(connections.size());
+        for (connection * cctx : connections) {
+            const auto usage = cctx->memory_usage();
+            if (memory_budget::evicted(*cctx)) {
+                excess -= std::min(excess, usage);
+            } else if (usage > 0) {
+                ranked.emplace_back(usage, cctx);
+            }
+        }
+
+        std::ranges::sort(ranked, std::ranges::greater{},
+                          &std::pair<std::size_t, connection *>::first);
+
+        for (auto [usage, cctx] : ranked) {
+            if (0 == excess) {
+                break;
+            }
+            if (!budget.evict(*cctx)) {
+                continue;
+            }
+            MAD_LOG_WARN("disconnecting a connection that holds {} byte(s), "
+                         "memory budget exceeded by {} byte(s)",
+                         usage, excess);
+            application.api()->ConnectionShutdown(
+                cctx->handle_as<HQUIC>(), QUIC_CONNECTION_SHUTDOWN_FLAG_NONE,
+                k_memory_budget_error_code);
+            excess -= std::min(excess, usage);
+            evicted++;
+        }
+    }
+
+    // Resume the streams held back for memory, if there is room now.
+    for (connection * cctx : connections) {
+        if (memory_budget::evicted(*cctx) || !budget.has_room(*cctx)) {
+            continue;
+        }
+        // The streams are locked meanwhile, so the stream that
+        // another thread delivers the data of is not waited for;
+        // its data callbacks might be waiting for the lock. It is
+        // resumed by a later run.
+        cctx->for_each([&](stream & sctx) {
+            if (sctx.receive_held()) {
+                try_resume_receive(sctx);
+            }
+        });
+    }
+
+    return evicted;
+}
+
+auto msquic_base::statistics(const connection & cctx) const
+    -> result<connection_statistics> {
+    QUIC_STATISTICS_V2 stats{};
+    std::uint32_t size = sizeof(stats);
+    // An older msquic may fill less than the whole structure; the
+    // fields it does not know stay zero.
+    if (auto result = application.api()->GetParam(
+            cctx.handle_as<HQUIC>(), QUIC_PARAM_CONN_STATISTICS_V2, &size,
+            &stats);
+        QUIC_FAILED(result)) {
+        MAD_LOG_ERROR("connection statistics could not be retrieved, {}",
+                      result);
+        return std::unexpected(quic_error_code::get_param_failed);
+    }
+
+    using std::chrono::microseconds;
+    return connection_statistics{
+        .rtt = microseconds{ stats.Rtt },
+        .min_rtt = microseconds{ stats.MinRtt },
+        .max_rtt = microseconds{ stats.MaxRtt },
+        .congestion_window = stats.SendCongestionWindow,
+        .path_mtu = stats.SendPathMtu,
+        .congestion_events = stats.SendCongestionCount,
+        .persistent_congestion_events = stats.SendPersistentCongestionCount,
+        .ecn_congestion_events = stats.SendEcnCongestionCount,
+        .sent_packets = stats.SendTotalPackets,
+        .lost_packets =
+            stats.SendSuspectedLostPackets - stats.SendSpuriousLostPackets,
+        .sent_bytes = stats.SendTotalBytes,
+        .sent_stream_bytes = stats.SendTotalStreamBytes,
+        .received_packets = stats.RecvTotalPackets,
+        .dropped_packets = stats.RecvDroppedPackets,
+        .duplicate_packets = stats.RecvDuplicatePackets,
+        .reordered_packets = stats.RecvReorderedPackets,
+        .received_bytes = stats.RecvTotalBytes,
+        .received_stream_bytes = stats.RecvTotalStreamBytes,
+    };
+}
+
+auto msquic_base::statistics(const stream & sctx) const
+    -> result<stream_statistics> {
+    QUIC_STREAM_STATISTICS stats{};
+    std::uint32_t size = sizeof(stats);
+    if (auto result = application.api()->GetParam(
+            sctx.handle_as<HQUIC>(), QUIC_PARAM_STREAM_STATISTICS, &size,
+            &stats);
+        QUIC_FAILED(result)) {
+        MAD_LOG_ERROR("stream statistics could not be retrieved, {}", result);
+        return std::unexpected(quic_error_code::get_param_failed);
+    }
+
+    using std::chrono::microseconds;
+    return stream_statistics{
+        .blocked_by_scheduling = microseconds{ stats.ConnBlockedBySchedulingUs },
+        .blocked_by_pacing = microseconds{ stats.ConnBlockedByPacingUs },
+        .blocked_by_amplification_protection =
+            microseconds{ stats.ConnBlockedByAmplificationProtUs },
+        .blocked_by_congestion_control =
+            microseconds{ stats.ConnBlockedByCongestionControlUs },
+        .blocked_by_connection_flow_control =
+            microseconds{ stats.ConnBlockedByFlowControlUs },
+        .blocked_by_stream_id_flow_control =
+            microseconds{ stats.StreamBlockedByIdFlowControlUs },
+        .blocked_by_stream_flow_control =
+            microseconds{ stats.StreamBlockedByFlowControlUs },
+        .blocked_by_app = microseconds{ stats.StreamBlockedByAppUs },
+    };
+}
+
+auto msquic_base::broadcast(
+    std::span<const std::reference_wrapper<stream>> streams,
+    const shared_send_buffer & buf,
+    send_urgency urgency) -> result<std::size_t> {
+    MAD_EXPECTS(buf);
+
+    if (streams.empty()) {
+        return 0;
+    }
 
-    // These are not invalidated after move.
-    auto quic_buffer_span = buf.quic_buffer_span();
     auto data_span = buf.data_span();
 
-    QUIC_BUFFER * qbuf = reinterpret_cast<QUIC_BUFFER *>(
-        quic_buffer_span.data());
-    qbuf->Length = static_cast<std::uint32_t>(data_span.size_bytes());
-    qbuf->Buffer = data_span.data();
+    // Every stream holds a reference until its send is completed.
+    // A failed send gives its reference back immediately.
+    void * storage = nullptr;
+    try {
+        storage = buffer_pool::allocate(sizeof(send_fanout));
+    } catch (const std::bad_alloc &) {
+        return std::unexpected(quic_error_code::memory_allocation_failed);
+    }
 
-    MAD_LOG_DEBUG("sending {} bytes of data of {}, offset: {}, allocation "
-                  "size: {}, encoded size: {}",
-                  qbuf->Length, buf.size(), buf.offset, buf.buf_size,
-                  buf.encoded_data_size());
+    auto * fanout = new (storage) send_fanout{
+        .payload = buf,
+        .quic_buffer = QUIC_BUFFER{ .Length = static_cast<std::uint32_t>(
+                                        data_span.size_bytes()),
+                                    .Buffer = const_cast<std::uint8_t *>(
+                                        data_span.data()) },
+        .refs = streams.size()
+    };
 
-    // We're using the context pointer here to store the key.
-    if (auto status = application.api()->StreamSend(
-            sctx.handle_as<HQUIC>(), qbuf, 1, QUIC_SEND_FLAG_NONE, buf.buf);
+    MAD_LOG_DEBUG("broadcasting {} bytes of data to {} stream(s)",
+                  data_span.size_bytes(), streams.size());
+
+    auto * context = make_send_context(fanout, send_context_kind::fanout);
+    const auto flags = to_send_flags(urgency);
+    std::size_t sent = 0;
+
+    for (stream & sctx : streams) {
+        // Keep the stream order; the broadcast send starts the
+        // transmission of the queued messages as well.
+        const send_queue_scope queue_locked{ sctx };
+        auto flushed = flush_stream(sctx, urgency, true);
+        if (!flushed) {
+            fanout->release();
+            continue;
+        }
+        // Every stream is charged the message size; the memory is
+        // held until the last of them completes.
+        if (auto * budget = sctx.budget()) {
+            budget->charge(sctx.connection(), data_span.size_bytes());
+        }
+        if (auto status = application.api()->StreamSend(
+                sctx.handle_as<HQUIC>(), &fanout->quic_buffer, 1, flags,
+                context);
+            QUIC_FAILED(status)) {
+            MAD_LOG_ERROR("stream send failed!");
+            credit_sends(sctx, data_span.size_bytes());
+            fanout->release();
+            if (flushed.value() > 0) {
+                start_delayed_sends(*application.api(), sctx);
+            }
+            continue;
+        }
+        sent++;
+    }
+
+    if (0 == sent) {
+        return std::unexpected(quic_error_code::send_failed);
+    }
+    transport_counter_recorder::sent(sent, sent * data_span.size_bytes());
+    return sent;
+}
+
+auto msquic_base::send_datagram(connection & cctx, send_buffer<true> buf)
+    -> result<std::size_t> {
+
+    // The datagram is self-delimiting, so the size prefix is not sent.
+    auto data_span = buf.data_span().subspan(k_frame_prefix_size);
+
+    void * storage = nullptr;
+    try {
+        storage = buffer_pool::allocate(sizeof(datagram_send));
+    } catch (const std::bad_alloc &) {
+        return std::unexpected(quic_error_code::memory_allocation_failed);
+    }
+
+    auto * datagram = new (storage) datagram_send{
+        .quic_buffer = QUIC_BUFFER{ .Length = static_cast<std::uint32_t>(
+                                        data_span.size_bytes()),
+                                    .Buffer = data_span.data() },
+        .allocation = buf.buf
+    };
+
+    MAD_LOG_DEBUG("sending a datagram of {} bytes", data_span.size_bytes());
+
+    // Charged up front, the datagram may reach its final state before
+    // DatagramSend returns.
+    const auto charged = buffer_pool::capacity(buf.buf);
+    if (auto * budget = cctx.budget()) {
+        budget->charge(cctx, charged);
+    }
+
+    if (auto status = application.api()->DatagramSend(
+            cctx.handle_as<HQUIC>(), &datagram->quic_buffer, 1,
+            QUIC_SEND_FLAG_NONE, datagram);
         QUIC_FAILED(status)) {
-        MAD_LOG_ERROR("stream send failed!");
+        MAD_LOG_ERROR("datagram send failed with {}", status);
+        if (auto * budget = cctx.budget()) {
+            budget->credit(cctx, charged);
+        }
+        buffer_pool::deallocate(datagram);
+        // msquic rejects the datagram synchronously when the peer
+        // does not accept datagrams, or when it does not fit.
+        if (status == QUIC_STATUS_INVALID_STATE) {
+            return std::unexpected(quic_error_code::datagram_not_enabled);
+        }
+        if (status == QUIC_STATUS_INVALID_PARAMETER) {
+            return std::unexpected(quic_error_code::datagram_too_large);
+        }
         return std::unexpected(quic_error_code::send_failed);
     }
-    // The object is in use by MSQUIC.
-    // The STREAM_SEND_COMPLETE callback will handle the cleanup.
-    send_buffer<false> _{ std::move(buf) };
 
-#ifndef NDEBUG
-    sctx.sends_in_flight.fetch_add(1);
-#endif
+    // The object is in use by MSQUIC. The final
+    // DATAGRAM_SEND_STATE_CHANGED event will handle the cleanup.
+    send_buffer<false> _{ std::move(buf) };
     return data_span.size_bytes();
 }
 
+void msquic_base::on_datagram_event(connection * cctx,
+                                    const QUIC_CONNECTION_EVENT & event) {
+    switch (event.Type) {
+        case QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED: {
+            const events::datagram_state_changed & v =
+                event.DATAGRAM_STATE_CHANGED;
+            MAD_LOG_DEBUG("datagram send enabled: {}, max send length: {}",
+                          static_cast<bool>(v.SendEnabled), v.MaxSendLength);
+        } break;
+        case QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED: {
+            const events::datagram_received & v = event.DATAGRAM_RECEIVED;
+            if (cctx && callbacks.on_datagram_received) {
+                callbacks.on_datagram_received(
+                    *cctx, std::span<const std::uint8_t>{ v.Buffer->Buffer,
+                                                         v.Buffer->Length });
+            }
+        } break;
+        case QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED: {
+            const events::datagram_send_state_changed & v =
+                event.DATAGRAM_SEND_STATE_CHANGED;
+            auto * datagram = static_cast<datagram_send *>(v.ClientContext);
+            MAD_EXPECTS(datagram);
+
+            if (auto state = to_datagram_send_state(v.State);
+                state && cctx && callbacks.on_datagram_send_state) {
+                callbacks.on_datagram_send_state(
+                    *cctx,
+                    std::span<const std::uint8_t>{
+                        datagram->quic_buffer.Buffer,
+                        datagram->quic_buffer.Length },
+                    *state);
+            }
+
+            if (QUIC_DATAGRAM_SEND_STATE_IS_FINAL(v.State)) {
+                // Without the connection, its memory is given back
+                // already, see memory_budget::release.
+                if (auto * budget = cctx ? cctx->budget() : nullptr) {
+                    budget->credit(
+                        *cctx, buffer_pool::capacity(datagram->allocation));
+                }
+                buffer_pool::deallocate(datagram->allocation);
+                buffer_pool::deallocate(datagram);
+            }
+        } break;
+        default:
+            MAD_LOG_WARN("not a datagram event: {}",
+                         std::to_underlying(event.Type));
+            break;
+    }
+}
+
 } // namespace mad::nexus
@@ -82,7 +82,7 @@ struct MsQuicClientCallbacks {
             case QUIC_CONNECTION_EVENT_IDEAL_PROCESSOR_CHANGED:
                 return "QUIC_CONNECTION_EVENT_IDEAL_PROCESSOR_CHANGED";
             case QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED:
-                return "QUIC_CONNECTION_EVENT_IDEAL_PROCESSOR_CHANGED";
+                return "QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED";
             case QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED:
                 return "QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED";
             case QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED:
@@ -127,16 +127,10 @@ struct MsQuicClientCallbacks {
             .on_data_received = client.callbacks.on_stream_data_received
         };
 
-        auto stream_shared_ptr = std::shared_ptr<void>{
-            new_stream,
-            [api = client.application.api()](QUIC_HANDLE * sp) {
-                api->StreamClose(sp);
-            }
-        };
-
         return client.connection
-            ->add(stream_shared_ptr, stream_shared_ptr.get(),
-                  *client.connection, std::move(scbs))
+            ->add(client.stream_closer(), new_stream, *client.connection,
+                  std::move(scbs), client.application.stream_receive(),
+                  client.stream_resetter(), client.connection->budget())
             .and_then([&](auto && v) noexcept
                       -> result<std::reference_wrapper<stream>> {
                 MAD_LOG_DEBUG_I(client, "Client peer stream started!");
@@ -169,7 +163,8 @@ struct MsQuicClientCallbacks {
                        std::string_view{
                            reinterpret_cast<const char *>(event.NegotiatedAlpn),
                            event.NegotiatedAlpnLength });
-        client.connection = std::make_unique<connection>(connection_handle);
+        client.connection = std::make_unique<connection>(
+            connection_handle, nullptr, &client.application.budget());
         assert(client.callbacks.on_connected);
         client.callbacks.on_connected(*(client.connection.get()));
 
@@ -265,6 +260,15 @@ struct MsQuicClientCallbacks {
                 return QUIC_STATUS_SUCCESS;
             }
 
+            case QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED:
+            case QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED:
+            case QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED: {
+                // The datagram state is reported during the handshake,
+                // before the connection object is created.
+                client.on_datagram_event(client.connection.get(), *event);
+                return QUIC_STATUS_SUCCESS;
+            }
+
             case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED: {
                 // TODO: Store resumption ticket for later?
                 MAD_LOG_DEBUG_I(
@@ -349,4 +353,28 @@ auto msquic_client::disconnect() -> result<> {
 
     return {};
 }
+
+/******************************************************/
+
+auto msquic_client::flush_all() -> result<std::size_t> {
+    if (nullptr == connection) {
+        return 0;
+    }
+    return flush(*connection);
+}
+
+auto msquic_client::trim_all_receive_buffers() -> std::size_t {
+    if (nullptr == connection) {
+        return 0;
+    }
+    return trim_receive_buffers(*connection);
+}
+
+auto msquic_client::enforce_memory_budget() -> std::size_t {
+    if (nullptr == connection) {
+        return 0;
+    }
+    struct connection * const connections [] = { connection.get() };
+    return enforce_memory_budget_on(connections);
+}
 } // namespace mad::nexus
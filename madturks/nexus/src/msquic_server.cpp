@@ -22,6 +22,7 @@
 #include <expected>
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace mad::nexus {
 
@@ -70,15 +71,26 @@ struct MsQuicServerCallbacks {
             new_connection, server.application.api());
         MAD_LOG_INFO_I(server, "New client connected: {}", remote.Address);
 
-        std::shared_ptr<QUIC_HANDLE> connection_shared_ptr{
-            new_connection,
-            [api = server.application.api()](QUIC_HANDLE * sp) {
-                api->ConnectionClose(sp);
-            }
+        // Closes the connection handle when the connection is removed
+        // from the server.
+        const handle_closer_t closer{
+            +[](void * api, void * h) {
+                static_cast<const QUIC_API_TABLE *>(api)->ConnectionClose(
+                    static_cast<HQUIC>(h));
+            },
+            const_cast<QUIC_API_TABLE *>(server.application.api())
         };
 
-        return server.add(connection_shared_ptr, connection_shared_ptr.get())
+        return server
+            .add_connection(closer, new_connection, &server,
+                            &server.application.budget())
             .and_then([&](auto && v) {
+                // The connection is known from now on; route the rest of
+                // its events to it directly.
+                server.application.api()->SetCallbackHandler(
+                    new_connection,
+                    reinterpret_cast<void *>(ServerConnectionCallback),
+                    &v.get());
                 server.application.api()->ConnectionSendResumptionTicket(
                     v.get().template handle_as<HQUIC>(),
                     QUIC_SEND_RESUMPTION_FLAG_NONE, 0, nullptr);
@@ -89,6 +101,7 @@ struct MsQuicServerCallbacks {
             })
             .or_else([&](auto &&) {
                 MAD_LOG_ERROR_I(server, "connection could not be stored!");
+                server.application.api()->ConnectionClose(new_connection);
                 return result<QUIC_STATUS>{ QUIC_STATUS_SUCCESS };
             })
             .value();
@@ -97,51 +110,51 @@ struct MsQuicServerCallbacks {
     /**
      * Connection shutdown handler function.
      *
-     * @param connection The connection that is shut down
+     * @param cctx The connection that is shut down, or nullptr if
+     * the connection is not established
      * @param event Shutdown event details
      * @param server Owning server
      *
      * @return QUIC_STATUS Return code indicating callback result
      */
     static MAD_ALWAYS_INLINE QUIC_STATUS ServerConnectionEventShutdownCompleted(
-        QUIC_HANDLE * connection, const shutdown_complete_event & event,
+        connection * cctx, const shutdown_complete_event & event,
         msquic_server & server) {
 
         if (event.AppCloseInProgress) {
             return QUIC_STATUS_SUCCESS;
         }
 
-        return server.erase(connection)
-            .and_then([&](auto && v) {
-                server.callbacks.on_disconnected(v.mapped());
-                return result<QUIC_STATUS>{ QUIC_STATUS_SUCCESS };
-            })
-            .or_else([&](auto &&) {
-                MAD_LOG_DEBUG_I(server,
-                                "connection shutdown complete but no such "
-                                "connection in map!");
-                return result<QUIC_STATUS>{ QUIC_STATUS_SUCCESS };
-            })
-            .value();
+        if (nullptr == cctx) {
+            MAD_LOG_DEBUG_I(server, "connection shutdown complete before "
+                                    "the connection is established!");
+            return QUIC_STATUS_SUCCESS;
+        }
+
+        server.callbacks.on_disconnected(*cctx);
+        // The handle is closed and the connection is destroyed once
+        // the application threads stop observing it.
+        if (auto r = server.remove_connection(*cctx); !r) {
+            MAD_LOG_ERROR_I(server, "connection could not be removed: {}",
+                            r.error().message());
+        }
+        return QUIC_STATUS_SUCCESS;
     }
 
     /**
-     * Server connection callback dispatcher function.
-     *
-     * Events from accepted connections will land here.
+     * Server connection event dispatcher function.
      *
      * @param chandle Subject
-     * @param context Context pointer (owning server)
+     * @param cctx The connection, or nullptr if the connection is
+     * not established yet
      * @param event MSQUIC event describing what happened
-     -
+     * @param server The owning server
+     *
      * @return QUIC_STATUS Return code indicating callback result
      */
-    static QUIC_STATUS ServerConnectionCallback(HQUIC chandle, void * context,
-                                                QUIC_CONNECTION_EVENT * event) {
-        assert(chandle);
-        assert(context);
-        assert(event);
-        auto & server = *static_cast<msquic_server *>(context);
+    static QUIC_STATUS ServerConnectionEvent(HQUIC chandle, connection * cctx,
+                                             QUIC_CONNECTION_EVENT * event,
+                                             msquic_server & server) {
         // We're only handling the connected and shutdown completed
         // events. Rest are for logging purposes.
 
@@ -150,12 +163,13 @@ struct MsQuicServerCallbacks {
 
         switch (event->Type) {
             case QUIC_CONNECTION_EVENT_CONNECTED:
+                MAD_EXPECTS(nullptr == cctx);
                 return ServerConnectionEventConnected(
                     chandle, event->CONNECTED, server);
 
             case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
                 return ServerConnectionEventShutdownCompleted(
-                    chandle, event->SHUTDOWN_COMPLETE, server);
+                    cctx, event->SHUTDOWN_COMPLETE, server);
 
             case QUIC_CONNECTION_EVENT_SHUTDOWN_INITIATED_BY_TRANSPORT: {
                 if (event->SHUTDOWN_INITIATED_BY_TRANSPORT.Status ==
@@ -184,6 +198,14 @@ struct MsQuicServerCallbacks {
                 MAD_LOG_INFO_I(server, "Connection resumed!");
             } break;
 
+            case QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED:
+            case QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED:
+            case QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED: {
+                // The datagram state is reported during the handshake,
+                // before the connection is added.
+                server.on_datagram_event(cctx, *event);
+            } break;
+
             default: {
                 MAD_LOG_WARN_I(server, "Unhandled connection event: {}",
                                std::to_underlying(event->Type));
@@ -193,6 +215,39 @@ struct MsQuicServerCallbacks {
         return QUIC_STATUS_SUCCESS;
     }
 
+    /**
+     * Callback of the connections that are not established yet.
+     *
+     * @param chandle Subject
+     * @param context Context pointer (owning server)
+     * @param event MSQUIC event describing what happened
+     *
+     * @return QUIC_STATUS Return code indicating callback result
+     */
+    static QUIC_STATUS ServerHandshakeCallback(HQUIC chandle, void * context,
+                                               QUIC_CONNECTION_EVENT * event) {
+        assert(context);
+        return ServerConnectionEvent(
+            chandle, nullptr, event, *static_cast<msquic_server *>(context));
+    }
+
+    /**
+     * Callback of the established connections.
+     *
+     * @param chandle Subject
+     * @param context Context pointer (the connection)
+     * @param event MSQUIC event describing what happened
+     *
+     * @return QUIC_STATUS Return code indicating callback result
+     */
+    static QUIC_STATUS ServerConnectionCallback(HQUIC chandle, void * context,
+                                                QUIC_CONNECTION_EVENT * event) {
+        assert(context);
+        auto & cctx = *static_cast<connection *>(context);
+        return ServerConnectionEvent(
+            chandle, &cctx, event, cctx.owner_as<msquic_server>());
+    }
+
     /**
      * Called when listener receives a new connection
      *
@@ -205,12 +260,21 @@ struct MsQuicServerCallbacks {
         const new_connection_event & event, msquic_server & server) {
 
         MAD_LOG_INFO_I(server, "Listener received a new connection.");
+
+        // Returning a failure status rejects the connection.
+        if (!server.application.budget().admit_connection()) {
+            MAD_LOG_WARN_I(server, "Memory budget exceeded ({} byte(s) in "
+                                   "use), refusing the connection!",
+                           server.application.budget().total());
+            return QUIC_STATUS_CONNECTION_REFUSED;
+        }
+
         // A new connection is being attempted by a client. For the handshake to
         // proceed, the server must provide a configuration for QUIC to use. The
         // app MUST set the callback handler before returning.
         server.application.api()->SetCallbackHandler(
             event.Connection,
-            reinterpret_cast<void *>(ServerConnectionCallback), &server);
+            reinterpret_cast<void *>(ServerHandshakeCallback), &server);
         return server.application.api()->ConnectionSetConfiguration(
             event.Connection, server.application.configuration());
     }
@@ -293,4 +357,44 @@ auto msquic_server::listen(std::string_view alpn,
     return {};
 }
 
+auto msquic_server::flush_all() -> result<std::size_t> {
+    std::size_t sent = 0;
+    bool failed = false;
+
+    // Keep flushing the rest of the connections on failure.
+    for_each_connection([&](connection & cctx) {
+        if (auto r = flush(cctx)) {
+            sent += r.value();
+        } else {
+            failed = true;
+        }
+    });
+
+    if (failed) {
+        return std::unexpected(quic_error_code::send_failed);
+    }
+    return sent;
+}
+
+auto msquic_server::trim_all_receive_buffers() -> std::size_t {
+    std::size_t released = 0;
+    for_each_connection([&](connection & cctx) {
+        released += trim_receive_buffers(cctx);
+    });
+    return released;
+}
+
+auto msquic_server::enforce_memory_budget() -> std::size_t {
+    // The snapshot keeps the connections alive while they are ranked
+    // and shut down.
+    const auto snapshot = connections_snapshot();
+    std::vector<connection *> connections{};
+    connections.reserve(snapshot.size());
+    for (std::size_t i = 0; i < snapshot.shard_count(); i++) {
+        const auto shard = snapshot.shard(i);
+        connections.insert(connections.end(), shard.begin(), shard.end());
+    }
+    return enforce_memory_budget_on(connections);
+}
+
 } // namespace mad::nexus
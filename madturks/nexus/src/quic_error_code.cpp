@@ -74,6 +74,14 @@ std::string quic_error_code_category::message(int condition) const {
             return "Memory allocation failed.";
         case no_such_implementation:
             return "No such implementation!";
+        case datagram_not_enabled:
+            return "Datagrams are not enabled on the connection.";
+        case datagram_too_large:
+            return "Datagram is larger than the connection allows.";
+        case set_param_failed:
+            return "Parameter could not be set.";
+        case get_param_failed:
+            return "Parameter could not be retrieved.";
     }
 
     MAD_EXHAUSTIVE_SWITCH_END
@@ -6,5 +6,69 @@
 #include <mad/nexus/quic_server.hpp>
 
 namespace mad::nexus {
+
+quic_server::quic_server() :
+    registry(connection_registry::reclaim_callback_t{ &reclaim_connection,
+                                                      this }) {}
+
 quic_server::~quic_server() = default;
+
+auto quic_server::add_connection(handle_closer_t closer, void * hconnection,
+                                 void * owner, memory_budget * budget)
+    -> result<std::reference_wrapper<connection>> {
+    auto added = [&]() {
+        std::lock_guard<std::mutex> guard{ connections_mtx };
+        return add(closer, hconnection, owner, budget);
+    }();
+
+    if (!added) {
+        return added;
+    }
+
+    if (auto r = registry.insert(added->get()); !r) {
+        // Not visible to anyone yet; the handle is left to the caller.
+        std::lock_guard<std::mutex> guard{ connections_mtx };
+        [[maybe_unused]] auto closer_r = release_closer(added->get());
+        [[maybe_unused]] auto erase_r = erase(added->get());
+        return std::unexpected(r.error());
+    }
+    return added;
+}
+
+auto quic_server::remove_connection(connection & cctx) -> result<> {
+    // Never fails for the lack of memory; the view that unpublishes
+    // the connection is set aside when it is published.
+    if (auto r = registry.remove(cctx); !r) {
+        if (quic_error_code::value_does_not_exists == r.error()) {
+            // Never published, so nobody can be observing it.
+            reclaim_connection(this, cctx);
+            return {};
+        }
+        return r;
+    }
+    return {};
 }
+
+void quic_server::reclaim_connection(void * uctx, connection & cctx) {
+    auto & server = *static_cast<quic_server *>(uctx);
+
+    handle_closer_t closer{};
+    {
+        std::lock_guard<std::mutex> guard{ server.connections_mtx };
+        if (auto r = server.release_closer(cctx)) {
+            closer = r.value();
+        }
+    }
+
+    // Close the handle outside of the lock. Closing may block
+    // until the connection's worker thread processes it, and the
+    // worker might be waiting for the lock.
+    if (closer) {
+        closer(cctx.handle_as<>());
+    }
+
+    std::lock_guard<std::mutex> guard{ server.connections_mtx };
+    [[maybe_unused]] auto r = server.erase(cctx);
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,208 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/receive_buffer_pool.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+using buffer_t = receive_buffer_pool::buffer_t;
+
+constexpr std::size_t k_class_count =
+    std::bit_width(receive_buffer_pool::k_max_buffer_size) -
+    std::bit_width(receive_buffer_pool::k_min_buffer_size) + 1;
+
+/******************************************************
+ * Index of the size class of exactly @p size bytes.
+ ******************************************************/
+constexpr std::size_t class_of(std::size_t size) noexcept {
+    return static_cast<std::size_t>(std::bit_width(size)) -
+           static_cast<std::size_t>(
+               std::bit_width(receive_buffer_pool::k_min_buffer_size));
+}
+
+static_assert(class_of(receive_buffer_pool::k_min_buffer_size) == 0);
+static_assert(class_of(receive_buffer_pool::k_max_buffer_size) ==
+              k_class_count - 1);
+
+/******************************************************
+ * Whether the buffers of @p size bytes are pooled.
+ ******************************************************/
+constexpr bool is_class_size(std::size_t size) noexcept {
+    return std::has_single_bit(size) &&
+           size >= receive_buffer_pool::k_min_buffer_size &&
+           size <= receive_buffer_pool::k_max_buffer_size;
+}
+
+struct shared_state {
+    struct alignas(64) class_cache {
+        std::mutex mtx;
+        std::vector<buffer_t> buffers;
+    };
+
+    std::array<class_cache, k_class_count> caches{};
+
+    alignas(64) std::atomic<std::size_t> buffers_per_class{
+        receive_buffer_pool_options{}.buffers_per_class
+    };
+    std::atomic<std::size_t> max_cached_bytes{
+        receive_buffer_pool_options{}.max_cached_bytes
+    };
+    std::atomic<bool> populate_buffers{
+        receive_buffer_pool_options{}.populate_buffers
+    };
+    std::atomic<std::uint64_t> acquisitions{ 0 };
+    std::atomic<std::uint64_t> cache_hits{ 0 };
+    std::atomic<std::uint64_t> buffers_cached{ 0 };
+    std::atomic<std::uint64_t> bytes_cached{ 0 };
+};
+
+shared_state & shared() noexcept {
+    // Intentionally leaked: streams may be destroyed after the
+    // static destructors run.
+    static auto * state = new shared_state{};
+    return *state;
+}
+
+} // namespace
+
+std::size_t receive_buffer_pool::buffer_size(std::size_t size) noexcept {
+    const auto page_size = static_cast<std::size_t>(getpagesize());
+    const auto class_size = std::bit_ceil(
+        std::max({ size, k_min_buffer_size, page_size }));
+
+    if (!is_class_size(class_size)) {
+        return (size + page_size - 1) / page_size * page_size;
+    }
+    return class_size;
+}
+
+auto receive_buffer_pool::acquire(std::size_t size) -> buffer_t {
+    auto & state = shared();
+    state.acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    const auto class_size = buffer_size(size);
+    const mad::vm_cb_map_options options{
+        .populate = state.populate_buffers.load(std::memory_order_relaxed)
+    };
+
+    if (!is_class_size(class_size)) {
+        return buffer_t{ class_size, options };
+    }
+
+    auto & cache = state.caches [class_of(class_size)];
+    {
+        std::scoped_lock guard{ cache.mtx };
+        if (!cache.buffers.empty()) {
+            auto buffer = std::move(cache.buffers.back());
+            cache.buffers.pop_back();
+            state.cache_hits.fetch_add(1, std::memory_order_relaxed);
+            state.buffers_cached.fetch_sub(1, std::memory_order_relaxed);
+            state.bytes_cached.fetch_sub(
+                class_size, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+    return buffer_t{ class_size, options };
+}
+
+void receive_buffer_pool::release(buffer_t && buffer) noexcept {
+    if (!buffer || !is_class_size(buffer.total_size())) {
+        return;
+    }
+
+    auto & state = shared();
+    const auto size = buffer.total_size();
+    auto & cache = state.caches [class_of(size)];
+
+    // Reserve the room in the byte limit first, so a buffer that
+    // does not fit is not cleared for nothing.
+    const auto max_bytes =
+        state.max_cached_bytes.load(std::memory_order_relaxed);
+    auto cached = state.bytes_cached.load(std::memory_order_relaxed);
+    do {
+        if (cached + size > max_bytes) {
+            return;
+        }
+    } while (!state.bytes_cached.compare_exchange_weak(
+        cached, cached + size, std::memory_order_relaxed));
+
+    if (size > k_resident_buffer_size) {
+        // Only the mapping is worth keeping for a large buffer.
+        if (!buffer.discard_pages()) {
+            buffer.clear();
+        }
+    } else {
+        buffer.clear();
+    }
+
+    {
+        std::scoped_lock guard{ cache.mtx };
+        if (cache.buffers.size() <
+            state.buffers_per_class.load(std::memory_order_relaxed)) {
+            try {
+                cache.buffers.push_back(std::move(buffer));
+                state.buffers_cached.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } catch (const std::bad_alloc &) {
+                // The buffer is unmapped by its owner instead.
+            }
+        }
+    }
+    state.bytes_cached.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void receive_buffer_pool::configure(
+    const receive_buffer_pool_options & options) noexcept {
+    auto & state = shared();
+    state.buffers_per_class.store(
+        options.buffers_per_class, std::memory_order_relaxed);
+    state.max_cached_bytes.store(
+        options.max_cached_bytes, std::memory_order_relaxed);
+    state.populate_buffers.store(
+        options.populate_buffers, std::memory_order_relaxed);
+}
+
+void receive_buffer_pool::trim() noexcept {
+    auto & state = shared();
+    for (auto & cache : state.caches) {
+        std::vector<buffer_t> released{};
+        {
+            std::scoped_lock guard{ cache.mtx };
+            std::swap(released, cache.buffers);
+        }
+        if (released.empty()) {
+            continue;
+        }
+        state.buffers_cached.fetch_sub(
+            released.size(), std::memory_order_relaxed);
+        state.bytes_cached.fetch_sub(released.size() *
+                                         released.front().total_size(),
+                                     std::memory_order_relaxed);
+    }
+}
+
+receive_buffer_pool_stats receive_buffer_pool::stats() noexcept {
+    const auto & state = shared();
+    return { .acquisitions = state.acquisitions.load(std::memory_order_relaxed),
+             .cache_hits = state.cache_hits.load(std::memory_order_relaxed),
+             .buffers_cached = state.buffers_cached.load(
+                 std::memory_order_relaxed),
+             .bytes_cached = state.bytes_cached.load(
+                 std::memory_order_relaxed) };
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,56 @@
+/******************************************************
+ * Periodic connection statistics sampler.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/macro>
+#include <mad/nexus/statistics_sampler.hpp>
+
+namespace mad::nexus {
+
+statistics_sampler::statistics_sampler(
+    const quic_server & srv, std::chrono::milliseconds period,
+    connection_statistics_callback_t callback) :
+    server(srv), interval(period), on_sample(callback),
+    worker([this](std::stop_token st) {
+        run(st);
+    }) {
+    MAD_EXPECTS(on_sample);
+    MAD_EXPECTS(interval.count() > 0);
+}
+
+statistics_sampler::~statistics_sampler() {
+    worker.request_stop();
+    worker.join();
+}
+
+std::size_t statistics_sampler::sample_now() {
+    std::size_t sampled = 0;
+    server.for_each_connection([&](connection & cctx) {
+        if (auto stats = server.statistics(cctx)) {
+            on_sample(cctx, stats.value());
+            sampled++;
+        }
+    });
+    return sampled;
+}
+
+void statistics_sampler::run(std::stop_token st) {
+    while (!st.stop_requested()) {
+        {
+            std::unique_lock<std::mutex> lock{ wait_mtx };
+            // Wakes up early only when the stop is requested.
+            wait_cv.wait_for(lock, st, interval, [] {
+                return false;
+            });
+        }
+
+        if (st.stop_requested()) {
+            break;
+        }
+        sample_now();
+    }
+}
+
+} // namespace mad::nexus
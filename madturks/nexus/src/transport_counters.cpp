@@ -0,0 +1,121 @@
+/******************************************************
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/transport_counters.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+using block = transport_counter_block;
+
+/******************************************************
+ * Process-wide part of the counters.
+ ******************************************************/
+struct shared_state {
+    shared_state() {
+        orphan.shared = true;
+    }
+
+    /******************************************************
+     * Blocks of the live threads, and the totals of the
+     * exited ones.
+     ******************************************************/
+    std::mutex registry_mtx;
+    std::vector<const block *> registry{};
+    std::array<std::uint64_t, block::k_counter_count> retired{};
+
+    /******************************************************
+     * Written by the threads that are past their
+     * thread_local destructors.
+     ******************************************************/
+    block orphan{};
+};
+
+shared_state & shared() noexcept {
+    // Intentionally leaked: the counters may be updated by
+    // threads that outlive the static destructors.
+    static auto * state = new shared_state{};
+    return *state;
+}
+
+/******************************************************
+ * Fold the block into the totals.
+ ******************************************************/
+void accumulate(std::array<std::uint64_t, block::k_counter_count> & totals,
+                const block & b) noexcept {
+    for (std::size_t i = 0; i < block::k_counter_count; i++) {
+        const auto value = b.values [i].load(std::memory_order_relaxed);
+        if (i == block::receive_buffer_high_water) {
+            totals [i] = std::max(totals [i], value);
+        } else {
+            totals [i] += value;
+        }
+    }
+}
+
+} // namespace
+
+/******************************************************
+ * Owns the calling thread's block.
+ ******************************************************/
+struct thread_block {
+    thread_block() {
+        auto & state = shared();
+        std::scoped_lock guard{ state.registry_mtx };
+        state.registry.push_back(&counters);
+    }
+
+    ~thread_block() {
+        auto & state = shared();
+        {
+            std::scoped_lock guard{ state.registry_mtx };
+            std::erase(state.registry, &counters);
+            accumulate(state.retired, counters);
+        }
+        transport_counter_recorder::local_block = &state.orphan;
+    }
+
+    block counters{};
+};
+
+auto transport_counter_recorder::attach() noexcept -> block & {
+    thread_local thread_block owner{};
+    local_block = &owner.counters;
+    return owner.counters;
+}
+
+transport_counters transport_counters::read() noexcept {
+    auto & state = shared();
+    std::array<std::uint64_t, block::k_counter_count> totals{};
+    {
+        std::scoped_lock guard{ state.registry_mtx };
+        totals = state.retired;
+        for (const auto * b : state.registry) {
+            accumulate(totals, *b);
+        }
+    }
+    accumulate(totals, state.orphan);
+
+    const auto sent = totals [block::messages_sent];
+    const auto completed = totals [block::sends_completed];
+
+    return transport_counters{
+        .messages_sent = sent,
+        .bytes_sent = totals [block::bytes_sent],
+        .messages_received = totals [block::messages_received],
+        .bytes_received = totals [block::bytes_received],
+        // A completion may be observed before its send.
+        .sends_in_flight = sent > completed ? sent - completed : 0,
+        .receive_buffer_high_water = totals [block::receive_buffer_high_water],
+        .framing_errors = totals [block::framing_errors]
+    };
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,128 @@
+/******************************************************
+ * buffer_pool benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/buffer_pool.hpp>
+
+#include <benchmark/benchmark.h>
+#include <flatbuffers/flatbuffer_builder.h>
+
+#include <array>
+#include <string>
+
+namespace mad::nexus {
+
+struct heap_alloc {
+    static std::uint8_t * allocate(std::size_t size) {
+        return new std::uint8_t [size];
+    }
+
+    static void deallocate(std::uint8_t * p) {
+        delete [] p;
+    }
+};
+
+struct pool_alloc {
+    static std::uint8_t * allocate(std::size_t size) {
+        return buffer_pool::allocate(size);
+    }
+
+    static void deallocate(std::uint8_t * p) {
+        buffer_pool::deallocate(p);
+    }
+};
+
+static void report_pool_stats(benchmark::State & st,
+                              const buffer_pool_stats & before) {
+    const auto after = buffer_pool::stats();
+    buffer_pool_stats delta{ .allocations = after.allocations -
+                                            before.allocations,
+                             .cache_hits = after.cache_hits -
+                                           before.cache_hits };
+    st.counters ["hit_rate"] = delta.hit_rate();
+    st.counters ["bytes_cached"] = static_cast<double>(after.bytes_cached);
+}
+
+/******************************************************
+ * Allocate and release a window of blocks.
+ *
+ * Args: block size
+ ******************************************************/
+template <typename Alloc>
+static void alloc_free(benchmark::State & st) {
+    constexpr std::size_t kWindow = 32;
+    const auto size = static_cast<std::size_t>(st.range(0));
+    std::array<std::uint8_t *, kWindow> blocks{};
+    const auto before = buffer_pool::stats();
+
+    for (auto _ : st) {
+        for (auto & b : blocks) {
+            b = Alloc::allocate(size);
+            benchmark::DoNotOptimize(b);
+        }
+        for (auto b : blocks) {
+            Alloc::deallocate(b);
+        }
+    }
+    st.SetItemsProcessed(
+        static_cast<std::int64_t>(st.iterations() * kWindow));
+    report_pool_stats(st, before);
+}
+
+/******************************************************
+ * Build a message and release it, the way build_message
+ * and the send completion do.
+ *
+ * Args: builder initial size, payload size
+ ******************************************************/
+template <bool Pooled>
+static void build_release(benchmark::State & st) {
+    const auto initial_size = static_cast<std::size_t>(st.range(0));
+    const std::string payload(static_cast<std::size_t>(st.range(1)), 'x');
+    ::flatbuffers::FlatBufferBuilder fbb(
+        initial_size, Pooled ? &buffer_pool::allocator() : nullptr);
+    const auto before = buffer_pool::stats();
+
+    for (auto _ : st) {
+        fbb.Finish(fbb.CreateString(payload));
+        std::size_t size{ 0 }, offset{ 0 };
+        auto raw = fbb.ReleaseRaw(size, offset);
+        benchmark::DoNotOptimize(raw);
+        if constexpr (Pooled) {
+            buffer_pool::deallocate(raw);
+        } else {
+            ::flatbuffers::DefaultAllocator::dealloc(raw, size);
+        }
+        fbb.Clear();
+    }
+    st.SetItemsProcessed(static_cast<std::int64_t>(st.iterations()));
+    report_pool_stats(st, before);
+}
+
+BENCHMARK_TEMPLATE(alloc_free, heap_alloc)
+    ->Name("alloc_free/heap")
+    ->ArgName("size")
+    ->RangeMultiplier(8)
+    ->Range(64, 256 * 1024);
+BENCHMARK_TEMPLATE(alloc_free, pool_alloc)
+    ->Name("alloc_free/pool")
+    ->ArgName("size")
+    ->RangeMultiplier(8)
+    ->Range(64, 256 * 1024);
+
+BENCHMARK_TEMPLATE(build_release, false)
+    ->Name("build_release/default_allocator")
+    ->ArgNames({ "initial", "payload" })
+    ->Args({ 1024 * 1024, 64 })
+    ->Args({ 1024 * 1024, 4096 })
+    ->Args({ 1024, 64 })
+    ->Args({ 1024, 4096 });
+BENCHMARK_TEMPLATE(build_release, true)
+    ->Name("build_release/buffer_pool")
+    ->ArgNames({ "initial", "payload" })
+    ->Args({ 1024, 64 })
+    ->Args({ 1024, 4096 });
+
+} // namespace mad::nexus
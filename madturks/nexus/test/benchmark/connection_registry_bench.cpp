@@ -0,0 +1,161 @@
+/******************************************************
+ * Connection registry benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/concurrent.hpp>
+#include <mad/nexus/connection_registry.hpp>
+#include <mad/nexus/quic_connection.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * A set of connections, and a background thread that
+ * keeps disconnecting and reconnecting them, like the
+ * msquic worker threads would.
+ ******************************************************/
+template <typename Store>
+struct churn_fixture {
+    explicit churn_fixture(std::size_t connection_count) {
+        for (std::size_t i = 0; i < connection_count; i++) {
+            auto & cctx = connections.emplace_back(
+                reinterpret_cast<void *>(i + 1), nullptr);
+            store.insert(cctx);
+        }
+    }
+
+    void start_churn() {
+        churn = std::jthread{ [this](std::stop_token st) {
+            std::size_t i = 0;
+            while (!st.stop_requested()) {
+                auto & cctx = connections [i++ % connections.size()];
+                const auto begin = std::chrono::steady_clock::now();
+                store.remove(cctx);
+                store.insert(cctx);
+                const auto elapsed = std::chrono::steady_clock::now() - begin;
+                const auto ns = static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        elapsed)
+                        .count());
+                writes.fetch_add(1, std::memory_order_relaxed);
+                if (ns > max_write_ns.load(std::memory_order_relaxed)) {
+                    max_write_ns.store(ns, std::memory_order_relaxed);
+                }
+            }
+        } };
+    }
+
+    void report(benchmark::State & state) {
+        churn = {};
+        state.counters ["writes"] = benchmark::Counter(
+            static_cast<double>(writes.load()), benchmark::Counter::kIsRate);
+        state.counters ["max_write_us"] =
+            static_cast<double>(max_write_ns.load()) / 1000.0;
+    }
+
+    std::deque<connection> connections{};
+    Store store{};
+    std::atomic<std::uint64_t> writes{ 0 };
+    std::atomic<std::uint64_t> max_write_ns{ 0 };
+    std::jthread churn{};
+};
+
+/******************************************************
+ * What the sample server used to do: a map behind a
+ * read-write lock.
+ ******************************************************/
+struct locked_map {
+    void insert(connection & cctx) {
+        map.exclusive_access()->emplace(cctx.serial_number(), &cctx);
+    }
+
+    void remove(connection & cctx) {
+        map.exclusive_access()->erase(cctx.serial_number());
+    }
+
+    template <typename F>
+    void for_each_connection(F && fn) {
+        for (auto & [serial, cctx] : map.shared_access()) {
+            fn(*cctx);
+        }
+    }
+
+    mad::concurrent<std::unordered_map<std::uint64_t, connection *>> map{};
+};
+
+struct registry {
+    void insert(connection & cctx) {
+        [[maybe_unused]] auto r = impl.insert(cctx);
+    }
+
+    void remove(connection & cctx) {
+        [[maybe_unused]] auto r = impl.remove(cctx);
+    }
+
+    template <typename F>
+    void for_each_connection(F && fn) {
+        impl.for_each_connection(std::forward<F>(fn));
+    }
+
+    connection_registry impl{};
+};
+
+template <typename Store>
+void iterate_while_churning(benchmark::State & state) {
+    churn_fixture<Store> fixture{ static_cast<std::size_t>(state.range(0)) };
+    fixture.start_churn();
+
+    for (auto _ : state) {
+        std::uint64_t sum = 0;
+        fixture.store.for_each_connection([&](connection & cctx) {
+            sum += cctx.serial_number();
+        });
+        benchmark::DoNotOptimize(sum);
+    }
+
+    fixture.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+/******************************************************
+ * Walk all connections on the application thread while
+ * another thread connects and disconnects them.
+ *
+ * "writes" is the connect/disconnect rate the other
+ * thread could sustain meanwhile, "max_write_us" the
+ * longest time a connect/disconnect pair was stalled.
+ ******************************************************/
+static void iterate_locked_map(benchmark::State & state) {
+    iterate_while_churning<locked_map>(state);
+}
+
+static void iterate_registry(benchmark::State & state) {
+    iterate_while_churning<registry>(state);
+}
+
+BENCHMARK(iterate_locked_map)
+    ->Arg(1000)
+    ->Arg(50000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(iterate_registry)
+    ->Arg(1000)
+    ->Arg(50000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace mad::nexus
@@ -0,0 +1,117 @@
+/******************************************************
+ * frame_decoder benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/frame_decoder.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * Amount of frames in the decoded data.
+ ******************************************************/
+constexpr std::size_t k_frame_count = 1024;
+
+/******************************************************
+ * k_frame_count back-to-back frames of @p size bytes.
+ ******************************************************/
+std::vector<std::uint8_t> make_frames(std::uint32_t size) {
+    std::vector<std::uint8_t> data{};
+    data.reserve(k_frame_count * (k_frame_prefix_size + size));
+    for (std::size_t i = 0; i < k_frame_count; i++) {
+        std::uint8_t prefix [k_frame_prefix_size];
+        std::memcpy(prefix, &size, sizeof(prefix));
+        data.insert(data.end(), std::begin(prefix), std::end(prefix));
+        data.insert(data.end(), size, static_cast<std::uint8_t>(i));
+    }
+    return data;
+}
+
+} // namespace
+
+/******************************************************
+ * The framing loop frame_decoder replaces: one frame per
+ * iteration, re-slicing the span for every frame.
+ *
+ * Args: frame payload size
+ ******************************************************/
+static void frame_decode_per_frame(benchmark::State & state) {
+    const auto data = make_frames(static_cast<std::uint32_t>(state.range(0)));
+
+    for (auto _ : state) {
+        std::span<const std::uint8_t> rest{ data };
+        while (rest.size() >= k_frame_prefix_size) {
+            const std::uint32_t size = read_frame_size(rest.data());
+            if ((rest.size() - k_frame_prefix_size) < size) {
+                break;
+            }
+            auto frame = rest.subspan(k_frame_prefix_size, size);
+            benchmark::DoNotOptimize(frame);
+            rest = rest.subspan(k_frame_prefix_size + size);
+        }
+        benchmark::DoNotOptimize(rest);
+    }
+
+    state.SetItemsProcessed(
+        static_cast<std::int64_t>(state.iterations() * k_frame_count));
+    state.SetBytesProcessed(
+        static_cast<std::int64_t>(state.iterations() * data.size()));
+}
+
+/******************************************************
+ * frame_decoder, decoding Capacity frames per call.
+ *
+ * Args: frame payload size
+ ******************************************************/
+template <std::size_t Capacity>
+static void frame_decode_batch(benchmark::State & state) {
+    const auto data = make_frames(static_cast<std::uint32_t>(state.range(0)));
+    frame_decoder<Capacity> decoder{};
+
+    for (auto _ : state) {
+        std::span<const std::uint8_t> rest{ data };
+        do {
+            rest = decoder.decode(rest);
+            for (auto frame : decoder.frames()) {
+                benchmark::DoNotOptimize(frame);
+            }
+        } while (decoder.full());
+        benchmark::DoNotOptimize(rest);
+    }
+
+    state.SetItemsProcessed(
+        static_cast<std::int64_t>(state.iterations() * k_frame_count));
+    state.SetBytesProcessed(
+        static_cast<std::int64_t>(state.iterations() * data.size()));
+}
+
+BENCHMARK(frame_decode_per_frame)
+    ->ArgName("size")
+    ->Arg(0)
+    ->Arg(8)
+    ->Arg(64)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(frame_decode_batch, 16)
+    ->ArgName("size")
+    ->Arg(0)
+    ->Arg(8)
+    ->Arg(64)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(frame_decode_batch, 64)
+    ->ArgName("size")
+    ->Arg(0)
+    ->Arg(8)
+    ->Arg(64)
+    ->Arg(1024);
+
+} // namespace mad::nexus
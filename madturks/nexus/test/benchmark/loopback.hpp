@@ -0,0 +1,230 @@
+/******************************************************
+ * Loopback server/client pair for the nexus benchmarks.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#pragma once
+
+#include <mad/nexus/buffer_pool.hpp>
+#include <mad/nexus/quic.hpp>
+#include <mad/nexus/quic_application.hpp>
+#include <mad/nexus/quic_client.hpp>
+#include <mad/nexus/quic_configuration.hpp>
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/quic_server.hpp>
+#include <mad/nexus/send_buffer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef NEXUS_TEST_CERT_DIR
+#define NEXUS_TEST_CERT_DIR "/workspaces/nexus/vendor/msquic/test-cert"
+#endif
+
+namespace mad::nexus {
+
+/******************************************************
+ * A server and its clients connected over the loopback
+ * interface, in the same process.
+ *
+ * The server opens the streams, and the clients receive
+ * the data through the on_client_data callback. The data
+ * callback is invoked on the msquic worker threads.
+ ******************************************************/
+struct loopback {
+
+    /******************************************************
+     * Loopback options.
+     ******************************************************/
+    struct options {
+        /******************************************************
+         * The UDP port the server listens on.
+         ******************************************************/
+        std::uint16_t port{ 16666 };
+
+        /******************************************************
+         * Amount of streams the server may open to a client.
+         ******************************************************/
+        std::uint16_t stream_count{ 1 };
+
+        /******************************************************
+         * Amount of clients, each with its own connection.
+         ******************************************************/
+        std::uint16_t connection_count{ 1 };
+
+        /******************************************************
+         * The clients' stream receive window, in bytes.
+         ******************************************************/
+        std::uint32_t receive_window{ 1024 * 1024 };
+
+        /******************************************************
+         * Invoked with each message the clients receive.
+         ******************************************************/
+        stream_data_callback_t on_client_data{};
+    };
+
+    explicit loopback(options opts) {
+        auto server_cfg = make_configuration(e_role::server, opts);
+        auto client_cfg = make_configuration(e_role::client, opts);
+        // The client accepts the streams opened by the server.
+        client_cfg.peer_stream_count = opts.stream_count;
+        client_cfg.stream_receive_window = opts.receive_window;
+
+        auto server_app = make_quic_application(server_cfg);
+        auto client_app = make_quic_application(client_cfg);
+        if (!server_app || !client_app) {
+            return;
+        }
+        server_application = std::move(server_app.value());
+        client_application = std::move(client_app.value());
+
+        auto srv = server_application->make_server();
+        if (!srv) {
+            return;
+        }
+        server = std::move(srv.value());
+
+        using enum callback_type;
+        server->register_callback<connected>(&on_server_connected, this);
+        server->register_callback<disconnected>(&on_ignored_connection,
+                                                nullptr);
+        server->register_callback<stream_start>(&on_ignored_stream, nullptr);
+        server->register_callback<stream_end>(&on_ignored_stream, nullptr);
+
+        if (!server->listen(server_cfg.alpn, opts.port)) {
+            return;
+        }
+
+        for (std::uint16_t i = 0; i < opts.connection_count; i++) {
+            auto cl = client_application->make_client();
+            if (!cl) {
+                return;
+            }
+            auto & client = *clients.emplace_back(std::move(cl.value()));
+            client.register_callback<connected>(&on_ignored_connection,
+                                                nullptr);
+            client.register_callback<disconnected>(&on_ignored_connection,
+                                                   nullptr);
+            client.register_callback<stream_start>(&on_ignored_stream,
+                                                   nullptr);
+            client.register_callback<stream_end>(&on_ignored_stream, nullptr);
+            client.register_callback<stream_data>(opts.on_client_data);
+
+            if (!client.connect("127.0.0.1", opts.port)) {
+                return;
+            }
+        }
+
+        // Wait for the handshakes.
+        expected_connections = opts.connection_count;
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::seconds{ 5 };
+        while (!this->connected() &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+    }
+
+    ~loopback() {
+        for (auto & client : clients) {
+            [[maybe_unused]] auto r = client->disconnect();
+        }
+        clients.clear();
+        server.reset();
+    }
+
+    loopback(const loopback &) = delete;
+    loopback & operator=(const loopback &) = delete;
+
+    /******************************************************
+     * Whether all clients are connected to the server.
+     ******************************************************/
+    bool connected() const noexcept {
+        return expected_connections > 0 &&
+               connection_count.load(std::memory_order_acquire) ==
+                   expected_connections;
+    }
+
+    /******************************************************
+     * The server side of the connection to the client at
+     * @p index, in the order the handshakes completed.
+     ******************************************************/
+    connection & connection_to_client(std::size_t index = 0) const {
+        std::scoped_lock guard{ connections_mtx };
+        return *server_connections.at(index);
+    }
+
+    /******************************************************
+     * Allocate a message of @p payload_size bytes, in the
+     * layout build_message produces.
+     ******************************************************/
+    static send_buffer<true> make_message(std::uint32_t payload_size) {
+        constexpr auto kTailSize = sizeof(send_buffer<true>::quic_buf_sentinel);
+        const std::size_t alloc_size = sizeof(std::uint32_t) + payload_size +
+                                       kTailSize;
+
+        send_buffer<true> buf;
+        buf.buf = buffer_pool::allocate(alloc_size);
+        buf.buf_size = alloc_size;
+        buf.offset = 0;
+        std::memcpy(buf.buf, &payload_size, sizeof(std::uint32_t));
+        std::memset(buf.buf + sizeof(std::uint32_t), 0, payload_size);
+        std::memcpy(buf.buf + alloc_size - kTailSize,
+                    send_buffer<true>::quic_buf_sentinel, kTailSize);
+        return buf;
+    }
+
+    /******************************************************
+     * The payload part of a message made by make_message.
+     ******************************************************/
+    static std::span<std::uint8_t> payload_of(send_buffer<true> & buf) {
+        return { buf.buf + buf.offset + sizeof(std::uint32_t),
+                 buf.encoded_data_size() };
+    }
+
+    std::unique_ptr<quic_application> server_application{};
+    std::unique_ptr<quic_application> client_application{};
+    std::unique_ptr<quic_server> server{};
+    std::vector<std::unique_ptr<quic_client>> clients{};
+
+private:
+    static quic_configuration make_configuration(e_role role,
+                                                 const options & opts) {
+        quic_configuration cfg{ e_quic_impl_type::msquic, role };
+        cfg.alpn = "nexus-bench";
+        cfg.appname = "nexus-bench";
+        cfg.credentials.certificate_path = NEXUS_TEST_CERT_DIR "/server.cert";
+        cfg.credentials.private_key_path = NEXUS_TEST_CERT_DIR "/server.key";
+        cfg.idle_timeout = std::chrono::milliseconds{ 10000 };
+        cfg.udp_port_number = opts.port;
+        return cfg;
+    }
+
+    static void on_server_connected(void * uptr, connection & cctx) {
+        auto & self = *static_cast<loopback *>(uptr);
+        std::scoped_lock guard{ self.connections_mtx };
+        self.server_connections.push_back(&cctx);
+        self.connection_count.store(
+            self.server_connections.size(), std::memory_order_release);
+    }
+
+    static void on_ignored_connection(void *, connection &) {}
+
+    static void on_ignored_stream(void *, stream &) {}
+
+    mutable std::mutex connections_mtx{};
+    std::vector<connection *> server_connections{};
+    std::atomic<std::size_t> connection_count{ 0 };
+    std::size_t expected_connections{ 0 };
+};
+
+} // namespace mad::nexus
@@ -0,0 +1,209 @@
+/******************************************************
+ * Loopback end-to-end throughput and latency benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/quic_stream.hpp>
+#include <mad/nexus/schemas/main_generated.h>
+
+#include <benchmark/benchmark.h>
+#include <flatbuffers/flatbuffer_builder.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loopback.hpp"
+
+namespace mad::nexus {
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+/******************************************************
+ * Maximum amount of message bytes sent but not yet
+ * received. Keeps the connections saturated without
+ * growing the send queues unbounded.
+ ******************************************************/
+constexpr std::uint64_t k_send_window = 4 * 1024 * 1024;
+
+/******************************************************
+ * Maximum amount of latency samples kept per run.
+ ******************************************************/
+constexpr std::size_t k_max_samples = 1024 * 1024;
+
+struct e2e_fixture {
+    std::atomic<std::uint64_t> received_messages{ 0 };
+    std::atomic<std::uint64_t> received_bytes{ 0 };
+    std::atomic<std::size_t> sample_count{ 0 };
+    std::vector<std::int64_t> latencies = std::vector<std::int64_t>(
+        k_max_samples);
+
+    /******************************************************
+     * Invoked on the msquic worker threads of the clients.
+     ******************************************************/
+    static std::size_t on_data(void * uptr, std::span<const std::uint8_t> data) {
+        auto & self = *static_cast<e2e_fixture *>(uptr);
+        const auto now_ns = bench_clock::now().time_since_epoch().count();
+
+        const auto * envelope = mad::schemas::GetEnvelope(data.data());
+        const auto * chat = envelope->message_as_Chat();
+        if (nullptr != chat) {
+            const auto idx = self.sample_count.fetch_add(
+                1, std::memory_order_relaxed);
+            if (idx < k_max_samples) {
+                self.latencies [idx] = now_ns -
+                                       static_cast<std::int64_t>(
+                                           chat->timestamp());
+            }
+        }
+        self.received_bytes.fetch_add(data.size(), std::memory_order_relaxed);
+        self.received_messages.fetch_add(1, std::memory_order_release);
+        return 0;
+    }
+
+    /******************************************************
+     * A chat message with a @p text of the payload size,
+     * stamped with the send time.
+     ******************************************************/
+    static send_buffer<true> make(const std::string & text) {
+        return quic_base::build_message(
+            [&](::flatbuffers::FlatBufferBuilder & fbb) {
+                auto message = fbb.CreateString(text);
+                mad::schemas::ChatBuilder cb{ fbb };
+                cb.add_message(message);
+                cb.add_timestamp(static_cast<std::uint64_t>(
+                    bench_clock::now().time_since_epoch().count()));
+                auto chat = cb.Finish();
+                mad::schemas::EnvelopeBuilder env{ fbb };
+                env.add_message(chat.Union());
+                env.add_message_type(mad::schemas::Message::Chat);
+                return env.Finish();
+            });
+    }
+
+    /******************************************************
+     * The latency samples, sorted.
+     ******************************************************/
+    std::vector<std::int64_t> sorted_latencies() {
+        const auto count = std::min(
+            sample_count.load(std::memory_order_acquire), k_max_samples);
+        std::vector<std::int64_t> result(
+            latencies.begin(),
+            latencies.begin() + static_cast<std::ptrdiff_t>(count));
+        std::ranges::sort(result);
+        return result;
+    }
+};
+
+double percentile(const std::vector<std::int64_t> & sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto idx = static_cast<std::size_t>(
+        p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted [idx]) / 1000.0;
+}
+
+} // namespace
+
+/******************************************************
+ * Stream flatbuffers messages from the server to its
+ * clients over 127.0.0.1, round-robin over all streams
+ * of all connections, as fast as the send window allows.
+ *
+ * Covers the whole send and receive path, from
+ * msquic_base::send to StreamCallbackReceive and the
+ * data callback. Reports the messages/s, the bytes/s
+ * (including the framing) and the one-way latency
+ * percentiles in microseconds.
+ *
+ * Args: message payload size, streams per connection,
+ * connection count
+ *
+ * Needs a working msquic runtime and the test certificate.
+ ******************************************************/
+static void loopback_stream(benchmark::State & state) {
+    const auto message_size = static_cast<std::size_t>(state.range(0));
+    const auto stream_count = static_cast<std::uint16_t>(state.range(1));
+    const auto connection_count = static_cast<std::uint16_t>(state.range(2));
+
+    e2e_fixture fixture{};
+    loopback lb{ loopback::options{
+        .port = 16669,
+        .stream_count = stream_count,
+        .connection_count = connection_count,
+        .receive_window = 4 * 1024 * 1024,
+        .on_client_data =
+            stream_data_callback_t{ &e2e_fixture::on_data, &fixture },
+    } };
+
+    if (!lb.connected()) {
+        state.SkipWithError("loopback connection could not be established");
+        return;
+    }
+
+    auto & server = *lb.server;
+    std::vector<std::reference_wrapper<stream>> streams{};
+    for (std::uint16_t c = 0; c < connection_count; c++) {
+        auto & conn = lb.connection_to_client(c);
+        for (std::uint16_t i = 0; i < stream_count; i++) {
+            auto s = server.open_stream(conn);
+            if (!s) {
+                state.SkipWithError("streams could not be opened");
+                return;
+            }
+            streams.push_back(s.value());
+        }
+    }
+
+    const std::string text(message_size, 'x');
+    std::uint64_t sent_messages = 0;
+    std::uint64_t sent_bytes = 0;
+
+    for (auto _ : state) {
+        while (sent_bytes - fixture.received_bytes.load(
+                                std::memory_order_relaxed) >=
+               k_send_window) {
+            std::this_thread::yield();
+        }
+        auto buf = e2e_fixture::make(text);
+        // The received bytes do not include the size prefix.
+        const auto size = buf.data_span().size_bytes() - sizeof(std::uint32_t);
+        auto & sctx = streams [sent_messages % streams.size()].get();
+        if (!server.send(sctx, std::move(buf))) {
+            state.SkipWithError("send failed");
+            break;
+        }
+        sent_messages++;
+        sent_bytes += size;
+    }
+
+    // Let the messages in the send window arrive.
+    const auto deadline = bench_clock::now() + std::chrono::seconds{ 5 };
+    while (fixture.received_messages.load(std::memory_order_acquire) <
+               sent_messages &&
+           bench_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+
+    const auto latencies = fixture.sorted_latencies();
+    state.SetItemsProcessed(static_cast<std::int64_t>(sent_messages));
+    state.SetBytesProcessed(static_cast<std::int64_t>(
+        sent_bytes + sent_messages * sizeof(std::uint32_t)));
+    state.counters ["p50_us"] = percentile(latencies, 0.50);
+    state.counters ["p99_us"] = percentile(latencies, 0.99);
+    state.counters ["p999_us"] = percentile(latencies, 0.999);
+}
+
+BENCHMARK(loopback_stream)
+    ->ArgNames({ "msg_size", "streams", "connections" })
+    ->ArgsProduct({ { 64, 1024, 16 * 1024 }, { 1, 4 }, { 1, 4 } })
+    ->UseRealTime();
+
+} // namespace mad::nexus
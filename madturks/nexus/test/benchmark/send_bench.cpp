@@ -0,0 +1,208 @@
+/******************************************************
+ * Stream send path benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/send_buffer.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "stub_msquic_application.hpp"
+
+namespace mad::nexus {
+
+/******************************************************
+ * Allocate a send buffer in the layout build_message
+ * produces, carrying @p payload_size bytes of payload.
+ ******************************************************/
+static send_buffer<true> make_send_buffer(std::uint32_t payload_size) {
+    constexpr auto kTailSize = sizeof(send_buffer<true>::quic_buf_sentinel);
+    const std::size_t alloc_size = kTailSize + sizeof(std::uint32_t) +
+                                   payload_size;
+
+    send_buffer<true> buf;
+    buf.buf = buffer_pool::allocate(alloc_size);
+    buf.buf_size = alloc_size;
+    buf.offset = 0;
+    std::memcpy(buf.buf, &payload_size, sizeof(std::uint32_t));
+    std::memset(buf.buf + sizeof(std::uint32_t), 0xAB, payload_size);
+    std::memcpy(buf.buf + alloc_size - kTailSize,
+                send_buffer<true>::quic_buf_sentinel, kTailSize);
+    return buf;
+}
+
+struct send_fixture : public benchmark::Fixture {
+    void SetUp(const ::benchmark::State &) override {
+        stub_msquic_application::stats = {};
+        uut.register_callback<callback_type::stream_start>(
+            +[](void *, stream &) {
+            },
+            nullptr);
+        uut.register_callback<callback_type::stream_end>(
+            +[](void *, stream &) {
+            },
+            nullptr);
+        sctx = &uut.open_stream(cctx).value().get();
+    }
+
+    void TearDown(const ::benchmark::State &) override {
+        [[maybe_unused]] auto r = uut.close_stream(*sctx);
+        sctx = nullptr;
+    }
+
+    void report(benchmark::State & st, std::size_t batch_size) {
+        const auto messages = st.iterations() * batch_size;
+        const auto & stats = stub_msquic_application::stats;
+        st.SetItemsProcessed(static_cast<std::int64_t>(messages));
+        st.counters ["send_calls/msg"] = static_cast<double>(
+                                             stats.stream_send_calls) /
+                                         static_cast<double>(messages);
+        st.counters ["completions/msg"] = static_cast<double>(
+                                              stats.send_completions) /
+                                          static_cast<double>(messages);
+    }
+
+    static constexpr std::uint32_t kPayloadSize = 64;
+    static constexpr std::size_t kEventSize = 512;
+
+    stub_msquic_application app{};
+    bench_msquic_base uut{ app };
+    connection cctx{ reinterpret_cast<void *>(0xDEADC0DE) };
+    stream * sctx{ nullptr };
+};
+
+/******************************************************
+ * One send() call per message.
+ *
+ * Args: batch size
+ ******************************************************/
+BENCHMARK_DEFINE_F(send_fixture, individual)(benchmark::State & st) {
+    const auto batch_size = static_cast<std::size_t>(st.range(0));
+
+    for (auto _ : st) {
+        for (std::size_t i = 0; i < batch_size; i++) {
+            benchmark::DoNotOptimize(
+                uut.send(*sctx, make_send_buffer(kPayloadSize)));
+        }
+    }
+    report(st, batch_size);
+}
+
+/******************************************************
+ * One gather send() call per batch.
+ *
+ * Args: batch size
+ ******************************************************/
+BENCHMARK_DEFINE_F(send_fixture, gather)(benchmark::State & st) {
+    const auto batch_size = static_cast<std::size_t>(st.range(0));
+    std::vector<send_buffer<true>> bufs{};
+    bufs.reserve(batch_size);
+
+    for (auto _ : st) {
+        for (std::size_t i = 0; i < batch_size; i++) {
+            bufs.emplace_back(make_send_buffer(kPayloadSize));
+        }
+        benchmark::DoNotOptimize(uut.send(*sctx, bufs));
+        bufs.clear();
+    }
+    report(st, batch_size);
+}
+
+/******************************************************
+ * send() calls queued by the send coalescing, and sent
+ * by one flush() per batch, as a server tick would.
+ *
+ * Args: batch size
+ ******************************************************/
+BENCHMARK_DEFINE_F(send_fixture, coalesced)(benchmark::State & st) {
+    const auto batch_size = static_cast<std::size_t>(st.range(0));
+    uut.set_send_coalescing(true);
+
+    for (auto _ : st) {
+        for (std::size_t i = 0; i < batch_size; i++) {
+            benchmark::DoNotOptimize(
+                uut.send(*sctx, make_send_buffer(kPayloadSize)));
+        }
+        benchmark::DoNotOptimize(uut.flush(cctx));
+    }
+    uut.set_send_coalescing(false);
+    report(st, batch_size);
+}
+
+/******************************************************
+ * Build a flatbuffers message carrying @p payload.
+ ******************************************************/
+static send_buffer<true> build_event(const std::string & payload) {
+    return quic_base::build_message(
+        [&](::flatbuffers::FlatBufferBuilder & fbb) {
+            return fbb.CreateString(payload);
+        });
+}
+
+/******************************************************
+ * Send the same event to N streams by building it once
+ * per stream.
+ *
+ * Args: stream count
+ ******************************************************/
+BENCHMARK_DEFINE_F(send_fixture, fanout_build_each)(benchmark::State & st) {
+    const auto stream_count = static_cast<std::size_t>(st.range(0));
+    const std::string payload(kEventSize, 'x');
+
+    for (auto _ : st) {
+        for (std::size_t i = 0; i < stream_count; i++) {
+            benchmark::DoNotOptimize(uut.send(*sctx, build_event(payload)));
+        }
+    }
+    report(st, stream_count);
+}
+
+/******************************************************
+ * Send the same event to N streams by building it once
+ * and broadcasting it.
+ *
+ * Args: stream count
+ ******************************************************/
+BENCHMARK_DEFINE_F(send_fixture, fanout_broadcast)(benchmark::State & st) {
+    const auto stream_count = static_cast<std::size_t>(st.range(0));
+    const std::string payload(kEventSize, 'x');
+    const std::vector<std::reference_wrapper<stream>> streams(stream_count,
+                                                              *sctx);
+
+    for (auto _ : st) {
+        shared_send_buffer buf{ build_event(payload) };
+        benchmark::DoNotOptimize(uut.broadcast(streams, buf));
+    }
+    report(st, stream_count);
+}
+
+BENCHMARK_REGISTER_F(send_fixture, individual)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 64);
+BENCHMARK_REGISTER_F(send_fixture, gather)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 64);
+BENCHMARK_REGISTER_F(send_fixture, coalesced)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 64);
+
+BENCHMARK_REGISTER_F(send_fixture, fanout_build_each)
+    ->ArgName("streams")
+    ->RangeMultiplier(8)
+    ->Range(1, 4096);
+BENCHMARK_REGISTER_F(send_fixture, fanout_broadcast)
+    ->ArgName("streams")
+    ->RangeMultiplier(8)
+    ->Range(1, 4096);
+
+} // namespace mad::nexus
@@ -0,0 +1,113 @@
+/******************************************************
+ * Tick-aligned send coalescing benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "loopback.hpp"
+
+namespace mad::nexus {
+
+namespace {
+
+constexpr std::uint32_t k_message_size = 64;
+constexpr std::uint16_t k_stream_count = 4;
+
+struct coalescing_fixture {
+    std::atomic<std::uint64_t> received{ 0 };
+
+    static std::size_t on_data(void * uptr, std::span<const std::uint8_t>) {
+        static_cast<coalescing_fixture *>(uptr)->received.fetch_add(
+            1, std::memory_order_release);
+        return 0;
+    }
+};
+
+} // namespace
+
+/******************************************************
+ * A server tick that sends a batch of small messages to
+ * each of the streams of a client, and waits until the
+ * client receives all of them.
+ *
+ * Reports the UDP packets and bytes per message.
+ *
+ * Args: coalescing (0: off, 1: on), messages per stream
+ *
+ * Needs a working msquic runtime and the test certificate.
+ ******************************************************/
+static void tick_send(benchmark::State & state) {
+    const bool coalescing = state.range(0) != 0;
+    const auto per_stream = static_cast<std::size_t>(state.range(1));
+
+    coalescing_fixture fixture{};
+    loopback lb{ loopback::options{
+        .port = 16668,
+        .stream_count = k_stream_count,
+        .on_client_data =
+            stream_data_callback_t{ &coalescing_fixture::on_data, &fixture },
+    } };
+
+    if (!lb.connected()) {
+        state.SkipWithError("loopback connection could not be established");
+        return;
+    }
+
+    auto & server = *lb.server;
+    auto & conn = lb.connection_to_client();
+    std::vector<std::reference_wrapper<stream>> streams{};
+    for (std::uint16_t i = 0; i < k_stream_count; i++) {
+        auto s = server.open_stream(conn);
+        if (!s) {
+            state.SkipWithError("streams could not be opened");
+            return;
+        }
+        streams.push_back(s.value());
+    }
+
+    server.set_send_coalescing(coalescing);
+    const auto before =
+        server.statistics(conn).value_or(connection_statistics{});
+    std::uint64_t expected = 0;
+
+    for (auto _ : state) {
+        for (stream & sctx : streams) {
+            for (std::size_t i = 0; i < per_stream; i++) {
+                if (!server.send(sctx, loopback::make_message(k_message_size))) {
+                    state.SkipWithError("send failed");
+                    return;
+                }
+            }
+        }
+        if (coalescing && !server.flush(conn)) {
+            state.SkipWithError("flush failed");
+            return;
+        }
+        expected += streams.size() * per_stream;
+        while (fixture.received.load(std::memory_order_acquire) < expected) {
+            std::this_thread::yield();
+        }
+    }
+
+    const auto after =
+        server.statistics(conn).value_or(connection_statistics{});
+    const auto messages = static_cast<double>(expected);
+    state.SetItemsProcessed(static_cast<std::int64_t>(expected));
+    state.counters ["packets/msg"] =
+        static_cast<double>(after.sent_packets - before.sent_packets) / messages;
+    state.counters ["udp_bytes/msg"] =
+        static_cast<double>(after.sent_bytes - before.sent_bytes) / messages;
+}
+
+BENCHMARK(tick_send)
+    ->ArgNames({ "coalescing", "per_stream" })
+    ->ArgsProduct({ { 0, 1 }, { 1, 8, 32 } })
+    ->UseRealTime();
+
+} // namespace mad::nexus
@@ -0,0 +1,149 @@
+/******************************************************
+ * Handle context storage churn benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/shared_ptr_raw_equal.hpp>
+#include <mad/nexus/shared_ptr_raw_hash.hpp>
+#include <mad/nexus/slot_map.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * Stand-in for a stream/connection context.
+ ******************************************************/
+struct fake_context {
+    void * handle;
+    std::array<std::uint64_t, 7> state{};
+};
+
+void * fake_handle(std::uintptr_t i) {
+    return reinterpret_cast<void *>((i + 1) * 64);
+}
+
+} // namespace
+
+/******************************************************
+ * The previous storage: handle contexts keyed by the
+ * handle's shared_ptr. A context is found by hashing the
+ * handle on every lookup and erase.
+ *
+ * Keeps range(0) contexts alive, and replaces the oldest
+ * one with a new one on each iteration.
+ ******************************************************/
+static void churn_unordered_map(benchmark::State & state) {
+    const auto live = static_cast<std::uintptr_t>(state.range(0));
+    std::unordered_map<std::shared_ptr<void>, fake_context,
+                       shared_ptr_raw_hash, shared_ptr_raw_equal>
+        map{};
+    std::deque<std::shared_ptr<void>> order{};
+    std::uintptr_t next = 0;
+
+    for (; next < live; next++) {
+        std::shared_ptr<void> h{ fake_handle(next), [](void *) {} };
+        map.emplace(h, fake_context{ .handle = h.get() });
+        order.push_back(std::move(h));
+    }
+
+    for (auto _ : state) {
+        std::shared_ptr<void> h{ fake_handle(next++), [](void *) {} };
+        auto [itr, ok] = map.emplace(h, fake_context{ .handle = h.get() });
+        benchmark::DoNotOptimize(itr);
+        order.push_back(std::move(h));
+
+        map.erase(order.front());
+        order.pop_front();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(churn_unordered_map)->RangeMultiplier(8)->Range(8, 4096);
+
+/******************************************************
+ * The slot_map storage: the context is erased by its key,
+ * without a lookup or a per-context allocation.
+ ******************************************************/
+static void churn_slot_map(benchmark::State & state) {
+    const auto live = static_cast<std::uintptr_t>(state.range(0));
+    slot_map<fake_context> map{};
+    std::deque<slot_key> order{};
+    std::uintptr_t next = 0;
+
+    for (; next < live; next++) {
+        order.push_back(
+            map.emplace(fake_context{ .handle = fake_handle(next) }).first);
+    }
+
+    for (auto _ : state) {
+        auto [key, value] =
+            map.emplace(fake_context{ .handle = fake_handle(next++) });
+        benchmark::DoNotOptimize(&value);
+        order.push_back(key);
+
+        map.erase(order.front());
+        order.pop_front();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(churn_slot_map)->RangeMultiplier(8)->Range(8, 4096);
+
+/******************************************************
+ * Looking up a context of an event: a hash lookup by the
+ * raw handle vs. the key carried in the event context.
+ ******************************************************/
+static void lookup_unordered_map(benchmark::State & state) {
+    const auto live = static_cast<std::uintptr_t>(state.range(0));
+    std::unordered_map<std::shared_ptr<void>, fake_context,
+                       shared_ptr_raw_hash, shared_ptr_raw_equal>
+        map{};
+    for (std::uintptr_t i = 0; i < live; i++) {
+        std::shared_ptr<void> h{ fake_handle(i), [](void *) {} };
+        map.emplace(h, fake_context{ .handle = h.get() });
+    }
+
+    std::uintptr_t i = 0;
+    for (auto _ : state) {
+        // Same as the previous find(void*): a non-owning shared_ptr.
+        const std::shared_ptr<void> h{ std::shared_ptr<void>{},
+                                       fake_handle(i++ % live) };
+        benchmark::DoNotOptimize(map.find(h));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(lookup_unordered_map)->RangeMultiplier(8)->Range(8, 4096);
+
+static void lookup_slot_map(benchmark::State & state) {
+    const auto live = static_cast<std::uintptr_t>(state.range(0));
+    slot_map<fake_context> map{};
+    std::vector<void *> contexts{};
+    for (std::uintptr_t i = 0; i < live; i++) {
+        contexts.push_back(
+            map.emplace(fake_context{ .handle = fake_handle(i) })
+                .first.to_context());
+    }
+
+    std::uintptr_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            map.get(slot_key::from_context(contexts [i++ % live])));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(lookup_slot_map)->RangeMultiplier(8)->Range(8, 4096);
+
+} // namespace mad::nexus
@@ -0,0 +1,125 @@
+/******************************************************
+ * Stream open and close benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/receive_buffer_pool.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "stub_msquic_application.hpp"
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * Enable or disable the receive buffer pool for the
+ * duration of a benchmark, and start it empty.
+ ******************************************************/
+struct pool_scope {
+    explicit pool_scope(bool enabled) {
+        receive_buffer_pool::configure(
+            { .buffers_per_class =
+                  enabled ? receive_buffer_pool_options{}.buffers_per_class
+                          : 0 });
+        receive_buffer_pool::trim();
+        before = receive_buffer_pool::stats();
+    }
+
+    ~pool_scope() {
+        receive_buffer_pool::configure(receive_buffer_pool_options{});
+        receive_buffer_pool::trim();
+    }
+
+    pool_scope(const pool_scope &) = delete;
+    pool_scope & operator=(const pool_scope &) = delete;
+
+    void report(benchmark::State & state, std::size_t streams) const {
+        const auto after = receive_buffer_pool::stats();
+        state.SetItemsProcessed(
+            static_cast<std::int64_t>(state.iterations() * streams));
+        state.counters ["pool_hit_rate"] =
+            receive_buffer_pool_stats{
+                .acquisitions = after.acquisitions - before.acquisitions,
+                .cache_hits = after.cache_hits - before.cache_hits }
+                .hit_rate();
+    }
+
+    receive_buffer_pool_stats before{};
+};
+
+} // namespace
+
+/******************************************************
+ * Open a stream and close it again, through msquic_base
+ * on top of the stub msquic API.
+ *
+ * Args: pool enabled (0/1)
+ ******************************************************/
+static void stream_open_close(benchmark::State & state) {
+    pool_scope pool{ state.range(0) != 0 };
+
+    stub_msquic_application app{};
+    bench_msquic_base uut{ app };
+    connection cctx{ reinterpret_cast<void *>(0xDEADC0DE) };
+    uut.register_callback<callback_type::stream_start>(
+        +[](void *, stream &) {
+        },
+        nullptr);
+    uut.register_callback<callback_type::stream_end>(
+        +[](void *, stream &) {
+        },
+        nullptr);
+
+    for (auto _ : state) {
+        auto sctx = uut.open_stream(cctx);
+        if (!sctx) {
+            state.SkipWithError("stream could not be opened");
+            break;
+        }
+        benchmark::DoNotOptimize(uut.close_stream(sctx->get()));
+    }
+    pool.report(state, 1);
+}
+
+BENCHMARK(stream_open_close)->ArgName("pool")->Arg(0)->Arg(1);
+
+/******************************************************
+ * A burst of streams created together and destroyed
+ * together, as in a login storm. Measures the stream
+ * object itself, along with its receive buffer.
+ *
+ * Args: pool enabled (0/1), streams per burst
+ ******************************************************/
+static void stream_burst(benchmark::State & state) {
+    pool_scope pool{ state.range(0) != 0 };
+    const auto burst = static_cast<std::size_t>(state.range(1));
+
+    connection cctx{ reinterpret_cast<void *>(0xDEADC0DE) };
+    std::vector<std::unique_ptr<stream>> streams{};
+    streams.reserve(burst);
+
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            auto & sctx = streams.emplace_back(std::make_unique<stream>(
+                reinterpret_cast<void *>(i + 1), cctx, stream_callbacks{}));
+            // The receive buffer is allocated on demand.
+            sctx->reserve_receive_buffer(sctx->receive_buffer_capacity());
+        }
+        benchmark::DoNotOptimize(streams.data());
+        streams.clear();
+    }
+    pool.report(state, burst);
+}
+
+BENCHMARK(stream_burst)
+    ->ArgNames({ "pool", "streams" })
+    ->ArgsProduct({ { 0, 1 }, { 16, 256 } });
+
+} // namespace mad::nexus
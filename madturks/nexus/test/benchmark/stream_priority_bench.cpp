@@ -0,0 +1,206 @@
+/******************************************************
+ * Stream priority tail latency benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/quic_stream.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "loopback.hpp"
+
+namespace mad::nexus {
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+/******************************************************
+ * Payload layout: [kind:1][send timestamp:8][filler].
+ ******************************************************/
+enum class message_kind : std::uint8_t
+{
+    bulk,
+    probe
+};
+
+constexpr std::uint32_t k_bulk_size = 16 * 1024;
+constexpr std::uint32_t k_probe_size = 64;
+
+/******************************************************
+ * Maximum amount of bulk bytes sent but not yet received.
+ * Keeps the connection saturated without growing the
+ * send queue unbounded.
+ ******************************************************/
+constexpr std::uint64_t k_bulk_window = 4 * 1024 * 1024;
+
+/******************************************************
+ * Benchmark modes, passed as the benchmark argument.
+ ******************************************************/
+enum class priority_mode : std::int64_t
+{
+    // Both streams at the same priority.
+    equal,
+    // The probe stream has a higher priority than the bulk.
+    high_priority,
+    // As above, and the probes are sent as urgent.
+    high_priority_urgent
+};
+
+struct priority_fixture {
+    std::atomic<std::uint64_t> bulk_received{ 0 };
+    std::atomic<std::uint64_t> probes_received{ 0 };
+    std::atomic<std::int64_t> last_probe_latency_ns{ 0 };
+
+    static std::size_t on_data(void * uptr, std::span<const std::uint8_t> data) {
+        auto & self = *static_cast<priority_fixture *>(uptr);
+        if (data.size() < 1 + sizeof(std::int64_t)) {
+            return 0;
+        }
+        if (static_cast<message_kind>(data [0]) == message_kind::bulk) {
+            self.bulk_received.fetch_add(data.size(),
+                                         std::memory_order_relaxed);
+            return 0;
+        }
+        std::int64_t sent_ns = 0;
+        std::memcpy(&sent_ns, data.data() + 1, sizeof(sent_ns));
+        const auto now_ns = bench_clock::now().time_since_epoch().count();
+        self.last_probe_latency_ns.store(now_ns - sent_ns,
+                                         std::memory_order_relaxed);
+        self.probes_received.fetch_add(1, std::memory_order_release);
+        return 0;
+    }
+
+    static send_buffer<true> make(message_kind kind, std::uint32_t size) {
+        auto buf = loopback::make_message(size);
+        auto payload = loopback::payload_of(buf);
+        payload [0] = static_cast<std::uint8_t>(kind);
+        const std::int64_t now_ns =
+            bench_clock::now().time_since_epoch().count();
+        std::memcpy(payload.data() + 1, &now_ns, sizeof(now_ns));
+        return buf;
+    }
+};
+
+double percentile(std::vector<std::int64_t> & sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto idx = static_cast<std::size_t>(
+        p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted [idx]) / 1000.0;
+}
+
+} // namespace
+
+/******************************************************
+ * Latency of a small probe message sent while another
+ * stream of the same connection is saturated with bulk
+ * data. Reports the percentiles in microseconds.
+ *
+ * Needs a working msquic runtime and the test certificate.
+ ******************************************************/
+static void probe_latency_under_bulk(benchmark::State & state) {
+    const auto mode = static_cast<priority_mode>(state.range(0));
+
+    priority_fixture fixture{};
+    loopback lb{ loopback::options{
+        .port = 16667,
+        .stream_count = 2,
+        .receive_window = 4 * 1024 * 1024,
+        .on_client_data =
+            stream_data_callback_t{ &priority_fixture::on_data, &fixture },
+    } };
+
+    if (!lb.connected()) {
+        state.SkipWithError("loopback connection could not be established");
+        return;
+    }
+
+    auto & server = *lb.server;
+    auto & conn = lb.connection_to_client();
+    const auto probe_priority = mode == priority_mode::equal
+                                    ? stream_priority_t{ 0 }
+                                    : stream_priority_t{ 0xFFFF };
+    const auto urgency = mode == priority_mode::high_priority_urgent
+                             ? send_urgency::urgent
+                             : send_urgency::normal;
+
+    auto bulk = server.open_stream(conn, std::nullopt, 0);
+    auto probe = server.open_stream(conn, std::nullopt, probe_priority);
+    if (!bulk || !probe) {
+        state.SkipWithError("streams could not be opened");
+        return;
+    }
+
+    std::atomic<bool> stop{ false };
+    std::uint64_t bulk_sent = 0;
+    std::thread bulk_sender{ [&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (bulk_sent - fixture.bulk_received.load(
+                                std::memory_order_relaxed) >=
+                k_bulk_window) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (!server.send(bulk->get(),
+                             priority_fixture::make(message_kind::bulk,
+                                                    k_bulk_size))) {
+                break;
+            }
+            bulk_sent += k_bulk_size;
+        }
+    } };
+
+    std::vector<std::int64_t> latencies{};
+    latencies.reserve(4096);
+
+    for (auto _ : state) {
+        const auto expected =
+            fixture.probes_received.load(std::memory_order_relaxed) + 1;
+        if (!server.send(probe->get(),
+                         priority_fixture::make(message_kind::probe,
+                                                k_probe_size),
+                         urgency)) {
+            state.SkipWithError("probe send failed");
+            break;
+        }
+        while (fixture.probes_received.load(std::memory_order_acquire) <
+               expected) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(
+            fixture.last_probe_latency_ns.load(std::memory_order_relaxed));
+    }
+
+    stop.store(true, std::memory_order_relaxed);
+    bulk_sender.join();
+
+    std::ranges::sort(latencies);
+    state.counters ["p50_us"] = percentile(latencies, 0.50);
+    state.counters ["p99_us"] = percentile(latencies, 0.99);
+    state.counters ["p999_us"] = percentile(latencies, 0.999);
+    state.counters ["max_us"] = percentile(latencies, 1.0);
+    state.counters ["bulk_MiB"] = static_cast<double>(
+        fixture.bulk_received.load(std::memory_order_relaxed) /
+        (1024.0 * 1024.0));
+}
+
+BENCHMARK(probe_latency_under_bulk)
+    ->ArgName("mode")
+    ->Arg(static_cast<std::int64_t>(priority_mode::equal))
+    ->Arg(static_cast<std::int64_t>(priority_mode::high_priority))
+    ->Arg(static_cast<std::int64_t>(priority_mode::high_priority_urgent))
+    ->Iterations(2000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace mad::nexus
@@ -0,0 +1,290 @@
+/******************************************************
+ * StreamCallbackReceive benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/callback.hpp>
+#include <mad/nexus/frame_decoder.hpp>
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/quic_stream.hpp>
+#include <mad/nexus/transport_counters.hpp>
+#include <mad/random_bytegen.hpp>
+
+#include <benchmark/benchmark.h>
+#include <msquic.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace mad::nexus {
+
+using receive_event = decltype(QUIC_STREAM_EVENT::RECEIVE);
+extern QUIC_STATUS StreamCallbackReceive(stream & sctx, receive_event & event);
+
+/**
+ * Length of the message size prefix.
+ */
+constexpr std::size_t k_size_prefix_len = sizeof(std::uint32_t);
+
+/**
+ * The largest message that fits into the default receive buffer of
+ * a stream.
+ */
+constexpr auto k_max_ring_frame = static_cast<std::int64_t>(32768 -
+                                                         k_size_prefix_len);
+
+/**
+ * Wire data for a batch of messages, split into QUIC_BUFFERs of
+ * `segment_size` bytes. A segment size of zero puts all data into
+ * a single QUIC_BUFFER.
+ */
+struct receive_payload {
+    receive_payload(std::size_t message_size, std::size_t message_count,
+                    std::size_t segment_size) {
+        std::vector<std::uint8_t> payload(message_size);
+        mad::random::bytegen(payload);
+        const auto size = static_cast<std::uint32_t>(message_size);
+
+        for (std::size_t i = 0; i < message_count; i++) {
+            std::uint8_t prefix [sizeof(std::uint32_t)];
+            std::memcpy(prefix, &size, sizeof(prefix));
+            storage.insert(storage.end(), std::begin(prefix),
+                           std::end(prefix));
+            storage.insert(storage.end(), payload.begin(), payload.end());
+        }
+
+        if (segment_size == 0) {
+            segment_size = storage.size();
+        }
+
+        for (std::size_t offset = 0; offset < storage.size();
+             offset += segment_size) {
+            const auto length = std::min(segment_size,
+                                         storage.size() - offset);
+            buffers.push_back(
+                QUIC_BUFFER{ .Length = static_cast<std::uint32_t>(length),
+                             .Buffer = storage.data() + offset });
+        }
+    }
+
+    receive_event event() {
+        return receive_event{ .AbsoluteOffset = 0,
+                              .TotalBufferLength = static_cast<std::uint64_t>(
+                                  storage.size()),
+                              .Buffers = buffers.data(),
+                              .BufferCount = static_cast<std::uint32_t>(
+                                  buffers.size()),
+                              .Flags = QUIC_RECEIVE_FLAG_NONE };
+    }
+
+    std::vector<std::uint8_t> storage{};
+    std::vector<QUIC_BUFFER> buffers{};
+};
+
+/**
+ * Reference receive implementation that copies all data.
+ *
+ * Every QUIC_BUFFER is copied into the stream's circular receive
+ * buffer before framing, regardless of whether it contains complete
+ * messages. The baseline StreamCallbackReceive is compared against.
+ */
+static QUIC_STATUS receive_buffered(stream & sctx, receive_event & event) {
+    auto & receive_buffer = sctx.rbuf();
+
+    // Everything is buffered here, so the buffer is needed up front.
+    if (!sctx.reserve_receive_buffer(k_frame_prefix_size)) {
+        return QUIC_STATUS_OUT_OF_MEMORY;
+    }
+
+    std::size_t buffer_offset = 0;
+
+    for (std::uint32_t buffer_idx = 0; buffer_idx < event.BufferCount;) {
+
+        const auto & received_data = event.Buffers [buffer_idx];
+
+        const auto pull_amount = std::min(
+            receive_buffer.empty_space(), received_data.Length - buffer_offset);
+
+        if (pull_amount == 0) {
+            return QUIC_STATUS_BUFFER_TOO_SMALL;
+        }
+        [[maybe_unused]] auto pull_r = receive_buffer.put(
+            received_data.Buffer + buffer_offset, pull_amount);
+        buffer_offset += pull_amount;
+
+        // Deliver all complete messages
+        for (auto available_span = receive_buffer.available_span();
+             available_span.size_bytes() >= k_frame_prefix_size;
+             available_span = receive_buffer.available_span()) {
+
+            const std::uint32_t size = read_frame_size(available_span.data());
+
+            if ((available_span.size_bytes() - k_frame_prefix_size) < size) {
+                break;
+            }
+
+            transport_counter_recorder::received(k_frame_prefix_size + size);
+            [[maybe_unused]] auto consumed_bytes =
+                sctx.callbacks.on_data_received(
+                    available_span.subspan(k_frame_prefix_size, size));
+            receive_buffer.mark_as_read(k_frame_prefix_size + size);
+        }
+
+        if (buffer_offset == received_data.Length) {
+            buffer_idx++;
+            buffer_offset = 0;
+        }
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
+static connection & bench_connection() {
+    static connection cctx{ nullptr };
+    return cctx;
+}
+
+static std::size_t count_message(void * uptr,
+                                 std::span<const std::uint8_t> buf) {
+    auto & bytes = *static_cast<std::size_t *>(uptr);
+    bytes += buf.size();
+    benchmark::DoNotOptimize(buf.data());
+    return 0;
+}
+
+/**
+ * Report the delivery rate, and the time spent per delivered message
+ * as `per_msg`.
+ */
+static void report_delivery(benchmark::State & st,
+                            std::size_t messages_per_event,
+                            std::size_t bytes_per_event) {
+    st.SetItemsProcessed(
+        static_cast<std::int64_t>(st.iterations() * messages_per_event));
+    st.SetBytesProcessed(
+        static_cast<std::int64_t>(st.iterations() * bytes_per_event));
+    st.counters ["per_msg"] = benchmark::Counter(
+        static_cast<double>(messages_per_event),
+        benchmark::Counter::kIsIterationInvariantRate |
+            benchmark::Counter::kInvert);
+}
+
+/**
+ * Args: message size, segment size (0 = single QUIC_BUFFER)
+ */
+template <auto ReceiveFn>
+static void stream_receive(benchmark::State & st) {
+    constexpr std::size_t kMessagesPerEvent = 64;
+    const auto message_size = static_cast<std::size_t>(st.range(0));
+    const auto segment_size = static_cast<std::size_t>(st.range(1));
+
+    receive_payload payload{ message_size, kMessagesPerEvent, segment_size };
+    std::size_t received_bytes = 0;
+    stream sctx{ nullptr, bench_connection(),
+                 stream_callbacks{
+                     .on_start = {},
+                     .on_close = {},
+                     .on_data_received = callback{ count_message,
+                                                   &received_bytes } } };
+
+    for (auto _ : st) {
+        auto evt = payload.event();
+        benchmark::DoNotOptimize(ReceiveFn(sctx, evt));
+    }
+
+    if (received_bytes != message_size * kMessagesPerEvent * st.iterations()) {
+        st.SkipWithError("Not all messages were delivered");
+    }
+
+    report_delivery(st, kMessagesPerEvent, payload.storage.size());
+}
+
+static void receive_args(benchmark::internal::Benchmark * b) {
+    b->ArgNames({ "msg_size", "segment" });
+    for (std::int64_t message_size : { 16, 256, 4096, 16000 }) {
+        // Whole event in a single buffer
+        b->Args({ message_size, 0 });
+        // Segments aligned with the frame boundaries
+        b->Args({ message_size, message_size + 4 });
+        // Segments straddling the frame boundaries
+        b->Args({ message_size, message_size + 4 + message_size / 2 + 1 });
+        // Fixed-size tiny fragments
+        b->Args({ message_size, 7 });
+        // MTU-sized fragments
+        b->Args({ message_size, 1200 });
+    }
+}
+
+/**
+ * Synthetic receive events of a given shape, delivered to a fresh
+ * stream. Measures the framing cost per delivered message.
+ *
+ * Args: message size, messages per event, segment size (0 = single
+ * QUIC_BUFFER)
+ */
+template <auto ReceiveFn>
+static void stream_receive_framing(benchmark::State & st) {
+    const auto message_size = static_cast<std::size_t>(st.range(0));
+    const auto message_count = static_cast<std::size_t>(st.range(1));
+    const auto segment_size = static_cast<std::size_t>(st.range(2));
+
+    receive_payload payload{ message_size, message_count, segment_size };
+    std::size_t received_bytes = 0;
+    stream sctx{ nullptr, bench_connection(),
+                 stream_callbacks{
+                     .on_start = {},
+                     .on_close = {},
+                     .on_data_received = callback{ count_message,
+                                                   &received_bytes } } };
+
+    if (k_size_prefix_len + message_size > sctx.receive_buffer_capacity()) {
+        st.SkipWithError("Message does not fit into the receive buffer");
+        return;
+    }
+
+    for (auto _ : st) {
+        auto evt = payload.event();
+        benchmark::DoNotOptimize(ReceiveFn(sctx, evt));
+    }
+
+    if (received_bytes != message_size * message_count * st.iterations()) {
+        st.SkipWithError("Not all messages were delivered");
+    }
+
+    report_delivery(st, message_count, payload.storage.size());
+}
+
+static void framing_args(benchmark::internal::Benchmark * b) {
+    b->ArgNames({ "msg_size", "msgs", "segment" });
+    // Many tiny frames, in a single buffer and in MTU-sized buffers
+    b->Args({ 1, 4096, 0 });
+    b->Args({ 8, 1024, 0 });
+    b->Args({ 8, 1024, 1200 });
+    // Frames split across buffers, including the size prefix
+    b->Args({ 100, 256, 3 });
+    b->Args({ 1000, 64, 1501 });
+    b->Args({ 4096, 16, 4097 });
+    // Frames close to the receive buffer size, which always
+    // go through the receive buffer when segmented
+    b->Args({ 32000, 8, 0 });
+    b->Args({ 32000, 8, 1200 });
+    b->Args({ k_max_ring_frame, 8, 1200 });
+}
+
+BENCHMARK_TEMPLATE(stream_receive_framing, StreamCallbackReceive)
+    ->Name("stream_receive_framing/zero_copy")
+    ->Apply(framing_args);
+BENCHMARK_TEMPLATE(stream_receive_framing, receive_buffered)
+    ->Name("stream_receive_framing/copy")
+    ->Apply(framing_args);
+
+BENCHMARK_TEMPLATE(stream_receive, StreamCallbackReceive)
+    ->Name("stream_receive/zero_copy")
+    ->Apply(receive_args);
+BENCHMARK_TEMPLATE(stream_receive, receive_buffered)
+    ->Name("stream_receive/copy")
+    ->Apply(receive_args);
+
+} // namespace mad::nexus
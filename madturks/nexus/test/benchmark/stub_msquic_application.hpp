@@ -0,0 +1,154 @@
+/******************************************************
+ * In-process msquic stand-in for the nexus benchmarks.
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#pragma once
+
+#include <mad/nexus/msquic/msquic_application.hpp>
+#include <mad/nexus/msquic/msquic_base.hpp>
+
+#include <msquic.h>
+
+#include <cstdint>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Calls made to the stub msquic API.
+ ******************************************************/
+struct stub_msquic_counters {
+    std::uint64_t stream_send_calls{ 0 };
+    std::uint64_t send_completions{ 0 };
+    std::uint64_t sent_buffers{ 0 };
+};
+
+/******************************************************
+ * A msquic_application whose API table does not touch
+ * the network. Streams are opened and started in place,
+ * and every StreamSend completes synchronously, so the
+ * benchmarks measure the cost of the nexus send path
+ * including the completion handling.
+ *
+ * Single-threaded use only.
+ ******************************************************/
+class stub_msquic_application : public msquic_application {
+public:
+    /******************************************************
+     * Calls made to the stub API.
+     ******************************************************/
+    static inline stub_msquic_counters stats{};
+
+    stub_msquic_application() :
+        msquic_application(
+            std::shared_ptr<const QUIC_API_TABLE>(&api_table,
+                                                  [](const QUIC_API_TABLE *) {
+                                                  }),
+            std::shared_ptr<QUIC_HANDLE>(k_registration,
+                                         [](QUIC_HANDLE *) {
+                                         }),
+            std::shared_ptr<QUIC_HANDLE>(k_configuration, [](QUIC_HANDLE *) {
+            })) {
+        api_table.SetContext = &set_context;
+        api_table.StreamOpen = &stream_open;
+        api_table.StreamStart = &stream_start;
+        api_table.StreamClose = &stream_close;
+        api_table.StreamSend = &stream_send;
+        api_table.StreamReceiveComplete = &stream_receive_complete;
+    }
+
+    const QUIC_API_TABLE * api() const noexcept override {
+        return msquic_api.get();
+    }
+
+    QUIC_HANDLE * registration() const noexcept override {
+        return registration_ptr.get();
+    }
+
+    QUIC_HANDLE * configuration() const noexcept override {
+        return configuration_ptr.get();
+    }
+
+private:
+    static inline QUIC_HANDLE * const k_registration =
+        reinterpret_cast<QUIC_HANDLE *>(0xDEADBEEF);
+    static inline QUIC_HANDLE * const k_configuration =
+        reinterpret_cast<QUIC_HANDLE *>(0xBADCAFE);
+    static inline QUIC_HANDLE * const k_stream =
+        reinterpret_cast<QUIC_HANDLE *>(0xBAD1DEA);
+
+    static inline QUIC_STREAM_CALLBACK_HANDLER stream_handler{ nullptr };
+    static inline void * stream_context{ nullptr };
+
+    static void QUIC_API set_context(HQUIC, void * context) {
+        stream_context = context;
+    }
+
+    static QUIC_STATUS QUIC_API stream_open(HQUIC, QUIC_STREAM_OPEN_FLAGS,
+                                            QUIC_STREAM_CALLBACK_HANDLER handler,
+                                            void * context, HQUIC * stream) {
+        stream_handler = handler;
+        stream_context = context;
+        *stream = k_stream;
+        return QUIC_STATUS_SUCCESS;
+    }
+
+    static QUIC_STATUS QUIC_API stream_start(HQUIC stream,
+                                             QUIC_STREAM_START_FLAGS) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_START_COMPLETE;
+        evt.START_COMPLETE = {};
+        evt.START_COMPLETE.Status = QUIC_STATUS_SUCCESS;
+        return stream_handler(stream, stream_context, &evt);
+    }
+
+    static void QUIC_API stream_close(HQUIC stream) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE;
+        evt.SHUTDOWN_COMPLETE = {};
+        evt.SHUTDOWN_COMPLETE.AppCloseInProgress = { true };
+        stream_handler(stream, stream_context, &evt);
+    }
+
+    static QUIC_STATUS QUIC_API stream_send(HQUIC stream, const QUIC_BUFFER *,
+                                            uint32_t buffer_count,
+                                            QUIC_SEND_FLAGS, void * context) {
+        stats.stream_send_calls++;
+        stats.sent_buffers += buffer_count;
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        evt.SEND_COMPLETE = {};
+        evt.SEND_COMPLETE.ClientContext = context;
+        stats.send_completions++;
+        return stream_handler(stream, stream_context, &evt);
+    }
+
+    static void QUIC_API stream_receive_complete(HQUIC, uint64_t) {}
+
+    QUIC_API_TABLE api_table{};
+};
+
+/******************************************************
+ * msquic_base with a public constructor. The benchmarks
+ * own their connections, so there is nothing to flush,
+ * trim or enforce on them all.
+ ******************************************************/
+struct bench_msquic_base : public msquic_base {
+    explicit bench_msquic_base(const msquic_application & app) :
+        msquic_base(app) {}
+
+    auto flush_all() -> result<std::size_t> override {
+        return 0;
+    }
+
+    auto trim_all_receive_buffers() -> std::size_t override {
+        return 0;
+    }
+
+    auto enforce_memory_budget() -> std::size_t override {
+        return 0;
+    }
+};
+
+} // namespace mad::nexus
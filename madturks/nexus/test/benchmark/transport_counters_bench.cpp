@@ -0,0 +1,62 @@
+/******************************************************
+ * Transport counter benchmarks
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+
+#include <mad/nexus/transport_counters.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * The former debug-only counter: a single process-wide
+ * atomic, updated by every thread.
+ ******************************************************/
+std::atomic<std::uint64_t> shared_sends_in_flight{ 0 };
+std::atomic<std::uint64_t> shared_bytes_sent{ 0 };
+
+} // namespace
+
+/******************************************************
+ * Account a send and its completion, as the send path
+ * and the send completion callback do.
+ ******************************************************/
+static void count_shared_atomic(benchmark::State & state) {
+    for (auto _ : state) {
+        shared_sends_in_flight.fetch_add(1, std::memory_order_relaxed);
+        shared_bytes_sent.fetch_add(64, std::memory_order_relaxed);
+        shared_sends_in_flight.fetch_sub(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void count_per_thread(benchmark::State & state) {
+    for (auto _ : state) {
+        transport_counter_recorder::sent(1, 64);
+        transport_counter_recorder::send_completed(1);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/******************************************************
+ * Sum the counters while the benchmark threads are
+ * recording.
+ ******************************************************/
+static void read_counters(benchmark::State & state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(transport_counters::read());
+    }
+}
+
+BENCHMARK(count_shared_atomic)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(count_per_thread)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(read_counters);
+
+} // namespace mad::nexus
@@ -18,6 +18,7 @@
 #include <gtest/gtest.h>
 #include <msquic.h>
 
+#include <memory>
 #include <numeric>
 
 static auto encode_monster_msg() {
@@ -107,7 +108,7 @@ struct StreamCallback : public ::testing::Test {
         std::size_t per_message_size = 0;
         std::size_t (*validator)(void *,
                                  std::span<const std::uint8_t>) = nullptr;
-        std::size_t called_times;
+        std::size_t called_times{ 0 };
         stream sctx{
             nullptr, message_object::cctx,
             stream_callbacks{
@@ -137,32 +138,33 @@ struct StreamCallback : public ::testing::Test {
         static inline connection cctx{ nullptr };
     };
 
+    // The message object holds a stream, which is not movable.
     auto generate_message_object(
         std::size_t how_many_messages,
         std::size_t segmentation_size = std::size_t{ ~0u },
         std::pair<send_buffer<true>,
                   std::size_t (*)(void *, std::span<const std::uint8_t>)>
             msg_obj = encode_monster_msg()) {
-        message_object result{};
+        auto result = std::make_unique<message_object>();
         auto & [msg, validator] = msg_obj;
         auto data_span{ msg.data_span() };
         for (std::size_t i = 0; i < how_many_messages; i++) {
 
-            result.storage.insert(
-                result.storage.end(), data_span.begin(), data_span.end());
+            result->storage.insert(
+                result->storage.end(), data_span.begin(), data_span.end());
         }
-        result.per_message_size = msg.data_span().size_bytes();
-        result.validator = validator;
-        result.sctx.callbacks.on_data_received =
-            callback{ result.validator, &result.called_times };
+        result->per_message_size = msg.data_span().size_bytes();
+        result->validator = validator;
+        result->sctx.callbacks.on_data_received =
+            callback{ result->validator, &result->called_times };
 
-        auto remanining_bytes = result.storage.size();
-        auto itr = result.storage.begin();
+        auto remanining_bytes = result->storage.size();
+        auto itr = result->storage.begin();
 
         while (remanining_bytes > 0) {
             const auto append_amount = std::min(
                 segmentation_size, remanining_bytes);
-            result.buffers.emplace_back(append_amount, &*itr);
+            result->buffers.emplace_back(append_amount, &*itr);
             std::advance(itr, append_amount);
             remanining_bytes -= append_amount;
         }
@@ -173,37 +175,37 @@ struct StreamCallback : public ::testing::Test {
 TEST_F(StreamCallback, SingleMessageSingleBuffer) {
     constexpr auto kHowManyMessages = 1u;
     auto obj = generate_message_object(kHowManyMessages);
-    auto evt = obj.get_receive_event();
-    StreamCallbackReceive(obj.sctx, evt);
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    auto evt = obj->get_receive_event();
+    StreamCallbackReceive(obj->sctx, evt);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 
 TEST_F(StreamCallback, MultipleMessagesSingleBuffer) {
     constexpr auto kHowManyMessages = 10u;
     auto obj = generate_message_object(kHowManyMessages);
-    auto evt = obj.get_receive_event();
-    StreamCallbackReceive(obj.sctx, evt);
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    auto evt = obj->get_receive_event();
+    StreamCallbackReceive(obj->sctx, evt);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 
 TEST_F(StreamCallback, SingleMessageMultipleBuffers) {
     constexpr auto kHowManyMessages = 1u;
     constexpr auto kSegmentationSize = 10u;
     auto obj = generate_message_object(kHowManyMessages, kSegmentationSize);
-    ASSERT_GE(obj.per_message_size, kSegmentationSize);
-    auto evt = obj.get_receive_event();
-    StreamCallbackReceive(obj.sctx, evt);
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    ASSERT_GE(obj->per_message_size, kSegmentationSize);
+    auto evt = obj->get_receive_event();
+    StreamCallbackReceive(obj->sctx, evt);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 
 TEST_F(StreamCallback, SingleMessageMultipleBuffersTorture) {
     constexpr auto kHowManyMessages = 1u;
     constexpr auto kSegmentationSize = 1u;
     auto obj = generate_message_object(kHowManyMessages, kSegmentationSize);
-    ASSERT_GE(obj.per_message_size, kSegmentationSize);
-    auto evt = obj.get_receive_event();
-    StreamCallbackReceive(obj.sctx, evt);
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    ASSERT_GE(obj->per_message_size, kSegmentationSize);
+    auto evt = obj->get_receive_event();
+    StreamCallbackReceive(obj->sctx, evt);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 
 TEST_F(StreamCallback, MultipleMessagesRecvBufferHasSpaceForOne) {
@@ -213,29 +215,94 @@ TEST_F(StreamCallback, MultipleMessagesRecvBufferHasSpaceForOne) {
     auto obj = generate_message_object(
         kHowManyMessages, std::size_t{ ~0u },
         encode_chat_message(kChatRandomTextLength));
-    auto evt = obj.get_receive_event();
-    StreamCallbackReceive(obj.sctx, evt);
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    auto evt = obj->get_receive_event();
+    StreamCallbackReceive(obj->sctx, evt);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 
 TEST_F(StreamCallback, SingleMessageLargerThanReceiveBuffer) {
+    // The message arrives in pieces, so it has to be buffered. The
+    // receive buffer grows to fit it.
+    constexpr auto kHowManyMessages = 1u;
+    constexpr auto kChatRandomTextLength = 5000u;
+    auto obj = generate_message_object(
+        kHowManyMessages, 1024, encode_chat_message(kChatRandomTextLength));
+    auto evt = obj->get_receive_event();
+    stream custom_sctx{ nullptr, obj->sctx.connection(), obj->sctx.callbacks,
+                        stream_receive_options{
+                            .buffer_size = obj->per_message_size / 2,
+                            .max_buffer_size = 1024 * 1024 } };
+    const auto initial_capacity = custom_sctx.receive_buffer_capacity();
+    ASSERT_LT(initial_capacity, obj->per_message_size);
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, StreamCallbackReceive(custom_sctx, evt));
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
+    EXPECT_GT(custom_sctx.receive_buffer_capacity(), initial_capacity);
+    EXPECT_EQ(custom_sctx.rbuf().consumed_space(), 0);
+}
+
+TEST_F(StreamCallback, SingleMessageLargerThanMaxReceiveBuffer) {
+    // The message arrives in pieces, so it has to be buffered, but it
+    // can never fit into the receive buffer. The stream is reset.
+    constexpr auto kHowManyMessages = 1u;
+    constexpr auto kChatRandomTextLength = 5000u;
+    auto obj = generate_message_object(
+        kHowManyMessages, 1024, encode_chat_message(kChatRandomTextLength));
+    auto evt = obj->get_receive_event();
+    std::size_t reset_times = 0;
+    stream custom_sctx{
+        reinterpret_cast<void *>(0x1), obj->sctx.connection(),
+        obj->sctx.callbacks,
+        stream_receive_options{ .buffer_size = obj->per_message_size / 2,
+                                .max_buffer_size = obj->per_message_size / 2 },
+        callback<void(void *)>{ +[](void * uptr, void *) {
+                                   ++*static_cast<std::size_t *>(uptr);
+                               },
+                                &reset_times }
+    };
+    ASSERT_LT(custom_sctx.max_receive_buffer_size(), obj->per_message_size);
+    StreamCallbackReceive(custom_sctx, evt);
+    EXPECT_EQ(obj->called_times, 0);
+    EXPECT_EQ(reset_times, 1);
+    EXPECT_EQ(custom_sctx.rbuf().consumed_space(), 0);
+}
+
+TEST_F(StreamCallback, SingleMessageLargerThanReceiveBufferSingleBuffer) {
+    // Complete messages are delivered without touching the receive
+    // buffer, so the receive buffer size does not matter.
     constexpr auto kHowManyMessages = 1u;
     constexpr auto kChatRandomTextLength = 5000u;
     auto obj = generate_message_object(
         kHowManyMessages, std::size_t{ ~0u },
         encode_chat_message(kChatRandomTextLength));
-    auto evt = obj.get_receive_event();
-    stream custom_sctx{ nullptr, obj.sctx.connection(), obj.sctx.callbacks,
-                        obj.per_message_size / 2 };
+    auto evt = obj->get_receive_event();
+    stream custom_sctx{ nullptr, obj->sctx.connection(), obj->sctx.callbacks,
+                        stream_receive_options{
+                            .buffer_size = obj->per_message_size / 2 } };
     StreamCallbackReceive(custom_sctx, evt);
-    EXPECT_EQ(obj.called_times, 0);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
+    EXPECT_EQ(custom_sctx.rbuf().consumed_space(), 0);
+}
+
+TEST_F(StreamCallback, MultipleMessagesMisalignedBuffers) {
+    // Segment boundaries never line up with the message boundaries, so
+    // each buffer completes a buffered message and leaves another one
+    // partially received.
+    constexpr auto kHowManyMessages = 10u;
+    auto obj = generate_message_object(kHowManyMessages);
+    const auto segmentation_size = obj->per_message_size + 7;
+    auto misaligned = generate_message_object(
+        kHowManyMessages, segmentation_size);
+    auto evt = misaligned->get_receive_event();
+    StreamCallbackReceive(misaligned->sctx, evt);
+    EXPECT_EQ(misaligned->called_times, kHowManyMessages);
+    EXPECT_EQ(misaligned->sctx.rbuf().consumed_space(), 0);
 }
 
 TEST_F(StreamCallback, SingleMessageBufferPerByteArrivingIndividually) {
     constexpr auto kHowManyMessages = 10u;
     auto obj = generate_message_object(kHowManyMessages, std::size_t{ ~0u });
 
-    for (const auto & buffer : obj.buffers) {
+    for (const auto & buffer : obj->buffers) {
 
         for (auto i = 0u; i < buffer.Length; i++) {
 
@@ -246,10 +313,10 @@ TEST_F(StreamCallback, SingleMessageBufferPerByteArrivingIndividually) {
                                .Buffers = &buf,
                                .BufferCount = 1,
                                .Flags = QUIC_RECEIVE_FLAG_NONE };
-            StreamCallbackReceive(obj.sctx, evt);
+            StreamCallbackReceive(obj->sctx, evt);
         }
     }
 
-    EXPECT_EQ(obj.called_times, kHowManyMessages);
+    EXPECT_EQ(obj->called_times, kHowManyMessages);
 }
 } // namespace mad::nexus
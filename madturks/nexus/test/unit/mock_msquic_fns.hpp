@@ -158,6 +158,65 @@ MAD_ALWAYS_INLINE void MockStreamSendCall(
     EXPECT_CALL(*mock_stream_send, Call(_, _, _, _, _)).Times(1);
 }
 
+template <typename MockType>
+MAD_ALWAYS_INLINE void MockStreamBroadcastCall(
+    QUIC_STATUS ret, MockType & mock_stream_send, HQUIC strm_object,
+    QUIC_STREAM_CALLBACK_HANDLER & strm_callback_handler, void *& ctxt,
+    std::uint32_t expected_calls) {
+    ON_CALL(*mock_stream_send, Call(_, _, _, _, _))
+        .WillByDefault(DoAll(
+            Invoke([&](HQUIC strm, const QUIC_BUFFER * qbuf, uint32_t bufcnt,
+                       QUIC_SEND_FLAGS flags, void * context) {
+                ASSERT_EQ(flags, QUIC_SEND_FLAG_NONE);
+                ASSERT_EQ(strm, strm_object);
+                ASSERT_EQ(bufcnt, 1);
+                ASSERT_EQ(qbuf->Length, 20);
+                ASSERT_NE(nullptr, context);
+
+                if (ret == QUIC_STATUS_SUCCESS) {
+                    QUIC_STREAM_EVENT evt{};
+                    evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+                    evt.SEND_COMPLETE = {};
+                    evt.SEND_COMPLETE.ClientContext = context;
+                    strm_callback_handler(strm, ctxt, &evt);
+                }
+            }),
+            Return(ret)));
+
+    EXPECT_CALL(*mock_stream_send, Call(_, _, _, _, _)).Times(expected_calls);
+}
+
+template <typename MockType>
+MAD_ALWAYS_INLINE void MockStreamSendBatchCall(
+    QUIC_STATUS ret, MockType & mock_stream_send, HQUIC strm_object,
+    QUIC_STREAM_CALLBACK_HANDLER & strm_callback_handler, void *& ctxt,
+    std::uint32_t expected_count) {
+    ON_CALL(*mock_stream_send, Call(_, _, _, _, _))
+        .WillByDefault(DoAll(
+            Invoke([&, expected_count](HQUIC strm, const QUIC_BUFFER * qbuf,
+                                       uint32_t bufcnt, QUIC_SEND_FLAGS flags,
+                                       void * context) {
+                ASSERT_EQ(flags, QUIC_SEND_FLAG_NONE);
+                ASSERT_EQ(strm, strm_object);
+                ASSERT_EQ(bufcnt, expected_count);
+                for (std::uint32_t i = 0; i < bufcnt; i++) {
+                    ASSERT_EQ(qbuf [i].Length, 20);
+                }
+                ASSERT_NE(nullptr, context);
+
+                if (ret == QUIC_STATUS_SUCCESS) {
+                    QUIC_STREAM_EVENT evt{};
+                    evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+                    evt.SEND_COMPLETE = {};
+                    evt.SEND_COMPLETE.ClientContext = context;
+                    strm_callback_handler(strm, ctxt, &evt);
+                }
+            }),
+            Return(ret)));
+
+    EXPECT_CALL(*mock_stream_send, Call(_, _, _, _, _)).Times(1);
+}
+
 template <typename MockType>
 MAD_ALWAYS_INLINE void
 MockListenerOpenCall(QUIC_STATUS ret, MockType & mock_listener_open,
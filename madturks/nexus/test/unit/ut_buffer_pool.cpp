@@ -0,0 +1,146 @@
+/******************************************************
+ * buffer_pool unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/buffer_pool.hpp>
+#include <mad/nexus/quic_base.hpp>
+
+#include <flatbuffers/flatbuffer_builder.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace mad::nexus {
+
+struct tf_buffer_pool : public ::testing::Test {
+    void SetUp() override {
+        buffer_pool::configure(buffer_pool_options{});
+        buffer_pool::trim();
+        before = buffer_pool::stats();
+    }
+
+    void TearDown() override {
+        buffer_pool::configure(buffer_pool_options{});
+        buffer_pool::trim();
+    }
+
+    buffer_pool_stats before{};
+};
+
+/******************************************************
+ * Requests are rounded up to the next size class.
+ ******************************************************/
+TEST_F(tf_buffer_pool, allocate_rounds_up_to_size_class) {
+    auto p = buffer_pool::allocate(100);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(buffer_pool::capacity(p), 128);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % 16, 0);
+    buffer_pool::deallocate(p);
+
+    p = buffer_pool::allocate(1);
+    EXPECT_EQ(buffer_pool::capacity(p), buffer_pool::k_min_block_size);
+    buffer_pool::deallocate(p);
+}
+
+/******************************************************
+ * A released block is handed out again for the same
+ * size class.
+ ******************************************************/
+TEST_F(tf_buffer_pool, released_block_is_reused) {
+    auto a = buffer_pool::allocate(200);
+    buffer_pool::deallocate(a);
+    auto b = buffer_pool::allocate(256);
+    EXPECT_EQ(a, b);
+    buffer_pool::deallocate(b);
+
+    const auto after = buffer_pool::stats();
+    EXPECT_EQ(after.allocations - before.allocations, 2);
+    EXPECT_EQ(after.cache_hits - before.cache_hits, 1);
+}
+
+/******************************************************
+ ******************************************************/
+TEST_F(tf_buffer_pool, bytes_in_flight_and_cached) {
+    auto a = buffer_pool::allocate(1000);
+    EXPECT_EQ(buffer_pool::stats().bytes_in_flight - before.bytes_in_flight,
+              1024);
+    EXPECT_EQ(buffer_pool::stats().bytes_cached, before.bytes_cached);
+
+    buffer_pool::deallocate(a);
+    EXPECT_EQ(buffer_pool::stats().bytes_in_flight, before.bytes_in_flight);
+    EXPECT_EQ(buffer_pool::stats().bytes_cached - before.bytes_cached, 1024);
+
+    buffer_pool::trim();
+    EXPECT_EQ(buffer_pool::stats().bytes_cached, 0);
+}
+
+/******************************************************
+ * Requests above the largest size class are not cached.
+ ******************************************************/
+TEST_F(tf_buffer_pool, oversized_bypasses_cache) {
+    const auto size = buffer_pool::k_max_block_size + 1;
+    auto p = buffer_pool::allocate(size);
+    EXPECT_EQ(buffer_pool::capacity(p), size);
+    buffer_pool::deallocate(p);
+
+    const auto after = buffer_pool::stats();
+    EXPECT_EQ(after.bytes_cached, before.bytes_cached);
+    EXPECT_EQ(after.bytes_in_flight, before.bytes_in_flight);
+}
+
+/******************************************************
+ * Blocks beyond the cache limits go back to the system.
+ ******************************************************/
+TEST_F(tf_buffer_pool, caches_are_bounded) {
+    buffer_pool::configure(
+        buffer_pool_options{ .thread_cache_bytes = 4096,
+                             .shared_cache_bytes = 4096 });
+
+    std::vector<std::uint8_t *> blocks{};
+    for (int i = 0; i < 16; i++) {
+        blocks.push_back(buffer_pool::allocate(1024));
+    }
+    for (auto p : blocks) {
+        buffer_pool::deallocate(p);
+    }
+
+    EXPECT_EQ(buffer_pool::stats().bytes_cached, 4096 + 4096);
+}
+
+/******************************************************
+ * Blocks released by a thread that exits become
+ * available to the other threads.
+ ******************************************************/
+TEST_F(tf_buffer_pool, cross_thread_release) {
+    auto p = buffer_pool::allocate(512);
+    std::thread{ [p] {
+        buffer_pool::deallocate(p);
+    } }.join();
+
+    EXPECT_EQ(buffer_pool::stats().bytes_cached - before.bytes_cached, 512);
+    auto q = buffer_pool::allocate(512);
+    EXPECT_EQ(p, q);
+    buffer_pool::deallocate(q);
+}
+
+/******************************************************
+ * build_message allocates from the pool, and the memory
+ * is returned when the send_buffer is destroyed.
+ ******************************************************/
+TEST_F(tf_buffer_pool, build_message_uses_pool) {
+    {
+        auto buf = quic_base::build_message(
+            [](::flatbuffers::FlatBufferBuilder & fbb) {
+                return fbb.CreateString("pooled");
+            });
+        ASSERT_NE(nullptr, buf.buf);
+        EXPECT_GE(buffer_pool::capacity(buf.buf), buf.buf_size);
+        EXPECT_GT(buffer_pool::stats().bytes_in_flight,
+                  before.bytes_in_flight);
+    }
+    EXPECT_EQ(buffer_pool::stats().bytes_in_flight, before.bytes_in_flight);
+}
+
+} // namespace mad::nexus
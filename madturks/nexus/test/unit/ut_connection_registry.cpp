@@ -0,0 +1,251 @@
+/******************************************************
+ * connection_registry unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/connection_registry.hpp>
+#include <mad/nexus/quic_connection.hpp>
+#include <mad/nexus/quic_error_code.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mad::nexus {
+
+struct tf_connection_registry : public ::testing::Test {
+
+    struct tracked_connection {
+        connection cctx{ reinterpret_cast<void *>(0x1D), nullptr };
+        std::atomic<bool> reclaimed{ false };
+    };
+
+    static void on_reclaim(void * uctx, connection & cctx) {
+        auto & self = *static_cast<tf_connection_registry *>(uctx);
+        auto & tracked = *self.by_address.at(&cctx);
+        ASSERT_FALSE(tracked.reclaimed.exchange(true));
+        self.reclaim_count.fetch_add(1);
+    }
+
+    connection & make_connection() {
+        auto & tracked = connections.emplace_back();
+        by_address.emplace(&tracked.cctx, &tracked);
+        return tracked.cctx;
+    }
+
+    bool reclaimed(const connection & cctx) const {
+        return by_address.at(&cctx)->reclaimed.load();
+    }
+
+    std::size_t visit_count(const connection_registry & registry) const {
+        std::size_t n = 0;
+        registry.for_each_connection([&](connection &) {
+            n++;
+        });
+        return n;
+    }
+
+    std::deque<tracked_connection> connections{};
+    std::unordered_map<const connection *, tracked_connection *> by_address{};
+    std::atomic<std::size_t> reclaim_count{ 0 };
+    connection_registry uut{
+        connection_registry::reclaim_callback_t{ &on_reclaim, this }, 4
+    };
+};
+
+/******************************************************
+ * Inserted connections are visited, removed ones are
+ * reclaimed right away when nobody is reading.
+ ******************************************************/
+TEST_F(tf_connection_registry, insert_remove) {
+    std::vector<connection *> inserted{};
+    for (int i = 0; i < 10; i++) {
+        auto & cctx = make_connection();
+        ASSERT_TRUE(uut.insert(cctx));
+        inserted.push_back(&cctx);
+    }
+
+    ASSERT_EQ(uut.size(), 10);
+    ASSERT_EQ(visit_count(uut), 10);
+
+    ASSERT_TRUE(uut.remove(*inserted [3]));
+    ASSERT_TRUE(reclaimed(*inserted [3]));
+    ASSERT_EQ(uut.size(), 9);
+    ASSERT_EQ(visit_count(uut), 9);
+
+    uut.for_each_connection([&](connection & cctx) {
+        ASSERT_NE(&cctx, inserted [3]);
+    });
+}
+
+/******************************************************
+ * Removing an unknown connection fails.
+ ******************************************************/
+TEST_F(tf_connection_registry, remove_unknown) {
+    auto & cctx = make_connection();
+    auto r = uut.remove(cctx);
+    ASSERT_FALSE(r);
+    ASSERT_EQ(r.error(), quic_error_code::value_does_not_exists);
+    ASSERT_EQ(reclaim_count.load(), 0);
+}
+
+/******************************************************
+ * A removed connection stays in the snapshots taken
+ * before, and is reclaimed when the last one is gone.
+ ******************************************************/
+TEST_F(tf_connection_registry, snapshot_defers_reclaim) {
+    auto & a = make_connection();
+    auto & b = make_connection();
+    ASSERT_TRUE(uut.insert(a));
+    ASSERT_TRUE(uut.insert(b));
+
+    {
+        auto first = uut.snapshot();
+        ASSERT_EQ(first.size(), 2);
+        ASSERT_EQ(first.shard_count(), uut.shard_count());
+
+        ASSERT_TRUE(uut.remove(a));
+        ASSERT_FALSE(reclaimed(a));
+        ASSERT_EQ(visit_count(uut), 1);
+
+        {
+            // Also pins the views that replaced the first one.
+            auto second = uut.snapshot();
+            ASSERT_EQ(second.size(), 1);
+            ASSERT_TRUE(uut.remove(b));
+            first = connection_snapshot{};
+            ASSERT_TRUE(reclaimed(a));
+            ASSERT_FALSE(reclaimed(b));
+
+            std::size_t n = 0;
+            second.for_each([&](connection & cctx) {
+                ASSERT_EQ(&cctx, &b);
+                n++;
+            });
+            ASSERT_EQ(n, 1);
+        }
+        ASSERT_TRUE(reclaimed(b));
+    }
+
+    ASSERT_EQ(reclaim_count.load(), 2);
+    ASSERT_TRUE(uut.snapshot().empty());
+}
+
+/******************************************************
+ * The shards of a snapshot cover all connections once.
+ ******************************************************/
+TEST_F(tf_connection_registry, snapshot_shards) {
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(uut.insert(make_connection()));
+    }
+
+    auto snapshot = uut.snapshot();
+    std::unordered_map<connection *, int> seen{};
+    for (std::size_t i = 0; i < snapshot.shard_count(); i++) {
+        ASSERT_FALSE(snapshot.shard(i).empty());
+        for (auto * cctx : snapshot.shard(i)) {
+            seen [cctx]++;
+        }
+    }
+    ASSERT_EQ(seen.size(), 100);
+    for (auto & [cctx, n] : seen) {
+        ASSERT_EQ(n, 1);
+    }
+}
+
+/******************************************************
+ * The views set aside by the inserts fit the removals,
+ * whatever order the connections come and go in.
+ ******************************************************/
+TEST_F(tf_connection_registry, interleaved_single_shard) {
+    connection_registry single{
+        connection_registry::reclaim_callback_t{ &on_reclaim, this }, 1
+    };
+
+    std::vector<connection *> live{};
+    for (int round = 0; round < 8; round++) {
+        for (int i = 0; i < round + 2; i++) {
+            auto & cctx = make_connection();
+            ASSERT_TRUE(single.insert(cctx));
+            live.push_back(&cctx);
+        }
+        // Oldest first, then the rest from the back.
+        ASSERT_TRUE(single.remove(*live.front()));
+        live.erase(live.begin());
+        for (int i = 0; i < round; i++) {
+            ASSERT_TRUE(single.remove(*live.back()));
+            live.pop_back();
+        }
+        ASSERT_EQ(single.size(), live.size());
+        ASSERT_EQ(visit_count(single), live.size());
+    }
+
+    while (!live.empty()) {
+        ASSERT_TRUE(single.remove(*live.back()));
+        live.pop_back();
+    }
+    ASSERT_EQ(reclaim_count.load(), connections.size());
+}
+
+/******************************************************
+ * Readers never observe a reclaimed connection while
+ * the writers keep adding and removing connections.
+ ******************************************************/
+TEST_F(tf_connection_registry, concurrent_readers) {
+    constexpr int k_connection_count = 2000;
+    constexpr int k_reader_count = 3;
+
+    for (int i = 0; i < k_connection_count; i++) {
+        make_connection();
+    }
+
+    std::atomic<bool> done{ false };
+    std::atomic<bool> failed{ false };
+    std::vector<std::jthread> readers{};
+    for (int r = 0; r < k_reader_count; r++) {
+        readers.emplace_back([&, r]() {
+            while (!done.load()) {
+                auto check = [&](connection & cctx) {
+                    if (reclaimed(cctx)) {
+                        failed.store(true);
+                    }
+                };
+                if (r % 2) {
+                    uut.snapshot().for_each(check);
+                } else {
+                    uut.for_each_connection(check);
+                }
+            }
+        });
+    }
+
+    // Two writers, each owns a half of the connections.
+    std::vector<std::jthread> writers{};
+    for (int w = 0; w < 2; w++) {
+        writers.emplace_back([&, w]() {
+            for (int i = w; i < k_connection_count; i += 2) {
+                auto & cctx = connections [static_cast<std::size_t>(i)].cctx;
+                ASSERT_TRUE(uut.insert(cctx));
+                if (i >= 64) {
+                    auto & old = connections [static_cast<std::size_t>(i - 64)]
+                                     .cctx;
+                    ASSERT_TRUE(uut.remove(old));
+                }
+            }
+        });
+    }
+    writers.clear();
+    done.store(true);
+    readers.clear();
+
+    ASSERT_FALSE(failed.load());
+    ASSERT_EQ(uut.size(), 64);
+    ASSERT_EQ(reclaim_count.load(), k_connection_count - 64);
+}
+
+} // namespace mad::nexus
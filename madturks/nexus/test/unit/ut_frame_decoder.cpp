@@ -0,0 +1,140 @@
+/******************************************************
+ * frame_decoder unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/frame_decoder.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace mad::nexus {
+
+namespace {
+
+/******************************************************
+ * Append a frame with @p size bytes of @p fill to @p out.
+ ******************************************************/
+void append_frame(std::vector<std::uint8_t> & out, std::uint32_t size,
+                  std::uint8_t fill) {
+    const std::uint8_t prefix [] = {
+        static_cast<std::uint8_t>(size),
+        static_cast<std::uint8_t>(size >> 8),
+        static_cast<std::uint8_t>(size >> 16),
+        static_cast<std::uint8_t>(size >> 24),
+    };
+    out.insert(out.end(), std::begin(prefix), std::end(prefix));
+    out.insert(out.end(), size, fill);
+}
+
+} // namespace
+
+/******************************************************
+ * The length prefix is little-endian regardless of the
+ * host byte order.
+ ******************************************************/
+TEST(frame_decoder, read_frame_size_little_endian) {
+    const std::uint8_t prefix [] = { 0x04, 0x03, 0x02, 0x01 };
+    ASSERT_EQ(read_frame_size(prefix), 0x01020304u);
+    ASSERT_EQ(peek_frame_size(prefix), 0x01020304u);
+    ASSERT_FALSE(peek_frame_size(std::span{ prefix }.first(3)));
+}
+
+/******************************************************
+ * All complete frames are decoded in one go, and the
+ * trailing partial frame is left over.
+ ******************************************************/
+TEST(frame_decoder, decode_complete_frames) {
+    std::vector<std::uint8_t> data{};
+    append_frame(data, 3, 0xAA);
+    append_frame(data, 0, 0x00);
+    append_frame(data, 5, 0xBB);
+    append_frame(data, 10, 0xCC);
+    // Cut the last frame in half.
+    data.resize(data.size() - 5);
+
+    frame_decoder<> decoder{};
+    auto rest = decoder.decode(data);
+
+    ASSERT_EQ(decoder.size(), 3);
+    ASSERT_FALSE(decoder.full());
+    const auto frames = decoder.frames();
+    ASSERT_EQ(frames [0].size(), 3);
+    ASSERT_EQ(frames [0] [0], 0xAA);
+    ASSERT_EQ(frames [1].size(), 0);
+    ASSERT_EQ(frames [2].size(), 5);
+    ASSERT_EQ(frames [2] [4], 0xBB);
+    ASSERT_EQ(frames [0].data(), data.data() + k_frame_prefix_size);
+
+    ASSERT_EQ(rest.size(), k_frame_prefix_size + 5);
+    ASSERT_EQ(rest.data(), decoder.frame_end(2));
+    ASSERT_EQ(peek_frame_size(rest), 10u);
+}
+
+/******************************************************
+ * Data without a complete frame decodes to nothing.
+ ******************************************************/
+TEST(frame_decoder, decode_partial_only) {
+    std::vector<std::uint8_t> data{};
+    append_frame(data, 8, 0x11);
+
+    frame_decoder<> decoder{};
+    for (std::size_t len : { std::size_t{ 0 }, std::size_t{ 2 },
+                             k_frame_prefix_size, data.size() - 1 }) {
+        auto rest = decoder.decode(std::span{ data }.first(len));
+        ASSERT_TRUE(decoder.empty());
+        ASSERT_EQ(rest.size(), len);
+    }
+
+    auto rest = decoder.decode(data);
+    ASSERT_EQ(decoder.size(), 1);
+    ASSERT_TRUE(rest.empty());
+}
+
+/******************************************************
+ * The decoder stops when it runs out of room, and the
+ * rest of the frames are decoded by the next call.
+ ******************************************************/
+TEST(frame_decoder, decode_in_batches) {
+    std::vector<std::uint8_t> data{};
+    for (std::uint8_t i = 0; i < 10; i++) {
+        append_frame(data, i, i);
+    }
+
+    frame_decoder<4> decoder{};
+    std::span<const std::uint8_t> rest{ data };
+    std::vector<std::size_t> sizes{};
+    std::size_t calls = 0;
+    do {
+        rest = decoder.decode(rest);
+        for (auto frame : decoder.frames()) {
+            sizes.push_back(frame.size());
+        }
+        calls++;
+    } while (decoder.full());
+
+    ASSERT_EQ(calls, 3);
+    ASSERT_TRUE(rest.empty());
+    ASSERT_EQ(sizes, (std::vector<std::size_t>{ 0, 1, 2, 3, 4, 5, 6, 7, 8,
+                                                 9 }));
+}
+
+/******************************************************
+ * A length prefix larger than the data does not overflow
+ * the bounds checks.
+ ******************************************************/
+TEST(frame_decoder, huge_length_prefix) {
+    std::vector<std::uint8_t> data{ 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x02 };
+
+    frame_decoder<> decoder{};
+    auto rest = decoder.decode(data);
+    ASSERT_TRUE(decoder.empty());
+    ASSERT_EQ(rest.size(), data.size());
+}
+
+} // namespace mad::nexus
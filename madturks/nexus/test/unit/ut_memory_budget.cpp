@@ -0,0 +1,123 @@
+/******************************************************
+ * memory_budget unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/memory_budget.hpp>
+#include <mad/nexus/quic_connection.hpp>
+
+#include <gtest/gtest.h>
+
+namespace mad::nexus {
+
+/******************************************************
+ * A budget without limits charges anything.
+ ******************************************************/
+TEST(memory_budget, unlimited) {
+    memory_budget budget{};
+    connection cctx{ nullptr, nullptr, &budget };
+
+    ASSERT_TRUE(budget.try_charge(cctx, 1 << 30));
+    ASSERT_EQ(cctx.memory_usage(), 1 << 30);
+    ASSERT_EQ(budget.total(), 1 << 30);
+    ASSERT_FALSE(budget.over_limit());
+    ASSERT_TRUE(budget.has_room(cctx));
+    ASSERT_TRUE(budget.admit_connection());
+
+    budget.credit(cctx, 1 << 30);
+    ASSERT_EQ(cctx.memory_usage(), 0);
+    ASSERT_EQ(budget.total(), 0);
+}
+
+/******************************************************
+ * try_charge fails when it takes the connection over its
+ * limit, and charges nothing then.
+ ******************************************************/
+TEST(memory_budget, connection_limit) {
+    memory_budget budget{};
+    budget.configure({ .connection_limit = 100 });
+    connection first{ nullptr, nullptr, &budget };
+    connection second{ nullptr, nullptr, &budget };
+
+    ASSERT_TRUE(budget.try_charge(first, 60));
+    ASSERT_FALSE(budget.try_charge(first, 41));
+    ASSERT_EQ(first.memory_usage(), 60);
+    ASSERT_TRUE(budget.has_room(first));
+    ASSERT_TRUE(budget.try_charge(first, 40));
+    ASSERT_FALSE(budget.has_room(first));
+
+    // The other connections are not affected.
+    ASSERT_TRUE(budget.try_charge(second, 100));
+    ASSERT_EQ(budget.total(), 200);
+}
+
+/******************************************************
+ * try_charge fails when it takes the total over its
+ * limit, and gives back the connection's share then.
+ ******************************************************/
+TEST(memory_budget, total_limit) {
+    memory_budget budget{};
+    budget.configure({ .total_limit = 100 });
+    connection first{ nullptr, nullptr, &budget };
+    connection second{ nullptr, nullptr, &budget };
+
+    ASSERT_TRUE(budget.try_charge(first, 70));
+    ASSERT_FALSE(budget.try_charge(second, 31));
+    ASSERT_EQ(second.memory_usage(), 0);
+    ASSERT_EQ(budget.total(), 70);
+    ASSERT_TRUE(budget.admit_connection());
+
+    ASSERT_TRUE(budget.try_charge(second, 30));
+    ASSERT_FALSE(budget.has_room(second));
+    ASSERT_FALSE(budget.admit_connection());
+    ASSERT_FALSE(budget.over_limit());
+
+    // Memory already in use is charged regardless.
+    budget.charge(second, 10);
+    ASSERT_TRUE(budget.over_limit());
+    ASSERT_EQ(budget.total(), 110);
+
+    const auto stats = budget.stats();
+    ASSERT_EQ(stats.bytes_in_use, 110);
+    ASSERT_EQ(stats.connections_refused, 1);
+}
+
+/******************************************************
+ * A destroyed connection gives back all its memory.
+ ******************************************************/
+TEST(memory_budget, release_on_destruction) {
+    memory_budget budget{};
+    connection first{ nullptr, nullptr, &budget };
+    {
+        connection second{ nullptr, nullptr, &budget };
+        budget.charge(first, 10);
+        budget.charge(second, 20);
+        ASSERT_EQ(budget.total(), 30);
+    }
+    ASSERT_EQ(budget.total(), 10);
+
+    budget.release(first);
+    ASSERT_EQ(first.memory_usage(), 0);
+    ASSERT_EQ(budget.total(), 0);
+}
+
+/******************************************************
+ * A connection is evicted only once.
+ ******************************************************/
+TEST(memory_budget, evict) {
+    memory_budget budget{};
+    connection cctx{ nullptr, nullptr, &budget };
+
+    ASSERT_FALSE(memory_budget::evicted(cctx));
+    ASSERT_TRUE(budget.evict(cctx));
+    ASSERT_TRUE(memory_budget::evicted(cctx));
+    ASSERT_FALSE(budget.evict(cctx));
+
+    budget.receive_held();
+    const auto stats = budget.stats();
+    ASSERT_EQ(stats.connections_evicted, 1);
+    ASSERT_EQ(stats.receives_held, 1);
+}
+
+} // namespace mad::nexus
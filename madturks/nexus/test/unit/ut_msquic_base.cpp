@@ -6,17 +6,43 @@
  ******************************************************/
 #include <mad/nexus/msquic/msquic_application.hpp>
 #include <mad/nexus/msquic/msquic_base.hpp>
+#include <mad/nexus/transport_counters.hpp>
 #include <mad/static_mock.hpp>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <msquic.h>
 
+#include <atomic>
+#include <thread>
+
 #include "mock_msquic_application.hpp"
 #include "mock_msquic_fns.hpp"
 
 namespace mad::nexus {
 
+/******************************************************
+ * msquic_base leaves owning the connections to the server
+ * and the client. The tests own their connections, so
+ * there is nothing to flush, trim or enforce on them all.
+ ******************************************************/
+struct test_msquic_base final : public msquic_base {
+    explicit test_msquic_base(const msquic_application & app) :
+        msquic_base(app) {}
+
+    auto flush_all() -> result<std::size_t> override {
+        return 0;
+    }
+
+    auto trim_all_receive_buffers() -> std::size_t override {
+        return 0;
+    }
+
+    auto enforce_memory_budget() -> std::size_t override {
+        return 0;
+    }
+};
+
 struct tf_msquic_base : public ::testing::Test {
     mock_msquic_application mock_app = {};
     // Alias for convenience.
@@ -25,7 +51,7 @@ struct tf_msquic_base : public ::testing::Test {
     template <typename... Args>
     auto construct_uut(Args &&... args) {
         return std::unique_ptr<msquic_base>(
-            new msquic_base(std::forward<Args>(args)...));
+            new test_msquic_base(std::forward<Args>(args)...));
     }
 
     void SetUp() override {
@@ -35,6 +61,11 @@ struct tf_msquic_base : public ::testing::Test {
         api.StreamSend = mock_stream_send;
         api.SetContext = mock_set_context;
         api.StreamClose = mock_stream_close;
+        api.StreamReceiveComplete = mock_stream_receive_complete;
+        api.StreamShutdown = mock_stream_shutdown;
+        api.DatagramSend = mock_datagram_send;
+        api.SetParam = mock_set_param;
+        api.GetParam = mock_get_param;
 
         uut = construct_uut(mock_app);
 
@@ -47,6 +78,15 @@ struct tf_msquic_base : public ::testing::Test {
             static_cast<void *>(&mock_stream_on_close_ctx));
     }
 
+    // Forwarder, since the tests themselves are not friends.
+    void datagram_event(connection * cctx, const QUIC_CONNECTION_EVENT & evt) {
+        uut->on_datagram_event(cctx, evt);
+    }
+
+    auto enforce_memory_budget(std::span<connection * const> connections) {
+        return uut->enforce_memory_budget_on(connections);
+    }
+
     static inline auto conn_object = []() {
         return reinterpret_cast<QUIC_HANDLE *>(0xDEADC0DE);
     }();
@@ -62,6 +102,12 @@ struct tf_msquic_base : public ::testing::Test {
     static_mock<QUIC_STREAM_SEND_FN> mock_stream_send{};
     static_mock<QUIC_SET_CONTEXT_FN> mock_set_context{};
     static_mock<QUIC_STREAM_CLOSE_FN> mock_stream_close{};
+    static_mock<QUIC_STREAM_RECEIVE_COMPLETE_FN>
+        mock_stream_receive_complete{};
+    static_mock<QUIC_STREAM_SHUTDOWN_FN> mock_stream_shutdown{};
+    static_mock<QUIC_DATAGRAM_SEND_FN> mock_datagram_send{};
+    static_mock<QUIC_SET_PARAM_FN> mock_set_param{};
+    static_mock<QUIC_GET_PARAM_FN> mock_get_param{};
     static_mock<void (*)(void *, struct stream &)> mock_stream_on_start{};
     static_mock<void (*)(void *, struct stream &)> mock_stream_on_close{};
 
@@ -168,7 +214,7 @@ TEST_F(tf_msquic_base, send_success) {
     MockStreamSendCall(QUIC_STATUS_SUCCESS, mock_stream_send, strm_object,
                        strm_callback_handler, ctxt);
 
-    auto alloc_buf = new std::uint8_t [1024];
+    auto alloc_buf = buffer_pool::allocate(1024);
 
     std::uint32_t encoded_size = 16;
     send_buffer<true> buf;
@@ -191,9 +237,16 @@ TEST_F(tf_msquic_base, send_success) {
     // stream mock_stream{ strm_object, mock_connection, stream_callbacks{} };
     auto stream_open_result = uut->open_stream(mock_connection);
     ASSERT_TRUE(stream_open_result.has_value());
+    const auto before = transport_counters::read();
     auto result = uut->send(stream_open_result.value().get(), std::move(buf));
     ASSERT_TRUE(result.has_value());
     ASSERT_EQ(result.value(), encoded_size + sizeof(std::uint32_t));
+
+    const auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_sent - before.messages_sent, 1);
+    ASSERT_EQ(after.bytes_sent - before.bytes_sent, result.value());
+    // The mock completes the send right away.
+    ASSERT_EQ(after.sends_in_flight, before.sends_in_flight);
 }
 
 /******************************************************
@@ -215,7 +268,7 @@ TEST_F(tf_msquic_base, send_failed) {
     MockStreamSendCall(QUIC_STATUS_ABORTED, mock_stream_send, strm_object,
                        strm_callback_handler, ctxt);
 
-    auto alloc_buf = new std::uint8_t [1024];
+    auto alloc_buf = buffer_pool::allocate(1024);
 
     std::uint32_t encoded_size = 16;
     send_buffer<true> buf;
@@ -243,4 +296,1630 @@ TEST_F(tf_msquic_base, send_failed) {
     ASSERT_EQ(result.error(), quic_error_code::send_failed);
 }
 
+/******************************************************
+ * Allocate a send buffer in the layout build_message
+ * produces, carrying @p encoded_size bytes of payload.
+ ******************************************************/
+static send_buffer<true> make_test_send_buffer(std::uint32_t encoded_size) {
+    constexpr std::size_t kAllocSize = 1024;
+    auto alloc_buf = buffer_pool::allocate(kAllocSize);
+
+    send_buffer<true> buf;
+    buf.buf = alloc_buf;
+    buf.buf_size = kAllocSize;
+    buf.offset = kAllocSize - sizeof(send_buffer<true>::quic_buf_sentinel) -
+                 sizeof(std::uint32_t) - encoded_size;
+
+    std::memcpy((alloc_buf + kAllocSize) -
+                    sizeof(send_buffer<true>::quic_buf_sentinel),
+                send_buffer<true>::quic_buf_sentinel,
+                sizeof(send_buffer<true>::quic_buf_sentinel));
+
+    std::memcpy((alloc_buf + kAllocSize) -
+                    sizeof(send_buffer<true>::quic_buf_sentinel) -
+                    encoded_size - sizeof(std::uint32_t),
+                &encoded_size, sizeof(std::uint32_t));
+    return buf;
+}
+
+/******************************************************
+ ******************************************************/
+TEST_F(tf_msquic_base, send_batch_success) {
+    constexpr std::uint32_t kBatchSize = 8;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_SUCCESS, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kBatchSize);
+
+    std::vector<send_buffer<true>> bufs{};
+    bufs.reserve(kBatchSize);
+    for (std::uint32_t i = 0; i < kBatchSize; i++) {
+        bufs.emplace_back(make_test_send_buffer(16));
+    }
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto result = uut->send(stream_open_result.value().get(), bufs);
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result.value(), kBatchSize * (16 + sizeof(std::uint32_t)));
+
+    // Ownership is transferred to the batch.
+    for (const auto & buf : bufs) {
+        ASSERT_EQ(buf.buf, nullptr);
+    }
+}
+
+/******************************************************
+ ******************************************************/
+TEST_F(tf_msquic_base, send_batch_failed) {
+    constexpr std::uint32_t kBatchSize = 4;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_ABORTED, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kBatchSize);
+
+    std::vector<send_buffer<true>> bufs{};
+    bufs.reserve(kBatchSize);
+    for (std::uint32_t i = 0; i < kBatchSize; i++) {
+        bufs.emplace_back(make_test_send_buffer(16));
+    }
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto result = uut->send(stream_open_result.value().get(), bufs);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::send_failed);
+
+    // The caller still owns the buffers.
+    for (const auto & buf : bufs) {
+        ASSERT_NE(buf.buf, nullptr);
+    }
+}
+
+/******************************************************
+ * A failed gather send of a single buffer leaves the
+ * buffer to the caller, like a failed batch.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_batch_single_failed) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_ABORTED, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, 1);
+
+    std::vector<send_buffer<true>> bufs{};
+    bufs.emplace_back(make_test_send_buffer(16));
+    const auto * allocation = bufs.front().buf;
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto result = uut->send(stream_open_result.value().get(), bufs);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::send_failed);
+
+    // The caller still owns the buffer.
+    ASSERT_EQ(bufs.front().buf, allocation);
+    ASSERT_EQ(bufs.front().data_span().size_bytes(),
+              16 + sizeof(std::uint32_t));
+}
+
+/******************************************************
+ * Broadcast the same message to a stream multiple times.
+ * The message memory must be shared by all sends, and
+ * must be released after the last send is completed.
+ ******************************************************/
+TEST_F(tf_msquic_base, broadcast_success) {
+    constexpr std::uint32_t kFanout = 3;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamBroadcastCall(QUIC_STATUS_SUCCESS, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kFanout);
+
+    shared_send_buffer buf{ make_test_send_buffer(16) };
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+
+    const std::vector<std::reference_wrapper<stream>> streams(
+        kFanout, stream_open_result.value());
+    const auto before = transport_counters::read();
+    auto result = uut->broadcast(streams, buf);
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result.value(), kFanout);
+
+    // All sends are completed, only our reference is left.
+    ASSERT_EQ(buf.use_count(), 1);
+
+    const auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_sent - before.messages_sent, kFanout);
+    ASSERT_EQ(after.sends_in_flight, before.sends_in_flight);
+}
+
+/******************************************************
+ ******************************************************/
+TEST_F(tf_msquic_base, broadcast_failed) {
+    constexpr std::uint32_t kFanout = 2;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamBroadcastCall(QUIC_STATUS_ABORTED, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kFanout);
+
+    shared_send_buffer buf{ make_test_send_buffer(16) };
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+
+    const std::vector<std::reference_wrapper<stream>> streams(
+        kFanout, stream_open_result.value());
+    auto result = uut->broadcast(streams, buf);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::send_failed);
+    ASSERT_EQ(buf.use_count(), 1);
+}
+
+/******************************************************
+ * Pause the stream from within the data callback, and
+ * resume it later. The receive event must stay pending
+ * until all of its data is delivered.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_pause_resume) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    struct receiver {
+        stream * sctx{ nullptr };
+        bool pause_after_each{ true };
+        std::vector<std::uint8_t> received{};
+    } rcv{};
+
+    // Three messages, each carrying a single byte payload.
+    std::array<std::uint8_t, 15> payload{ 1, 0, 0, 0, 0xA, 1, 0, 0,
+                                          0, 0xB, 1, 0, 0, 0, 0xC };
+    QUIC_BUFFER qbuf{ .Length = payload.size(), .Buffer = payload.data() };
+
+    QUIC_STREAM_EVENT evt{};
+    evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+    evt.RECEIVE = {};
+    evt.RECEIVE.TotalBufferLength = payload.size();
+    evt.RECEIVE.Buffers = &qbuf;
+    evt.RECEIVE.BufferCount = 1;
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                auto & r = *static_cast<receiver *>(uptr);
+                r.received.insert(r.received.end(), buf.begin(), buf.end());
+                if (r.pause_after_each) {
+                    r.sctx->pause_receive();
+                }
+                return buf.size();
+            },
+            &rcv });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    rcv.sctx = &stream;
+
+    EXPECT_CALL(*mock_stream_receive_complete, Call(_, _)).Times(0);
+    ASSERT_EQ(QUIC_STATUS_PENDING,
+              strm_callback_handler(strm_object, ctxt, &evt));
+    ASSERT_TRUE(stream.receive_paused());
+    ASSERT_EQ(rcv.received, (std::vector<std::uint8_t>{ 0xA }));
+
+    // Paused again by the callback, the event is still pending.
+    ASSERT_TRUE(uut->resume_receive(stream).has_value());
+    ASSERT_EQ(rcv.received, (std::vector<std::uint8_t>{ 0xA, 0xB }));
+    ::testing::Mock::VerifyAndClearExpectations(&*mock_stream_receive_complete);
+
+    EXPECT_CALL(*mock_stream_receive_complete,
+                Call(strm_object, payload.size()))
+        .Times(1);
+    rcv.pause_after_each = false;
+    ASSERT_TRUE(uut->resume_receive(stream).has_value());
+    ASSERT_FALSE(stream.receive_paused());
+    ASSERT_EQ(rcv.received, (std::vector<std::uint8_t>{ 0xA, 0xB, 0xC }));
+
+    // Nothing is pending anymore.
+    ASSERT_TRUE(uut->resume_receive(stream).has_value());
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * The receive event held back by a paused stream is let
+ * go when the stream is shut down, and is not resumed.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_paused_shutdown) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    // Once for the shutdown below, and once for the close.
+    EXPECT_CALL(*mock_stream_on_close, Call(_, _)).Times(2);
+
+    std::array<std::uint8_t, 10> payload{ 1, 0, 0, 0, 0xA, 1, 0, 0, 0, 0xB };
+    QUIC_BUFFER qbuf{ .Length = payload.size(), .Buffer = payload.data() };
+
+    QUIC_STREAM_EVENT evt{};
+    evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+    evt.RECEIVE = {};
+    evt.RECEIVE.TotalBufferLength = payload.size();
+    evt.RECEIVE.Buffers = &qbuf;
+    evt.RECEIVE.BufferCount = 1;
+
+    connection mock_connection{ conn_object };
+    stream * sctx = nullptr;
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                (*static_cast<stream **>(uptr))->pause_receive();
+                return buf.size();
+            },
+            &sctx });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    sctx = &stream;
+
+    EXPECT_CALL(*mock_stream_receive_complete, Call(_, _)).Times(0);
+    ASSERT_EQ(QUIC_STATUS_PENDING,
+              strm_callback_handler(strm_object, ctxt, &evt));
+    ASSERT_TRUE(stream.pending_receive().active);
+
+    QUIC_STREAM_EVENT shutdown{};
+    shutdown.Type = QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE;
+    shutdown.SHUTDOWN_COMPLETE = {};
+    shutdown.SHUTDOWN_COMPLETE.AppCloseInProgress = { true };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS,
+              strm_callback_handler(strm_object, ctxt, &shutdown));
+    ASSERT_FALSE(stream.pending_receive().active);
+
+    ASSERT_TRUE(uut->resume_receive(stream).has_value());
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * Pause and resume the stream from within its own data
+ * callback. The delivery carries on within the same
+ * receive event.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_pause_resume_within_callback) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    struct receiver {
+        msquic_base * base{ nullptr };
+        stream * sctx{ nullptr };
+        std::vector<std::uint8_t> received{};
+    } rcv{ .base = uut.get() };
+
+    std::array<std::uint8_t, 10> payload{ 1, 0, 0, 0, 0xA, 1, 0, 0, 0, 0xB };
+    QUIC_BUFFER qbuf{ .Length = payload.size(), .Buffer = payload.data() };
+
+    QUIC_STREAM_EVENT evt{};
+    evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+    evt.RECEIVE = {};
+    evt.RECEIVE.TotalBufferLength = payload.size();
+    evt.RECEIVE.Buffers = &qbuf;
+    evt.RECEIVE.BufferCount = 1;
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                auto & r = *static_cast<receiver *>(uptr);
+                r.received.insert(r.received.end(), buf.begin(), buf.end());
+                r.sctx->pause_receive();
+                EXPECT_TRUE(r.base->resume_receive(*r.sctx).has_value());
+                return buf.size();
+            },
+            &rcv });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    rcv.sctx = &stream;
+
+    EXPECT_CALL(*mock_stream_receive_complete, Call(_, _)).Times(0);
+    ASSERT_EQ(QUIC_STATUS_SUCCESS,
+              strm_callback_handler(strm_object, ctxt, &evt));
+    ASSERT_FALSE(stream.receive_paused());
+    ASSERT_FALSE(stream.pending_receive().active);
+    ASSERT_EQ(rcv.received, (std::vector<std::uint8_t>{ 0xA, 0xB }));
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * The received messages, the receive buffer usage and the
+ * messages that cannot be framed are counted.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_counters) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void *, std::span<const std::uint8_t> buf) -> std::size_t {
+                return buf.size();
+            },
+            nullptr });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+
+    const auto receive = [&](std::span<std::uint8_t> data) {
+        QUIC_BUFFER qbuf{ .Length = static_cast<std::uint32_t>(data.size()),
+                          .Buffer = data.data() };
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+        evt.RECEIVE = {};
+        evt.RECEIVE.TotalBufferLength = data.size();
+        evt.RECEIVE.Buffers = &qbuf;
+        evt.RECEIVE.BufferCount = 1;
+        return strm_callback_handler(strm_object, ctxt, &evt);
+    };
+
+    const auto before = transport_counters::read();
+
+    // A complete message, followed by the first half of another.
+    std::array<std::uint8_t, 7> first{ 1, 0, 0, 0, 0xA, 2, 0 };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(first));
+    std::array<std::uint8_t, 4> second{ 0, 0, 0xB, 0xC };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(second));
+
+    auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_received - before.messages_received, 2);
+    ASSERT_EQ(after.bytes_received - before.bytes_received, 11);
+    ASSERT_GE(after.receive_buffer_high_water, 2);
+    ASSERT_EQ(after.framing_errors, before.framing_errors);
+
+    // Does not fit into any receive buffer, the stream is reset.
+    EXPECT_CALL(*mock_stream_shutdown,
+                Call(strm_object, QUIC_STREAM_SHUTDOWN_FLAG_ABORT, _))
+        .Times(1)
+        .WillOnce(Return(QUIC_STATUS_SUCCESS));
+    std::array<std::uint8_t, 5> oversized{ 0, 0, 0, 0x7F, 0xD };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(oversized));
+
+    after = transport_counters::read();
+    ASSERT_EQ(after.messages_received - before.messages_received, 2);
+    ASSERT_EQ(after.framing_errors - before.framing_errors, 1);
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * A message larger than the receive buffer grows it,
+ * up to the configured limit. A message beyond the limit
+ * resets the stream.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_grows_buffer) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    std::vector<std::size_t> received{};
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                static_cast<std::vector<std::size_t> *>(uptr)->push_back(
+                    buf.size());
+                return buf.size();
+            },
+            &received });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    const auto initial_size = stream.receive_buffer_capacity();
+
+    const auto receive = [&](std::span<std::uint8_t> data) {
+        QUIC_BUFFER qbuf{ .Length = static_cast<std::uint32_t>(data.size()),
+                          .Buffer = data.data() };
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+        evt.RECEIVE = {};
+        evt.RECEIVE.TotalBufferLength = data.size();
+        evt.RECEIVE.Buffers = &qbuf;
+        evt.RECEIVE.BufferCount = 1;
+        return strm_callback_handler(strm_object, ctxt, &evt);
+    };
+
+    // Twice the initial buffer, split over two events.
+    const auto size = static_cast<std::uint32_t>(initial_size * 2);
+    std::vector<std::uint8_t> message(sizeof(size) + size, 0xAB);
+    std::memcpy(message.data(), &size, sizeof(size));
+    const auto half = message.size() / 2;
+
+    EXPECT_CALL(*mock_stream_shutdown, Call(_, _, _)).Times(0);
+    ASSERT_EQ(QUIC_STATUS_SUCCESS,
+              receive(std::span{ message }.first(half)));
+    ASSERT_TRUE(received.empty());
+    ASSERT_EQ(QUIC_STATUS_SUCCESS,
+              receive(std::span{ message }.subspan(half)));
+    ASSERT_EQ(received, (std::vector<std::size_t>{ size }));
+    ASSERT_GT(stream.rbuf().total_size(), initial_size);
+    ASSERT_LE(stream.rbuf().total_size(), stream.max_receive_buffer_size());
+    ::testing::Mock::VerifyAndClearExpectations(&*mock_stream_shutdown);
+
+    // One byte beyond the limit.
+    const auto too_large = static_cast<std::uint32_t>(
+        stream.max_receive_buffer_size() - sizeof(size) + 1);
+    std::array<std::uint8_t, 6> oversized{ 0, 0, 0, 0, 0xC, 0xD };
+    std::memcpy(oversized.data(), &too_large, sizeof(too_large));
+    EXPECT_CALL(*mock_stream_shutdown,
+                Call(strm_object, QUIC_STREAM_SHUTDOWN_FLAG_ABORT, _))
+        .Times(1)
+        .WillOnce(Return(QUIC_STATUS_SUCCESS));
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(oversized));
+    ASSERT_EQ(received.size(), 1);
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * The receive buffer is allocated only when a partial
+ * message has to be buffered.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_buffer_allocated_lazily) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    std::vector<std::size_t> received{};
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                static_cast<std::vector<std::size_t> *>(uptr)->push_back(
+                    buf.size());
+                return buf.size();
+            },
+            &received });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    ASSERT_FALSE(stream.rbuf());
+    ASSERT_GT(stream.receive_buffer_capacity(), 0);
+
+    const auto receive = [&](std::span<std::uint8_t> data) {
+        QUIC_BUFFER qbuf{ .Length = static_cast<std::uint32_t>(data.size()),
+                          .Buffer = data.data() };
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+        evt.RECEIVE = {};
+        evt.RECEIVE.TotalBufferLength = data.size();
+        evt.RECEIVE.Buffers = &qbuf;
+        evt.RECEIVE.BufferCount = 1;
+        return strm_callback_handler(strm_object, ctxt, &evt);
+    };
+
+    // Whole messages only.
+    std::array<std::uint8_t, 11> whole{ 1, 0, 0, 0, 0xA, 2, 0, 0, 0, 0xB, 0xC };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(whole));
+    ASSERT_EQ(received, (std::vector<std::size_t>{ 1, 2 }));
+    ASSERT_FALSE(stream.rbuf());
+
+    // A partial size prefix.
+    std::array<std::uint8_t, 6> split{ 1, 0, 0, 0, 0xD };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ split }.first(2)));
+    ASSERT_TRUE(stream.rbuf());
+    ASSERT_EQ(stream.rbuf().total_size(), stream.receive_buffer_capacity());
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ split }.subspan(2, 3)));
+    ASSERT_EQ(received, (std::vector<std::size_t>{ 1, 2, 1 }));
+    ASSERT_EQ(stream.rbuf().consumed_space(), 0);
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * The receive buffer of a stream that stays idle with an
+ * empty receive buffer is released, and acquired again
+ * when needed.
+ ******************************************************/
+TEST_F(tf_msquic_base, trim_receive_buffers) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    std::vector<std::size_t> received{};
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                static_cast<std::vector<std::size_t> *>(uptr)->push_back(
+                    buf.size());
+                return buf.size();
+            },
+            &received });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+
+    const auto receive = [&](std::span<std::uint8_t> data) {
+        QUIC_BUFFER qbuf{ .Length = static_cast<std::uint32_t>(data.size()),
+                          .Buffer = data.data() };
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+        evt.RECEIVE = {};
+        evt.RECEIVE.TotalBufferLength = data.size();
+        evt.RECEIVE.Buffers = &qbuf;
+        evt.RECEIVE.BufferCount = 1;
+        return strm_callback_handler(strm_object, ctxt, &evt);
+    };
+
+    const auto idle_period =
+        stream_receive_options{}.idle_release_after.value();
+    std::array<std::uint8_t, 6> message{ 2, 0, 0, 0, 0xA, 0xB };
+
+    // A partial message is never released.
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ message }.first(5)));
+    ASSERT_TRUE(stream.rbuf());
+    ASSERT_FALSE(stream.release_idle_receive_buffer(
+        std::chrono::steady_clock::now() + idle_period));
+    ASSERT_TRUE(stream.rbuf());
+
+    // Empty, but not idle for long enough yet.
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ message }.subspan(5)));
+    ASSERT_EQ(received, (std::vector<std::size_t>{ 2 }));
+    ASSERT_EQ(uut->trim_receive_buffers(mock_connection), 0);
+    ASSERT_TRUE(stream.rbuf());
+
+    ASSERT_TRUE(stream.release_idle_receive_buffer(
+        std::chrono::steady_clock::now() + idle_period));
+    ASSERT_FALSE(stream.rbuf());
+
+    // Acquired again for the next partial message.
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ message }.first(3)));
+    ASSERT_TRUE(stream.rbuf());
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(std::span{ message }.subspan(3)));
+    ASSERT_EQ(received, (std::vector<std::size_t>{ 2, 2 }));
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * A stream opened with a batch callback receives all the
+ * complete messages of a buffer in a single call, and the
+ * message completed in the receive buffer on its own.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_batch) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    // One entry per call, with the messages of that call.
+    std::vector<std::vector<std::vector<std::uint8_t>>> batches{};
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_batch_data_callback_t{
+            [](void * uptr,
+               std::span<const std::span<const std::uint8_t>> messages) {
+                auto & b = *static_cast<decltype(batches) *>(uptr);
+                auto & batch = b.emplace_back();
+                for (auto message : messages) {
+                    batch.emplace_back(message.begin(), message.end());
+                }
+            },
+            &batches });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+
+    // Three complete messages and the first half of a fourth one,
+    // then the rest of the fourth one.
+    std::array<std::uint8_t, 17> first{ 1, 0, 0, 0, 0xA, 2, 0, 0, 0,
+                                        0xB, 0xC, 0, 0, 0, 0, 2, 0 };
+    std::array<std::uint8_t, 4> second{ 0, 0, 0xD, 0xE };
+    std::array<QUIC_BUFFER, 2> qbufs{
+        QUIC_BUFFER{ .Length = first.size(), .Buffer = first.data() },
+        QUIC_BUFFER{ .Length = second.size(), .Buffer = second.data() }
+    };
+
+    QUIC_STREAM_EVENT evt{};
+    evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+    evt.RECEIVE = {};
+    evt.RECEIVE.TotalBufferLength = first.size() + second.size();
+    evt.RECEIVE.Buffers = qbufs.data();
+    evt.RECEIVE.BufferCount = qbufs.size();
+
+    const auto before = transport_counters::read();
+    ASSERT_EQ(QUIC_STATUS_SUCCESS,
+              strm_callback_handler(strm_object, ctxt, &evt));
+
+    using batch_t = std::vector<std::vector<std::uint8_t>>;
+    ASSERT_EQ(batches.size(), 2);
+    ASSERT_EQ(batches [0], (batch_t{ { 0xA }, { 0xB, 0xC }, {} }));
+    ASSERT_EQ(batches [1], (batch_t{ { 0xD, 0xE } }));
+
+    const auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_received - before.messages_received, 4);
+    ASSERT_EQ(after.bytes_received - before.bytes_received, 21);
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * A stream opened with chunked message callbacks passes
+ * the messages that do not fit into its receive buffer on
+ * piece by piece, and never grows the receive buffer.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_chunked_message) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    struct receiver {
+        std::vector<std::vector<std::uint8_t>> messages{};
+        std::vector<std::size_t> begins{};
+        std::vector<std::uint8_t> payload{};
+        std::size_t chunks{ 0 };
+        std::size_t ends{ 0 };
+    } rcv{};
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                static_cast<receiver *>(uptr)->messages.emplace_back(
+                    buf.begin(), buf.end());
+                return buf.size();
+            },
+            &rcv },
+        stream_message_callbacks{
+            .on_message_begin = { [](void * uptr, std::size_t size) {
+                                     static_cast<receiver *>(uptr)
+                                         ->begins.push_back(size);
+                                 },
+                                  &rcv },
+            .on_message_chunk = { [](void * uptr,
+                                     std::span<const std::uint8_t> chunk) {
+                                     auto & r = *static_cast<receiver *>(uptr);
+                                     r.payload.insert(r.payload.end(),
+                                                      chunk.begin(),
+                                                      chunk.end());
+                                     r.chunks++;
+                                 },
+                                  &rcv },
+            .on_message_end = { [](void * uptr) {
+                                   static_cast<receiver *>(uptr)->ends++;
+                               },
+                                &rcv } });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    const auto buffer_size = stream.receive_buffer_capacity();
+
+    const auto receive = [&](std::span<std::uint8_t> data) {
+        QUIC_BUFFER qbuf{ .Length = static_cast<std::uint32_t>(data.size()),
+                          .Buffer = data.data() };
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+        evt.RECEIVE = {};
+        evt.RECEIVE.TotalBufferLength = data.size();
+        evt.RECEIVE.Buffers = &qbuf;
+        evt.RECEIVE.BufferCount = 1;
+        return strm_callback_handler(strm_object, ctxt, &evt);
+    };
+
+    // A small message, a large one that is twice the receive buffer,
+    // and another small one.
+    const auto size = static_cast<std::uint32_t>(buffer_size * 2);
+    std::vector<std::uint8_t> data{ 1, 0, 0, 0, 0xA };
+    data.resize(data.size() + sizeof(size) + size);
+    std::memcpy(data.data() + 5, &size, sizeof(size));
+    for (std::size_t i = 0; i < size; i++) {
+        data [9 + i] = static_cast<std::uint8_t>(i);
+    }
+    data.insert(data.end(), { 1, 0, 0, 0, 0xB });
+
+    // Split the size prefix of the large message, and its payload.
+    const std::span all{ data };
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(all.first(7)));
+    ASSERT_TRUE(rcv.begins.empty());
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(all.subspan(7, 1000)));
+    ASSERT_EQ(rcv.begins, (std::vector<std::size_t>{ size }));
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(all.subspan(1007)));
+
+    ASSERT_EQ(rcv.messages,
+              (std::vector<std::vector<std::uint8_t>>{ { 0xA }, { 0xB } }));
+    ASSERT_EQ(rcv.chunks, 2);
+    ASSERT_EQ(rcv.ends, 1);
+    ASSERT_TRUE(std::ranges::equal(rcv.payload, all.subspan(9, size)));
+    ASSERT_EQ(stream.rbuf().total_size(), buffer_size);
+    ASSERT_EQ(stream.rbuf().consumed_space(), 0);
+
+    // A large message that arrives whole is passed on in one chunk.
+    rcv.payload.clear();
+    ASSERT_EQ(QUIC_STATUS_SUCCESS, receive(all.subspan(5, 4 + size)));
+    ASSERT_EQ(rcv.begins.size(), 2);
+    ASSERT_EQ(rcv.chunks, 3);
+    ASSERT_EQ(rcv.ends, 2);
+    ASSERT_TRUE(std::ranges::equal(rcv.payload, all.subspan(9, size)));
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * Send a datagram, and report its state changes. The
+ * datagram is released after its final state.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_datagram_success) {
+    struct observer {
+        std::vector<datagram_send_state> states{};
+        std::size_t size{ 0 };
+    } obs{};
+
+    uut->register_callback<callback_type::datagram_send_state>(
+        +[](void * uptr, connection &, std::span<const std::uint8_t> data,
+            datagram_send_state state) {
+            auto & o = *static_cast<observer *>(uptr);
+            o.states.push_back(state);
+            o.size = data.size();
+        },
+        static_cast<void *>(&obs));
+
+    void * send_context{ nullptr };
+    EXPECT_CALL(*mock_datagram_send, Call(conn_object, _, 1, _, _))
+        .WillOnce(DoAll(Invoke([&](HQUIC, const QUIC_BUFFER * qbuf, uint32_t,
+                                   QUIC_SEND_FLAGS, void * context) {
+                            // The size prefix is not sent.
+                            ASSERT_EQ(qbuf->Length, 16);
+                            send_context = context;
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)));
+
+    const auto before = buffer_pool::stats();
+    connection mock_connection{ conn_object };
+    auto result = uut->send_datagram(mock_connection,
+                                     make_test_send_buffer(16));
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result.value(), 16);
+    ASSERT_NE(nullptr, send_context);
+
+    QUIC_CONNECTION_EVENT evt{};
+    evt.Type = QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED;
+    evt.DATAGRAM_SEND_STATE_CHANGED.ClientContext = send_context;
+    for (auto state :
+         { QUIC_DATAGRAM_SEND_SENT, QUIC_DATAGRAM_SEND_LOST_SUSPECT,
+           QUIC_DATAGRAM_SEND_ACKNOWLEDGED_SPURIOUS }) {
+        evt.DATAGRAM_SEND_STATE_CHANGED.State = state;
+        datagram_event(&mock_connection, evt);
+    }
+
+    ASSERT_EQ(obs.states, (std::vector<datagram_send_state>{
+                              datagram_send_state::sent,
+                              datagram_send_state::lost_suspect,
+                              datagram_send_state::acknowledged }));
+    ASSERT_EQ(obs.size, 16);
+    ASSERT_EQ(buffer_pool::stats().bytes_in_flight, before.bytes_in_flight);
+}
+
+/******************************************************
+ * The datagram is rejected when the peer does not accept
+ * datagrams.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_datagram_not_enabled) {
+    EXPECT_CALL(*mock_datagram_send, Call(conn_object, _, 1, _, _))
+        .WillOnce(Return(QUIC_STATUS_INVALID_STATE));
+
+    connection mock_connection{ conn_object };
+    auto result = uut->send_datagram(mock_connection,
+                                     make_test_send_buffer(16));
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::datagram_not_enabled);
+}
+
+/******************************************************
+ ******************************************************/
+TEST_F(tf_msquic_base, datagram_received) {
+    struct receiver {
+        connection * cctx{ nullptr };
+        std::vector<std::uint8_t> received{};
+    } rcv{};
+
+    uut->register_callback<callback_type::datagram_received>(
+        +[](void * uptr, connection & cctx,
+            std::span<const std::uint8_t> data) {
+            auto & r = *static_cast<receiver *>(uptr);
+            r.cctx = &cctx;
+            r.received.assign(data.begin(), data.end());
+        },
+        static_cast<void *>(&rcv));
+
+    std::array<std::uint8_t, 3> payload{ 0xA, 0xB, 0xC };
+    QUIC_BUFFER qbuf{ .Length = payload.size(), .Buffer = payload.data() };
+
+    QUIC_CONNECTION_EVENT evt{};
+    evt.Type = QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED;
+    evt.DATAGRAM_RECEIVED.Buffer = &qbuf;
+
+    connection mock_connection{ conn_object };
+    datagram_event(&mock_connection, evt);
+    ASSERT_EQ(rcv.cctx, &mock_connection);
+    ASSERT_EQ(rcv.received, (std::vector<std::uint8_t>{ 0xA, 0xB, 0xC }));
+}
+
+/******************************************************
+ * Open a stream with a non-default priority, and change
+ * it afterwards.
+ ******************************************************/
+TEST_F(tf_msquic_base, stream_priority) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    std::vector<stream_priority_t> priorities{};
+    EXPECT_CALL(*mock_set_param,
+                Call(strm_object, QUIC_PARAM_STREAM_PRIORITY,
+                     sizeof(stream_priority_t), _))
+        .Times(3)
+        .WillOnce(DoAll(Invoke([&](HQUIC, uint32_t, uint32_t,
+                                   const void * value) {
+                            priorities.push_back(
+                                *static_cast<const stream_priority_t *>(
+                                    value));
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)))
+        .WillOnce(DoAll(Invoke([&](HQUIC, uint32_t, uint32_t,
+                                   const void * value) {
+                            priorities.push_back(
+                                *static_cast<const stream_priority_t *>(
+                                    value));
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)))
+        .WillOnce(Return(QUIC_STATUS_INVALID_STATE));
+
+    connection mock_connection{ conn_object };
+    auto result = uut->open_stream(mock_connection, std::nullopt, 0xFFFF);
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+    ASSERT_EQ(stream.priority(), 0xFFFF);
+
+    ASSERT_TRUE(uut->set_stream_priority(stream, 0x10).has_value());
+    ASSERT_EQ(stream.priority(), 0x10);
+
+    // The priority stays as is when it could not be set.
+    auto set_result = uut->set_stream_priority(stream, 0x20);
+    ASSERT_FALSE(set_result.has_value());
+    ASSERT_EQ(set_result.error(), quic_error_code::set_param_failed);
+    ASSERT_EQ(stream.priority(), 0x10);
+
+    ASSERT_EQ(priorities, (std::vector<stream_priority_t>{ 0xFFFF, 0x10 }));
+}
+
+/******************************************************
+ * Urgent sends are flagged as priority work.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_urgent) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    EXPECT_CALL(*mock_stream_send,
+                Call(strm_object, _, 1, QUIC_SEND_FLAG_PRIORITY_WORK, _))
+        .WillOnce(DoAll(Invoke([&](HQUIC strm, const QUIC_BUFFER *, uint32_t,
+                                   QUIC_SEND_FLAGS, void * context) {
+                            QUIC_STREAM_EVENT evt{};
+                            evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+                            evt.SEND_COMPLETE.ClientContext = context;
+                            strm_callback_handler(strm, ctxt, &evt);
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)));
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto result = uut->send(stream_open_result.value().get(),
+                            make_test_send_buffer(16), send_urgency::urgent);
+    ASSERT_TRUE(result.has_value());
+}
+
+/******************************************************
+ * Coalesced sends are queued on the stream, and sent
+ * together by the flush.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_flush) {
+    constexpr std::uint32_t kQueued = 3;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_SUCCESS, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kQueued);
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    for (std::uint32_t i = 0; i < kQueued; i++) {
+        auto result = uut->send(stream, make_test_send_buffer(16));
+        ASSERT_TRUE(result.has_value());
+        ASSERT_EQ(result.value(), 16 + sizeof(std::uint32_t));
+    }
+    ASSERT_EQ(stream.queued_sends(), kQueued);
+
+    auto flush_result = uut->flush(mock_connection);
+    ASSERT_TRUE(flush_result.has_value());
+    ASSERT_EQ(flush_result.value(), kQueued * (16 + sizeof(std::uint32_t)));
+    ASSERT_EQ(stream.queued_sends(), 0);
+
+    // Nothing left to send.
+    flush_result = uut->flush(mock_connection);
+    ASSERT_TRUE(flush_result.has_value());
+    ASSERT_EQ(flush_result.value(), 0);
+}
+
+/******************************************************
+ * Coalesced sends to the same stream from several threads
+ * are all queued, and sent together by the flush.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_concurrent) {
+    constexpr std::uint32_t kThreads = 4;
+    constexpr std::uint32_t kSendsPerThread = 64;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_SUCCESS, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt,
+                            kThreads * kSendsPerThread);
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    std::atomic<std::uint32_t> failed{ 0 };
+    {
+        std::vector<std::jthread> senders{};
+        for (std::uint32_t t = 0; t < kThreads; t++) {
+            senders.emplace_back([&] {
+                for (std::uint32_t i = 0; i < kSendsPerThread; i++) {
+                    if (!uut->send(stream, make_test_send_buffer(16))) {
+                        failed++;
+                    }
+                }
+            });
+        }
+    }
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(stream.queued_sends(), kThreads * kSendsPerThread);
+
+    auto flush_result = uut->flush(mock_connection);
+    ASSERT_TRUE(flush_result.has_value());
+    ASSERT_EQ(flush_result.value(),
+              kThreads * kSendsPerThread * (16 + sizeof(std::uint32_t)));
+    ASSERT_EQ(stream.queued_sends(), 0);
+}
+
+/******************************************************
+ * A failed flush keeps the messages queued.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_flush_failed) {
+    constexpr std::uint32_t kQueued = 2;
+
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+    MockStreamSendBatchCall(QUIC_STATUS_ABORTED, mock_stream_send, strm_object,
+                            strm_callback_handler, ctxt, kQueued);
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    std::vector<send_buffer<true>> bufs{};
+    for (std::uint32_t i = 0; i < kQueued; i++) {
+        bufs.emplace_back(make_test_send_buffer(16));
+    }
+    ASSERT_TRUE(uut->send(stream, bufs).has_value());
+    ASSERT_EQ(stream.queued_sends(), kQueued);
+
+    auto flush_result = uut->flush(mock_connection);
+    ASSERT_FALSE(flush_result.has_value());
+    ASSERT_EQ(flush_result.error(), quic_error_code::send_failed);
+    ASSERT_EQ(stream.queued_sends(), kQueued);
+}
+
+/******************************************************
+ * When the last send of a flush fails, the delayed sends
+ * of the other streams are started with an empty send.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_flush_last_failed) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    const auto failing_object = reinterpret_cast<HQUIC>(0xFA11);
+
+    auto complete = [&](HQUIC strm, const QUIC_BUFFER *, uint32_t,
+                        QUIC_SEND_FLAGS, void * context) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        evt.SEND_COMPLETE.ClientContext = context;
+        strm_callback_handler(strm, ctxt, &evt);
+    };
+
+    {
+        ::testing::InSequence seq;
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1, QUIC_SEND_FLAG_DELAY_SEND, _))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(failing_object, _, 1, QUIC_SEND_FLAG_NONE, _))
+            .WillOnce(Return(QUIC_STATUS_ABORTED));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, nullptr, 0, QUIC_SEND_FLAG_NONE, nullptr))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+    }
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+    // Follows the opened stream in the iteration order.
+    auto failing_result = mock_connection.add(
+        handle_closer_t{}, failing_object, mock_connection, stream_callbacks{});
+    ASSERT_TRUE(failing_result.has_value());
+    auto & failing = failing_result.value().get();
+
+    ASSERT_TRUE(uut->send(stream, make_test_send_buffer(16)).has_value());
+    ASSERT_TRUE(uut->send(failing, make_test_send_buffer(16)).has_value());
+
+    auto flush_result = uut->flush(mock_connection);
+    ASSERT_FALSE(flush_result.has_value());
+    ASSERT_EQ(flush_result.error(), quic_error_code::send_failed);
+    ASSERT_EQ(stream.queued_sends(), 0);
+    ASSERT_EQ(failing.queued_sends(), 1);
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+}
+
+/******************************************************
+ * An urgent send sends the queued messages first, without
+ * starting the transmission, then itself.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_urgent) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    auto complete = [&](HQUIC strm, const QUIC_BUFFER *, uint32_t,
+                        QUIC_SEND_FLAGS, void * context) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        evt.SEND_COMPLETE.ClientContext = context;
+        strm_callback_handler(strm, ctxt, &evt);
+    };
+
+    {
+        ::testing::InSequence seq;
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 2,
+                         QUIC_SEND_FLAG_PRIORITY_WORK |
+                             QUIC_SEND_FLAG_DELAY_SEND,
+                         _))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1, QUIC_SEND_FLAG_PRIORITY_WORK, _))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+    }
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    ASSERT_TRUE(uut->send(stream, make_test_send_buffer(16)).has_value());
+    ASSERT_TRUE(uut->send(stream, make_test_send_buffer(16)).has_value());
+    auto result = uut->send(stream, make_test_send_buffer(16),
+                            send_urgency::urgent);
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result.value(), 16 + sizeof(std::uint32_t));
+    ASSERT_EQ(stream.queued_sends(), 0);
+}
+
+/******************************************************
+ * When the urgent send fails, the queued messages sent
+ * before it are started with an empty send.
+ ******************************************************/
+TEST_F(tf_msquic_base, send_coalesced_urgent_failed) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    auto complete = [&](HQUIC strm, const QUIC_BUFFER *, uint32_t,
+                        QUIC_SEND_FLAGS, void * context) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        evt.SEND_COMPLETE.ClientContext = context;
+        strm_callback_handler(strm, ctxt, &evt);
+    };
+
+    {
+        ::testing::InSequence seq;
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1,
+                         QUIC_SEND_FLAG_PRIORITY_WORK |
+                             QUIC_SEND_FLAG_DELAY_SEND,
+                         _))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1, QUIC_SEND_FLAG_PRIORITY_WORK, _))
+            .WillOnce(Return(QUIC_STATUS_ABORTED));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, nullptr, 0, QUIC_SEND_FLAG_NONE, nullptr))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+    }
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    ASSERT_TRUE(uut->send(stream, make_test_send_buffer(16)).has_value());
+    auto result = uut->send(stream, make_test_send_buffer(16),
+                            send_urgency::urgent);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::send_failed);
+    ASSERT_EQ(stream.queued_sends(), 0);
+}
+
+/******************************************************
+ * When the broadcast send fails, the queued messages sent
+ * before it are started with an empty send.
+ ******************************************************/
+TEST_F(tf_msquic_base, broadcast_coalesced_failed) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    auto complete = [&](HQUIC strm, const QUIC_BUFFER *, uint32_t,
+                        QUIC_SEND_FLAGS, void * context) {
+        QUIC_STREAM_EVENT evt{};
+        evt.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        evt.SEND_COMPLETE.ClientContext = context;
+        strm_callback_handler(strm, ctxt, &evt);
+    };
+
+    {
+        ::testing::InSequence seq;
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1, QUIC_SEND_FLAG_DELAY_SEND, _))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, _, 1, QUIC_SEND_FLAG_NONE, _))
+            .WillOnce(Return(QUIC_STATUS_ABORTED));
+        EXPECT_CALL(*mock_stream_send,
+                    Call(strm_object, nullptr, 0, QUIC_SEND_FLAG_NONE, nullptr))
+            .WillOnce(DoAll(Invoke(complete), Return(QUIC_STATUS_SUCCESS)));
+    }
+
+    uut->set_send_coalescing(true);
+
+    connection mock_connection{ conn_object };
+    auto stream_open_result = uut->open_stream(mock_connection);
+    ASSERT_TRUE(stream_open_result.has_value());
+    auto & stream = stream_open_result.value().get();
+
+    ASSERT_TRUE(uut->send(stream, make_test_send_buffer(16)).has_value());
+
+    shared_send_buffer buf{ make_test_send_buffer(16) };
+    const std::vector<std::reference_wrapper<struct stream>> streams{ stream };
+    auto result = uut->broadcast(streams, buf);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error(), quic_error_code::send_failed);
+    ASSERT_EQ(buf.use_count(), 1);
+    ASSERT_EQ(stream.queued_sends(), 0);
+}
+
+/******************************************************
+ * The connection statistics are translated from the
+ * msquic statistics.
+ ******************************************************/
+TEST_F(tf_msquic_base, connection_statistics) {
+    EXPECT_CALL(*mock_get_param,
+                Call(conn_object, QUIC_PARAM_CONN_STATISTICS_V2, _, _))
+        .WillOnce(DoAll(Invoke([](HQUIC, uint32_t, uint32_t * size,
+                                  void * value) {
+                            ASSERT_EQ(*size, sizeof(QUIC_STATISTICS_V2));
+                            auto & stats = *static_cast<QUIC_STATISTICS_V2 *>(
+                                value);
+                            stats.Rtt = 1500;
+                            stats.MinRtt = 900;
+                            stats.MaxRtt = 4000;
+                            stats.SendCongestionWindow = 64000;
+                            stats.SendPathMtu = 1500;
+                            stats.SendTotalPackets = 100;
+                            stats.SendSuspectedLostPackets = 7;
+                            stats.SendSpuriousLostPackets = 2;
+                            stats.RecvTotalBytes = 12345;
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)))
+        .WillOnce(Return(QUIC_STATUS_INVALID_STATE));
+
+    connection mock_connection{ conn_object };
+    auto stats = uut->statistics(mock_connection);
+    ASSERT_TRUE(stats.has_value());
+    ASSERT_EQ(stats->rtt, std::chrono::microseconds{ 1500 });
+    ASSERT_EQ(stats->min_rtt, std::chrono::microseconds{ 900 });
+    ASSERT_EQ(stats->max_rtt, std::chrono::microseconds{ 4000 });
+    ASSERT_EQ(stats->congestion_window, 64000);
+    ASSERT_EQ(stats->path_mtu, 1500);
+    ASSERT_EQ(stats->sent_packets, 100);
+    ASSERT_EQ(stats->lost_packets, 5);
+    ASSERT_EQ(stats->received_bytes, 12345);
+
+    auto failed = uut->statistics(mock_connection);
+    ASSERT_FALSE(failed.has_value());
+    ASSERT_EQ(failed.error(), quic_error_code::get_param_failed);
+}
+
+/******************************************************
+ * The stream statistics report the blocked durations.
+ ******************************************************/
+TEST_F(tf_msquic_base, stream_statistics) {
+    EXPECT_CALL(*mock_get_param,
+                Call(strm_object, QUIC_PARAM_STREAM_STATISTICS, _, _))
+        .WillOnce(DoAll(Invoke([](HQUIC, uint32_t, uint32_t *, void * value) {
+                            auto & stats =
+                                *static_cast<QUIC_STREAM_STATISTICS *>(value);
+                            stats.ConnBlockedByCongestionControlUs = 10;
+                            stats.ConnBlockedByFlowControlUs = 20;
+                            stats.StreamBlockedByFlowControlUs = 30;
+                            stats.StreamBlockedByAppUs = 40;
+                        }),
+                        Return(QUIC_STATUS_SUCCESS)));
+
+    connection mock_connection{ conn_object };
+    stream mock_stream{ strm_object, mock_connection, stream_callbacks{} };
+    auto stats = uut->statistics(mock_stream);
+    ASSERT_TRUE(stats.has_value());
+    ASSERT_EQ(stats->blocked_by_congestion_control,
+              std::chrono::microseconds{ 10 });
+    ASSERT_EQ(stats->blocked_by_connection_flow_control,
+              std::chrono::microseconds{ 20 });
+    ASSERT_EQ(stats->blocked_by_stream_flow_control,
+              std::chrono::microseconds{ 30 });
+    ASSERT_EQ(stats->blocked_by_app, std::chrono::microseconds{ 40 });
+    ASSERT_EQ(stats->blocked_by_pacing, std::chrono::microseconds{ 0 });
+}
+
+/******************************************************
+ * A stream that has no memory for a partial message stops
+ * reading, and goes on once the memory budget has room.
+ ******************************************************/
+TEST_F(tf_msquic_base, receive_held_for_memory_budget) {
+    MockStreamOpenCall(QUIC_STATUS_SUCCESS, mock_stream_open, conn_object,
+                       strm_object, strm_callback_handler, ctxt);
+    MockStreamStartCall(QUIC_STATUS_SUCCESS, mock_stream_start, strm_object,
+                        strm_callback_handler, ctxt);
+    MockStreamCloseCall(QUIC_STATUS_SUCCESS, mock_stream_close, strm_object,
+                        strm_callback_handler, ctxt);
+    MockSetContextCall(mock_set_context, strm_object, ctxt);
+    MockStreamOnStartCall(
+        mock_stream_on_start, &mock_stream_on_start_ctx, strm_object);
+    MockStreamOnCloseCall(
+        mock_stream_on_close, &mock_stream_on_close_ctx, strm_object);
+
+    auto & budget = mock_app.budget();
+    budget.configure({ .connection_limit = 1 });
+
+    std::vector<std::size_t> received{};
+    connection mock_connection{ conn_object, nullptr, &budget };
+    auto result = uut->open_stream(
+        mock_connection,
+        stream_data_callback_t{
+            [](void * uptr, std::span<const std::uint8_t> buf) -> std::size_t {
+                static_cast<std::vector<std::size_t> *>(uptr)->push_back(
+                    buf.size());
+                return buf.size();
+            },
+            &received });
+    ASSERT_TRUE(result.has_value());
+    auto & stream = result.value().get();
+
+    // A whole message and a partial one.
+    std::array<std::uint8_t, 8> payload{ 1, 0, 0, 0, 0xA, 2, 0, 0 };
+    QUIC_BUFFER qbuf{ .Length = payload.size(), .Buffer = payload.data() };
+    QUIC_STREAM_EVENT evt{};
+    evt.Type = QUIC_STREAM_EVENT_RECEIVE;
+    evt.RECEIVE = {};
+    evt.RECEIVE.TotalBufferLength = payload.size();
+    evt.RECEIVE.Buffers = &qbuf;
+    evt.RECEIVE.BufferCount = 1;
+
+    EXPECT_CALL(*mock_stream_receive_complete, Call(_, _)).Times(0);
+    ASSERT_EQ(QUIC_STATUS_PENDING,
+              strm_callback_handler(strm_object, ctxt, &evt));
+    ASSERT_TRUE(stream.receive_held());
+    ASSERT_FALSE(stream.rbuf());
+    ASSERT_EQ(received, (std::vector<std::size_t>{ 1 }));
+    ASSERT_EQ(budget.stats().receives_held, 1);
+    ASSERT_EQ(mock_connection.memory_usage(), 0);
+
+    // Still no room.
+    struct connection * const connections[] = { &mock_connection };
+    ASSERT_EQ(enforce_memory_budget(connections), 0);
+    ASSERT_TRUE(stream.receive_held());
+
+    // Not waited for while another thread delivers the data.
+    budget.configure({});
+    std::thread{ [&] {
+        stream.begin_receive();
+    } }.join();
+    ASSERT_EQ(enforce_memory_budget(connections), 0);
+    ASSERT_TRUE(stream.receive_held());
+    stream.end_receive();
+    ::testing::Mock::VerifyAndClearExpectations(&*mock_stream_receive_complete);
+
+    EXPECT_CALL(*mock_stream_receive_complete,
+                Call(strm_object, payload.size()))
+        .Times(1);
+    budget.configure({});
+    ASSERT_EQ(enforce_memory_budget(connections), 0);
+    ASSERT_FALSE(stream.receive_held());
+    ASSERT_FALSE(stream.receive_paused());
+    ASSERT_TRUE(stream.rbuf());
+    ASSERT_EQ(mock_connection.memory_usage(), stream.rbuf().total_size());
+
+    ASSERT_TRUE(uut->close_stream(stream).has_value());
+    ASSERT_EQ(mock_connection.memory_usage(), 0);
+    ASSERT_EQ(budget.total(), 0);
+}
+
+/******************************************************
+ * Over the total limit, the connections holding the most
+ * memory are disconnected until the rest fits.
+ ******************************************************/
+TEST_F(tf_msquic_base, memory_budget_eviction) {
+    static_mock<QUIC_CONNECTION_SHUTDOWN_FN> mock_connection_shutdown{};
+    api.ConnectionShutdown = mock_connection_shutdown;
+
+    auto & budget = mock_app.budget();
+    budget.configure({ .total_limit = 100 });
+
+    const auto large_object = reinterpret_cast<HQUIC>(0x1);
+    const auto small_object = reinterpret_cast<HQUIC>(0x2);
+    connection large{ large_object, nullptr, &budget };
+    connection small{ small_object, nullptr, &budget };
+    budget.charge(large, 80);
+    budget.charge(small, 40);
+    ASSERT_TRUE(budget.over_limit());
+
+    EXPECT_CALL(*mock_connection_shutdown,
+                Call(large_object, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, _))
+        .Times(1);
+    struct connection * const connections[] = { &small, &large };
+    ASSERT_EQ(enforce_memory_budget(connections), 1);
+    ASSERT_TRUE(memory_budget::evicted(large));
+    ASSERT_FALSE(memory_budget::evicted(small));
+
+    // Not evicted twice while its shutdown is in progress.
+    ASSERT_EQ(enforce_memory_budget(connections), 0);
+    ASSERT_EQ(budget.stats().connections_evicted, 1);
+
+    budget.release(large);
+    ASSERT_FALSE(budget.over_limit());
+    budget.release(small);
+}
+
 } // namespace mad::nexus
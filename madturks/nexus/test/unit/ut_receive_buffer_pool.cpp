@@ -0,0 +1,190 @@
+/******************************************************
+ * receive_buffer_pool unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/receive_buffer_pool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace mad::nexus {
+
+struct tf_receive_buffer_pool : public ::testing::Test {
+    void SetUp() override {
+        receive_buffer_pool::configure(receive_buffer_pool_options{});
+        receive_buffer_pool::trim();
+        before = receive_buffer_pool::stats();
+    }
+
+    void TearDown() override {
+        receive_buffer_pool::configure(receive_buffer_pool_options{});
+        receive_buffer_pool::trim();
+    }
+
+    static std::size_t page_size() {
+        return static_cast<std::size_t>(getpagesize());
+    }
+
+    receive_buffer_pool_stats before{};
+};
+
+/******************************************************
+ * Requests are rounded up to the next size class.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, acquire_rounds_up_to_size_class) {
+    const auto size = std::max<std::size_t>(
+        page_size(), receive_buffer_pool::k_min_buffer_size);
+    auto buffer = receive_buffer_pool::acquire(size + 1);
+    EXPECT_EQ(buffer.total_size(), std::bit_ceil(size + 1));
+    EXPECT_EQ(buffer.consumed_space(), 0);
+}
+
+/******************************************************
+ * A released buffer is handed out again, empty.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, release_and_reuse) {
+    auto buffer = receive_buffer_pool::acquire(32768);
+    std::array<std::uint8_t, 4> data{ 1, 2, 3, 4 };
+    ASSERT_TRUE(buffer.put(data));
+    const auto * mapping = buffer.available_span().data();
+
+    receive_buffer_pool::release(std::move(buffer));
+    auto stats = receive_buffer_pool::stats();
+    EXPECT_EQ(stats.buffers_cached - before.buffers_cached, 1);
+    EXPECT_EQ(stats.bytes_cached - before.bytes_cached, 32768);
+
+    auto reused = receive_buffer_pool::acquire(32768);
+    EXPECT_EQ(reused.consumed_space(), 0);
+    EXPECT_EQ(reused.total_size(), 32768);
+    // Cleared, not remapped.
+    EXPECT_EQ(reused.available_span().data(), mapping + data.size());
+
+    stats = receive_buffer_pool::stats();
+    EXPECT_EQ(stats.acquisitions - before.acquisitions, 2);
+    EXPECT_EQ(stats.cache_hits - before.cache_hits, 1);
+    EXPECT_EQ(stats.buffers_cached, before.buffers_cached);
+}
+
+/******************************************************
+ * Buffers beyond the size class limit are unmapped.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, buffers_per_class_limit) {
+    receive_buffer_pool::configure({ .buffers_per_class = 1 });
+
+    auto first = receive_buffer_pool::acquire(32768);
+    auto second = receive_buffer_pool::acquire(32768);
+    receive_buffer_pool::release(std::move(first));
+    receive_buffer_pool::release(std::move(second));
+
+    EXPECT_EQ(receive_buffer_pool::stats().buffers_cached -
+                  before.buffers_cached,
+              1);
+}
+
+/******************************************************
+ * Buffers beyond the byte limit are unmapped.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, max_cached_bytes_limit) {
+    receive_buffer_pool::configure(
+        { .max_cached_bytes = before.bytes_cached + 65536 });
+
+    auto small = receive_buffer_pool::acquire(32768);
+    auto large = receive_buffer_pool::acquire(65536);
+    receive_buffer_pool::release(std::move(small));
+    receive_buffer_pool::release(std::move(large));
+
+    const auto stats = receive_buffer_pool::stats();
+    EXPECT_EQ(stats.buffers_cached - before.buffers_cached, 1);
+    EXPECT_EQ(stats.bytes_cached - before.bytes_cached, 32768);
+}
+
+/******************************************************
+ * The pages of the large buffers are given back to the
+ * system when they are cached.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, large_buffers_drop_pages) {
+    receive_buffer_pool::configure({ .populate_buffers = true });
+
+    auto is_first_page_resident = [](const auto & buffer) {
+        unsigned char page = 0;
+        auto * addr = const_cast<std::uint8_t *>(
+            buffer.available_span().data());
+        return mincore(addr, page_size(), &page) == 0 && (page & 1) != 0;
+    };
+
+    const auto large = receive_buffer_pool::k_resident_buffer_size * 2;
+    auto buffer = receive_buffer_pool::acquire(large);
+    ASSERT_TRUE(is_first_page_resident(buffer));
+    receive_buffer_pool::release(std::move(buffer));
+
+    auto reused = receive_buffer_pool::acquire(large);
+    EXPECT_EQ(receive_buffer_pool::stats().cache_hits - before.cache_hits, 1);
+    EXPECT_FALSE(is_first_page_resident(reused));
+
+    // The small ones keep their pages.
+    auto small = receive_buffer_pool::acquire(32768);
+    ASSERT_TRUE(is_first_page_resident(small));
+    receive_buffer_pool::release(std::move(small));
+    EXPECT_TRUE(is_first_page_resident(receive_buffer_pool::acquire(32768)));
+}
+
+/******************************************************
+ * The pool is disabled with a zero limit.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, disabled) {
+    receive_buffer_pool::configure({ .buffers_per_class = 0 });
+
+    receive_buffer_pool::release(receive_buffer_pool::acquire(32768));
+    auto buffer = receive_buffer_pool::acquire(32768);
+
+    const auto stats = receive_buffer_pool::stats();
+    EXPECT_EQ(stats.cache_hits, before.cache_hits);
+    EXPECT_EQ(stats.buffers_cached, before.buffers_cached);
+}
+
+/******************************************************
+ * Requests beyond the largest size class bypass the pool.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, oversized_bypasses_pool) {
+    const auto size = receive_buffer_pool::k_max_buffer_size + page_size();
+    auto buffer = receive_buffer_pool::acquire(size);
+    EXPECT_EQ(buffer.total_size(), size);
+
+    receive_buffer_pool::release(std::move(buffer));
+    EXPECT_EQ(receive_buffer_pool::stats().buffers_cached,
+              before.buffers_cached);
+}
+
+/******************************************************
+ * Moved-from buffers are ignored.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, release_moved_from) {
+    auto buffer = receive_buffer_pool::acquire(32768);
+    auto owner = std::move(buffer);
+
+    receive_buffer_pool::release(std::move(buffer));
+    EXPECT_EQ(receive_buffer_pool::stats().buffers_cached,
+              before.buffers_cached);
+}
+
+/******************************************************
+ * The newly mapped buffers are pre-faulted on request.
+ ******************************************************/
+TEST_F(tf_receive_buffer_pool, populate_buffers) {
+    EXPECT_FALSE(receive_buffer_pool::acquire(32768).options().populate);
+
+    receive_buffer_pool::configure({ .populate_buffers = true });
+    receive_buffer_pool::trim();
+    auto buffer = receive_buffer_pool::acquire(32768);
+    EXPECT_TRUE(buffer.options().populate);
+}
+
+} // namespace mad::nexus
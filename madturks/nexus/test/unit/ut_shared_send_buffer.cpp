@@ -0,0 +1,114 @@
+/******************************************************
+ * shared_send_buffer unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/buffer_pool.hpp>
+#include <mad/nexus/quic_base.hpp>
+#include <mad/nexus/shared_send_buffer.hpp>
+
+#include <flatbuffers/flatbuffer_builder.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace mad::nexus {
+
+struct tf_shared_send_buffer : public ::testing::Test {
+    void SetUp() override {
+        before = buffer_pool::stats();
+    }
+
+    static send_buffer<true> make_message() {
+        return quic_base::build_message(
+            [](::flatbuffers::FlatBufferBuilder & fbb) {
+                return fbb.CreateString("shared");
+            });
+    }
+
+    std::uint64_t bytes_in_flight_delta() const {
+        return buffer_pool::stats().bytes_in_flight - before.bytes_in_flight;
+    }
+
+    buffer_pool_stats before{};
+};
+
+/******************************************************
+ * A default constructed buffer is empty.
+ ******************************************************/
+TEST_F(tf_shared_send_buffer, default_construct) {
+    shared_send_buffer buf{};
+    EXPECT_FALSE(buf);
+    EXPECT_EQ(buf.use_count(), 0);
+}
+
+/******************************************************
+ * The shared buffer exposes the same bytes the send
+ * buffer carried.
+ ******************************************************/
+TEST_F(tf_shared_send_buffer, takes_over_send_buffer) {
+    auto msg = make_message();
+    const auto expected = std::vector<std::uint8_t>(
+        msg.data_span().begin(), msg.data_span().end());
+
+    shared_send_buffer buf{ std::move(msg) };
+    EXPECT_EQ(nullptr, msg.buf);
+    ASSERT_TRUE(buf);
+    EXPECT_EQ(buf.use_count(), 1);
+
+    const auto data = buf.data_span();
+    EXPECT_EQ(std::vector<std::uint8_t>(data.begin(), data.end()), expected);
+}
+
+/******************************************************
+ * Copies share the memory, and the memory is released
+ * with the last copy.
+ ******************************************************/
+TEST_F(tf_shared_send_buffer, copies_share_memory) {
+    {
+        shared_send_buffer buf{ make_message() };
+        const auto in_flight = bytes_in_flight_delta();
+        {
+            auto copy = buf;
+            EXPECT_EQ(buf.use_count(), 2);
+            EXPECT_EQ(copy.data_span().data(), buf.data_span().data());
+            EXPECT_EQ(bytes_in_flight_delta(), in_flight);
+
+            auto moved = std::move(copy);
+            EXPECT_FALSE(copy);
+            EXPECT_EQ(buf.use_count(), 2);
+        }
+        EXPECT_EQ(buf.use_count(), 1);
+        EXPECT_GT(bytes_in_flight_delta(), 0);
+    }
+    EXPECT_EQ(bytes_in_flight_delta(), 0);
+}
+
+/******************************************************
+ * References may be released from multiple threads.
+ ******************************************************/
+TEST_F(tf_shared_send_buffer, cross_thread_release) {
+    constexpr std::size_t kThreads = 4;
+    constexpr std::size_t kCopiesPerThread = 1000;
+    {
+        shared_send_buffer buf{ make_message() };
+        std::vector<std::thread> threads{};
+        for (std::size_t i = 0; i < kThreads; i++) {
+            threads.emplace_back([copy = buf] {
+                for (std::size_t j = 0; j < kCopiesPerThread; j++) {
+                    auto c = copy;
+                    (void) c;
+                }
+            });
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(buf.use_count(), 1);
+    }
+    EXPECT_EQ(bytes_in_flight_delta(), 0);
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,292 @@
+/******************************************************
+ * slot_map & handle_context_container unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/handle_carrier.hpp>
+#include <mad/nexus/handle_context_container.hpp>
+#include <mad/nexus/slot_map.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace mad::nexus {
+
+/******************************************************
+ * Inserted values are found by their keys, and the keys
+ * are invalidated on erase.
+ ******************************************************/
+TEST(slot_map, emplace_get_erase) {
+    slot_map<std::string, 4> map{};
+    auto [k1, v1] = map.emplace("first");
+    auto [k2, v2] = map.emplace("second");
+
+    ASSERT_TRUE(k1);
+    ASSERT_TRUE(k2);
+    ASSERT_NE(k1, k2);
+    ASSERT_EQ(map.size(), 2);
+    ASSERT_EQ(map.get(k1), &v1);
+    ASSERT_EQ(*map.get(k2), "second");
+
+    ASSERT_TRUE(map.erase(k1));
+    ASSERT_EQ(map.get(k1), nullptr);
+    ASSERT_FALSE(map.erase(k1));
+    ASSERT_EQ(map.size(), 1);
+    ASSERT_EQ(*map.get(k2), "second");
+
+    ASSERT_EQ(map.get(slot_key{}), nullptr);
+    ASSERT_EQ(map.get(slot_key{ .index = 1000, .generation = 1 }), nullptr);
+}
+
+/******************************************************
+ * A reused slot does not make the old key valid again.
+ ******************************************************/
+TEST(slot_map, stale_key_after_reuse) {
+    slot_map<int, 4> map{};
+    auto [old_key, old_value] = map.emplace(1);
+    ASSERT_TRUE(map.erase(old_key));
+
+    auto [new_key, new_value] = map.emplace(2);
+    ASSERT_EQ(new_key.index, old_key.index);
+    ASSERT_NE(new_key.generation, old_key.generation);
+    ASSERT_EQ(map.get(old_key), nullptr);
+    ASSERT_EQ(*map.get(new_key), 2);
+}
+
+/******************************************************
+ * Values keep their addresses while the map grows.
+ ******************************************************/
+TEST(slot_map, stable_addresses) {
+    slot_map<int, 4> map{};
+    std::vector<std::pair<slot_key, int *>> inserted{};
+    for (int i = 0; i < 100; i++) {
+        auto [key, value] = map.emplace(i);
+        inserted.emplace_back(key, &value);
+    }
+    ASSERT_GE(map.capacity(), 100);
+
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(map.get(inserted [i].first), inserted [i].second);
+        ASSERT_EQ(*inserted [i].second, i);
+    }
+
+    int sum = 0;
+    map.for_each([&](int & v) {
+        sum += v;
+    });
+    ASSERT_EQ(sum, 99 * 100 / 2);
+}
+
+/******************************************************
+ * The inline slots are used first, without allocating,
+ * and the map grows into chunks past them.
+ ******************************************************/
+TEST(slot_map, inline_slots) {
+    slot_map<std::shared_ptr<int>, 2, 3> map{};
+    const auto * begin = reinterpret_cast<const std::byte *>(&map);
+    const auto * end = begin + sizeof(map);
+    const auto is_inline = [&](const void * p) {
+        const auto * b = static_cast<const std::byte *>(p);
+        return b >= begin && b < end;
+    };
+    ASSERT_EQ(map.capacity(), 3);
+
+    auto counter = std::make_shared<int>(0);
+    std::vector<std::pair<slot_key, std::shared_ptr<int> *>> inserted{};
+    for (int i = 0; i < 3; i++) {
+        auto [key, value] = map.emplace(counter);
+        ASSERT_TRUE(is_inline(&value));
+        inserted.emplace_back(key, &value);
+    }
+    ASSERT_EQ(map.capacity(), 3);
+
+    for (int i = 0; i < 3; i++) {
+        auto [key, value] = map.emplace(counter);
+        ASSERT_FALSE(is_inline(&value));
+        inserted.emplace_back(key, &value);
+    }
+    ASSERT_EQ(map.capacity(), 7);
+    ASSERT_EQ(counter.use_count(), 7);
+
+    for (const auto & [key, value] : inserted) {
+        ASSERT_EQ(map.get(key), value);
+    }
+
+    std::size_t visited = 0;
+    map.for_each([&](std::shared_ptr<int> &) {
+        visited++;
+    });
+    ASSERT_EQ(visited, 6);
+
+    // An erased inline slot is reused before the chunks.
+    ASSERT_TRUE(map.erase(inserted [1].first));
+    ASSERT_EQ(map.get(inserted [1].first), nullptr);
+    auto [key, value] = map.emplace(counter);
+    ASSERT_EQ(key.index, inserted [1].first.index);
+    ASSERT_TRUE(is_inline(&value));
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(counter.use_count(), 1);
+}
+
+/******************************************************
+ * Keys survive the round trip through an opaque context.
+ ******************************************************/
+TEST(slot_map, context_round_trip) {
+    const slot_key key{ .index = 0xABCD, .generation = 0x1234 };
+    auto * ctx = key.to_context();
+    ASSERT_NE(ctx, nullptr);
+    ASSERT_EQ(slot_key::from_context(ctx), key);
+}
+
+/******************************************************
+ * Values that are still in the map are destroyed with it.
+ ******************************************************/
+TEST(slot_map, destroys_values) {
+    auto counter = std::make_shared<int>(0);
+    {
+        slot_map<std::shared_ptr<int>, 2> map{};
+        for (int i = 0; i < 5; i++) {
+            map.emplace(counter);
+        }
+        auto [key, value] = map.emplace(counter);
+        ASSERT_EQ(counter.use_count(), 7);
+        map.erase(key);
+        ASSERT_EQ(counter.use_count(), 6);
+    }
+    ASSERT_EQ(counter.use_count(), 1);
+}
+
+namespace {
+struct test_context : handle_carrier {
+    explicit test_context(void * handle, int v) :
+        handle_carrier(handle), value(v) {}
+
+    int value;
+};
+
+struct test_container : handle_context_container<test_context> {
+    test_container() = default;
+    ~test_container() = default;
+};
+
+void record_close(void * closed, void * handle) {
+    static_cast<std::vector<void *> *>(closed)->push_back(handle);
+}
+} // namespace
+
+/******************************************************
+ * The handle is closed when its context is removed.
+ ******************************************************/
+TEST(handle_context_container, add_find_erase) {
+    std::vector<void *> closed{};
+    const handle_closer_t closer{ &record_close, &closed };
+    auto * h1 = reinterpret_cast<void *>(0x1000);
+    auto * h2 = reinterpret_cast<void *>(0x2000);
+
+    {
+        test_container container{};
+        auto c1 = container.add(closer, h1, 1);
+        auto c2 = container.add(closer, h2, 2);
+        ASSERT_TRUE(c1.has_value());
+        ASSERT_TRUE(c2.has_value());
+        ASSERT_EQ(container.size(), 2);
+
+        const auto key = c1->get().context_key();
+        ASSERT_TRUE(key);
+        auto found = container.find(key);
+        ASSERT_TRUE(found.has_value());
+        ASSERT_EQ(found->get().value, 1);
+
+        ASSERT_TRUE(container.erase(c1->get()).has_value());
+        ASSERT_EQ(closed, std::vector<void *>{ h1 });
+
+        auto stale = container.find(key);
+        ASSERT_FALSE(stale.has_value());
+        ASSERT_EQ(stale.error(), quic_error_code::value_does_not_exists);
+
+        auto again = container.erase(key);
+        ASSERT_FALSE(again.has_value());
+        ASSERT_EQ(again.error(), quic_error_code::value_does_not_exists);
+    }
+
+    // The rest is closed along with the container.
+    ASSERT_EQ(closed, (std::vector<void *>{ h1, h2 }));
+}
+
+/******************************************************
+ * The handle contexts removed from within for_each are
+ * skipped, and closed once the iteration is over. The
+ * ones added meanwhile are kept.
+ ******************************************************/
+TEST(handle_context_container, erase_add_within_for_each) {
+    std::vector<void *> closed{};
+    const handle_closer_t closer{ &record_close, &closed };
+    auto * h1 = reinterpret_cast<void *>(0x1000);
+    auto * h2 = reinterpret_cast<void *>(0x2000);
+    auto * h3 = reinterpret_cast<void *>(0x3000);
+
+    test_container container{};
+    ASSERT_TRUE(container.add(closer, h1, 1).has_value());
+    ASSERT_TRUE(container.add(closer, h2, 2).has_value());
+
+    std::vector<int> visited{};
+    container.for_each([&](test_context & ctx) {
+        visited.push_back(ctx.value);
+        if (1 == ctx.value) {
+            ASSERT_TRUE(container.erase(ctx).has_value());
+            ASSERT_FALSE(container.erase(ctx).has_value());
+            ASSERT_TRUE(container.add(closer, h3, 3).has_value());
+            // Not closed while iterating.
+            ASSERT_TRUE(closed.empty());
+            ASSERT_TRUE(container.find(ctx.context_key()).has_value());
+        }
+    });
+
+    ASSERT_EQ(closed, std::vector<void *>{ h1 });
+    ASSERT_EQ(container.size(), 2);
+    ASSERT_GE(visited.size(), 2);
+
+    visited.clear();
+    container.for_each([&](test_context & ctx) {
+        visited.push_back(ctx.value);
+    });
+    ASSERT_EQ(visited, (std::vector<int>{ 2, 3 }));
+}
+
+/******************************************************
+ * A removal made while the lock is held completes when
+ * the outermost holder releases it.
+ ******************************************************/
+TEST(handle_context_container, erase_under_lock) {
+    std::vector<void *> closed{};
+    const handle_closer_t closer{ &record_close, &closed };
+    auto * h1 = reinterpret_cast<void *>(0x1000);
+
+    test_container container{};
+    auto c1 = container.add(closer, h1, 1);
+    ASSERT_TRUE(c1.has_value());
+
+    {
+        auto guard = container.lock();
+        container.for_each([&](test_context & ctx) {
+            ASSERT_TRUE(container.erase(ctx).has_value());
+        });
+        ASSERT_TRUE(closed.empty());
+
+        std::size_t visited = 0;
+        container.for_each([&](test_context &) {
+            visited++;
+        });
+        ASSERT_EQ(visited, 0);
+    }
+
+    ASSERT_EQ(closed, std::vector<void *>{ h1 });
+    ASSERT_EQ(container.size(), 0);
+}
+
+} // namespace mad::nexus
@@ -0,0 +1,153 @@
+/******************************************************
+ * statistics_sampler unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/msquic/msquic_application.hpp>
+#include <mad/nexus/msquic/msquic_server.hpp>
+#include <mad/nexus/statistics_sampler.hpp>
+#include <mad/static_mock.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <msquic.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "mock_msquic_application.hpp"
+#include "mock_msquic_fns.hpp"
+
+namespace mad::nexus {
+
+struct tf_statistics_sampler : public ::testing::Test {
+    mock_msquic_application mock_app = {};
+    // Alias for convenience.
+    QUIC_API_TABLE & api = mock_app.api_table;
+
+    void SetUp() override {
+        api.GetParam = mock_get_param;
+        server = std::unique_ptr<msquic_server>(new msquic_server(mock_app));
+
+        // The first connection has statistics, the second has none.
+        ON_CALL(*mock_get_param,
+                Call(_, QUIC_PARAM_CONN_STATISTICS_V2, _, _))
+            .WillByDefault(Invoke([](HQUIC h, uint32_t, uint32_t *, void *) {
+                return h == sampled_object ? QUIC_STATUS_SUCCESS
+                                           : QUIC_STATUS_INVALID_STATE;
+            }));
+        EXPECT_CALL(*mock_get_param, Call(_, _, _, _))
+            .Times(::testing::AnyNumber());
+
+        for (auto * h : { sampled_object, unsampled_object }) {
+            auto r = server->add_connection(handle_closer_t{}, h, server.get());
+            ASSERT_TRUE(r.has_value());
+        }
+    }
+
+    void TearDown() override {
+        server.reset();
+    }
+
+    /******************************************************
+     * Counts the samples, and the samples of the connection
+     * that has no statistics.
+     ******************************************************/
+    struct sample_counter {
+        std::atomic<std::size_t> samples{ 0 };
+        std::atomic<std::size_t> unexpected{ 0 };
+    };
+
+    static connection_statistics_callback_t
+    count_samples(sample_counter & counter) {
+        return connection_statistics_callback_t{
+            [](void * uptr, connection & cctx,
+               const connection_statistics &) {
+                auto & c = *static_cast<sample_counter *>(uptr);
+                if (cctx.handle_as<HQUIC>() != sampled_object) {
+                    c.unexpected++;
+                }
+                c.samples++;
+            },
+            &counter
+        };
+    }
+
+    static inline auto sampled_object = []() {
+        return reinterpret_cast<QUIC_HANDLE *>(0xC0FFEE);
+    }();
+
+    static inline auto unsampled_object = []() {
+        return reinterpret_cast<QUIC_HANDLE *>(0xDECAF);
+    }();
+
+    static_mock<QUIC_GET_PARAM_FN> mock_get_param{};
+
+    std::unique_ptr<msquic_server> server{ nullptr };
+};
+
+/******************************************************
+ * sample_now samples the connections on the calling
+ * thread, and skips the ones without statistics.
+ ******************************************************/
+TEST_F(tf_statistics_sampler, sample_now) {
+    sample_counter counter{};
+    statistics_sampler sampler{ *server, std::chrono::hours{ 1 },
+                                count_samples(counter) };
+
+    ASSERT_EQ(sampler.sample_now(), 1);
+    ASSERT_EQ(sampler.sample_now(), 1);
+    ASSERT_EQ(counter.samples, 2);
+    ASSERT_EQ(counter.unexpected, 0);
+}
+
+/******************************************************
+ * The sampler's thread samples the connections once per
+ * interval.
+ ******************************************************/
+TEST_F(tf_statistics_sampler, periodic) {
+    constexpr std::size_t kSamples = 3;
+
+    sample_counter counter{};
+    {
+        statistics_sampler sampler{ *server, std::chrono::milliseconds{ 1 },
+                                    count_samples(counter) };
+
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::seconds{ 10 };
+        while (counter.samples < kSamples &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+    }
+
+    ASSERT_GE(counter.samples, kSamples);
+    ASSERT_EQ(counter.unexpected, 0);
+
+    // Nothing is sampled after the sampler is destroyed.
+    const std::size_t samples = counter.samples;
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+    ASSERT_EQ(counter.samples, samples);
+}
+
+/******************************************************
+ * Destroying the sampler stops its thread right away,
+ * without waiting for the interval to pass.
+ ******************************************************/
+TEST_F(tf_statistics_sampler, prompt_shutdown) {
+    sample_counter counter{};
+    const auto start = std::chrono::steady_clock::now();
+    {
+        statistics_sampler sampler{ *server, std::chrono::hours{ 1 },
+                                    count_samples(counter) };
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ASSERT_LT(elapsed, std::chrono::seconds{ 5 });
+    ASSERT_EQ(counter.samples, 0);
+}
+
+} // namespace mad::nexus
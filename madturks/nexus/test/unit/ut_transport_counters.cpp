@@ -0,0 +1,95 @@
+/******************************************************
+ * transport_counters unit tests
+ *
+ * Copyright (c) 2024 The Madturks Organization
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ ******************************************************/
+#include <mad/nexus/transport_counters.hpp>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace mad::nexus {
+
+/******************************************************
+ * The counters of the calling thread are visible to the
+ * reader right away.
+ ******************************************************/
+TEST(transport_counters, record_and_read) {
+    const auto before = transport_counters::read();
+
+    transport_counter_recorder::sent(3, 300);
+    transport_counter_recorder::send_completed(1);
+    transport_counter_recorder::received(40);
+    transport_counter_recorder::received(60);
+    transport_counter_recorder::framing_error();
+
+    const auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_sent - before.messages_sent, 3);
+    ASSERT_EQ(after.bytes_sent - before.bytes_sent, 300);
+    ASSERT_EQ(after.sends_in_flight - before.sends_in_flight, 2);
+    ASSERT_EQ(after.messages_received - before.messages_received, 2);
+    ASSERT_EQ(after.bytes_received - before.bytes_received, 100);
+    ASSERT_EQ(after.framing_errors - before.framing_errors, 1);
+
+    transport_counter_recorder::send_completed(2);
+    ASSERT_EQ(transport_counters::read().sends_in_flight,
+              before.sends_in_flight);
+}
+
+/******************************************************
+ * The high-water mark is the largest usage reported by
+ * any thread.
+ ******************************************************/
+TEST(transport_counters, receive_buffer_high_water) {
+    const auto base = transport_counters::read().receive_buffer_high_water;
+
+    transport_counter_recorder::receive_buffer_usage(base + 10);
+    transport_counter_recorder::receive_buffer_usage(base + 5);
+    ASSERT_EQ(transport_counters::read().receive_buffer_high_water, base + 10);
+
+    std::thread{ [base] {
+        transport_counter_recorder::receive_buffer_usage(base + 20);
+    } }.join();
+    ASSERT_EQ(transport_counters::read().receive_buffer_high_water, base + 20);
+}
+
+/******************************************************
+ * The counters of the exited threads are kept, and a
+ * send may complete on a different thread.
+ ******************************************************/
+TEST(transport_counters, threads) {
+    constexpr std::uint64_t kThreads = 4;
+    constexpr std::uint64_t kSends = 10000;
+
+    const auto before = transport_counters::read();
+
+    std::vector<std::thread> senders{};
+    for (std::uint64_t i = 0; i < kThreads; i++) {
+        senders.emplace_back([] {
+            for (std::uint64_t j = 0; j < kSends; j++) {
+                transport_counter_recorder::sent(1, 8);
+            }
+        });
+    }
+    for (auto & t : senders) {
+        t.join();
+    }
+
+    auto after = transport_counters::read();
+    ASSERT_EQ(after.messages_sent - before.messages_sent, kThreads * kSends);
+    ASSERT_EQ(after.bytes_sent - before.bytes_sent, kThreads * kSends * 8);
+    ASSERT_EQ(after.sends_in_flight - before.sends_in_flight,
+              kThreads * kSends);
+
+    std::thread{ [] {
+        transport_counter_recorder::send_completed(kThreads * kSends);
+    } }.join();
+
+    after = transport_counters::read();
+    ASSERT_EQ(after.sends_in_flight, before.sends_in_flight);
+}
+
+} // namespace mad::nexus
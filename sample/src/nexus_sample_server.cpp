@@ -11,6 +11,7 @@
 #include <mad/nexus/quic_connection.hpp>
 #include <mad/nexus/quic_error_code.hpp>
 #include <mad/nexus/quic_stream.hpp>
+#include <mad/nexus/transport_counters.hpp>
 #include <mad/nexus/schemas/chat_generated.h>
 #include <mad/nexus/schemas/main_generated.h>
 #include <mad/nexus/schemas/monster_generated.h>
@@ -287,8 +288,12 @@ int main(int argc, char * argv []) {
 
     std::thread{ []() {
         while (!stop_src.get_token().stop_requested()) {
-            MAD_LOG_INFO_I(logger, "{} sends are still in flight.",
-                           mad::nexus::stream::sends_in_flight.load());
+            const auto counters = mad::nexus::transport_counters::read();
+            MAD_LOG_INFO_I(logger,
+                           "{} sends are still in flight, {} message(s) "
+                           "sent, {} message(s) received.",
+                           counters.sends_in_flight, counters.messages_sent,
+                           counters.messages_received);
             //   MAD_LOG_INFO_I(logger, "mem: {} / {}.",
             //                mem_usage.load(), mem_usage_arr.load());
             std::this_thread::sleep_for(std::chrono::milliseconds{ 1000 });
@@ -303,9 +308,7 @@ int main(int argc, char * argv []) {
         auto map = connections.exclusive_access();
         map->clear();
         MAD_LOG_INFO_I(logger, "{} conns going to be freed.", map->size());
-#ifndef NDEBUG
         MAD_LOG_INFO_I(logger, "{} sends are still in flight.",
-                       mad::nexus::stream::sends_in_flight.load());
-#endif
+                       mad::nexus::transport_counters::read().sends_in_flight);
     }
 }